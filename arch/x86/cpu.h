@@ -0,0 +1,59 @@
+/*
+ * OpenOS - x86 CPU Helpers
+ *
+ * Small inline helpers shared by the kernel: interrupt-flag save and
+ * restore, the time-stamp counter, CPUID, and 64-by-32-bit division (the
+ * kernel links without libgcc, so plain 64-bit `/` and `%` would pull
+ * in __udivdi3 and fail to link).
+ */
+
+#ifndef OPENOS_ARCH_X86_CPU_H
+#define OPENOS_ARCH_X86_CPU_H
+
+#include <stdint.h>
+
+/* Disable interrupts, returning the previous EFLAGS for irq_restore(). */
+static inline uint32_t irq_save(void) {
+    uint32_t flags;
+    __asm__ __volatile__("pushfl\n\tpopl %0\n\tcli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+/* Restore the interrupt flag saved by irq_save(). */
+static inline void irq_restore(uint32_t flags) {
+    if (flags & 0x200) {
+        __asm__ __volatile__("sti" : : : "memory");
+    }
+}
+
+/* Read the time-stamp counter (cycles since reset). */
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* CPUID leaf `leaf`, subleaf `sub`: regs[] gets EAX, EBX, ECX, EDX.
+ * Every CPU with a TSC has CPUID, so there is no need to probe for it. */
+static inline void cpuid_count(uint32_t leaf, uint32_t sub, uint32_t regs[4]) {
+    __asm__ __volatile__("cpuid"
+                         : "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3])
+                         : "a"(leaf), "c"(sub));
+}
+
+/*
+ * Divide a 64-bit value by a 32-bit divisor using two `divl` steps.
+ * Returns the quotient; the remainder is stored in *rem if non-NULL.
+ */
+static inline uint64_t udiv64(uint64_t n, uint32_t d, uint32_t *rem) {
+    uint32_t hi = (uint32_t)(n >> 32);
+    uint32_t lo = (uint32_t)n;
+    uint32_t q_hi = hi / d;
+    uint32_t r = hi % d;
+    uint32_t q_lo;
+    __asm__("divl %4" : "=a"(q_lo), "=d"(r) : "a"(lo), "d"(r), "rm"(d));
+    if (rem) *rem = r;
+    return ((uint64_t)q_hi << 32) | q_lo;
+}
+
+#endif /* OPENOS_ARCH_X86_CPU_H */
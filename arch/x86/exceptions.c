@@ -5,11 +5,14 @@
 
 #include "exceptions.h"
 #include "idt.h"
+#include "../../memory/vmm.h"
 #include <stddef.h>
 
 /* Forward declarations */
 void console_write(const char* s);
 void console_put_char(char c);
+void serial_panic(void);
+void printk_panic(void);
 
 /* Exception names for error reporting */
 static const char* exception_messages[] = {
@@ -87,6 +90,19 @@ static void print_dec(uint32_t value) {
  * Main exception handler called from assembly stubs
  */
 void exception_handler(struct exception_registers *regs) {
+    /* Recoverable page faults (copy-on-write) resume the faulting code. */
+    if (regs->int_no == EXCEPTION_PAGE_FAULT) {
+        uint32_t faulting_address;
+        __asm__ __volatile__("mov %%cr2, %0" : "=r"(faulting_address));
+        if (vmm_handle_fault(faulting_address, regs->err_code)) {
+            return;
+        }
+    }
+
+    /* Nothing runs after this; get the serial log out synchronously */
+    serial_panic();
+    printk_panic();
+
     /* Print exception header */
     console_write("\n");
     console_write("======================================\n");
@@ -0,0 +1,83 @@
+/*
+ * OpenOS - Device IRQ Dispatch Implementation
+ */
+
+#include "irq.h"
+#include "idt.h"
+#include "pic.h"
+#include "cpu.h"
+#include "../../kernel/kernel.h"
+
+/* Stubs from isr.S */
+extern void irq3_handler(void);
+extern void irq4_handler(void);
+extern void irq5_handler(void);
+extern void irq6_handler(void);
+extern void irq7_handler(void);
+extern void irq8_handler(void);
+extern void irq9_handler(void);
+extern void irq10_handler(void);
+extern void irq11_handler(void);
+extern void irq12_handler(void);
+extern void irq13_handler(void);
+extern void irq14_handler(void);
+extern void irq15_handler(void);
+
+static void (*const irq_stubs[IRQ_LINES])(void) = {
+    0, 0, 0,
+    irq3_handler,  irq4_handler,  irq5_handler,  irq6_handler,
+    irq7_handler,  irq8_handler,  irq9_handler,  irq10_handler,
+    irq11_handler, irq12_handler, irq13_handler, irq14_handler,
+    irq15_handler,
+};
+
+typedef struct irq_action {
+    irq_handler_t handler;
+    void         *ctx;
+} irq_action_t;
+
+static irq_action_t irq_actions[IRQ_LINES][IRQ_MAX_SHARED];
+static uint32_t     irq_counts[IRQ_LINES];
+
+int irq_register(uint8_t irq, irq_handler_t handler, void *ctx) {
+    if (irq >= IRQ_LINES || !irq_stubs[irq] || !handler) return -1;
+
+    uint32_t flags = irq_save();
+    int slot = -1;
+    for (int i = 0; i < IRQ_MAX_SHARED; i++) {
+        if (!irq_actions[irq][i].handler) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        irq_restore(flags);
+        return -1;
+    }
+
+    irq_actions[irq][slot].handler = handler;
+    irq_actions[irq][slot].ctx     = ctx;
+    if (slot == 0) {
+        idt_set_gate((uint8_t)(0x20 + irq), (uint32_t)irq_stubs[irq],
+                     KERNEL_CODE_SEGMENT, IDT_FLAGS_KERNEL);
+        if (irq >= 8) pic_unmask_irq(2);    /* cascade */
+        pic_unmask_irq(irq);
+    }
+    irq_restore(flags);
+    return 0;
+}
+
+void irq_dispatch(uint32_t irq) {
+    if (irq >= IRQ_LINES) return;
+
+    irq_counts[irq]++;
+    for (int i = 0; i < IRQ_MAX_SHARED; i++) {
+        irq_action_t *a = &irq_actions[irq][i];
+        if (a->handler) a->handler(a->ctx);
+    }
+    pic_send_eoi((uint8_t)irq);
+}
+
+uint32_t irq_count(uint8_t irq) {
+    return (irq < IRQ_LINES) ? irq_counts[irq] : 0;
+}
@@ -0,0 +1,32 @@
+/*
+ * OpenOS - Device IRQ Dispatch
+ *
+ * IRQ 0 (timer) and 1 (keyboard) keep their dedicated stubs. Lines 3
+ * to 15 go through one common stub to irq_dispatch(), which calls the
+ * handlers registered for the line and then acknowledges the PIC.
+ * PCI interrupts are level-triggered and may be shared, so a line can
+ * carry a few handlers; each must check whether its device actually
+ * raised the interrupt.
+ */
+
+#ifndef OPENOS_ARCH_X86_IRQ_H
+#define OPENOS_ARCH_X86_IRQ_H
+
+#include <stdint.h>
+
+#define IRQ_LINES       16
+#define IRQ_MAX_SHARED  4       /* Handlers per line */
+
+typedef void (*irq_handler_t)(void *ctx);
+
+/* Add `handler` to `irq` (3..15), install the gate and unmask the
+ * line. Returns 0, or -1 if the line cannot be used or is full. */
+int irq_register(uint8_t irq, irq_handler_t handler, void *ctx);
+
+/* Called by the assembly stubs with interrupts disabled. */
+void irq_dispatch(uint32_t irq);
+
+/* Interrupts taken per line since boot. */
+uint32_t irq_count(uint8_t irq);
+
+#endif /* OPENOS_ARCH_X86_IRQ_H */
@@ -1,79 +1,113 @@
 /*
  * OpenOS - Console Driver Implementation
- * 
+ *
  * VGA text mode console for kernel output.
  */
 
 #include "console.h"
 #include "serial.h"
+#include "../kernel/string.h"
+#include "../arch/x86/cpu.h"
 #include <stdint.h>
 #include <stddef.h>
 
 /* VGA memory address */
 #define VGA_MEMORY ((uint16_t*)0xB8000)
 
+#define LINE_MASK  (CONSOLE_LINES - 1)
+#define ALL_ROWS   ((1u << VGA_HEIGHT) - 1)
+
 static uint16_t* const vga_buf = VGA_MEMORY;
 static size_t term_row = 0;
 static size_t term_col = 0;
 static uint8_t term_color = 0x0F; /* white on black */
 
+/*
+ * The text lives in `lines`, a ring of CONSOLE_LINES rows in RAM; the
+ * screen shows the VGA_HEIGHT of them starting at `top` (a line number
+ * that only grows, taken modulo the ring). Scrolling advances `top` and
+ * blanks the one line that comes into view. Rows of the screen whose
+ * contents changed are set in `dirty` and copied to VGA memory, whole
+ * rows at a time, by console_flush(): once per console_write() rather
+ * than once per character. Lines past the cursor on the screen are
+ * always blank.
+ */
+static uint16_t lines[CONSOLE_LINES][VGA_WIDTH];
+static uint32_t top;
+static uint32_t view_back;          /* Scrollback: lines above the live screen */
+static uint32_t dirty;
+
 /* Create a VGA entry with character and color */
 static uint16_t vga_entry(char c, uint8_t color) {
     return (uint16_t)(uint8_t)c | ((uint16_t)color << 8);
 }
 
-/* Scroll the terminal up by one line */
-static void terminal_scroll(void) {
-    /* Scroll up by moving all lines up by one */
-    for (size_t y = 0; y < VGA_HEIGHT - 1; y++) {
-        for (size_t x = 0; x < VGA_WIDTH; x++) {
-            vga_buf[y * VGA_WIDTH + x] = vga_buf[(y + 1) * VGA_WIDTH + x];
-        }
+static inline uint16_t* line_at(uint32_t n) {
+    return lines[n & LINE_MASK];
+}
+
+static void blank_line(uint32_t n) {
+    uint32_t blank = vga_entry(' ', term_color) * 0x00010001u;
+    uint32_t* p = (uint32_t*)line_at(n);
+    for (size_t x = 0; x < VGA_WIDTH / 2; x++) {
+        p[x] = blank;
     }
-    /* Clear the last line */
-    for (size_t x = 0; x < VGA_WIDTH; x++) {
-        vga_buf[(VGA_HEIGHT - 1) * VGA_WIDTH + x] = vga_entry(' ', term_color);
+}
+
+/* Copy the dirty rows of what is on view to VGA memory */
+static void console_flush(void) {
+    uint32_t first = top - view_back;
+    while (dirty) {
+        uint32_t y = (uint32_t)__builtin_ctz(dirty);
+        dirty &= dirty - 1;
+        memcpy(&vga_buf[y * VGA_WIDTH], line_at(first + y),
+               VGA_WIDTH * sizeof(uint16_t));
     }
 }
 
+/* Scroll the terminal up by one line */
+static void terminal_scroll(void) {
+    top++;
+    blank_line(top + VGA_HEIGHT - 1);
+    dirty = ALL_ROWS;
+}
+
 /* Initialize console */
 void console_init(void) {
     /* Bring up COM1 so all console output is mirrored to the serial port
      * (harmless no-op if no UART is present). */
     serial_init();
-    console_clear();
+    for (uint32_t n = 0; n < CONSOLE_LINES; n++) {
+        blank_line(n);
+    }
+    dirty = ALL_ROWS;
+    console_flush();
 }
 
-/* Clear console */
+/* Clear console: the screen's lines move into the scrollback, and only
+ * as many blank ones as were in use have to be made */
 void console_clear(void) {
-    for (size_t y = 0; y < VGA_HEIGHT; y++) {
-        for (size_t x = 0; x < VGA_WIDTH; x++) {
-            vga_buf[y * VGA_WIDTH + x] = vga_entry(' ', term_color);
-        }
+    uint32_t flags = irq_save();
+    uint32_t used = (uint32_t)term_row + 1;
+    for (uint32_t i = 0; i < used; i++) {
+        blank_line(top + VGA_HEIGHT + i);
     }
+    top += used;
     term_row = 0;
     term_col = 0;
+    view_back = 0;
+    dirty = ALL_ROWS;
+    console_flush();
+    irq_restore(flags);
 }
 
-/* Backspace operation */
-void console_backspace(void) {
-    if (term_col > 0) {
-        term_col--;
-    } else if (term_row > 0) {
-        term_row--;
-        term_col = VGA_WIDTH - 1;
-    }
-    vga_buf[term_row * VGA_WIDTH + term_col] = vga_entry(' ', term_color);
-}
-
-/* Put a character on the console */
-void console_put_char(char c) {
-    /* Mirror every character to the serial port for headless logging,
-     * expanding '\n' to CR/LF so terminals render lines correctly. */
-    if (c == '\n') {
-        serial_write_char('\r');
+/* Put a character on the screen, leaving the flush to the caller */
+static void console_emit(char c) {
+    if (view_back) {
+        /* Output returns the view to the live screen */
+        view_back = 0;
+        dirty = ALL_ROWS;
     }
-    serial_write_char(c);
 
     if (c == '\n') {
         term_col = 0;
@@ -85,7 +119,8 @@ void console_put_char(char c) {
         return;
     }
 
-    vga_buf[term_row * VGA_WIDTH + term_col] = vga_entry(c, term_color);
+    line_at(top + term_row)[term_col] = vga_entry(c, term_color);
+    dirty |= 1u << term_row;
     term_col++;
     if (term_col >= VGA_WIDTH) {
         term_col = 0;
@@ -97,11 +132,50 @@ void console_put_char(char c) {
     }
 }
 
+/* Backspace operation */
+void console_backspace(void) {
+    uint32_t flags = irq_save();
+    if (term_col > 0) {
+        term_col--;
+    } else if (term_row > 0) {
+        term_row--;
+        term_col = VGA_WIDTH - 1;
+    }
+    line_at(top + term_row)[term_col] = vga_entry(' ', term_color);
+    dirty |= 1u << term_row;
+    if (view_back) {
+        view_back = 0;
+        dirty = ALL_ROWS;
+    }
+    console_flush();
+    irq_restore(flags);
+}
+
+/* Put a character on the console */
+void console_put_char(char c) {
+    /* Mirror every character to the serial port for headless logging,
+     * expanding '\n' to CR/LF so terminals render lines correctly. */
+    if (c == '\n') {
+        serial_write_char('\r');
+    }
+    serial_write_char(c);
+
+    uint32_t flags = irq_save();
+    console_emit(c);
+    console_flush();
+    irq_restore(flags);
+}
+
 /* Write a string to the console */
 void console_write(const char* s) {
+    serial_write(s);
+
+    uint32_t flags = irq_save();
     for (size_t i = 0; s[i] != '\0'; i++) {
-        console_put_char(s[i]);
+        console_emit(s[i]);
     }
+    console_flush();
+    irq_restore(flags);
 }
 
 /* Set console color */
@@ -109,6 +183,21 @@ void console_set_color(uint8_t fg, uint8_t bg) {
     term_color = fg | (bg << 4);
 }
 
+void console_scroll_view(int delta) {
+    uint32_t flags = irq_save();
+    /* What is still kept above the screen, and was ever written */
+    uint32_t max = top < CONSOLE_LINES - VGA_HEIGHT ? top : CONSOLE_LINES - VGA_HEIGHT;
+    int32_t back = (int32_t)view_back + delta;
+    if (back < 0) back = 0;
+    if ((uint32_t)back > max) back = (int32_t)max;
+    if ((uint32_t)back != view_back) {
+        view_back = (uint32_t)back;
+        dirty = ALL_ROWS;
+        console_flush();
+    }
+    irq_restore(flags);
+}
+
 /* Legacy function aliases for backwards compatibility */
 void terminal_put_char(char c) {
     console_put_char(c);
@@ -2,6 +2,12 @@
  * OpenOS - Console Driver
  * 
  * Provides VGA text mode console interface for kernel output.
+ *
+ * Text is kept in a ring of lines in RAM and copied to VGA memory a
+ * changed row at a time, so scrolling is moving an index, and a
+ * console_write() updates the screen once however many lines it
+ * prints. The lines that scrolled off stay in the ring as scrollback,
+ * which Shift+PgUp / Shift+PgDn page through.
  */
 
 #ifndef OPENOS_DRIVERS_CONSOLE_H
@@ -14,6 +20,9 @@
 #define VGA_WIDTH  80
 #define VGA_HEIGHT 25
 
+/* Lines kept, the screen included; a power of two */
+#define CONSOLE_LINES 256
+
 /* Initialize console */
 void console_init(void);
 
@@ -32,4 +41,8 @@ void console_backspace(void);
 /* Set console color */
 void console_set_color(uint8_t fg, uint8_t bg);
 
+/* Move the view `delta` lines back into the scrollback (negative:
+ * forward). The next output returns it to the live screen. */
+void console_scroll_view(int delta);
+
 #endif /* OPENOS_DRIVERS_CONSOLE_H */
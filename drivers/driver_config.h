@@ -43,6 +43,12 @@
 #define KB_LAYOUT_AZERTY       2
 #define KB_LAYOUT_QWERTZ       3
 
+/* Compiled-in keyboard defaults (KeyboardConfig::default() in
+ * keyboard_config.rs), for C code that must not depend on the library */
+#define KB_DEFAULT_LAYOUT      KB_LAYOUT_QWERTY_US
+#define KB_DEFAULT_CAPS_LOCK   0
+#define KB_DEFAULT_BUFFER_SIZE 256
+
 /* ------------------------------------------------------------------ */
 /* Console configuration                                               */
 /* ------------------------------------------------------------------ */
@@ -0,0 +1,477 @@
+/*
+ * OpenOS - Intel 8254x (e1000) Ethernet Driver Implementation
+ */
+
+#include "e1000.h"
+#include "pci.h"
+#include "../kernel/printk.h"
+#include "../kernel/string.h"
+#include "../memory/pmm.h"
+#include "../arch/x86/irq.h"
+#include "../arch/x86/cpu.h"
+
+/* Registers (byte offsets into BAR0) */
+#define REG_CTRL    0x0000
+#define REG_STATUS  0x0008
+#define REG_EERD    0x0014
+#define REG_MDIC    0x0020
+#define REG_ICR     0x00C0
+#define REG_ITR     0x00C4
+#define REG_IMS     0x00D0
+#define REG_IMC     0x00D8
+#define REG_RCTL    0x0100
+#define REG_TCTL    0x0400
+#define REG_TIPG    0x0410
+#define REG_RDBAL   0x2800
+#define REG_RDBAH   0x2804
+#define REG_RDLEN   0x2808
+#define REG_RDH     0x2810
+#define REG_RDT     0x2818
+#define REG_TDBAL   0x3800
+#define REG_TDBAH   0x3804
+#define REG_TDLEN   0x3808
+#define REG_TDH     0x3810
+#define REG_TDT     0x3818
+#define REG_MPC     0x4010
+#define REG_MTA     0x5200
+#define REG_RAL0    0x5400
+#define REG_RAH0    0x5404
+
+#define CTRL_ASDE   (1u << 5)
+#define CTRL_SLU    (1u << 6)
+#define CTRL_RST    (1u << 26)
+
+#define EERD_START  (1u << 0)
+#define EERD_DONE   (1u << 4)
+
+#define MDIC_OP_WRITE   (1u << 26)
+#define MDIC_OP_READ    (2u << 26)
+#define MDIC_READY      (1u << 28)
+#define MDIC_ERROR      (1u << 30)
+#define PHY_ADDR        1
+#define PHY_BMCR        0
+#define BMCR_LOOPBACK   (1u << 14)
+
+#define RCTL_EN     (1u << 1)
+#define RCTL_BAM    (1u << 15)
+#define RCTL_SECRC  (1u << 26)      /* Strip the CRC; BSIZE 00 = 2048 */
+
+#define TCTL_EN     (1u << 1)
+#define TCTL_PSP    (1u << 3)       /* Pad short frames */
+#define TCTL_CT     (0x0Fu << 4)
+#define TCTL_COLD   (0x40u << 12)
+#define TIPG_DEFAULT 0x0060200Au
+
+#define INT_TXDW    (1u << 0)
+#define INT_LSC     (1u << 2)
+#define INT_RXDMT0  (1u << 4)
+#define INT_RXO     (1u << 6)
+#define INT_RXT0    (1u << 7)
+#define INT_MASK    (INT_RXT0 | INT_RXO | INT_RXDMT0 | INT_LSC | INT_TXDW)
+
+/* Interrupt throttling, in 256 ns units: at most ~8000 interrupts/s */
+#define ITR_DEFAULT 488
+
+#define RAH_AV      (1u << 31)
+
+/* Legacy descriptors */
+typedef struct e1000_rx_desc {
+    uint64_t addr;
+    uint16_t length;
+    uint16_t checksum;
+    uint8_t  status;
+    uint8_t  errors;
+    uint16_t special;
+} __attribute__((packed)) e1000_rx_desc_t;
+
+typedef struct e1000_tx_desc {
+    uint64_t addr;
+    uint16_t length;
+    uint8_t  cso;
+    uint8_t  cmd;
+    uint8_t  status;
+    uint8_t  css;
+    uint16_t special;
+} __attribute__((packed)) e1000_tx_desc_t;
+
+#define RXD_STAT_DD     0x01
+#define RXD_STAT_EOP    0x02
+#define TXD_CMD_EOP     0x01
+#define TXD_CMD_IFCS    0x02
+#define TXD_CMD_RS      0x08
+#define TXD_STAT_DD     0x01
+
+/* Keeps the compiler from moving buffer accesses across descriptor
+ * status checks and doorbell writes (x86 does not reorder them). */
+#define barrier() __asm__ __volatile__("" : : : "memory")
+
+typedef struct e1000 {
+    volatile uint8_t *mmio;
+    pci_device_t     *pci;
+    net_device_t     *dev;
+    napi_t            napi;
+
+    volatile e1000_rx_desc_t *rx_ring;
+    volatile e1000_tx_desc_t *tx_ring;
+    sk_buff_t *rx_skb[E1000_RX_DESC];   /* Buffer each RX slot fills   */
+    sk_buff_t *tx_skb[E1000_TX_DESC];   /* Set on a frame's last slot  */
+
+    uint32_t rx_next;       /* Next descriptor the NIC will fill       */
+    uint32_t tx_tail;       /* Next free descriptor                    */
+    uint32_t tx_clean;      /* Oldest descriptor not yet reclaimed     */
+    uint32_t tx_unreported; /* Frames queued since the last RS         */
+    uint32_t tx_doorbell;   /* Last TDT value written                  */
+    uint8_t  tx_rs[E1000_TX_DESC];
+
+    e1000_stats_t stats;
+} e1000_t;
+
+static e1000_t nic;
+static int nic_present = 0;
+
+static inline uint32_t rd(e1000_t *e, uint32_t reg) {
+    return *(volatile uint32_t *)(e->mmio + reg);
+}
+
+static inline void wr(e1000_t *e, uint32_t reg, uint32_t value) {
+    *(volatile uint32_t *)(e->mmio + reg) = value;
+}
+
+/* ------------------------------------------------------------------ */
+/* EEPROM and PHY                                                       */
+/* ------------------------------------------------------------------ */
+
+static int e1000_eeprom_read(e1000_t *e, uint8_t addr, uint16_t *out) {
+    wr(e, REG_EERD, ((uint32_t)addr << 8) | EERD_START);
+    for (int i = 0; i < 100000; i++) {
+        uint32_t v = rd(e, REG_EERD);
+        if (v & EERD_DONE) {
+            *out = (uint16_t)(v >> 16);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int e1000_mdic(e1000_t *e, uint32_t cmd, uint16_t *out) {
+    wr(e, REG_MDIC, cmd);
+    for (int i = 0; i < 100000; i++) {
+        uint32_t v = rd(e, REG_MDIC);
+        if (v & MDIC_ERROR) return -1;
+        if (v & MDIC_READY) {
+            if (out) *out = (uint16_t)v;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int e1000_phy_read(e1000_t *e, uint32_t reg, uint16_t *out) {
+    return e1000_mdic(e, MDIC_OP_READ | (reg << 16) | (PHY_ADDR << 21), out);
+}
+
+static int e1000_phy_write(e1000_t *e, uint32_t reg, uint16_t value) {
+    return e1000_mdic(e, MDIC_OP_WRITE | (reg << 16) | (PHY_ADDR << 21) | value,
+                      0);
+}
+
+static void e1000_read_mac(e1000_t *e, mac_addr_t *mac) {
+    uint32_t ral = rd(e, REG_RAL0);
+    uint32_t rah = rd(e, REG_RAH0);
+
+    if ((rah & RAH_AV) && (ral || (rah & 0xFFFF))) {
+        for (int i = 0; i < 4; i++) mac->addr[i] = (uint8_t)(ral >> (i * 8));
+        mac->addr[4] = (uint8_t)rah;
+        mac->addr[5] = (uint8_t)(rah >> 8);
+        return;
+    }
+
+    /* Receive address not loaded: take it from the EEPROM */
+    for (uint8_t w = 0; w < 3; w++) {
+        uint16_t v = 0;
+        if (e1000_eeprom_read(e, w, &v) < 0) return;
+        mac->addr[w * 2]     = (uint8_t)v;
+        mac->addr[w * 2 + 1] = (uint8_t)(v >> 8);
+    }
+    wr(e, REG_RAL0, mac->addr[0] | (mac->addr[1] << 8) |
+                    (mac->addr[2] << 16) | ((uint32_t)mac->addr[3] << 24));
+    wr(e, REG_RAH0, mac->addr[4] | (mac->addr[5] << 8) | RAH_AV);
+}
+
+/* ------------------------------------------------------------------ */
+/* Rings                                                                */
+/* ------------------------------------------------------------------ */
+
+/* Give RX slot `i` a fresh sk_buff. The NIC writes at most a 1518-byte
+ * frame (long packets are off), which fits behind the headroom even
+ * though BSIZE says 2048. */
+static int e1000_rx_refill(e1000_t *e, uint32_t i) {
+    sk_buff_t *skb = skb_alloc();
+    if (!skb) return -1;
+
+    e->rx_skb[i] = skb;
+    e->rx_ring[i].addr   = (uint32_t)skb->data;
+    e->rx_ring[i].status = 0;
+    return 0;
+}
+
+static int e1000_setup_rings(e1000_t *e) {
+    /* Both descriptor rings (2 KiB each) share one page */
+    uint8_t *rings = (uint8_t *)pmm_alloc_page();
+    if (!rings) return -1;
+    memset(rings, 0, 4096);
+    e->rx_ring = (volatile e1000_rx_desc_t *)rings;
+    e->tx_ring = (volatile e1000_tx_desc_t *)(rings + 2048);
+
+    for (uint32_t i = 0; i < E1000_RX_DESC; i++) {
+        if (e1000_rx_refill(e, i) < 0) return -1;
+    }
+    for (uint32_t i = 0; i < E1000_TX_DESC; i++) {
+        e->tx_skb[i] = NULL;
+        e->tx_rs[i]  = 0;
+    }
+
+    /* RX: all descriptors but one belong to the NIC */
+    wr(e, REG_RDBAL, (uint32_t)e->rx_ring);
+    wr(e, REG_RDBAH, 0);
+    wr(e, REG_RDLEN, E1000_RX_DESC * sizeof(e1000_rx_desc_t));
+    wr(e, REG_RDH, 0);
+    wr(e, REG_RDT, E1000_RX_DESC - 1);
+    e->rx_next = 0;
+    wr(e, REG_RCTL, RCTL_EN | RCTL_BAM | RCTL_SECRC);
+
+    wr(e, REG_TDBAL, (uint32_t)e->tx_ring);
+    wr(e, REG_TDBAH, 0);
+    wr(e, REG_TDLEN, E1000_TX_DESC * sizeof(e1000_tx_desc_t));
+    wr(e, REG_TDH, 0);
+    wr(e, REG_TDT, 0);
+    e->tx_tail = e->tx_clean = e->tx_doorbell = 0;
+    e->tx_unreported = 0;
+    wr(e, REG_TIPG, TIPG_DEFAULT);
+    wr(e, REG_TCTL, TCTL_EN | TCTL_PSP | TCTL_CT | TCTL_COLD);
+    return 0;
+}
+
+/*
+ * Free transmitted descriptors and their sk_buffs. Only descriptors
+ * with RS get their DD bit written back, and the NIC completes them in
+ * order, so one DD on such a descriptor frees everything up to it.
+ * Interrupts must be disabled.
+ */
+static void e1000_tx_reclaim(e1000_t *e) {
+    uint32_t i = e->tx_clean;
+    while (i != e->tx_tail) {
+        if (e->tx_rs[i]) {
+            if (!(e->tx_ring[i].status & TXD_STAT_DD)) break;
+            e->tx_rs[i] = 0;
+            uint32_t end = (i + 1) % E1000_TX_DESC;
+            for (uint32_t j = e->tx_clean; j != end; j = (j + 1) % E1000_TX_DESC) {
+                if (e->tx_skb[j]) {
+                    skb_free(e->tx_skb[j]);
+                    e->tx_skb[j] = NULL;
+                }
+            }
+            e->tx_clean = end;
+            e->stats.tx_reclaims++;
+        }
+        i = (i + 1) % E1000_TX_DESC;
+    }
+}
+
+static uint32_t e1000_tx_free(const e1000_t *e) {
+    return (e->tx_clean + E1000_TX_DESC - e->tx_tail - 1) % E1000_TX_DESC;
+}
+
+static void e1000_tx_doorbell(e1000_t *e) {
+    if (e->tx_doorbell == e->tx_tail) return;
+    barrier();
+    wr(e, REG_TDT, e->tx_tail);
+    e->tx_doorbell = e->tx_tail;
+    e->stats.tx_doorbells++;
+}
+
+/* Fill the next TX descriptor with `len` bytes at `addr`. */
+static void e1000_tx_fill(e1000_t *e, const uint8_t *addr, uint32_t len,
+                          uint8_t cmd) {
+    volatile e1000_tx_desc_t *d = &e->tx_ring[e->tx_tail];
+    d->addr   = (uint32_t)addr;
+    d->length = (uint16_t)len;
+    d->cso    = 0;
+    d->status = 0;
+    d->cmd    = cmd | TXD_CMD_IFCS;
+    e->tx_rs[e->tx_tail] = 0;
+    e->tx_tail = (e->tx_tail + 1) % E1000_TX_DESC;
+}
+
+/* Scatter-gather: one descriptor for the linear part and one per
+ * fragment, EOP on the last; the NIC reads the buffers in place. */
+static int e1000_xmit(net_device_t *dev, sk_buff_t *skb, uint32_t flags) {
+    e1000_t *e = (e1000_t *)dev->priv;
+    uint32_t headlen = skb_headlen(skb);
+    uint32_t need = skb->nr_frags + (headlen ? 1 : 0);
+
+    uint32_t irq = irq_save();
+    if (e1000_tx_free(e) < need) {
+        e1000_tx_reclaim(e);
+        if (e1000_tx_free(e) < need) {
+            /* Let the NIC work through what is already queued */
+            e1000_tx_doorbell(e);
+            e->stats.tx_ring_full++;
+            irq_restore(irq);
+            return -1;
+        }
+    }
+
+    if (headlen) {
+        e1000_tx_fill(e, skb->data, headlen, skb->nr_frags ? 0 : TXD_CMD_EOP);
+    }
+    for (uint32_t f = 0; f < skb->nr_frags; f++) {
+        const skb_frag_t *frag = &skb->frags[f];
+        e1000_tx_fill(e, skb_frag_address(frag), frag->size,
+                      (f + 1 == skb->nr_frags) ? TXD_CMD_EOP : 0);
+    }
+
+    uint32_t last = (e->tx_tail + E1000_TX_DESC - 1) % E1000_TX_DESC;
+    e->tx_skb[last] = skb;
+    if (!(flags & NET_XMIT_MORE) || ++e->tx_unreported >= E1000_TX_RS_EVERY) {
+        e->tx_ring[last].cmd |= TXD_CMD_RS;
+        e->tx_rs[last] = 1;
+        e->tx_unreported = 0;
+    }
+
+    if (!(flags & NET_XMIT_MORE)) e1000_tx_doorbell(e);
+    irq_restore(irq);
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* Interrupts and NAPI                                                  */
+/* ------------------------------------------------------------------ */
+
+static void e1000_irq(void *ctx) {
+    e1000_t *e = (e1000_t *)ctx;
+    uint32_t icr = rd(e, REG_ICR);        /* reading clears it */
+    if (!icr) return;                     /* another device on the line */
+
+    e->stats.irqs++;
+    wr(e, REG_IMC, 0xFFFFFFFFu);
+    napi_schedule(&e->napi);
+}
+
+static int e1000_poll(napi_t *napi, int budget) {
+    e1000_t *e = (e1000_t *)napi->dev->priv;
+    int done = 0;
+
+    uint32_t irq = irq_save();
+    e1000_tx_reclaim(e);
+    irq_restore(irq);
+
+    while (done < budget) {
+        volatile e1000_rx_desc_t *d = &e->rx_ring[e->rx_next];
+        uint8_t status = d->status;
+        if (!(status & RXD_STAT_DD)) break;
+        barrier();
+
+        /* Pass the filled buffer up and put a fresh one in its place;
+         * without one the frame is dropped and the buffer reused. */
+        sk_buff_t *skb = e->rx_skb[e->rx_next];
+        uint32_t len = d->length;
+        if (!(status & RXD_STAT_EOP) || d->errors) {
+            e->stats.rx_errors++;
+            e->dev->stats.rx_errors++;
+        } else if (e1000_rx_refill(e, e->rx_next) < 0) {
+            e->dev->stats.rx_dropped++;
+        } else {
+            skb_put(skb, len);
+            net_rx(e->dev, skb);
+        }
+        d->status = 0;
+        e->rx_next = (e->rx_next + 1) % E1000_RX_DESC;
+        done++;
+    }
+
+    /* Give the whole batch back with one tail write */
+    if (done) {
+        barrier();
+        wr(e, REG_RDT, (e->rx_next + E1000_RX_DESC - 1) % E1000_RX_DESC);
+    }
+
+    /* Ring drained: back to interrupts. Frames that arrived since the
+     * ICR read have left their cause set, so unmasking raises them. */
+    if (done < budget) {
+        napi_complete(napi);
+        wr(e, REG_IMS, INT_MASK);
+    }
+    return done;
+}
+
+/* ------------------------------------------------------------------ */
+/* Setup                                                                */
+/* ------------------------------------------------------------------ */
+
+int e1000_init(net_device_t *dev) {
+    pci_device_t *pci = pci_find(E1000_VENDOR_INTEL, E1000_DEV_82540EM);
+    if (!pci) pci = pci_find(E1000_VENDOR_INTEL, E1000_DEV_82545EM);
+    if (!pci || !dev) return -1;
+
+    e1000_t *e = &nic;
+    memset(e, 0, sizeof(*e));
+    e->pci  = pci;
+    e->dev  = dev;
+    e->mmio = (volatile uint8_t *)pci_bar_address(pci, 0);
+    if (!e->mmio || pci->irq_line >= IRQ_LINES) return -1;
+    pci_enable_device(pci);
+
+    /* Reset, then keep every interrupt masked until the rings exist */
+    wr(e, REG_IMC, 0xFFFFFFFFu);
+    wr(e, REG_CTRL, rd(e, REG_CTRL) | CTRL_RST);
+    for (int i = 0; i < 100000 && (rd(e, REG_CTRL) & CTRL_RST); i++) { }
+    wr(e, REG_IMC, 0xFFFFFFFFu);
+    (void)rd(e, REG_ICR);
+
+    wr(e, REG_CTRL, rd(e, REG_CTRL) | CTRL_SLU | CTRL_ASDE);
+    e1000_read_mac(e, &dev->mac);
+    for (int i = 0; i < 128; i++) wr(e, REG_MTA + i * 4, 0);
+
+    if (e1000_setup_rings(e) < 0) {
+        printk(LOG_ERR, "e1000: out of memory for rings\n");
+        return -1;
+    }
+
+    e->napi.poll  = e1000_poll;
+    e->napi.dev   = dev;
+    e->napi.queue = 0;
+    if (irq_register(pci->irq_line, e1000_irq, e) < 0) {
+        printk(LOG_ERR, "e1000: cannot use IRQ %u\n", pci->irq_line);
+        return -1;
+    }
+    napi_add(&e->napi);
+    dev->xmit = e1000_xmit;
+    dev->priv = e;
+
+    wr(e, REG_ITR, ITR_DEFAULT);
+    wr(e, REG_IMS, INT_MASK);
+
+    nic_present = 1;
+    return 0;
+}
+
+int e1000_present(void) {
+    return nic_present;
+}
+
+int e1000_set_loopback(int on) {
+    if (!nic_present) return -1;
+
+    uint16_t bmcr;
+    if (e1000_phy_read(&nic, PHY_BMCR, &bmcr) < 0) return -1;
+    if (on) bmcr |= BMCR_LOOPBACK;
+    else    bmcr &= (uint16_t)~BMCR_LOOPBACK;
+    return e1000_phy_write(&nic, PHY_BMCR, bmcr);
+}
+
+void e1000_get_stats(e1000_stats_t *stats) {
+    if (!stats) return;
+    if (nic_present) nic.stats.rx_missed += rd(&nic, REG_MPC);  /* clears */
+    *stats = nic.stats;
+}
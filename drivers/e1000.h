@@ -0,0 +1,60 @@
+/*
+ * OpenOS - Intel 8254x (e1000) Ethernet Driver
+ *
+ * Drives the 82540EM that QEMU emulates by default (and its 82545EM
+ * sibling) through legacy descriptors in two DMA rings:
+ *
+ *   RX: every descriptor owns an sk_buff the NIC receives into. The
+ *       interrupt handler only masks the device and schedules NAPI; the
+ *       RX thread then walks the ring, hands each filled sk_buff to
+ *       net_rx() as it is, puts a fresh one in its slot and returns
+ *       the descriptors to the NIC with one RDT write per poll.
+ *   TX: the sk_buff's linear part and fragments each get a descriptor
+ *       pointing at them, so nothing is copied; the sk_buff is freed
+ *       when the NIC is done. A completion report (RS) is requested
+ *       only every E1000_TX_RS_EVERY frames and on the last frame of a
+ *       batch, and the TDT doorbell is written once per batch (see
+ *       NET_XMIT_MORE), so finished descriptors are reclaimed in groups
+ *       rather than one by one.
+ *
+ * Paging is not enabled, so ring and sk_buff addresses are physical
+ * addresses as they stand and the register BAR is used directly.
+ */
+
+#ifndef OPENOS_DRIVERS_E1000_H
+#define OPENOS_DRIVERS_E1000_H
+
+#include <stdint.h>
+#include "../include/network.h"
+
+#define E1000_VENDOR_INTEL  0x8086
+#define E1000_DEV_82540EM   0x100E      /* QEMU -device e1000 (default) */
+#define E1000_DEV_82545EM   0x100F
+
+#define E1000_RX_DESC       128
+#define E1000_TX_DESC       128
+#define E1000_TX_RS_EVERY   32
+
+typedef struct e1000_stats {
+    uint32_t irqs;          /* Interrupts that were ours              */
+    uint32_t tx_doorbells;  /* TDT writes                             */
+    uint32_t tx_reclaims;   /* RS completions processed               */
+    uint32_t tx_ring_full;  /* xmit calls refused                     */
+    uint32_t rx_missed;     /* MPC: frames lost for lack of buffers   */
+    uint32_t rx_errors;     /* Descriptors with error bits set        */
+} e1000_stats_t;
+
+/* Find and bring up the NIC, attaching it to `dev`. Returns 0, or -1
+ * if there is none (or it cannot be set up). */
+int e1000_init(net_device_t *dev);
+
+/* 1 if e1000_init() found a NIC. */
+int e1000_present(void);
+
+/* PHY loopback: transmitted frames come straight back on the RX ring
+ * instead of going to the wire. Returns 0 or -1. */
+int e1000_set_loopback(int on);
+
+void e1000_get_stats(e1000_stats_t *stats);
+
+#endif /* OPENOS_DRIVERS_E1000_H */
@@ -5,14 +5,24 @@
 #include "keyboard.h"
 #include "../arch/x86/pic.h"
 #include "../arch/x86/ports.h"
+#include "../arch/x86/cpu.h"
+#include "../process/waitqueue.h"
+#include "../process/scheduler.h"
+#include "../kernel/file.h"
+#include "../include/epoll.h"
+#include "../memory/heap.h"
+#include "../kernel/string.h"
+#include "driver_config.h"
 #include <stdint.h>
 #include <stddef.h>
 
 /* External terminal functions from kernel.c */
 extern void terminal_put_char(char c);
 extern void terminal_backspace(void);
+extern void console_scroll_view(int delta);
 
-/* US QWERTY scan code to ASCII translation table (Set 1) */
+/* US QWERTY scan code to ASCII translation table (Set 1); the other
+ * layouts are this with the differences below applied */
 static const char scancode_to_ascii[128] = {
     0,  27, '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=', '\b',
     '\t', 'q', 'w', 'e', 'r', 't', 'y', 'u', 'i', 'o', 'p', '[', ']', '\n',
@@ -80,98 +90,412 @@ static const char scancode_to_ascii_shift[128] = {
     0, /* Rest are undefined */
 };
 
-/* Keyboard state */
-static uint8_t shift_pressed = 0;
-static uint8_t caps_lock = 0;
+/*
+ * Keys a layout changes: what each gives alone, with Shift and with
+ * AltGr. 0 is nothing, which is also what characters outside ASCII
+ * (such as the accented letters) come out as.
+ */
+typedef struct key_override {
+    uint8_t scancode;
+    char    normal, shift, altgr;
+} key_override_t;
+
+static const key_override_t layout_uk[] = {
+    { 0x03, '2',  '"',  0    },
+    { 0x04, '3',  0,    0    },     /* Shift: pound sign */
+    { 0x28, '\'', '@',  0    },
+    { 0x29, '`',  0,    '|'  },
+    { 0x2B, '#',  '~',  '\\' },
+    { 0x56, '\\', '|',  0    },
+};
+
+static const key_override_t layout_fr[] = {
+    { 0x02, '&',  '1',  0    },
+    { 0x03, 0,    '2',  '~'  },
+    { 0x04, '"',  '3',  '#'  },
+    { 0x05, '\'', '4',  '{'  },
+    { 0x06, '(',  '5',  '['  },
+    { 0x07, '-',  '6',  '|'  },
+    { 0x08, 0,    '7',  '`'  },
+    { 0x09, '_',  '8',  '\\' },
+    { 0x0A, 0,    '9',  '^'  },
+    { 0x0B, 0,    '0',  '@'  },
+    { 0x0C, ')',  0,    ']'  },
+    { 0x0D, '=',  '+',  '}'  },
+    { 0x10, 'a',  'A',  0    },
+    { 0x11, 'z',  'Z',  0    },
+    { 0x1A, '^',  0,    0    },
+    { 0x1B, '$',  0,    0    },
+    { 0x1E, 'q',  'Q',  0    },
+    { 0x27, 'm',  'M',  0    },
+    { 0x28, 0,    '%',  0    },
+    { 0x29, 0,    0,    0    },
+    { 0x2B, '*',  0,    0    },
+    { 0x2C, 'w',  'W',  0    },
+    { 0x32, ',',  '?',  0    },
+    { 0x33, ';',  '.',  0    },
+    { 0x34, ':',  '/',  0    },
+    { 0x35, '!',  0,    0    },
+    { 0x56, '<',  '>',  0    },
+};
+
+static const key_override_t layout_de[] = {
+    { 0x03, '2',  '"',  0    },
+    { 0x04, '3',  0,    0    },
+    { 0x07, '6',  '&',  0    },
+    { 0x08, '7',  '/',  '{'  },
+    { 0x09, '8',  '(',  '['  },
+    { 0x0A, '9',  ')',  ']'  },
+    { 0x0B, '0',  '=',  '}'  },
+    { 0x0C, 0,    '?',  '\\' },
+    { 0x0D, 0,    '`',  0    },
+    { 0x10, 'q',  'Q',  '@'  },
+    { 0x15, 'z',  'Z',  0    },
+    { 0x1A, 0,    0,    0    },
+    { 0x1B, '+',  '*',  '~'  },
+    { 0x27, 0,    0,    0    },
+    { 0x28, 0,    0,    0    },
+    { 0x29, '^',  0,    0    },
+    { 0x2B, '#',  '\'', 0    },
+    { 0x2C, 'y',  'Y',  0    },
+    { 0x33, ',',  ';',  0    },
+    { 0x34, '.',  ':',  0    },
+    { 0x35, '-',  '_',  0    },
+    { 0x56, '<',  '>',  '|'  },
+};
+
+typedef struct kbd_layout {
+    const char*           name;
+    const key_override_t* keys;
+    uint32_t              count;
+} kbd_layout_t;
+
+#define LAYOUT(name, keys) { name, keys, sizeof(keys) / sizeof(keys[0]) }
+
+/* Indexed by the KB_LAYOUT_* ids of driver_config.h */
+static const kbd_layout_t layouts[] = {
+    [KB_LAYOUT_QWERTY_US] = { "us", NULL, 0 },
+    [KB_LAYOUT_QWERTY_UK] = LAYOUT("uk", layout_uk),
+    [KB_LAYOUT_AZERTY]    = LAYOUT("fr", layout_fr),
+    [KB_LAYOUT_QWERTZ]    = LAYOUT("de", layout_de),
+};
+
+#define NUM_LAYOUTS (sizeof(layouts) / sizeof(layouts[0]))
+
+/* The active layout, expanded so that translating is one lookup */
+enum { MAP_NORMAL, MAP_SHIFT, MAP_ALTGR, MAP_COUNT };
+static char    keymap[MAP_COUNT][128];
+static uint8_t layout_id;
+
+/* Keypad 0x47..0x53 with Num Lock on */
+static const char keypad_chars[] = "789-456+1230.";
+
+#define SC_EXTENDED     0xE0
+#define SC_PAUSE        0xE1    /* Starts the 6-byte Pause sequence */
+#define SCROLLBACK_STEP 12      /* Lines per Shift+PgUp */
+
+/* Modifier keys held down */
+#define HELD_LSHIFT     0x01
+#define HELD_RSHIFT     0x02
+#define HELD_LCTRL      0x04
+#define HELD_RCTRL      0x08
+#define HELD_LALT       0x10
+#define HELD_ALTGR      0x20
+
+/* In file_t::flags of a line descriptor, beside FILE_READ */
+#define KBD_FILE_NONBLOCK 0x100
+
+/*
+ * Scancode ring. Only the IRQ handler moves sc_head and only the
+ * translator moves sc_tail, so neither needs a lock; each publishes its
+ * index after touching the slot.
+ */
+static uint8_t  sc_ring[KBD_SCANCODE_RING];
+static uint32_t sc_head, sc_tail;
+static wait_queue_t kbd_wait;           /* The kbd thread, for scancodes */
+static int kbd_thread_running;
+
+#if KBD_SCANCODE_RING != KB_DEFAULT_BUFFER_SIZE
+#error "KBD_SCANCODE_RING should match the driver_config default"
+#endif
+
+/* Translator state */
+static uint8_t prefix;                  /* Last byte was 0xE0            */
+static uint8_t pause_skip;              /* Bytes of a Pause left         */
+static uint8_t held;                    /* HELD_*                        */
+static uint8_t locks;                   /* KBD_MOD_CAPS | KBD_MOD_NUM    */
 
-/* Input buffer */
+/* Line editor */
 #define INPUT_BUFFER_SIZE 256
 static char input_buffer[INPUT_BUFFER_SIZE];
 static volatile size_t input_buffer_pos = 0;
 static volatile uint8_t line_ready = 0;
 
+/* Processes waiting for a line (and epoll hooks) */
+static wait_queue_t line_wait;
+
+/* Event queues */
+typedef struct kbd_consumer {
+    key_event_t  ev[KBD_EVENT_QUEUE];
+    uint32_t     head, tail;
+    uint32_t     flags;                 /* KBD_GRAB | KBD_NONBLOCK       */
+    wait_queue_t wait;
+    struct kbd_consumer* next;
+} kbd_consumer_t;
+
+static kbd_consumer_t* consumers;
+static uint32_t grabs;                  /* Open with KBD_GRAB            */
+static keyboard_stats_t stats;
+
 /* Initialize keyboard */
 void keyboard_init(void) {
+    wait_queue_init(&line_wait);
+    wait_queue_init(&kbd_wait);
+    keyboard_set_layout(KB_DEFAULT_LAYOUT);
+    if (KB_DEFAULT_CAPS_LOCK) locks |= KBD_MOD_CAPS;
+
     /* Enable keyboard interrupt (IRQ1) */
     uint8_t mask = inb(PIC1_DATA);
     mask &= ~(1 << 1);  /* Clear bit 1 to enable IRQ1 */
     outb(PIC1_DATA, mask);
 }
 
-/* Keyboard interrupt handler */
+int keyboard_set_layout(uint8_t id) {
+    if (id >= NUM_LAYOUTS || !layouts[id].name) return -1;
+
+    const kbd_layout_t* l = &layouts[id];
+    uint32_t irq = irq_save();
+    memcpy(keymap[MAP_NORMAL], scancode_to_ascii, 128);
+    memcpy(keymap[MAP_SHIFT], scancode_to_ascii_shift, 128);
+    memset(keymap[MAP_ALTGR], 0, 128);
+    for (uint32_t i = 0; i < l->count; i++) {
+        const key_override_t* k = &l->keys[i];
+        keymap[MAP_NORMAL][k->scancode] = k->normal;
+        keymap[MAP_SHIFT][k->scancode]  = k->shift;
+        keymap[MAP_ALTGR][k->scancode]  = k->altgr;
+    }
+    layout_id = id;
+    irq_restore(irq);
+    return 0;
+}
+
+const char* keyboard_layout_name(uint8_t id) {
+    return id < NUM_LAYOUTS ? layouts[id].name : NULL;
+}
+
+/* Keyboard interrupt handler: queue the byte, nothing else */
 void keyboard_handler(void) {
-    /* Read scan code from keyboard */
     uint8_t scancode = inb(KEYBOARD_DATA_PORT);
-    
-    /* Check if it's a break code (key release) */
-    if (scancode & 0x80) {
-        /* Key released */
-        scancode &= 0x7F;  /* Remove break bit */
-        
-        /* Check for shift key release */
-        if (scancode == 0x2A || scancode == 0x36) {
-            shift_pressed = 0;
-        }
+
+    uint32_t head = sc_head;
+    if (head - __atomic_load_n(&sc_tail, __ATOMIC_ACQUIRE) < KBD_SCANCODE_RING) {
+        sc_ring[head & (KBD_SCANCODE_RING - 1)] = scancode;
+        __atomic_store_n(&sc_head, head + 1, __ATOMIC_RELEASE);
     } else {
-        /* Key pressed */
-        
-        /* Check for shift key press */
-        if (scancode == 0x2A || scancode == 0x36) {
-            shift_pressed = 1;
+        stats.scancode_drops++;
+    }
+    stats.scancodes++;
+    if (kbd_thread_running) {
+        wait_queue_wake_one(&kbd_wait);
+    }
+
+    /* Send EOI to PIC */
+    pic_send_eoi(1);
+}
+
+/* ------------------------------------------------------------------ */
+/* Translation                                                          */
+/* ------------------------------------------------------------------ */
+
+static uint8_t modifier_bit(uint8_t key) {
+    switch (key) {
+    case KEY_LSHIFT: return HELD_LSHIFT;
+    case KEY_RSHIFT: return HELD_RSHIFT;
+    case KEY_LCTRL:  return HELD_LCTRL;
+    case KEY_RCTRL:  return HELD_RCTRL;
+    case KEY_LALT:   return HELD_LALT;
+    case KEY_ALTGR:  return HELD_ALTGR;
+    default:         return 0;
+    }
+}
+
+static uint8_t current_mods(void) {
+    uint8_t mods = locks;
+    if (held & (HELD_LSHIFT | HELD_RSHIFT)) mods |= KBD_MOD_SHIFT;
+    if (held & (HELD_LCTRL | HELD_RCTRL))   mods |= KBD_MOD_CTRL;
+    if (held & HELD_LALT)                   mods |= KBD_MOD_ALT;
+    if (held & HELD_ALTGR)                  mods |= KBD_MOD_ALTGR;
+    return mods;
+}
+
+static int is_letter(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static char key_ascii(uint8_t key, uint8_t mods) {
+    if (key == KEY_KP_ENTER) return '\n';
+    if (key == KEY_KP_SLASH) return '/';
+    if (key & 0x80) return 0;
+    if (key >= 0x47 && key <= 0x53) {
+        /* Only reached with Num Lock on, or for - + and 5 */
+        char c = keypad_chars[key - 0x47];
+        return (c == '-' || c == '+' || (mods & KBD_MOD_NUM)) ? c : 0;
+    }
+
+    char c;
+    if (mods & KBD_MOD_ALTGR) {
+        c = keymap[MAP_ALTGR][key];
+    } else {
+        c = keymap[(mods & KBD_MOD_SHIFT) ? MAP_SHIFT : MAP_NORMAL][key];
+        /* Caps Lock inverts Shift, for letters only */
+        if ((mods & KBD_MOD_CAPS) && is_letter(c)) c ^= 0x20;
+    }
+    if ((mods & KBD_MOD_CTRL) && is_letter(c)) c &= 0x1F;
+    return c;
+}
+
+/* Feed one scancode to the state machine. Returns 1 with `ev` filled
+ * when it completes a key event. */
+static int kbd_translate(uint8_t sc, key_event_t* ev) {
+    if (pause_skip) {
+        pause_skip--;
+        return 0;
+    }
+    switch (sc) {
+    case 0x00: case 0xFA: case 0xFE: case 0xFF:
+        return 0;                   /* Errors, ACK, resend */
+    case SC_EXTENDED:
+        prefix = 1;
+        return 0;
+    case SC_PAUSE:
+        pause_skip = 5;
+        return 0;
+    }
+
+    uint8_t key = sc & 0x7F;
+    uint8_t pressed = !(sc & 0x80);
+    if (prefix) {
+        prefix = 0;
+        /* With Num Lock on, the grey navigation keys come wrapped in
+         * fake Shift presses and releases; they are not the user's */
+        if (key == KEY_LSHIFT || key == KEY_RSHIFT) return 0;
+        key |= 0x80;
+    } else if (key >= 0x47 && key <= 0x53 && key != 0x4A && key != 0x4C &&
+               key != 0x4E && !(locks & KBD_MOD_NUM)) {
+        key |= 0x80;                /* Keypad as navigation keys */
+    }
+
+    uint8_t bit = modifier_bit(key);
+    if (bit) {
+        if (pressed) held |= bit;
+        else held &= (uint8_t)~bit;
+    } else if (pressed && key == KEY_CAPSLOCK) {
+        locks ^= KBD_MOD_CAPS;
+    } else if (pressed && key == KEY_NUMLOCK) {
+        locks ^= KBD_MOD_NUM;
+    }
+
+    ev->keycode = key;
+    ev->pressed = pressed;
+    ev->mods    = current_mods();
+    ev->ascii   = pressed ? key_ascii(key, ev->mods) : 0;
+    return 1;
+}
+
+/* The console line editor's view of a key */
+static void line_input(const key_event_t* ev) {
+    if (!ev->pressed) return;
+
+    /* Shift+PgUp / Shift+PgDn page through the scrollback */
+    if ((ev->mods & KBD_MOD_SHIFT) &&
+        (ev->keycode == KEY_PAGEUP || ev->keycode == KEY_PAGEDOWN)) {
+        console_scroll_view(ev->keycode == KEY_PAGEUP ? SCROLLBACK_STEP
+                                                      : -SCROLLBACK_STEP);
+        return;
+    }
+
+    char ascii = ev->ascii;
+    if (ascii == '\b') {
+        /* Backspace */
+        if (input_buffer_pos > 0) {
+            input_buffer_pos--;
+            terminal_backspace();
         }
-        /* Check for caps lock */
-        else if (scancode == 0x3A) {
-            caps_lock = !caps_lock;
+    } else if (ascii == '\n') {
+        /* Enter */
+        terminal_put_char('\n');
+        input_buffer[input_buffer_pos] = '\0';
+        line_ready = 1;
+        wait_queue_wake_all(&line_wait);
+    } else if ((uint8_t)ascii >= ' ' || ascii == '\t') {
+        /* Regular character */
+        if (input_buffer_pos < INPUT_BUFFER_SIZE - 1) {
+            input_buffer[input_buffer_pos++] = ascii;
+            terminal_put_char(ascii);
         }
-        /* Regular key press */
-        else {
-            char ascii = 0;
-            
-            /* Validate scancode to prevent out-of-bounds access */
-            if (scancode >= 128) {
-                /* Invalid scancode, ignore */
-                pic_send_eoi(1);
-                return;
-            }
-            
-            /* Get ASCII character */
-            if (shift_pressed) {
-                ascii = scancode_to_ascii_shift[scancode];
-            } else {
-                ascii = scancode_to_ascii[scancode];
-            }
-            
-            /* Apply caps lock for letters (only when shift is not pressed) */
-            if (caps_lock && !shift_pressed) {
-                if (ascii >= 'a' && ascii <= 'z') {
-                    ascii -= 32;  /* Convert to uppercase */
-                }
-            }
-            
-            /* Handle special keys */
-            if (ascii == '\b') {
-                /* Backspace */
-                if (input_buffer_pos > 0) {
-                    input_buffer_pos--;
-                    terminal_backspace();
-                }
-            } else if (ascii == '\n') {
-                /* Enter */
-                terminal_put_char('\n');
-                input_buffer[input_buffer_pos] = '\0';
-                line_ready = 1;
-            } else if (ascii != 0) {
-                /* Regular character */
-                if (input_buffer_pos < INPUT_BUFFER_SIZE - 1) {
-                    input_buffer[input_buffer_pos++] = ascii;
-                    terminal_put_char(ascii);
-                }
-            }
+    }
+}
+
+static void kbd_deliver(const key_event_t* ev) {
+    stats.events++;
+    for (kbd_consumer_t* c = consumers; c; c = c->next) {
+        if (c->head - c->tail == KBD_EVENT_QUEUE) {
+            stats.event_drops++;
+            continue;
         }
+        c->ev[c->head++ & (KBD_EVENT_QUEUE - 1)] = *ev;
+        wait_queue_wake_all(&c->wait);
+    }
+    if (!grabs) {
+        line_input(ev);
+    }
+}
+
+/* Translate and deliver every queued scancode. Each runs with
+ * interrupts disabled, which on one CPU is also what keeps a second
+ * translator out. */
+static void keyboard_process(void) {
+    for (;;) {
+        uint32_t irq = irq_save();
+        uint32_t tail = sc_tail;
+        if (tail == __atomic_load_n(&sc_head, __ATOMIC_ACQUIRE)) {
+            irq_restore(irq);
+            return;
+        }
+        uint8_t sc = sc_ring[tail & (KBD_SCANCODE_RING - 1)];
+        __atomic_store_n(&sc_tail, tail + 1, __ATOMIC_RELEASE);
+
+        key_event_t ev;
+        if (kbd_translate(sc, &ev)) {
+            kbd_deliver(&ev);
+        }
+        irq_restore(irq);
+    }
+}
+
+static void kbd_task(void* arg) {
+    (void)arg;
+    for (;;) {
+        uint32_t irq = irq_save();
+        while (sc_tail == __atomic_load_n(&sc_head, __ATOMIC_ACQUIRE)) {
+            wait_queue_sleep(&kbd_wait);
+        }
+        irq_restore(irq);
+        keyboard_process();
+    }
+}
+
+void keyboard_start(void) {
+    if (kbd_thread_running) return;
+    if (process_create("kbd", kbd_task, 0, PRIORITY_HIGH)) {
+        kbd_thread_running = 1;
     }
-    
-    /* Send EOI to PIC */
-    pic_send_eoi(1);
+}
+
+/* Processes sleep for input; before the scheduler (or the kbd thread)
+ * runs, readers translate and halt instead. */
+static int keyboard_can_block(void) {
+    return kbd_thread_running && scheduler_active() && process_getpid() != 0;
 }
 
 /* Get a line of input (blocking) */
@@ -182,14 +506,24 @@ void keyboard_get_line(char* buffer, size_t max_len) {
     }
     
     /* Reset buffer - disable interrupts to prevent race condition */
-    __asm__ __volatile__("cli");
+    uint32_t irq = irq_save();
     input_buffer_pos = 0;
     line_ready = 0;
-    __asm__ __volatile__("sti");
-    
-    /* Wait for line to be ready (interrupts must be enabled) */
-    while (!line_ready) {
-        __asm__ __volatile__("hlt");
+
+    if (keyboard_can_block()) {
+        while (!line_ready) {
+            wait_queue_sleep(&line_wait);
+        }
+        irq_restore(irq);
+    } else {
+        /* Wait for line to be ready (interrupts must be enabled) */
+        __asm__ __volatile__("sti");
+        while (!line_ready) {
+            keyboard_process();
+            if (!line_ready) {
+                __asm__ __volatile__("hlt");
+            }
+        }
     }
     
     /* Copy to output buffer */
@@ -199,3 +533,185 @@ void keyboard_get_line(char* buffer, size_t max_len) {
     }
     buffer[i] = '\0';
 }
+
+/* ------------------------------------------------------------------ */
+/* Event queues                                                         */
+/* ------------------------------------------------------------------ */
+
+kbd_consumer_t* keyboard_open_events(uint32_t flags) {
+    kbd_consumer_t* c = (kbd_consumer_t*)kmalloc(sizeof(*c));
+    if (!c) return NULL;
+    c->head  = 0;
+    c->tail  = 0;
+    c->flags = flags;
+    wait_queue_init(&c->wait);
+
+    uint32_t irq = irq_save();
+    c->next = consumers;
+    consumers = c;
+    stats.consumers++;
+    if (flags & KBD_GRAB) grabs++;
+    irq_restore(irq);
+    return c;
+}
+
+void keyboard_close_events(kbd_consumer_t* c) {
+    if (!c) return;
+
+    uint32_t irq = irq_save();
+    for (kbd_consumer_t** pp = &consumers; *pp; pp = &(*pp)->next) {
+        if (*pp == c) {
+            *pp = c->next;
+            break;
+        }
+    }
+    stats.consumers--;
+    if (c->flags & KBD_GRAB) grabs--;
+    irq_restore(irq);
+    kfree(c);
+}
+
+/* Take up to `max` queued events without waiting. Caller holds
+ * irq_save(). */
+static uint32_t take_events(kbd_consumer_t* c, key_event_t* out, uint32_t max) {
+    uint32_t n = 0;
+    while (n < max && c->tail != c->head) {
+        out[n++] = c->ev[c->tail++ & (KBD_EVENT_QUEUE - 1)];
+    }
+    return n;
+}
+
+/* Wait until `c` has an event. Returns with interrupts disabled (flags
+ * in *irq), or -1 with them restored if the caller may not wait. */
+static int wait_event(kbd_consumer_t* c, uint32_t* irq) {
+    if (!kbd_thread_running) keyboard_process();
+
+    *irq = irq_save();
+    while (c->tail == c->head) {
+        if ((c->flags & KBD_NONBLOCK) || !keyboard_can_block()) {
+            irq_restore(*irq);
+            return -1;
+        }
+        wait_queue_sleep(&c->wait);
+    }
+    return 0;
+}
+
+int keyboard_read_event(kbd_consumer_t* c, key_event_t* ev) {
+    uint32_t irq;
+    if (wait_event(c, &irq) < 0) return -1;
+    take_events(c, ev, 1);
+    irq_restore(irq);
+    return 0;
+}
+
+void keyboard_get_stats(keyboard_stats_t* out) {
+    uint32_t irq = irq_save();
+    *out = stats;
+    out->layout = layout_id;
+    irq_restore(irq);
+}
+
+/* ------------------------------------------------------------------ */
+/* Keyboard as a file descriptor                                        */
+/* ------------------------------------------------------------------ */
+
+/* Read the next completed line, newline included, blocking until the
+ * user presses Enter. The line is consumed even if `n` cuts it short. */
+static int keyboard_file_read(file_t* f, void* buf, size_t n) {
+    if (n == 0) return 0;
+    if (!kbd_thread_running) keyboard_process();
+
+    uint32_t irq = irq_save();
+    while (!line_ready) {
+        if ((f->flags & KBD_FILE_NONBLOCK) || !keyboard_can_block()) {
+            irq_restore(irq);
+            return -1;
+        }
+        wait_queue_sleep(&line_wait);
+    }
+
+    char* out = (char*)buf;
+    size_t len = 0;
+    while (len < input_buffer_pos && len < n - 1) {
+        out[len] = input_buffer[len];
+        len++;
+    }
+    out[len++] = '\n';
+
+    input_buffer_pos = 0;
+    line_ready = 0;
+    irq_restore(irq);
+    return (int)len;
+}
+
+static uint32_t keyboard_file_poll(file_t* f, poll_table_t* pt) {
+    (void)f;
+    poll_wait(pt, &line_wait, EPOLLIN);
+    return line_ready ? EPOLLIN : 0;
+}
+
+static const file_ops_t keyboard_file_ops = {
+    .read    = keyboard_file_read,
+    .write   = NULL,
+    .release = NULL,
+    .poll    = keyboard_file_poll,
+};
+
+/* Whole events only: everything queued that fits, after waiting for
+ * the first */
+static int keyboard_events_read(file_t* f, void* buf, size_t n) {
+    kbd_consumer_t* c = (kbd_consumer_t*)f->object;
+    uint32_t max = (uint32_t)(n / sizeof(key_event_t));
+    if (max == 0) return -1;
+
+    uint32_t irq;
+    if (wait_event(c, &irq) < 0) return -1;
+    uint32_t got = take_events(c, (key_event_t*)buf, max);
+    irq_restore(irq);
+    return (int)(got * sizeof(key_event_t));
+}
+
+static uint32_t keyboard_events_poll(file_t* f, poll_table_t* pt) {
+    kbd_consumer_t* c = (kbd_consumer_t*)f->object;
+    poll_wait(pt, &c->wait, EPOLLIN);
+    return c->tail != c->head ? EPOLLIN : 0;
+}
+
+static void keyboard_events_release(file_t* f) {
+    keyboard_close_events((kbd_consumer_t*)f->object);
+}
+
+static const file_ops_t keyboard_events_ops = {
+    .read    = keyboard_events_read,
+    .write   = NULL,
+    .release = keyboard_events_release,
+    .poll    = keyboard_events_poll,
+};
+
+int keyboard_open_fd(uint32_t flags) {
+    process_t* self = process_current();
+    if (!self) return -1;
+
+    file_t* f;
+    if (flags & KBD_OPEN_EVENTS) {
+        kbd_consumer_t* c = keyboard_open_events(flags & (KBD_GRAB | KBD_NONBLOCK));
+        if (!c) return -1;
+        f = file_alloc(&keyboard_events_ops, c, FILE_READ);
+        if (!f) {
+            keyboard_close_events(c);
+            return -1;
+        }
+    } else {
+        f = file_alloc(&keyboard_file_ops, NULL,
+                       FILE_READ | ((flags & KBD_NONBLOCK) ? KBD_FILE_NONBLOCK : 0));
+        if (!f) return -1;
+    }
+
+    int fd = fd_install(self, f);
+    if (fd < 0) {
+        file_put(f);
+        return -1;
+    }
+    return fd;
+}
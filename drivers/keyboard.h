@@ -1,5 +1,18 @@
 /*
  * OpenOS - Keyboard Driver
+ *
+ * Input goes through three stages. The IRQ handler only reads the
+ * scancode and appends it to a ring (written by the handler alone,
+ * read by the translator alone, so neither side locks). The "kbd"
+ * thread then turns scancodes into key events: it follows E0-prefixed
+ * extended keys, modifiers, the lock keys and the keyboard layout
+ * (KB_LAYOUT_* from driver_config.h). Each event is copied to every
+ * open event queue and fed to the line editor, which echoes to the
+ * console and hands out complete lines. Readers of either sleep on a
+ * wait queue until there is something for them.
+ *
+ * An event queue opened with KBD_GRAB takes the keyboard for itself:
+ * while it is open the line editor sees nothing.
  */
 
 #ifndef OPENOS_DRIVERS_KEYBOARD_H
@@ -12,13 +25,111 @@
 #define KEYBOARD_DATA_PORT 0x60
 #define KEYBOARD_STATUS_PORT 0x64
 
+#define KBD_SCANCODE_RING   256     /* power of two; driver_config default */
+#define KBD_EVENT_QUEUE     64      /* Events per consumer; power of two   */
+
+/*
+ * Key codes are set 1 make codes, with 0x80 added for E0-prefixed keys.
+ * The keypad's navigation keys (Num Lock off) report the codes of the
+ * dedicated ones.
+ */
+#define KEY_ESC         0x01
+#define KEY_BACKSPACE   0x0E
+#define KEY_TAB         0x0F
+#define KEY_ENTER       0x1C
+#define KEY_LCTRL       0x1D
+#define KEY_LSHIFT      0x2A
+#define KEY_RSHIFT      0x36
+#define KEY_LALT        0x38
+#define KEY_SPACE       0x39
+#define KEY_CAPSLOCK    0x3A
+#define KEY_F1          0x3B        /* F1..F10 are consecutive */
+#define KEY_NUMLOCK     0x45
+#define KEY_SCROLLLOCK  0x46
+#define KEY_F11         0x57
+#define KEY_F12         0x58
+#define KEY_KP_ENTER    0x9C
+#define KEY_RCTRL       0x9D
+#define KEY_KP_SLASH    0xB5
+#define KEY_ALTGR       0xB8
+#define KEY_HOME        0xC7
+#define KEY_UP          0xC8
+#define KEY_PAGEUP      0xC9
+#define KEY_LEFT        0xCB
+#define KEY_RIGHT       0xCD
+#define KEY_END         0xCF
+#define KEY_DOWN        0xD0
+#define KEY_PAGEDOWN    0xD1
+#define KEY_INSERT      0xD2
+#define KEY_DELETE      0xD3
+
+/* Modifier and lock state, as of the event */
+#define KBD_MOD_SHIFT   0x01
+#define KBD_MOD_CTRL    0x02
+#define KBD_MOD_ALT     0x04
+#define KBD_MOD_ALTGR   0x08
+#define KBD_MOD_CAPS    0x10
+#define KBD_MOD_NUM     0x20
+
+typedef struct key_event {
+    uint8_t keycode;        /* KEY_*                                   */
+    uint8_t pressed;        /* 1 = make (or repeat), 0 = break         */
+    uint8_t mods;           /* KBD_MOD_*                               */
+    char    ascii;          /* After layout and modifiers, or 0        */
+} key_event_t;
+
+/* Event queue flags */
+#define KBD_GRAB        0x1     /* Keep events from the line editor    */
+#define KBD_NONBLOCK    0x2     /* Reads return -1 instead of waiting  */
+
+/* SYS_KBD_OPEN flags: lines by default */
+#define KBD_OPEN_EVENTS 0x100   /* Read key_event_t records            */
+
+struct kbd_consumer;
+
+typedef struct keyboard_stats {
+    uint32_t scancodes;         /* Taken by the IRQ handler            */
+    uint32_t scancode_drops;    /* Ring full                           */
+    uint32_t events;            /* Translated key events               */
+    uint32_t event_drops;       /* Some consumer's queue full          */
+    uint32_t consumers;         /* Event queues open                   */
+    uint8_t  layout;            /* KB_LAYOUT_*                         */
+} keyboard_stats_t;
+
 /* Initialize keyboard */
 void keyboard_init(void);
 
+/* Start the translation thread; until then readers translate. */
+void keyboard_start(void);
+
 /* Keyboard interrupt handler (called from ISR) */
 void keyboard_handler(void);
 
 /* Get a line of input (blocking) */
 void keyboard_get_line(char* buffer, size_t max_len);
 
+/* Select a KB_LAYOUT_* layout. Returns 0, or -1 if unknown. */
+int keyboard_set_layout(uint8_t layout);
+
+/* Short name of a layout ("us", "uk", "fr", "de"), or NULL */
+const char* keyboard_layout_name(uint8_t layout);
+
+/* Open / close a queue of key events. Returns NULL on OOM. */
+struct kbd_consumer* keyboard_open_events(uint32_t flags);
+void keyboard_close_events(struct kbd_consumer* c);
+
+/* Take the oldest event from `c`, waiting for one unless KBD_NONBLOCK.
+ * Returns 0, or -1 if there is none (or the caller cannot sleep). */
+int keyboard_read_event(struct kbd_consumer* c, key_event_t* ev);
+
+void keyboard_get_stats(keyboard_stats_t* stats);
+
+/* Install a read-only keyboard descriptor in the current process.
+ * By default read() returns the next line, newline included, and the
+ * descriptor polls EPOLLIN once a line is complete. With
+ * KBD_OPEN_EVENTS it has its own event queue instead, read() fills
+ * whole key_event_t records, and KBD_GRAB applies. With KBD_NONBLOCK
+ * a read with nothing ready returns -1. Returns fd or -1. */
+int keyboard_open_fd(uint32_t flags);
+
 #endif /* OPENOS_DRIVERS_KEYBOARD_H */
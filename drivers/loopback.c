@@ -0,0 +1,86 @@
+/*
+ * OpenOS - Loopback Network Device Implementation
+ */
+
+#include "loopback.h"
+#include "../include/rss.h"
+#include "../kernel/string.h"
+#include "../arch/x86/cpu.h"
+
+/* One RX queue: the packets RSS sent to it and the NAPI context
+ * polling them (napi.queue is its index) */
+typedef struct lo_queue {
+    sk_buff_head_t backlog;
+    napi_t         napi;
+} lo_queue_t;
+
+static lo_queue_t lo_queues[LOOPBACK_QUEUES];
+
+/* Called with any interrupt state, from the sender's context. Data is
+ * at the IP header. */
+static int loopback_xmit(net_device_t *dev, sk_buff_t *skb, uint32_t flags) {
+    (void)flags;
+
+    uint32_t q = rss_select_queue(dev, rss_skb_hash(skb));
+    lo_queue_t *lq = &lo_queues[q];
+    uint32_t irq = irq_save();
+    if (lq->backlog.qlen >= LOOPBACK_BACKLOG) {
+        dev->rxq[q].dropped++;
+        irq_restore(irq);
+        return -1;
+    }
+    skb->dev       = dev;
+    skb->queue     = (uint16_t)q;
+    skb->ip_summed = CHECKSUM_UNNECESSARY;
+    skb_queue_tail(&lq->backlog, skb);
+    napi_schedule(&lq->napi);
+    irq_restore(irq);
+    return 0;
+}
+
+static int loopback_poll(napi_t *napi, int budget) {
+    lo_queue_t *lq = &lo_queues[napi->queue];
+    int done = 0;
+    while (done < budget) {
+        uint32_t irq = irq_save();
+        sk_buff_t *skb = skb_dequeue(&lq->backlog);
+        irq_restore(irq);
+        if (!skb) break;
+        net_rx(napi->dev, skb);
+        done++;
+    }
+
+    /* Complete only if still empty, or a packet queued meanwhile would
+     * wait for the next one */
+    uint32_t irq = irq_save();
+    if (lq->backlog.qlen == 0) napi_complete(napi);
+    irq_restore(irq);
+    return done;
+}
+
+int loopback_init(net_device_t *dev) {
+    strncpy(dev->name, "lo", sizeof(dev->name));
+    memset(&dev->mac, 0, sizeof(dev->mac));
+    dev->ip.addr[0] = 127;
+    dev->ip.addr[1] = 0;
+    dev->ip.addr[2] = 0;
+    dev->ip.addr[3] = 1;
+    dev->netmask.addr[0] = 255;
+    for (int i = 1; i < 4; i++) dev->netmask.addr[i] = 0;
+    dev->mtu   = LOOPBACK_MTU;
+    dev->flags = NETDEV_LOOPBACK | NETDEV_NO_CSUM;
+    dev->xmit  = loopback_xmit;
+    dev->priv  = 0;
+
+    net_dev_set_rx_queues(dev, LOOPBACK_QUEUES);
+    for (uint32_t q = 0; q < LOOPBACK_QUEUES; q++) {
+        skb_queue_init(&lo_queues[q].backlog);
+        lo_queues[q].napi.poll  = loopback_poll;
+        lo_queues[q].napi.dev   = dev;
+        lo_queues[q].napi.queue = q;
+        napi_add(&lo_queues[q].napi);
+    }
+
+    dev->is_up = 1;
+    return 0;
+}
@@ -0,0 +1,37 @@
+/*
+ * OpenOS - Loopback Network Device
+ *
+ * `lo` carries every packet this host sends to itself: 127.0.0.0/8 and
+ * the addresses of the other devices are routed to it. Its transmit
+ * function queues the sender's sk_buff as it is and schedules NAPI; the
+ * RX thread then hands the same sk_buff to the stack as received on
+ * `lo`. There is no link header, nothing is copied, and the device is
+ * NETDEV_NO_CSUM, so transport checksums are never computed and arrive
+ * marked CHECKSUM_UNNECESSARY. Local benchmarks therefore measure the
+ * protocol code rather than an emulated NIC.
+ *
+ * It does behave like an RSS NIC in one respect: it has LOOPBACK_QUEUES
+ * RX queues, each with its own backlog and NAPI context, and transmit
+ * picks the queue of a packet by its flow hash (include/rss.h), so
+ * concurrent local connections are received on different queues.
+ */
+
+#ifndef OPENOS_DRIVERS_LOOPBACK_H
+#define OPENOS_DRIVERS_LOOPBACK_H
+
+#include <stdint.h>
+#include "../include/network.h"
+
+/* The MTU Linux long used for lo: a TCP segment of 16396 bytes is nine
+ * sk_buff buffers, well inside SKB_MAX_FRAGS. */
+#define LOOPBACK_MTU        16436
+
+/* RX queues, and packets sent but not yet taken by the RX thread, per
+ * queue */
+#define LOOPBACK_QUEUES     4
+#define LOOPBACK_BACKLOG    512
+
+/* Set up `dev` as lo, 127.0.0.1/8. Returns 0. */
+int loopback_init(net_device_t *dev);
+
+#endif /* OPENOS_DRIVERS_LOOPBACK_H */
@@ -0,0 +1,113 @@
+/*
+ * OpenOS - PCI Bus Enumeration Implementation
+ */
+
+#include "pci.h"
+#include "../arch/x86/ports.h"
+
+static pci_device_t pci_devices[PCI_MAX_DEVICES];
+static int pci_count = 0;
+
+static uint32_t pci_address(uint8_t bus, uint8_t slot, uint8_t func, uint8_t off) {
+    return 0x80000000u | ((uint32_t)bus << 16) | ((uint32_t)(slot & 0x1F) << 11) |
+           ((uint32_t)(func & 0x07) << 8) | (off & 0xFC);
+}
+
+uint32_t pci_config_read32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t off) {
+    outl(PCI_CONFIG_ADDRESS, pci_address(bus, slot, func, off));
+    return inl(PCI_CONFIG_DATA);
+}
+
+uint16_t pci_config_read16(uint8_t bus, uint8_t slot, uint8_t func, uint8_t off) {
+    uint32_t v = pci_config_read32(bus, slot, func, off);
+    return (uint16_t)(v >> ((off & 2) * 8));
+}
+
+void pci_config_write32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t off,
+                        uint32_t value) {
+    outl(PCI_CONFIG_ADDRESS, pci_address(bus, slot, func, off));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+void pci_config_write16(uint8_t bus, uint8_t slot, uint8_t func, uint8_t off,
+                        uint16_t value) {
+    uint32_t v = pci_config_read32(bus, slot, func, off);
+    uint32_t shift = (off & 2) * 8;
+    v = (v & ~(0xFFFFu << shift)) | ((uint32_t)value << shift);
+    pci_config_write32(bus, slot, func, off, v);
+}
+
+static void pci_record(uint8_t bus, uint8_t slot, uint8_t func, uint32_t id) {
+    if (pci_count >= PCI_MAX_DEVICES) return;
+
+    pci_device_t *d = &pci_devices[pci_count++];
+    uint32_t cls = pci_config_read32(bus, slot, func, PCI_CLASS_REVISION);
+
+    d->bus        = bus;
+    d->slot       = slot;
+    d->func       = func;
+    d->vendor     = (uint16_t)id;
+    d->device     = (uint16_t)(id >> 16);
+    d->class_code = (uint8_t)(cls >> 24);
+    d->subclass   = (uint8_t)(cls >> 16);
+    d->prog_if    = (uint8_t)(cls >> 8);
+    d->revision   = (uint8_t)cls;
+    d->irq_line   = (uint8_t)pci_config_read32(bus, slot, func, PCI_INTERRUPT_LINE);
+    for (int i = 0; i < 6; i++) {
+        d->bar[i] = pci_config_read32(bus, slot, func, (uint8_t)(PCI_BAR0 + i * 4));
+    }
+}
+
+void pci_init(void) {
+    pci_count = 0;
+    for (uint32_t bus = 0; bus < 256; bus++) {
+        for (uint8_t slot = 0; slot < 32; slot++) {
+            uint32_t id = pci_config_read32((uint8_t)bus, slot, 0, PCI_VENDOR_ID);
+            if ((id & 0xFFFF) == 0xFFFF) continue;
+
+            pci_record((uint8_t)bus, slot, 0, id);
+
+            /* Bit 7 of the header type: more functions behind this slot */
+            uint8_t hdr = (uint8_t)pci_config_read16((uint8_t)bus, slot, 0,
+                                                     PCI_HEADER_TYPE);
+            if (!(hdr & 0x80)) continue;
+            for (uint8_t func = 1; func < 8; func++) {
+                id = pci_config_read32((uint8_t)bus, slot, func, PCI_VENDOR_ID);
+                if ((id & 0xFFFF) != 0xFFFF) {
+                    pci_record((uint8_t)bus, slot, func, id);
+                }
+            }
+        }
+    }
+}
+
+pci_device_t *pci_find(uint16_t vendor, uint16_t device) {
+    for (int i = 0; i < pci_count; i++) {
+        if (pci_devices[i].vendor == vendor && pci_devices[i].device == device) {
+            return &pci_devices[i];
+        }
+    }
+    return 0;
+}
+
+pci_device_t *pci_get(int index) {
+    return (index >= 0 && index < pci_count) ? &pci_devices[index] : 0;
+}
+
+int pci_device_count(void) {
+    return pci_count;
+}
+
+uint32_t pci_bar_address(const pci_device_t *dev, int n) {
+    if (!dev || n < 0 || n > 5) return 0;
+    if (dev->bar[n] & 1) return 0;          /* I/O space */
+    return dev->bar[n] & ~0xFu;
+}
+
+void pci_enable_device(pci_device_t *dev) {
+    if (!dev) return;
+    uint16_t cmd = pci_config_read16(dev->bus, dev->slot, dev->func, PCI_COMMAND);
+    cmd |= PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER;
+    cmd &= (uint16_t)~PCI_COMMAND_INTX_OFF;
+    pci_config_write16(dev->bus, dev->slot, dev->func, PCI_COMMAND, cmd);
+}
@@ -0,0 +1,73 @@
+/*
+ * OpenOS - PCI Bus Enumeration
+ *
+ * Configuration space is reached through the legacy 0xCF8/0xCFC
+ * mechanism. pci_init() walks every bus, slot and function once and
+ * records what it finds; drivers then look their hardware up by
+ * vendor/device ID.
+ */
+
+#ifndef OPENOS_DRIVERS_PCI_H
+#define OPENOS_DRIVERS_PCI_H
+
+#include <stdint.h>
+
+#define PCI_CONFIG_ADDRESS  0xCF8
+#define PCI_CONFIG_DATA     0xCFC
+
+/* Configuration space offsets */
+#define PCI_VENDOR_ID       0x00
+#define PCI_DEVICE_ID       0x02
+#define PCI_COMMAND         0x04
+#define PCI_CLASS_REVISION  0x08
+#define PCI_HEADER_TYPE     0x0E
+#define PCI_BAR0            0x10
+#define PCI_INTERRUPT_LINE  0x3C
+
+/* Command register bits */
+#define PCI_COMMAND_IO          0x0001
+#define PCI_COMMAND_MEMORY      0x0002
+#define PCI_COMMAND_MASTER      0x0004
+#define PCI_COMMAND_INTX_OFF    0x0400
+
+#define PCI_MAX_DEVICES     32
+
+typedef struct pci_device {
+    uint8_t  bus;
+    uint8_t  slot;
+    uint8_t  func;
+    uint8_t  irq_line;      /* Legacy PIC line assigned by the BIOS    */
+    uint16_t vendor;
+    uint16_t device;
+    uint8_t  class_code;
+    uint8_t  subclass;
+    uint8_t  prog_if;
+    uint8_t  revision;
+    uint32_t bar[6];        /* Raw BAR values                          */
+} pci_device_t;
+
+/* Scan all buses and record the functions present. */
+void pci_init(void);
+
+uint32_t pci_config_read32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t off);
+uint16_t pci_config_read16(uint8_t bus, uint8_t slot, uint8_t func, uint8_t off);
+void pci_config_write32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t off,
+                        uint32_t value);
+void pci_config_write16(uint8_t bus, uint8_t slot, uint8_t func, uint8_t off,
+                        uint16_t value);
+
+/* First device with this vendor/device ID, or NULL. */
+pci_device_t *pci_find(uint16_t vendor, uint16_t device);
+
+/* Device `index` in scan order (0..pci_device_count()-1), or NULL. */
+pci_device_t *pci_get(int index);
+int pci_device_count(void);
+
+/* Base address of memory BAR `n`, or 0 if it is an I/O BAR or unset. */
+uint32_t pci_bar_address(const pci_device_t *dev, int n);
+
+/* Enable memory decoding and bus mastering (DMA), and make sure legacy
+ * INTx interrupts are not disabled. */
+void pci_enable_device(pci_device_t *dev);
+
+#endif /* OPENOS_DRIVERS_PCI_H */
@@ -4,28 +4,63 @@
 
 #include "serial.h"
 #include "../arch/x86/ports.h"
+#include "../arch/x86/irq.h"
+#include "../arch/x86/cpu.h"
 
 /* 16550 UART register offsets from the base port. */
 #define UART_DATA          0  /* DLAB=0: RX/TX buffer                       */
 #define UART_INT_ENABLE    1  /* DLAB=0: interrupt enable                   */
 #define UART_DIVISOR_LO    0  /* DLAB=1: divisor latch low byte             */
 #define UART_DIVISOR_HI    1  /* DLAB=1: divisor latch high byte            */
-#define UART_FIFO_CTRL     2  /* FIFO control                              */
+#define UART_INT_ID        2  /* read: interrupt identification             */
+#define UART_FIFO_CTRL     2  /* write: FIFO control                        */
 #define UART_LINE_CTRL     3  /* line control (DLAB, word length, parity)  */
 #define UART_MODEM_CTRL    4  /* modem control                             */
 #define UART_LINE_STATUS   5  /* line status                               */
+#define UART_MODEM_STATUS  6  /* modem status                              */
+
+/* Interrupt enable bits. */
+#define IER_RX_DATA        0x01  /* received data available              */
+#define IER_THRE           0x02  /* transmit holding register empty      */
+
+/* Interrupt identification: bit 0 clear if one is pending, bits 1-2
+ * which, bits 6-7 set if the FIFOs are enabled (16550A). */
+#define IIR_NONE           0x01
+#define IIR_ID_MASK        0x06
+#define IIR_MODEM          0x00
+#define IIR_THRE           0x02
+#define IIR_RX_DATA        0x04
+#define IIR_LINE           0x06
+#define IIR_FIFO_ON        0xC0
 
 /* Line status register bits. */
+#define LSR_RX_READY       0x01  /* a received byte is waiting      */
 #define LSR_TX_EMPTY       0x20  /* transmit holding register empty */
 
+#define SERIAL_COM1_IRQ    4
+
 static bool serial_available = false;
 
+/*
+ * TX ring. Writers add at tx_head, the THRE interrupt (or, before it is
+ * enabled, the writers themselves) removes from tx_tail; both under
+ * irq_save(). tx_busy is set while a THRE interrupt is due, so writers
+ * only touch the UART to start an idle transmitter.
+ */
+static uint8_t  tx_ring[SERIAL_TX_RING_SIZE];
+static uint32_t tx_head, tx_tail;
+static uint32_t tx_fifo = 1;            /* Bytes per THRE: 16 with a FIFO */
+static int      tx_busy;
+static int      tx_irq_on;              /* serial_start_irq() succeeded   */
+static int      tx_sync;                /* Panic: write through           */
+static serial_stats_t stats;
+
 void serial_init(void) {
     const uint16_t base = SERIAL_COM1_BASE;
 
     outb(base + UART_INT_ENABLE, 0x00);  /* Disable all interrupts          */
     outb(base + UART_LINE_CTRL,  0x80);  /* Enable DLAB (set baud divisor)  */
-    outb(base + UART_DIVISOR_LO, 0x03);  /* Divisor = 3 -> 38400 baud (lo)  */
+    outb(base + UART_DIVISOR_LO, 115200 / SERIAL_BAUD);  /* Divisor 3 (lo) */
     outb(base + UART_DIVISOR_HI, 0x00);  /*                            (hi) */
     outb(base + UART_LINE_CTRL,  0x03);  /* 8 bits, no parity, 1 stop; DLAB off */
     outb(base + UART_FIFO_CTRL,  0xC7);  /* Enable FIFO, clear, 14-byte threshold */
@@ -42,6 +77,11 @@ void serial_init(void) {
 
     /* Restore normal operation. */
     outb(base + UART_MODEM_CTRL, 0x0F);
+
+    /* Only a 16550A has a working 16-byte FIFO; an 8250/16450 (or a
+     * 16550 with the broken FIFO) takes one byte per THRE. */
+    tx_fifo = ((inb(base + UART_INT_ID) & IIR_FIFO_ON) == IIR_FIFO_ON)
+              ? SERIAL_FIFO_SIZE : 1;
     serial_available = true;
 }
 
@@ -53,24 +93,163 @@ static inline int tx_ready(void) {
     return inb(SERIAL_COM1_BASE + UART_LINE_STATUS) & LSR_TX_EMPTY;
 }
 
+/* Move up to one FIFO's worth from the ring to the UART, which must
+ * have reported THRE. Returns 1 if anything was written. Caller holds
+ * irq_save(). */
+static int tx_fill(void) {
+    uint32_t n = tx_head - tx_tail;
+    if (n == 0) return 0;
+    if (n > tx_fifo) n = tx_fifo;
+    for (uint32_t i = 0; i < n; i++) {
+        outb(SERIAL_COM1_BASE + UART_DATA,
+             tx_ring[tx_tail++ & (SERIAL_TX_RING_SIZE - 1)]);
+    }
+    stats.tx_bytes += n;
+    stats.tx_bursts++;
+    return 1;
+}
+
+/* Start the transmitter if it is idle. Without the interrupt nothing
+ * will come back for the rest, so tx_busy stays clear and the next
+ * write tries again. */
+static void tx_kick(void) {
+    if (tx_busy || !tx_ready()) return;
+    if (tx_fill() && tx_irq_on) tx_busy = 1;
+}
+
+/* Polled write, for panics and before the UART has a ring to use. */
+static void tx_put_sync(uint8_t c) {
+    while (!tx_ready()) {
+        /* spin until the holding register is free */
+    }
+    outb(SERIAL_COM1_BASE + UART_DATA, c);
+    stats.tx_bytes++;
+}
+
+/* Add `c` to the ring. Caller holds irq_save(). */
+static void tx_put(uint8_t c) {
+    if (tx_head - tx_tail == SERIAL_TX_RING_SIZE) {
+        if (tx_irq_on) {
+            /* Never wait on the interrupt path; a THRE that got lost
+             * would otherwise stall output for good, so check. */
+            if (tx_ready()) {
+                tx_busy = 0;
+                tx_kick();
+            }
+            if (tx_head - tx_tail == SERIAL_TX_RING_SIZE) {
+                stats.tx_dropped++;
+                return;
+            }
+        } else {
+            /* Early boot: no interrupt will drain the ring, so make
+             * room by polling. */
+            while (!tx_ready()) {
+            }
+            tx_fill();
+        }
+    }
+    tx_ring[tx_head++ & (SERIAL_TX_RING_SIZE - 1)] = c;
+    stats.tx_queued++;
+}
+
 void serial_write_char(char c) {
     if (!serial_available) {
         return;
     }
-    while (!tx_ready()) {
-        /* spin until the holding register is free */
+    uint32_t flags = irq_save();
+    if (tx_sync) {
+        tx_put_sync((uint8_t)c);
+    } else {
+        tx_put((uint8_t)c);
+        tx_kick();
     }
-    outb(SERIAL_COM1_BASE + UART_DATA, (uint8_t)c);
+    irq_restore(flags);
 }
 
 void serial_write(const char* s) {
     if (!serial_available || s == 0) {
         return;
     }
+    uint32_t flags = irq_save();
     for (uint32_t i = 0; s[i] != '\0'; i++) {
+        if (tx_sync) {
+            if (s[i] == '\n') tx_put_sync('\r');
+            tx_put_sync((uint8_t)s[i]);
+            continue;
+        }
         if (s[i] == '\n') {
-            serial_write_char('\r');
+            tx_put('\r');
+        }
+        tx_put((uint8_t)s[i]);
+    }
+    if (!tx_sync) tx_kick();
+    irq_restore(flags);
+}
+
+static void serial_irq(void *ctx) {
+    (void)ctx;
+    const uint16_t base = SERIAL_COM1_BASE;
+
+    stats.interrupts++;
+    for (;;) {
+        uint8_t iir = inb(base + UART_INT_ID);
+        if (iir & IIR_NONE) break;
+        switch (iir & IIR_ID_MASK) {
+        case IIR_THRE:
+            /* Reading IIR cleared it; the next comes when this burst
+             * has left the FIFO */
+            if (!tx_fill()) tx_busy = 0;
+            break;
+        case IIR_RX_DATA:
+            /* No input path yet: keep the receiver from jamming */
+            while (inb(base + UART_LINE_STATUS) & LSR_RX_READY) {
+                (void)inb(base + UART_DATA);
+            }
+            break;
+        case IIR_LINE:
+            (void)inb(base + UART_LINE_STATUS);
+            break;
+        default:
+            (void)inb(base + UART_MODEM_STATUS);
+            break;
         }
-        serial_write_char(s[i]);
     }
 }
+
+int serial_start_irq(void) {
+    if (!serial_available) return -1;
+    if (tx_irq_on) return 0;
+    if (irq_register(SERIAL_COM1_IRQ, serial_irq, 0) < 0) return -1;
+
+    uint32_t flags = irq_save();
+    tx_irq_on = 1;
+    /* Enabling THRE while the holding register is empty raises the
+     * interrupt at once, which drains whatever boot left queued */
+    tx_busy = 1;
+    outb(SERIAL_COM1_BASE + UART_INT_ENABLE, IER_THRE);
+    irq_restore(flags);
+    return 0;
+}
+
+void serial_panic(void) {
+    if (!serial_available) return;
+
+    uint32_t flags = irq_save();
+    tx_sync = 1;
+    outb(SERIAL_COM1_BASE + UART_INT_ENABLE, 0x00);
+    /* Whatever led up to the panic goes out first, in order */
+    while (tx_head != tx_tail) {
+        tx_put_sync(tx_ring[tx_tail++ & (SERIAL_TX_RING_SIZE - 1)]);
+    }
+    tx_busy = 0;
+    irq_restore(flags);
+}
+
+void serial_get_stats(serial_stats_t *out) {
+    uint32_t flags = irq_save();
+    *out = stats;
+    out->tx_pending = tx_head - tx_tail;
+    out->fifo_size  = tx_fifo;
+    out->irq_driven = tx_irq_on && !tx_sync;
+    irq_restore(flags);
+}
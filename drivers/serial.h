@@ -9,6 +9,14 @@
  *     make qemu-log   (serial + machine events written to qemu.log)
  *     qemu-system-i386 -cdrom openos.iso -serial stdio
  *
+ * Output is buffered: writers copy into a TX ring and return, and the
+ * UART's THRE interrupt refills its 16-byte FIFO a burst at a time, so
+ * printing no longer waits ~260 us per byte at 38400 baud. Until
+ * serial_start_irq() (once interrupts are on) writers drain the ring
+ * themselves, waiting only when it is full. After that a full ring
+ * drops bytes, counted in tx_dropped, rather than block. A panic
+ * switches to synchronous writes so its message gets out.
+ *
  * Output only for now; interrupt-driven input can be layered on later.
  */
 
@@ -21,6 +29,21 @@
 /* COM1 base I/O port. */
 #define SERIAL_COM1_BASE 0x3F8
 
+#define SERIAL_TX_RING_SIZE  8192   /* power of two */
+#define SERIAL_FIFO_SIZE     16     /* 16550A transmit FIFO */
+#define SERIAL_BAUD          38400  /* 8N1: 10 bits on the line per byte */
+
+typedef struct serial_stats {
+    uint32_t tx_queued;             /* Bytes accepted into the ring      */
+    uint32_t tx_bytes;              /* Bytes written to the UART         */
+    uint32_t tx_bursts;             /* FIFO refills                      */
+    uint32_t tx_dropped;            /* Ring full                         */
+    uint32_t interrupts;
+    uint32_t tx_pending;            /* In the ring now                   */
+    uint32_t fifo_size;             /* Bytes per refill                  */
+    int      irq_driven;
+} serial_stats_t;
+
 /*
  * Initialize COM1 at 38400 baud, 8 data bits, no parity, 1 stop bit.
  * Performs the UART loopback self-test; if the port does not echo back
@@ -32,10 +55,20 @@ void serial_init(void);
 /* True if serial_init() found a working UART. */
 bool serial_is_available(void);
 
-/* Write a single byte to COM1 (blocks until the TX holding register is free). */
+/* Queue a single byte for COM1. */
 void serial_write_char(char c);
 
-/* Write a NUL-terminated string to COM1. '\n' is expanded to CR/LF. */
+/* Queue a NUL-terminated string for COM1. '\n' is expanded to CR/LF. */
 void serial_write(const char* s);
 
+/* Hand the ring to the THRE interrupt (IRQ 4). Call with interrupts
+ * enabled; returns 0, or -1 if there is no UART or the line is taken. */
+int serial_start_irq(void);
+
+/* Flush the ring by polling and write through from now on. For panic
+ * paths, which run with interrupts off and may never return. */
+void serial_panic(void);
+
+void serial_get_stats(serial_stats_t *stats);
+
 #endif /* OPENOS_DRIVERS_SERIAL_H */
@@ -6,6 +6,7 @@
 #include "../arch/x86/pic.h"
 #include "../arch/x86/ports.h"
 #include "../process/scheduler.h"
+#include "../arch/x86/cpu.h"
 
 /* System tick counter */
 static volatile uint64_t system_ticks = 0;
@@ -13,6 +14,9 @@ static volatile uint64_t system_ticks = 0;
 /* Timer frequency in Hz */
 static uint32_t timer_frequency = 0;
 
+/* Calibrated TSC frequency in kHz (0 = not yet measured) */
+static uint32_t tsc_khz = 0;
+
 /*
  * Initialize the timer with the specified frequency
  * Note: This function configures the PIT hardware but does NOT
@@ -89,3 +93,33 @@ void timer_wait(uint32_t ticks) {
         __asm__ __volatile__("hlt");
     }
 }
+
+/*
+ * Calibrate the TSC against the PIT
+ * Counts cycles across a few whole ticks (starting on a tick edge) and
+ * scales to kHz. The result is cached.
+ */
+uint32_t timer_get_tsc_khz(void) {
+    if (tsc_khz != 0 || timer_frequency == 0) {
+        return tsc_khz;
+    }
+
+    const uint32_t ticks = 10;
+
+    /* Align to a tick boundary so we measure whole periods. */
+    uint64_t edge = system_ticks;
+    while (system_ticks == edge) {
+        __asm__ __volatile__("hlt");
+    }
+
+    uint64_t start_ticks = system_ticks;
+    uint64_t start_tsc = rdtsc();
+    while (system_ticks < start_ticks + ticks) {
+        __asm__ __volatile__("hlt");
+    }
+    uint64_t cycles = rdtsc() - start_tsc;
+
+    /* cycles / (ticks / freq) seconds -> kHz */
+    tsc_khz = (uint32_t)udiv64(cycles * timer_frequency, ticks * 1000u, 0);
+    return tsc_khz;
+}
@@ -29,6 +29,10 @@ uint64_t timer_get_uptime_ms(void);
 /* Wait for a specified number of ticks */
 void timer_wait(uint32_t ticks);
 
+/* TSC frequency in kHz, calibrated against the PIT on first use.
+ * Needs interrupts enabled; used to turn rdtsc deltas into time. */
+uint32_t timer_get_tsc_khz(void);
+
 /* Timer interrupt handler (called from IRQ0) */
 void timer_handler(void);
 
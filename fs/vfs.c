@@ -7,6 +7,7 @@
 #include "vfs.h"
 #include "../kernel/string.h"
 #include "../drivers/console.h"
+#include "../kernel/printk.h"
 
 /* Static memory pool for VFS nodes */
 static vfs_node_t node_pool[VFS_MAX_NODES];
@@ -19,6 +20,10 @@ static vfs_node_t* vfs_root = 0;
 /* Static dirent for readdir operations */
 static vfs_dirent_t static_dirent;
 
+/* Called before a write modifies pinned content, one per kind of holder */
+static vfs_pin_break_fn pin_break_handlers[VFS_MAX_PIN_BREAK];
+static uint32_t pin_break_count = 0;
+
 /* Forward declarations of operation functions */
 static ssize_t ramfs_read(vfs_node_t* node, uint32_t offset, uint32_t size, uint8_t* buffer);
 static ssize_t ramfs_write(vfs_node_t* node, uint32_t offset, uint32_t size, const uint8_t* buffer);
@@ -45,6 +50,7 @@ static vfs_node_t* allocate_node(void) {
             node->flags = 0;
             node->parent = 0;
             node->child_count = 0;
+            node->pins = 0;
             for (int j = 0; j < VFS_MAX_CHILDREN; j++) {
                 node->children[j] = 0;
             }
@@ -94,9 +100,7 @@ static ssize_t ramfs_read(vfs_node_t* node, uint32_t offset, uint32_t size, uint
         bytes_to_read = node->length - offset;
     }
     
-    for (uint32_t i = 0; i < bytes_to_read; i++) {
-        buffer[i] = node->content[offset + i];
-    }
+    memcpy(buffer, node->content + offset, bytes_to_read);
     
     return bytes_to_read;
 }
@@ -113,10 +117,13 @@ static ssize_t ramfs_write(vfs_node_t* node, uint32_t offset, uint32_t size, con
         size = VFS_MAX_FILE_SIZE - offset;
     }
     
-    for (uint32_t i = 0; i < size; i++) {
-        node->content[offset + i] = buffer[i];
+    /* Zero-copy holders must stop sharing the old content first */
+    for (uint32_t i = 0; i < pin_break_count && node->pins > 0; i++) {
+        pin_break_handlers[i](node);
     }
     
+    memcpy(node->content + offset, buffer, size);
+    
     if (offset + size > node->length) {
         node->length = offset + size;
     }
@@ -175,7 +182,7 @@ void vfs_init(void) {
     /* Create root directory */
     vfs_root = allocate_node();
     if (!vfs_root) {
-        console_write("ERROR: Failed to allocate root directory\n");
+        printk(LOG_CRIT, "VFS: failed to allocate the root directory\n");
         return;
     }
     
@@ -278,13 +285,17 @@ int vfs_remove_child(vfs_node_t* parent, const char* name) {
     
     for (uint32_t i = 0; i < parent->child_count; i++) {
         if (parent->children[i] && string_compare(parent->children[i]->name, name) == 0) {
+            /* Content still referenced in place (spliced) */
+            if (parent->children[i]->pins > 0) {
+                return -1;
+            }
+            
             /* Free the node */
             free_node(parent->children[i]);
             
             /* Shift remaining children */
-            for (uint32_t j = i; j < parent->child_count - 1; j++) {
-                parent->children[j] = parent->children[j + 1];
-            }
+            memmove(&parent->children[i], &parent->children[i + 1],
+                    (parent->child_count - 1 - i) * sizeof(parent->children[0]));
             parent->children[parent->child_count - 1] = 0;
             parent->child_count--;
             
@@ -316,7 +327,12 @@ vfs_node_t* vfs_resolve_path(const char* path) {
     
     /* Parse path components */
     char path_copy[VFS_MAX_PATH_LENGTH];
-    string_copy(path_copy, path + 1);  /* Skip leading slash */
+    strbuf_t sb;
+    strbuf_init(&sb, path_copy, sizeof(path_copy));
+    strbuf_append(&sb, path + 1);  /* Skip leading slash */
+    if (sb.overflow) {
+        return 0;
+    }
     
     char* token = string_tokenize(path_copy, "/");
     while (token) {
@@ -343,6 +359,25 @@ vfs_node_t* vfs_resolve_path(const char* path) {
     return current;
 }
 
+void vfs_path_append(strbuf_t* sb, const vfs_node_t* node) {
+    if (!node || !node->parent || node->parent == node) {
+        return;
+    }
+    vfs_path_append(sb, node->parent);
+    strbuf_putc(sb, '/');
+    strbuf_append(sb, node->name);
+}
+
+int vfs_get_path(const vfs_node_t* node, char* buf, size_t size) {
+    strbuf_t sb;
+    strbuf_init(&sb, buf, size);
+    vfs_path_append(&sb, node);
+    if (sb.len == 0) {
+        strbuf_putc(&sb, '/');
+    }
+    return sb.overflow ? -1 : (int)sb.len;
+}
+
 /*
  * Read from a file
  */
@@ -396,3 +431,26 @@ void vfs_list_directory(vfs_node_t* dir) {
         }
     }
 }
+
+/*
+ * Pin / unpin a node's content for zero-copy references
+ */
+void vfs_pin(vfs_node_t* node) {
+    if (node) {
+        node->pins++;
+    }
+}
+
+void vfs_unpin(vfs_node_t* node) {
+    if (node && node->pins > 0) {
+        node->pins--;
+    }
+}
+
+int vfs_add_pin_break_handler(vfs_pin_break_fn fn) {
+    if (!fn || pin_break_count >= VFS_MAX_PIN_BREAK) {
+        return -1;
+    }
+    pin_break_handlers[pin_break_count++] = fn;
+    return 0;
+}
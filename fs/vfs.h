@@ -31,6 +31,7 @@ typedef enum {
 /* Forward declarations */
 struct vfs_node;
 struct vfs_dirent;
+struct strbuf;
 
 /* Directory entry structure */
 typedef struct vfs_dirent {
@@ -48,6 +49,7 @@ typedef struct vfs_node {
     struct vfs_node* parent;
     struct vfs_node* children[VFS_MAX_CHILDREN];
     uint32_t child_count;
+    uint32_t pins;              /* Outstanding zero-copy references */
     uint8_t content[VFS_MAX_FILE_SIZE];
     
     /* Function pointers for operations */
@@ -69,6 +71,14 @@ int vfs_add_child(vfs_node_t* parent, vfs_node_t* child);
 int vfs_remove_child(vfs_node_t* parent, const char* name);
 vfs_node_t* vfs_resolve_path(const char* path);
 
+/* Append the absolute path of `node` to `sb`: "/a/b", and nothing for
+ * the root, so that "/" + name can follow. */
+void vfs_path_append(struct strbuf* sb, const vfs_node_t* node);
+
+/* The absolute path of `node` ("/" for the root) in `buf`. Returns its
+ * length, or -1 if it did not fit (`buf` then holds a truncated one). */
+int vfs_get_path(const vfs_node_t* node, char* buf, size_t size);
+
 /* File operations */
 ssize_t vfs_read(vfs_node_t* node, uint32_t offset, uint32_t size, uint8_t* buffer);
 ssize_t vfs_write(vfs_node_t* node, uint32_t offset, uint32_t size, const uint8_t* buffer);
@@ -77,4 +87,21 @@ vfs_dirent_t* vfs_readdir(vfs_node_t* node, uint32_t index);
 /* Utility functions */
 void vfs_list_directory(vfs_node_t* dir);
 
+/*
+ * Zero-copy pins
+ *
+ * A pinned file's content is referenced in place (e.g. spliced into a
+ * pipe). While pinned the node cannot be removed, and before a write
+ * modifies it the pin-break handlers are called so every holder can
+ * take a private copy and unpin - a software copy-on-write. Each kind
+ * of holder (pipes, sockets) registers one handler.
+ */
+#define VFS_MAX_PIN_BREAK   4
+
+typedef void (*vfs_pin_break_fn)(vfs_node_t* node);
+
+void vfs_pin(vfs_node_t* node);
+void vfs_unpin(vfs_node_t* node);
+int vfs_add_pin_break_handler(vfs_pin_break_fn fn);
+
 #endif /* OPENOS_FS_VFS_H */
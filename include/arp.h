@@ -0,0 +1,101 @@
+/*
+ * OpenOS - Address Resolution Protocol (ARP)
+ *
+ * Maps next-hop IPv4 addresses to Ethernet addresses through a hashed
+ * neighbour cache. An entry starts INCOMPLETE when a packet needs an
+ * address nobody has answered for yet: the packet waits on the entry's
+ * pending queue (up to ARP_MAX_PENDING of them) while requests are
+ * broadcast once a second, and the whole queue goes out as soon as the
+ * reply arrives. Resolved entries are REACHABLE for ARP_REACHABLE_TICKS
+ * after the last confirmation and STALE after that: still used, but
+ * the next use sends a fresh request. Entries nobody used for
+ * ARP_GC_TICKS are dropped.
+ */
+
+#ifndef OPENOS_ARP_H
+#define OPENOS_ARP_H
+
+#include <stdint.h>
+#include "network.h"
+
+#define ARP_HASH_SIZE        32         /* power of two */
+#define ARP_MAX_ENTRIES      64
+#define ARP_MAX_PENDING      4          /* Packets queued per unresolved entry */
+#define ARP_MAX_PROBES       3
+#define ARP_RETRY_TICKS      100        /* 1 s between requests          */
+#define ARP_REACHABLE_TICKS  3000       /* 30 s                          */
+#define ARP_GC_TICKS         6000       /* 60 s unused                   */
+
+#define ARP_OP_REQUEST  1
+#define ARP_OP_REPLY    2
+
+typedef struct arp_header {
+    uint16_t   htype;           /* 1: Ethernet                          */
+    uint16_t   ptype;           /* ETH_P_IP                             */
+    uint8_t    hlen;
+    uint8_t    plen;
+    uint16_t   op;
+    mac_addr_t sha;
+    in_addr_t  spa;
+    mac_addr_t tha;
+    in_addr_t  tpa;
+} __attribute__((packed)) arp_header_t;
+
+typedef enum {
+    NUD_INCOMPLETE = 1,
+    NUD_REACHABLE,
+    NUD_STALE,
+} nud_state_t;
+
+/* Neighbour cache entry */
+typedef struct neighbour {
+    struct neighbour *next;         /* Hash chain                         */
+    net_device_t     *dev;
+    in_addr_t         ip;
+    mac_addr_t        mac;
+    uint8_t           state;        /* nud_state_t                        */
+    uint8_t           probes;       /* Requests sent while INCOMPLETE     */
+    uint64_t          confirmed;    /* Tick of the last reply / request   */
+    uint64_t          used;         /* Tick of the last packet sent       */
+    uint64_t          probed;       /* Tick of the last request we sent   */
+    sk_buff_head_t    pending;      /* IP packets waiting for the address */
+} neighbour_t;
+
+/* Snapshot of one entry, for the `arp` command */
+typedef struct arp_entry_info {
+    in_addr_t  ip;
+    mac_addr_t mac;
+    uint8_t    state;
+    uint32_t   age_ticks;           /* Since the last confirmation        */
+    uint32_t   pending;
+} arp_entry_info_t;
+
+typedef struct arp_stats {
+    uint32_t entries;
+    uint32_t requests_sent;
+    uint32_t replies_sent;
+    uint32_t lookups;               /* Packets sent through the cache     */
+    uint32_t misses;                /* ... that found no usable entry     */
+    uint32_t pending_drops;         /* Queued packets dropped (queue full,
+                                     * resolution failed)                 */
+} arp_stats_t;
+
+void arp_init(void);
+
+/* A received ARP packet (data at the ARP header). Consumes `skb`. */
+void arp_input(net_device_t *dev, sk_buff_t *skb);
+
+/* Send the IP packet in `skb` to `next_hop` on `dev`, resolving its
+ * address first if needed. Consumes `skb`. Returns 0 if the packet was
+ * sent or queued, -1 if it was dropped. */
+int arp_output(net_device_t *dev, sk_buff_t *skb, in_addr_t next_hop);
+
+/* Aging and retransmission; called every NET_TIMER_TICKS. */
+void arp_timer(void);
+
+/* Copy up to `max` entries into `out`; returns how many. */
+int arp_snapshot(arp_entry_info_t *out, int max);
+
+void arp_get_stats(arp_stats_t *stats);
+
+#endif /* OPENOS_ARP_H */
@@ -0,0 +1,143 @@
+/*
+ * OpenOS - Packet Filters (classic BPF)
+ *
+ * A filter is a program for the classic BPF machine: an accumulator A,
+ * an index register X, 16 words of scratch memory, big-endian loads
+ * from the packet, and forward-only jumps, so every program terminates
+ * in at most as many steps as it has instructions. It returns how
+ * many bytes of the packet to keep; 0 drops it. A load past the end of
+ * the packet ends the program with 0. Instructions have the Linux
+ * encoding, so programs written for it (or produced by tcpdump -dd)
+ * run unchanged.
+ *
+ * bpf_prog_create() runs the verifier, which only accepts programs
+ * whose opcodes, jumps, scratch slots and constant divisors are valid
+ * and that end in a return; the machine then needs no checks other
+ * than packet bounds and division by X. The interpreter dispatches
+ * each instruction with a computed goto straight from the handler of
+ * the previous one, instead of returning to a switch. If bpf_jit_enable
+ * is set, the program is also compiled to i386 code, with A in EAX, X in
+ * EBX and the scratch memory on the stack; loads from the linear part
+ * of the packet are inline and only the rest go through a call.
+ *
+ * Filters are attached to a device, seeing every frame the driver
+ * delivers before any protocol does (from the Ethernet header, or the
+ * IP header on lo), or to a UDP socket, seeing the payload of each
+ * datagram for it. They run with interrupts disabled, which is what
+ * makes replacing one safe.
+ */
+
+#ifndef OPENOS_BPF_H
+#define OPENOS_BPF_H
+
+#include <stdint.h>
+#include "skbuff.h"
+
+/* Instruction classes */
+#define BPF_CLASS(code) ((code) & 0x07)
+#define BPF_LD          0x00
+#define BPF_LDX         0x01
+#define BPF_ST          0x02
+#define BPF_STX         0x03
+#define BPF_ALU         0x04
+#define BPF_JMP         0x05
+#define BPF_RET         0x06
+#define BPF_MISC        0x07
+
+/* Load size and mode */
+#define BPF_SIZE(code)  ((code) & 0x18)
+#define BPF_W           0x00
+#define BPF_H           0x08
+#define BPF_B           0x10
+#define BPF_MODE(code)  ((code) & 0xe0)
+#define BPF_IMM         0x00
+#define BPF_ABS         0x20
+#define BPF_IND         0x40
+#define BPF_MEM         0x60
+#define BPF_LEN         0x80
+#define BPF_MSH         0xa0
+
+/* ALU and jump operations, and their operand */
+#define BPF_OP(code)    ((code) & 0xf0)
+#define BPF_ADD         0x00
+#define BPF_SUB         0x10
+#define BPF_MUL         0x20
+#define BPF_DIV         0x30
+#define BPF_OR          0x40
+#define BPF_AND         0x50
+#define BPF_LSH         0x60
+#define BPF_RSH         0x70
+#define BPF_NEG         0x80
+#define BPF_MOD         0x90
+#define BPF_XOR         0xa0
+
+#define BPF_JA          0x00
+#define BPF_JEQ         0x10
+#define BPF_JGT         0x20
+#define BPF_JGE         0x30
+#define BPF_JSET        0x40
+
+#define BPF_SRC(code)   ((code) & 0x08)
+#define BPF_K           0x00
+#define BPF_X           0x08
+
+/* Return value source */
+#define BPF_RVAL(code)  ((code) & 0x18)
+#define BPF_A           0x10
+
+/* BPF_MISC operations */
+#define BPF_MISCOP(code) ((code) & 0xf8)
+#define BPF_TAX         0x00
+#define BPF_TXA         0x80
+
+#define BPF_MEMWORDS    16
+#define BPF_MAXINSNS    512
+
+/* Builders for filter tables */
+#define BPF_STMT(code, k)           { (uint16_t)(code), 0, 0, (uint32_t)(k) }
+#define BPF_JUMP(code, k, jt, jf)   { (uint16_t)(code), (jt), (jf), (uint32_t)(k) }
+
+typedef struct bpf_insn {
+    uint16_t code;
+    uint8_t  jt;            /* Conditional jumps: skipped instructions */
+    uint8_t  jf;
+    uint32_t k;
+} bpf_insn_t;
+
+/* A program as passed to SO_ATTACH_FILTER / net_dev_attach_filter() */
+typedef struct bpf_fprog {
+    uint16_t len;
+    const bpf_insn_t* insns;
+} bpf_fprog_t;
+
+typedef uint32_t (*bpf_jit_fn)(const sk_buff_t* skb, const uint8_t* data,
+                               uint32_t headlen);
+
+typedef struct bpf_prog {
+    uint32_t len;
+    bpf_jit_fn jited;       /* Compiled code, or NULL                */
+    uint32_t jited_len;     /* Its size in bytes                     */
+    bpf_insn_t insns[];
+} bpf_prog_t;
+
+/* Compile new programs (1, the default) or only interpret them */
+extern int bpf_jit_enable;
+
+/* 0 if `insns` is a valid program of `len` instructions, else -1 */
+int bpf_check(const bpf_insn_t* insns, uint32_t len);
+
+/* Verify and copy a program, compiling it if bpf_jit_enable is set.
+ * Returns NULL if it is invalid or memory runs out. */
+bpf_prog_t* bpf_prog_create(const bpf_insn_t* insns, uint32_t len);
+void bpf_prog_destroy(bpf_prog_t* prog);
+
+/* Run `prog` on `skb` (data at the first byte it may load) with the
+ * interpreter, or however it is best run. */
+uint32_t bpf_prog_run_interp(const bpf_prog_t* prog, const sk_buff_t* skb);
+
+static inline uint32_t bpf_prog_run(const bpf_prog_t* prog, const sk_buff_t* skb) {
+    if (prog->jited) return prog->jited(skb, skb->data, skb_headlen(skb));
+    return bpf_prog_run_interp(prog, skb);
+}
+
+#endif /* OPENOS_BPF_H */
@@ -0,0 +1,65 @@
+/*
+ * OpenOS - Internet Checksum (RFC 1071)
+ *
+ * Sums are kept as unfolded 32-bit one's complement partial sums of
+ * the bytes as they sit in memory (16-bit words in wire order read
+ * little-endian, which the one's complement sum does not care about),
+ * and folded to the final 16-bit checksum only at the end.
+ *
+ * net_csum_partial() sums 32 bytes per iteration as one chain of 32-bit
+ * add-with-carry instructions, with words before and after the chain
+ * going into a 64-bit accumulator that is folded once at the end. SSE2
+ * is not used: the kernel does not save FPU/SSE state across context
+ * switches, so vector registers are off limits here.
+ *
+ * net_csum_copy() copies while it sums, so data written into a packet
+ * is read only once; net_csum_replace*() update a checksum in place
+ * for a rewritten header field (RFC 1624), e.g. a decremented TTL, a
+ * translated address or an ICMP type.
+ */
+
+#ifndef OPENOS_CHECKSUM_H
+#define OPENOS_CHECKSUM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* One's complement sum of `length` bytes added to `sum`, unfolded, and
+ * folded to the final 16-bit checksum. net_checksum() is
+ * net_csum_fold(net_csum_partial(data, length, 0)). */
+uint32_t net_csum_partial(const void* data, size_t length, uint32_t sum);
+uint16_t net_csum_fold(uint32_t sum);
+uint16_t net_checksum(const void* data, size_t length);
+
+/* Copy `length` bytes from `src` to `dst` and return their sum added
+ * to `sum`, as net_csum_partial(src, length, sum) would. */
+uint32_t net_csum_copy(void* dst, const void* src, size_t length, uint32_t sum);
+
+/* Add `block`, the sum of bytes that start `offset` bytes into the
+ * message, to `sum`. At an odd offset the block's bytes sit in the
+ * other halves of the message's 16-bit words. */
+static inline uint32_t net_csum_block_add(uint32_t sum, uint32_t block,
+                                          uint32_t offset) {
+    if (offset & 1) {
+        block = ((block & 0x00FF00FFu) << 8) | ((block >> 8) & 0x00FF00FFu);
+    }
+    uint32_t r = sum + block;
+    return r + (r < block);     /* end-around carry */
+}
+
+/* RFC 1624 eqn. 3: HC' = ~(~HC + ~m + m') for a 16-bit field changed
+ * from `from` to `to` (both as stored in the packet). */
+static inline void net_csum_replace16(uint16_t* check, uint16_t from, uint16_t to) {
+    uint32_t sum = (uint32_t)(uint16_t)~*check + (uint16_t)~from + to;
+    *check = net_csum_fold(sum);
+}
+
+/* The same for a 32-bit field, such as an IPv4 address */
+static inline void net_csum_replace32(uint16_t* check, uint32_t from, uint32_t to) {
+    uint32_t sum = (uint32_t)(uint16_t)~*check +
+                   (uint16_t)~(from & 0xFFFF) + (uint16_t)~(from >> 16) +
+                   (to & 0xFFFF) + (to >> 16);
+    *check = net_csum_fold(sum);
+}
+
+#endif /* OPENOS_CHECKSUM_H */
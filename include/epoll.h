@@ -0,0 +1,129 @@
+/*
+ * OpenOS - Event Polling (epoll)
+ *
+ * An epoll instance keeps an interest set of open files in the kernel
+ * and reports which of them are ready, so one process can serve many
+ * pipes, queues, sockets and the keyboard from a single blocking wait.
+ *
+ * Adding a file calls its poll operation once with a poll table: the
+ * object answers with its current readiness and hooks the item onto
+ * the wait queues that signal changes (poll_wait()). From then on each
+ * wake of such a queue runs a callback that puts the item on the
+ * instance's ready list, so epoll_wait() only looks at items that may
+ * be ready and costs O(ready), not O(interest set).
+ *
+ * Level-triggered items (the default) stay on the ready list after
+ * being reported and are re-checked on the next wait until their
+ * condition clears. Edge-triggered items (EPOLLET) are reported once
+ * per wake-up of their object. EPOLLONESHOT items are disabled after
+ * one report until re-armed with EPOLL_CTL_MOD.
+ */
+
+#ifndef OPENOS_EPOLL_H
+#define OPENOS_EPOLL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../process/waitqueue.h"
+
+/* Event bits */
+#define EPOLLIN      0x001      /* Data (or a line, a message) to read   */
+#define EPOLLPRI     0x002      /* Exceptional: zero-copy sends complete */
+#define EPOLLOUT     0x004      /* Room to write                         */
+#define EPOLLERR     0x008      /* Writing would fail (no readers)       */
+#define EPOLLHUP     0x010      /* Peer closed; reads return EOF         */
+#define EPOLLONESHOT (1u << 30)
+#define EPOLLET      (1u << 31)
+
+/* epoll_ctl() operations */
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+/* epoll_wait() timeouts, in milliseconds */
+#define EPOLL_NOWAIT  0u
+#define EPOLL_FOREVER 0xFFFFFFFFu
+
+/* Most events one epoll_wait() call returns */
+#define EPOLL_MAX_EVENTS 64
+
+/* Wait queues one item can be hooked on (e.g. a queue's send and
+ * receive sides) */
+#define EPOLL_ITEM_HOOKS 2
+
+typedef struct epoll_event {
+    uint32_t events;            /* EPOLL* bits                          */
+    uint32_t data;              /* Caller's cookie, returned as is      */
+} epoll_event_t;
+
+struct file;
+struct eventpoll;
+
+/*
+ * Interest set entry: one file in one instance. Linked on the
+ * instance's item list, on the file's list (so closing the file drops
+ * it everywhere) and, while possibly ready, on the ready list.
+ */
+typedef struct epitem {
+    struct eventpoll *ep;
+    struct file      *file;
+    epoll_event_t     event;    /* Interest bits + cookie               */
+    wait_hook_t       hooks[EPOLL_ITEM_HOOKS];
+    uint32_t          nhooks;
+    struct epitem    *next;     /* Instance's items                     */
+    struct epitem    *prev;
+    struct epitem    *file_next;
+    struct epitem    *rd_next;  /* Ready list                           */
+    int               ready;    /* On the ready list                    */
+} epitem_t;
+
+typedef struct eventpoll {
+    epitem_t     *items;
+    epitem_t     *rd_head;
+    epitem_t     *rd_tail;
+    wait_queue_t  wait;         /* Processes in epoll_wait()            */
+    uint32_t      count;        /* Items in the interest set            */
+    uint32_t      refs;         /* The file + waiters in progress       */
+    int           is_open;
+} eventpoll_t;
+
+/*
+ * Handed to a file's poll operation. With a table the object must call
+ * poll_wait() for every wait queue that is woken when its readiness
+ * changes, passing the event bits that queue stands for; without one
+ * (NULL) it only reports its state.
+ */
+typedef struct poll_table {
+    epitem_t *item;
+} poll_table_t;
+
+void poll_wait(poll_table_t *pt, wait_queue_t *wq, uint32_t events);
+
+/* Initialize the item cache */
+void epoll_init(void);
+
+/* Create an instance with one reference (its file's). */
+eventpoll_t *epoll_create(void);
+
+/* Add, change or remove the interest in `f`. Returns 0, or -1 if `f`
+ * cannot be polled, is already there (ADD) or is not there (MOD/DEL). */
+int epoll_ctl(eventpoll_t *ep, int op, struct file *f, epoll_event_t *ev);
+
+/* Wait up to timeout_ms for ready items and store at most `max` of
+ * them in `events`. Returns the number stored (0 on timeout), or -1. */
+int epoll_wait(eventpoll_t *ep, epoll_event_t *events, int max,
+               uint32_t timeout_ms);
+
+/* Close an instance: empty the interest set and wake any waiter. */
+void epoll_close(eventpoll_t *ep);
+
+/* Create an instance and install it in the current process. */
+int epoll_open_fd(void);
+
+/* The instance behind a descriptor, or NULL. */
+eventpoll_t *epoll_from_file(struct file *f);
+
+/* `f` is being released: drop it from every interest set. */
+void epoll_file_release(struct file *f);
+
+#endif /* OPENOS_EPOLL_H */
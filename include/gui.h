@@ -2,6 +2,18 @@
  * OpenOS - Graphics and Windowing System
  * 
  * Provides basic GUI framework with framebuffer support
+ *
+ * Every window draws into its own backing store (width x height pixels
+ * in the heap), never into the framebuffer. Anything that changes what
+ * the screen should show (drawing in a window, moving, raising, showing
+ * or hiding one) adds the affected screen rectangle to a damage list,
+ * merging it with damage it overlaps. gui_render_all() is the compositor:
+ * for each damaged rectangle it walks the windows front to back, copies
+ * the part a window covers from its backing store, and passes only what
+ * is left on to the windows behind it, so covered pixels are never drawn
+ * and each framebuffer pixel is written once. The desktop color fills
+ * whatever no window covers. The cost of a frame follows the damaged
+ * area, not the number or size of the windows.
  */
 
 #ifndef OPENOS_GUI_H
@@ -23,6 +35,9 @@
 #define COLOR_GRAY    0xFF808080
 #define COLOR_LIGHTGRAY 0xFFC0C0C0
 
+#define GUI_TITLE_HEIGHT 20
+#define GUI_MAX_DAMAGE   32     /* Pending rectangles before merging harder */
+
 /* Window states */
 typedef enum {
     WINDOW_HIDDEN,
@@ -43,22 +58,38 @@ typedef struct window {
     rect_t rect;
     uint32_t bg_color;
     window_state_t state;
-    struct window* next;
+    uint32_t* pixels;           /* Backing store, rect.width * rect.height */
+    struct window* next;        /* The window behind this one */
 } window_t;
 
 /* GUI system state */
 typedef struct gui_state {
     uint32_t* framebuffer;
     int width, height;
-    window_t* window_list;
+    window_t* window_list;      /* Front to back */
     uint32_t next_window_id;
+    uint32_t desktop_color;
+    rect_t damage[GUI_MAX_DAMAGE];
+    int damage_count;
     int initialized;
 } gui_state_t;
 
+typedef struct gui_stats {
+    uint32_t frames;            /* gui_render_all() calls with damage   */
+    uint32_t damage_rects;      /* Rectangles composited                */
+    uint32_t damage_merged;     /* Added rectangles merged into another */
+    uint32_t pixels_copied;     /* From backing stores                  */
+    uint32_t pixels_filled;     /* Desktop color                        */
+    uint32_t pixels_culled;     /* Damaged window pixels not drawn
+                                 * because a window in front covers them */
+} gui_stats_t;
+
 /* Initialize GUI subsystem */
 void gui_init(void);
 
-/* Drawing primitives */
+/* Drawing primitives. These draw on the framebuffer itself, over
+ * whatever the compositor put there; the next frame that damages the
+ * area paints over them. */
 void gui_draw_pixel(int x, int y, uint32_t color);
 void gui_draw_rect(rect_t* rect, uint32_t color);
 void gui_draw_filled_rect(rect_t* rect, uint32_t color);
@@ -70,10 +101,26 @@ window_t* gui_create_window(int x, int y, int width, int height, const char* tit
 void gui_destroy_window(window_t* window);
 void gui_show_window(window_t* window);
 void gui_hide_window(window_t* window);
+void gui_move_window(window_t* window, int x, int y);
+void gui_raise_window(window_t* window);
+
+/* Draw the window's frame, background and title into its backing store */
 void gui_render_window(window_t* window);
+
+/* Drawing inside a window, in window coordinates, clipped to it */
+void gui_window_fill_rect(window_t* window, rect_t* rect, uint32_t color);
+void gui_window_draw_text(window_t* window, int x, int y, const char* text,
+                          uint32_t color);
+
+/* Mark a screen rectangle as needing to be composited again */
+void gui_damage(const rect_t* rect);
+
+/* Composite the damaged regions onto the framebuffer */
 void gui_render_all(void);
 
-/* Clear screen */
+/* Set the desktop color and damage the whole screen */
 void gui_clear_screen(uint32_t color);
 
+void gui_get_stats(gui_stats_t* stats);
+
 #endif /* OPENOS_GUI_H */
@@ -0,0 +1,56 @@
+/*
+ * OpenOS - ICMP
+ *
+ * Echo requests are answered by turning the received sk_buff around in
+ * place. icmp_ping() sends one echo request and waits for its reply,
+ * timing the round trip with the TSC; one ping is outstanding at a time.
+ */
+
+#ifndef OPENOS_ICMP_H
+#define OPENOS_ICMP_H
+
+#include <stdint.h>
+#include "network.h"
+
+#define ICMP_ECHO_REPLY     0
+#define ICMP_DEST_UNREACH   3
+#define ICMP_ECHO_REQUEST   8
+
+#define ICMP_PING_MAX_DATA  8192        /* Payload bytes per echo request */
+
+typedef struct icmp_header {
+    uint8_t  type;
+    uint8_t  code;
+    uint16_t checksum;
+    uint16_t id;                /* Echo only */
+    uint16_t seq;
+} __attribute__((packed)) icmp_header_t;
+
+typedef struct icmp_ping_result {
+    uint64_t rtt_cycles;
+    uint32_t bytes;             /* ICMP payload bytes in the reply */
+    uint8_t  ttl;
+} icmp_ping_result_t;
+
+typedef struct icmp_stats {
+    uint32_t rx_messages;
+    uint32_t rx_errors;         /* Short or bad checksum */
+    uint32_t rx_csum_errors;    /* ... of which checksum */
+    uint32_t echo_requests;     /* Received              */
+    uint32_t echo_replies;      /* Sent                  */
+    uint32_t pings_sent;
+    uint32_t pings_answered;
+} icmp_stats_t;
+
+/* Register with the IP layer. */
+void icmp_init(void);
+
+/* Send an echo request with `size` payload bytes to `dst` and wait up
+ * to `timeout_ms` for the reply. Returns 0 and fills `result`, or -1
+ * on timeout, if another ping is in flight, or if sending failed. */
+int icmp_ping(in_addr_t dst, uint16_t seq, uint32_t size, uint32_t timeout_ms,
+              icmp_ping_result_t *result);
+
+void icmp_get_stats(icmp_stats_t *stats);
+
+#endif /* OPENOS_ICMP_H */
@@ -0,0 +1,102 @@
+/*
+ * OpenOS - IPv4
+ *
+ * Input validates the header, reassembles fragments and hands the
+ * payload to the protocol registered for it. Output picks a route by
+ * longest prefix match over a small table, fragments to the device MTU
+ * and passes each packet to ARP for the next hop. Our own addresses
+ * are routed to lo, which hands packets straight back to input; a
+ * transport checksum left CHECKSUM_PARTIAL is finished here unless the
+ * device is NETDEV_NO_CSUM.
+ *
+ * Reassembly keeps the received fragments themselves: once a datagram
+ * is complete, the payloads of fragments after the first are attached
+ * to the first one's sk_buff as fragments (a reference on their data
+ * buffers), so nothing is copied. A datagram that would need more than
+ * SKB_MAX_FRAGS pieces, has overlapping fragments, or is still missing
+ * parts after IP_REASM_TIMEOUT_TICKS is dropped.
+ */
+
+#ifndef OPENOS_IP_H
+#define OPENOS_IP_H
+
+#include <stdint.h>
+#include "network.h"
+
+#define IP_HLEN                 20
+#define IP_DEFAULT_TTL          64
+#define IP_MAX_ROUTES           16
+#define IP_REASM_SLOTS          8          /* Datagrams reassembled at once */
+#define IP_REASM_TIMEOUT_TICKS  3000       /* 30 s                          */
+
+/* Routing table entry; `dest` and `mask` in network order */
+typedef struct route {
+    in_addr_t     dest;
+    in_addr_t     mask;
+    in_addr_t     gateway;          /* INADDR_ANY: directly connected    */
+    net_device_t *dev;
+    uint8_t       prefix;           /* Bits set in mask                  */
+} route_t;
+
+/* Called with data at the transport header; `iph` stays valid (it is in
+ * the headroom). The handler owns `skb`. */
+typedef void (*ip_proto_handler_t)(sk_buff_t *skb, const ip_header_t *iph);
+
+typedef struct ip_stats {
+    uint32_t rx_packets;
+    uint32_t rx_delivered;          /* Handed to a protocol              */
+    uint32_t rx_hdr_errors;         /* Bad version/length/checksum       */
+    uint32_t rx_csum_errors;        /* ... of which checksum             */
+    uint32_t rx_not_local;          /* Not addressed to us (no forwarding) */
+    uint32_t rx_no_proto;
+    uint32_t reasm_frags;           /* Fragments received                */
+    uint32_t reasm_ok;
+    uint32_t reasm_failed;          /* Overlap, too many pieces, evicted */
+    uint32_t reasm_timeouts;
+    uint32_t tx_packets;
+    uint32_t tx_no_route;
+    uint32_t tx_frags;              /* Fragments created                 */
+} ip_stats_t;
+
+/* Add the connected route of `dev` and a default route via `gateway`
+ * (skipped if INADDR_ANY). */
+void ip_init(net_device_t *dev, in_addr_t gateway);
+
+/* Add a route for dest/prefix. Returns 0, or -1 if the table is full
+ * or the prefix is invalid. */
+int ip_route_add(in_addr_t dest, uint8_t prefix, in_addr_t gateway,
+                 net_device_t *dev);
+
+/* Longest prefix match for `dst`, copied into `out`. Returns 0 or -1. */
+int ip_route_lookup(in_addr_t dst, route_t *out);
+
+/* Source address for packets to `dst`: that of the outgoing device,
+ * or `dst` itself when it is one of ours. The device goes to *dev if
+ * that is not NULL. Returns 0 or -1 (no route). */
+int ip_route_source(in_addr_t dst, in_addr_t *src, net_device_t **dev);
+
+/* Entry `index` in match order, for the `route` command. Returns 0 or
+ * -1 past the end. */
+int ip_route_get(int index, route_t *out);
+
+/* Deliver payloads of protocol `proto` to `handler`. */
+void ip_register_protocol(uint8_t proto, ip_proto_handler_t handler);
+
+/* A received IPv4 packet (data at the IP header). Consumes `skb`. */
+void ip_input(net_device_t *dev, sk_buff_t *skb);
+
+/* Send the payload in `skb` (data at the transport header) to `dst`.
+ * Consumes `skb`. Returns 0 if it was sent or queued for address
+ * resolution, -1 if dropped. */
+int ip_output(sk_buff_t *skb, in_addr_t dst, uint8_t proto);
+
+/* Unfolded one's complement sum of the TCP/UDP pseudo-header */
+uint32_t ip_pseudo_csum(in_addr_t src, in_addr_t dst, uint8_t proto,
+                        uint32_t len);
+
+/* Reassembly timeouts; called every NET_TIMER_TICKS. */
+void ip_timer(void);
+
+void ip_get_stats(ip_stats_t *stats);
+
+#endif /* OPENOS_IP_H */
@@ -1,7 +1,9 @@
 /*
  * OpenOS - Inter-Process Communication
  * 
- * Provides IPC mechanisms: pipes and message queues
+ * Provides IPC mechanisms: pipes, message queues and rendezvous
+ * endpoints, all built on a common reference-counted object header
+ * with an optional global name.
  */
 
 #ifndef OPENOS_IPC_H
@@ -9,56 +11,340 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "../process/waitqueue.h"
 
-/* Pipe buffer size */
+/* Default pipe capacity, and the largest capacity pipe_create_sized()
+ * accepts (16 pages). */
 #define PIPE_BUF_SIZE 4096
+#define PIPE_MAX_SIZE (16 * 4096)
 
-/* Message queue limits */
-#define MSG_QUEUE_SIZE 16
-#define MSG_MAX_SIZE 256
+/* Pipe flags */
+#define PIPE_NONBLOCK 0x1   /* read/write return -1 instead of blocking */
 
-/* Pipe structure */
+/* Pipe ends, for pipe_close_end() */
+#define PIPE_END_READ  0
+#define PIPE_END_WRITE 1
+
+/* Zero-copy page references a pipe can hold at once */
+#define PIPE_MAX_SEGS 16
+
+/* pipe_vmsplice() flags */
+#define SPLICE_F_GIFT 0x1   /* queue the caller's pages instead of copying */
+
+/* Pipe segment kinds */
+#define PIPE_SEG_GIFT 1     /* Gifted user page, copy-on-write protected */
+#define PIPE_SEG_FILE 2     /* ramfs file content, pinned                */
+#define PIPE_SEG_PAGE 3     /* Private page owned by the pipe            */
+
+/* Message queue sizing: each queue owns an arena that holds its
+ * messages back to back, headers included. */
+#define MSGQ_DEFAULT_ARENA   (16 * 1024)
+#define MSGQ_MAX_ARENA       (256 * 1024)
+#define MSGQ_DEFAULT_MSG_MAX 4096
+#define MSGQ_PRIORITIES      32      /* 0 (lowest) .. 31 (highest) */
+
+/* Synchronous IPC message: a few words, passed in registers by the
+ * syscalls (ECX, EDX, ESI, EDI) */
+#define IPC_MSG_WORDS 4
+
+/* Message queue timeouts, in milliseconds */
+#define MSGQ_NOWAIT   0u             /* fail instead of blocking   */
+#define MSGQ_FOREVER  0xFFFFFFFFu    /* block with no deadline     */
+
+/* Longest global object name, terminator included */
+#define IPC_NAME_MAX 32
+
+/* IPC object types */
+#define IPC_OBJ_PIPE     1
+#define IPC_OBJ_MSGQ     2
+#define IPC_OBJ_ENDPOINT 3
+#define IPC_OBJ_SHM      4
+#define IPC_OBJ_TYPES    5
+
+struct vfs_node;
+struct ipc_object;
+
+typedef struct ipc_object_ops {
+    const char* kind;                           /* "pipe", "msgq", ...  */
+    void (*shutdown)(struct ipc_object* obj);   /* last handle closed   */
+    void (*free)(struct ipc_object* obj);       /* last reference gone  */
+} ipc_object_ops_t;
+
+/*
+ * Common IPC object header
+ *
+ * Every pipe, queue, endpoint and shared memory object starts with
+ * one and comes from its type's slab cache. `handles` counts the
+ * references that keep the object alive (descriptors, the kernel code
+ * that created it); when the last handle closes the object shuts
+ * down: its name goes away, blocked processes fail and its buffers
+ * are freed. `refs` counts everything that may still touch the
+ * structure, i.e. the handles plus operations in progress such as a
+ * process asleep in a read, and the last one returns the memory to
+ * the slab. Live objects of each type are kept on a list.
+ */
+typedef struct ipc_object {
+    const ipc_object_ops_t* ops;
+    uint32_t type;                  /* IPC_OBJ_*                    */
+    uint32_t handles;
+    uint32_t refs;
+    struct ipc_object* next;        /* Live list of this type       */
+    struct ipc_object* prev;
+    struct ipc_object* name_next;   /* Name hash chain              */
+    char name[IPC_NAME_MAX];        /* "" while anonymous           */
+} ipc_object_t;
+
+/*
+ * Pipe segment
+ *
+ * A reference to bytes that live outside the pipe's ring: a gifted
+ * user page, a pinned ramfs file, or a page the pipe had to copy into
+ * when one of those was about to change. `mark` is the ring position
+ * (ring_in) at the time the segment was queued, so ring bytes written
+ * before it are read first and the stream order is preserved.
+ */
+typedef struct pipe_seg {
+    const uint8_t* data;        /* First unread byte                 */
+    size_t len;                 /* Unread bytes                      */
+    uint32_t mark;              /* Ring bytes preceding this segment */
+    uint32_t kind;              /* PIPE_SEG_*                        */
+    uint32_t page;              /* GIFT/PAGE: page holding `data`    */
+    struct vfs_node* node;      /* FILE: pinned node                 */
+} pipe_seg_t;
+
+/*
+ * Pipe structure
+ *
+ * A byte ring of `capacity` bytes. Transfers copy at most two
+ * contiguous chunks (up to the end of the buffer, then from its
+ * start). Readers block on read_wait while the ring is empty and
+ * writers on write_wait while it is full; each side wakes the other
+ * after moving data. Once every writer has closed, reads drain the
+ * ring and then return 0 (EOF); once every reader has closed, writes
+ * fail.
+ *
+ * Next to the ring sits a small FIFO of segments (splice/vmsplice)
+ * that reference whole pages in place. pipe_read() copies out of them
+ * like ring bytes; pipe_read_view() hands the reader a pointer to
+ * them so a page travels producer -> consumer without any copy.
+ */
 typedef struct pipe {
-    uint8_t buffer[PIPE_BUF_SIZE];
+    ipc_object_t obj;
+    uint8_t* buffer;
+    size_t capacity;
     size_t read_pos;
     size_t write_pos;
     size_t count;
     uint32_t reader_pid;
     uint32_t writer_pid;
+    uint32_t readers;           /* Open read ends                   */
+    uint32_t writers;           /* Open write ends                  */
+    uint32_t flags;             /* PIPE_NONBLOCK                    */
+    wait_queue_t read_wait;     /* Readers waiting for data         */
+    wait_queue_t write_wait;    /* Writers waiting for space        */
+    uint32_t ring_in;           /* Bytes ever put into the ring     */
+    uint32_t ring_out;          /* Bytes ever taken from the ring   */
+    pipe_seg_t segs[PIPE_MAX_SEGS];
+    uint32_t seg_head;
+    uint32_t seg_count;
+    size_t view;                /* Bytes lent out by pipe_read_view */
     int is_open;
 } pipe_t;
 
-/* Message structure */
-typedef struct message {
+/* Message metadata returned by msgqueue_receive() */
+typedef struct msg_info {
     uint32_t sender_pid;
     uint32_t type;
-    size_t size;
-    uint8_t data[MSG_MAX_SIZE];
-} message_t;
+    uint32_t priority;
+    size_t size;                /* Payload bytes */
+} msg_info_t;
+
+struct msg_block;
 
-/* Message queue structure */
+/*
+ * Message queue structure
+ *
+ * Messages are variable-length blocks carved first-fit out of the
+ * queue's arena (freed blocks coalesce with their neighbours). Queued
+ * blocks hang off one FIFO per priority; `prio_map` has bit N set
+ * while list N is non-empty, so the highest pending priority is a
+ * single bit scan. Senders block on send_wait while the arena cannot
+ * fit their message, receivers on recv_wait while the queue is empty,
+ * both with an optional timeout.
+ */
 typedef struct msg_queue {
-    message_t messages[MSG_QUEUE_SIZE];
-    size_t head;
-    size_t tail;
-    size_t count;
+    ipc_object_t obj;
+    uint8_t* arena;
+    size_t arena_size;
+    size_t max_msg;             /* Largest payload accepted         */
+    struct msg_block* free_list;        /* Address ordered         */
+    struct msg_block* head[MSGQ_PRIORITIES];
+    struct msg_block* tail[MSGQ_PRIORITIES];
+    uint32_t prio_map;
+    size_t count;               /* Queued messages                  */
+    size_t bytes;               /* Arena bytes in use               */
     uint32_t owner_pid;
+    wait_queue_t send_wait;     /* Senders waiting for arena space  */
+    wait_queue_t recv_wait;     /* Receivers waiting for a message  */
     int is_open;
 } msg_queue_t;
 
+/* Synchronous IPC message */
+typedef struct ipc_msg {
+    uint32_t w[IPC_MSG_WORDS];
+} ipc_msg_t;
+
+/*
+ * Rendezvous endpoint
+ *
+ * A server sits in ipc_reply_wait(); `server` is set while it is
+ * blocked there with no caller. A client's ipc_call() copies its words
+ * straight into the waiting server and switches to it directly
+ * (scheduler_handoff(), donating the rest of its timeslice); the
+ * server's next ipc_reply_wait() copies the reply back and switches
+ * straight to the client. Clients that find the server busy queue on
+ * `callers` and are picked up in FIFO order.
+ */
+typedef struct ipc_endpoint {
+    ipc_object_t obj;
+    process_t* server;          /* Server blocked waiting, or NULL  */
+    wait_queue_t callers;       /* Clients waiting for the server   */
+    uint32_t owner_pid;
+    int is_open;
+} ipc_endpoint_t;
+
 /* IPC initialization */
 void ipc_init(void);
 
+/*
+ * Object lifetime and names
+ *
+ * ipc_object_setup() starts an object with one handle and links it
+ * into its type's live list. ipc_object_open() adds a handle and
+ * ipc_object_close() drops one, shutting the object down with the
+ * last. ipc_object_get()/put() pin the memory around an operation
+ * that may sleep.
+ *
+ * ipc_name_bind() publishes an object under a global name (-1 if the
+ * name is taken); the name is dropped when the object shuts down.
+ * ipc_name_open() finds a named object of `type` and returns it with
+ * a new handle, or NULL.
+ *
+ * ipc_object_first() returns the head of a type's live list (walk it
+ * through ->next with interrupts disabled).
+ */
+void ipc_object_setup(ipc_object_t* obj, uint32_t type,
+                      const ipc_object_ops_t* ops);
+void ipc_object_open(ipc_object_t* obj);
+void ipc_object_close(ipc_object_t* obj);
+void ipc_object_get(ipc_object_t* obj);
+void ipc_object_put(ipc_object_t* obj);
+int ipc_name_bind(ipc_object_t* obj, const char* name);
+ipc_object_t* ipc_name_open(const char* name, uint32_t type);
+ipc_object_t* ipc_object_first(uint32_t type);
+
 /* Pipe operations */
 pipe_t* pipe_create(uint32_t reader_pid, uint32_t writer_pid);
+pipe_t* pipe_create_sized(uint32_t reader_pid, uint32_t writer_pid, size_t capacity);
 int pipe_write(pipe_t* pipe, const void* data, size_t size);
 int pipe_read(pipe_t* pipe, void* buffer, size_t size);
+void pipe_set_flags(pipe_t* pipe, uint32_t flags);
+void pipe_close_end(pipe_t* pipe, int end);
 void pipe_close(pipe_t* pipe);
 
-/* Message queue operations */
+/*
+ * Zero-copy transfers
+ *
+ * pipe_vmsplice() with SPLICE_F_GIFT queues references to the pages
+ * under `buf` instead of copying them. The pages are write-protected
+ * copy-on-write until the reader is done with them: a store by the
+ * producer makes the pipe take a private copy first. (The protection
+ * needs paging; without it the producer must leave gifted pages alone
+ * until they are consumed.) Without the flag it behaves as pipe_write.
+ *
+ * pipe_splice_from_file() queues a pinned reference to a ramfs file's
+ * content; pipe_splice_to_file() drains pipe data into a file.
+ *
+ * pipe_read_view() blocks like pipe_read() but returns a pointer to
+ * the next contiguous run of data instead of copying it. The view
+ * stays valid until the next read, view or close of the pipe, which
+ * consumes it.
+ *
+ * All return the byte count, 0 at EOF (reads), or -1.
+ */
+int pipe_vmsplice(pipe_t* pipe, const void* buf, size_t len, uint32_t flags);
+int pipe_splice_from_file(pipe_t* pipe, struct vfs_node* node,
+                          uint32_t offset, size_t len);
+int pipe_splice_to_file(pipe_t* pipe, struct vfs_node* node,
+                        uint32_t offset, size_t len);
+int pipe_read_view(pipe_t* pipe, const void** data);
+
+/* The pipe behind an open file, or NULL if it is not a pipe end. */
+struct file;
+pipe_t* pipe_from_file(struct file* f);
+
+/* Create a pipe and install its read and write ends as descriptors
+ * fds[0] and fds[1] of the current process. Returns 0 or -1. */
+int pipe_open_fds(int fds[2], size_t capacity);
+
+/* The same without the descriptor table: files[0] reads, files[1]
+ * writes, each holding one reference. Returns 0 or -1. */
+int pipe_open_files(struct file* files[2], size_t capacity);
+
+/*
+ * Message queue operations
+ *
+ * Timeouts are in milliseconds: MSGQ_NOWAIT fails at once when the
+ * queue is full (send) or empty (receive), MSGQ_FOREVER waits without
+ * a deadline. Receive returns the highest-priority message, oldest
+ * first within a priority, and copies only its payload into `buf`;
+ * it returns the payload size, or -1 on timeout, on a closed queue,
+ * or when `bufsize` is too small (the message then stays queued).
+ */
 msg_queue_t* msgqueue_create(uint32_t owner_pid);
-int msgqueue_send(msg_queue_t* queue, uint32_t sender_pid, uint32_t type, const void* data, size_t size);
-int msgqueue_receive(msg_queue_t* queue, message_t* msg);
+msg_queue_t* msgqueue_create_sized(uint32_t owner_pid, size_t arena_size,
+                                   size_t max_msg);
+int msgqueue_send(msg_queue_t* queue, uint32_t sender_pid, uint32_t type,
+                  uint32_t priority, const void* data, size_t size,
+                  uint32_t timeout_ms);
+int msgqueue_receive(msg_queue_t* queue, void* buf, size_t bufsize,
+                     msg_info_t* info, uint32_t timeout_ms);
 void msgqueue_close(msg_queue_t* queue);
 
+/*
+ * Synchronous call / reply
+ *
+ * ipc_call() sends msg to the endpoint's server and blocks until it
+ * replies; the reply overwrites msg. Returns 0, or -1 if the endpoint
+ * is closed or the server died.
+ *
+ * ipc_reply_wait() first replies with msg to the caller the server is
+ * serving (if any), then waits for the next call and stores its words
+ * in msg. Returns the caller's pid, or -1 if the endpoint was closed.
+ */
+ipc_endpoint_t* ipc_endpoint_create(uint32_t owner_pid);
+void ipc_endpoint_close(ipc_endpoint_t* ep);
+int ipc_call(ipc_endpoint_t* ep, ipc_msg_t* msg);
+int ipc_reply_wait(ipc_endpoint_t* ep, ipc_msg_t* msg);
+
+/* Create an endpoint and install it as a descriptor. With a name, an
+ * existing endpoint of that name is opened instead, or the new one is
+ * published under it. Returns fd or -1. */
+int ipc_endpoint_open_fd(const char* name);
+
+/* The endpoint behind an open file, or NULL. */
+ipc_endpoint_t* ipc_endpoint_from_file(struct file* f);
+
+/* Break any rendezvous `p` takes part in (process exit/kill). */
+void ipc_process_cleanup(process_t* p);
+
+/* Create a queue and install it as a read/write descriptor of the
+ * current process. With a name, an existing queue of that name is
+ * opened instead (the sizes are then ignored), or the new queue is
+ * published under it. Returns the fd or -1. */
+int msgqueue_open_fd(const char* name, size_t arena_size, size_t max_msg);
+
+/* The queue behind an open file, or NULL if it is not a queue. */
+msg_queue_t* msgqueue_from_file(struct file* f);
+
 #endif /* OPENOS_IPC_H */
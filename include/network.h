@@ -9,6 +9,11 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "../process/waitqueue.h"
+#include "skbuff.h"
+#include "timer_wheel.h"
+#include "checksum.h"
+#include "smp.h"
 
 /* MAC address length */
 #define MAC_ADDR_LEN 6
@@ -24,6 +29,33 @@
 #define PROTO_TCP  6
 #define PROTO_UDP  17
 
+/* Ethernet */
+#define ETH_HLEN    14
+#define ETH_MTU     1500
+#define ETH_P_IP    0x0800
+#define ETH_P_ARP   0x0806
+
+/* Byte order: the wire is big-endian, x86 little-endian */
+static inline uint16_t htons(uint16_t v) {
+    return (uint16_t)((v << 8) | (v >> 8));
+}
+
+static inline uint32_t htonl(uint32_t v) {
+    return __builtin_bswap32(v);
+}
+
+#define ntohs(v) htons(v)
+#define ntohl(v) htonl(v)
+
+/* IPv4 address as it appears on the wire (network byte order), so it
+ * can be compared, hashed and masked as one word. */
+typedef uint32_t in_addr_t;
+
+#define IP4(a, b, c, d) ((in_addr_t)((uint32_t)(a) | ((uint32_t)(b) << 8) | \
+                                     ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24)))
+#define INADDR_ANY       0u
+#define INADDR_BROADCAST 0xFFFFFFFFu
+
 /* MAC address structure */
 typedef struct mac_addr {
     uint8_t addr[MAC_ADDR_LEN];
@@ -51,10 +83,15 @@ typedef struct ip_header {
     uint8_t ttl;
     uint8_t protocol;
     uint16_t checksum;
-    ip_addr_t src_ip;
-    ip_addr_t dst_ip;
+    in_addr_t src_ip;
+    in_addr_t dst_ip;
 } __attribute__((packed)) ip_header_t;
 
+/* ip_header_t::flags_offset, host order */
+#define IP_FLAG_DF      0x4000
+#define IP_FLAG_MF      0x2000
+#define IP_OFFSET_MASK  0x1FFF  /* In 8-byte units */
+
 /* TCP header */
 typedef struct tcp_header {
     uint16_t src_port;
@@ -75,30 +112,201 @@ typedef struct udp_header {
     uint16_t checksum;
 } __attribute__((packed)) udp_header_t;
 
-/* Network packet structure */
+/* Flat copy of a frame, for net_send_packet()/net_receive_packet();
+ * the stack itself passes sk_buffs (include/skbuff.h). */
 typedef struct packet {
     uint8_t data[MAX_PACKET_SIZE];
     size_t length;
 } packet_t;
 
-/* Socket structure */
+/* IPv4 socket address; port in host order */
+typedef struct sockaddr_in {
+    in_addr_t addr;
+    uint16_t port;
+    uint16_t reserved;
+} sockaddr_in_t;
+
+/* One datagram of a net_socket_sendmmsg()/net_socket_recvmmsg() batch.
+ * `len` is the payload size (send) or buffer size (receive); `addr` is
+ * the destination or, on return, the sender; `result` gets the bytes
+ * sent or received. */
+typedef struct net_mmsg {
+    void* buf;
+    uint32_t len;
+    sockaddr_in_t addr;
+    uint32_t result;
+} net_mmsg_t;
+
+/* Largest batch net_socket_recvmmsg() takes at once */
+#define NET_MMSG_MAX    64
+
+/* net_socket_recvfrom()/recvmmsg()/sendmsg() flags */
+#define MSG_DONTWAIT    0x40    /* Fail instead of blocking when empty */
+#define MSG_ZEROCOPY    0x4000000   /* Send: lend the buffer, see below */
+
+/* MSG_ZEROCOPY sends shorter than this are copied: pinning and
+ * completion tracking would cost more than the copy saves. They still
+ * take an id and complete at once. */
+#define NET_ZEROCOPY_MIN    1024
+
+/* Socket-level options: net_socket_getopt(SO_ZEROCOPY_DONE), and
+ * net_socket_setopt() with a const bpf_fprog_t* as the value for
+ * SO_ATTACH_FILTER (UDP sockets; see include/bpf.h) */
+#define SO_ZEROCOPY_DONE    0x100   /* MSG_ZEROCOPY sends completed */
+#define SO_ATTACH_FILTER    0x101   /* Replace the receive filter   */
+#define SO_DETACH_FILTER    0x102
+
+/* Receive queue limit, in buffer bytes (see skb_truesize()) */
+#define SOCK_RCVBUF_DEFAULT (64 * SKB_BUF_SIZE)
+
+/*
+ * Socket structure. Sockets are reference counted: the creator holds
+ * one reference and a caller blocked in it holds another, so a close
+ * from elsewhere cannot free it under the sleeper. Datagrams wait on
+ * rx_queue with data at the payload and the sender's address and port
+ * in skb->cb[0] and cb[1]; a TCP socket's data lives in its connection
+ * (`tcp`, see include/tcp.h).
+ *
+ * A MSG_ZEROCOPY send lends the caller's buffer to the stack instead of
+ * copying it; the caller must leave it unchanged until the send has
+ * completed. Sends are numbered from 0 per socket, and complete once
+ * no packet references their buffer any more (for TCP: the data is
+ * acknowledged and every copy in flight is freed). zc_done counts
+ * them, oldest first, so every send with a lower id is complete;
+ * EPOLLPRI is raised while a new count is waiting to be read with
+ * getopt(SO_ZEROCOPY_DONE). Closing the socket copies whatever is
+ * still lent, which completes it.
+ */
+struct net_lend;
+struct bpf_prog;
+struct bpf_fprog;
+
 typedef struct socket {
     uint32_t id;
-    uint16_t local_port;
-    uint16_t remote_port;
-    ip_addr_t remote_ip;
     uint8_t protocol;
     int is_open;
+    uint32_t refs;
+    in_addr_t local_addr;       /* INADDR_ANY: every local address   */
+    uint16_t local_port;        /* Host order; 0 until bound          */
+    in_addr_t remote_addr;      /* Default destination (connect)      */
+    uint16_t remote_port;
+    struct socket* hash_next;   /* Protocol port table chain          */
+    sk_buff_head_t rx_queue;
+    uint32_t rx_queued;         /* Buffer bytes charged to rx_queue   */
+    uint32_t rcvbuf;            /* Limit for rx_queued                */
+    uint32_t rx_drops;          /* Datagrams refused: queue full      */
+    struct bpf_prog* filter;    /* Decides which datagrams to queue   */
+    uint32_t rx_filtered;       /* Datagrams it refused               */
+    wait_queue_t rx_wait;   /* Woken when data arrives (and epoll hooks) */
+    wait_queue_t tx_wait;   /* Woken when a send may proceed          */
+    struct tcp_sock* tcp;   /* Connection of a TCP socket             */
+    struct net_lend* zc_head;   /* MSG_ZEROCOPY sends not yet counted */
+    struct net_lend* zc_tail;
+    uint32_t zc_next;       /* Id of the next MSG_ZEROCOPY send       */
+    uint32_t zc_done;       /* Sends with lower ids have completed    */
+    uint32_t zc_reported;   /* zc_done as last read by getopt         */
 } socket_t;
 
+/* net_device_t::xmit flags */
+#define NET_XMIT_MORE   0x1     /* More frames follow at once: the driver
+                                 * may defer its doorbell write. The last
+                                 * frame of a batch must not carry it. */
+
+/* Frames one NAPI poll may take before yielding the CPU */
+#define NAPI_BUDGET     64
+
+/* Received frames of unknown type queued for net_receive_packet() */
+#define NET_RX_BACKLOG  32
+
+/* Protocol housekeeping (ARP aging, reassembly timeouts) runs in the
+ * RX thread this often */
+#define NET_TIMER_TICKS 10
+
+/* net_device_t::flags */
+#define NETDEV_LOOPBACK 0x1     /* No link layer: IP packets go in and
+                                 * out with skb->protocol set         */
+#define NETDEV_NO_CSUM  0x2     /* Cannot corrupt packets: checksums
+                                 * are neither computed nor verified  */
+
+/* Receive queues a device may have, and the RSS indirection table that
+ * maps a flow hash to one of them (see include/rss.h) */
+#define NET_MAX_QUEUES  8
+#define RSS_INDIR_SIZE  128
+
+/* Per-queue counters: a device's RX queues, and RPS backlogs */
+typedef struct net_queue_stats {
+    uint32_t packets;
+    uint64_t bytes;
+    uint32_t dropped;       /* Queue full                            */
+    uint32_t polls;         /* NAPI poll calls                       */
+} net_queue_stats_t;
+
+/* Per-device counters */
+typedef struct net_dev_stats {
+    uint32_t rx_packets;
+    uint32_t tx_packets;
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    uint32_t rx_dropped;    /* Backlog full                          */
+    uint32_t tx_dropped;    /* Refused: no driver, or the ring full  */
+    uint32_t rx_polls;      /* NAPI poll calls                       */
+    uint32_t rx_filtered;   /* Dropped by the RX filter              */
+    uint32_t rx_errors;     /* Bad descriptor, runt frame            */
+    uint32_t tx_errors;     /* Empty or oversized, device down       */
+} net_dev_stats_t;
+
 /* Network device structure */
 typedef struct net_device {
     char name[16];
     mac_addr_t mac;
     ip_addr_t ip;
+    ip_addr_t netmask;
+    uint32_t mtu;           /* Largest IP packet, header included    */
     int is_up;
+    uint32_t flags;         /* NETDEV_*                              */
+
+    /* Queue one frame (Ethernet header included, unless
+     * NETDEV_LOOPBACK) for transmission, taking over the caller's
+     * reference on success. Returns 0, or -1 if the TX ring is full.
+     * NULL: no hardware. */
+    int (*xmit)(struct net_device* dev, sk_buff_t* skb, uint32_t flags);
+    void* priv;             /* Driver state                          */
+    net_dev_stats_t stats;
+
+    /* Receive queues: each has its own NAPI context (napi_t::queue),
+     * and its interrupt is meant for rxq_cpu[q]. Multi-queue devices
+     * pick the queue of a flow by RSS through rss_indir. */
+    uint32_t num_rx_queues;
+    uint8_t rxq_cpu[NET_MAX_QUEUES];
+    uint8_t rss_indir[RSS_INDIR_SIZE];
+    net_queue_stats_t rxq[NET_MAX_QUEUES];
+
+    /* RPS: IPv4 input is spread by flow over the backlogs of these
+     * CPUs (rps_map, rps_len entries); 0 handles it in place */
+    uint32_t rps_cpus;
+    uint8_t rps_map[MAX_CPUS];
+    uint32_t rps_len;
+
+    /* Runs on every received frame before the protocols see it */
+    struct bpf_prog* rx_filter;
 } net_device_t;
 
+/*
+ * NAPI-style receive: a driver's interrupt handler masks its RX
+ * interrupts and calls napi_schedule(); the network RX thread then
+ * calls poll() with a budget until the driver finds fewer frames than
+ * that, at which point the driver calls napi_complete() and unmasks.
+ * Under load the device is drained by polling with its interrupts
+ * off, at most `budget` frames before other threads get the CPU.
+ */
+typedef struct napi {
+    int (*poll)(struct napi* napi, int budget);  /* Returns frames done */
+    net_device_t* dev;      /* NULL for an RPS backlog               */
+    uint32_t queue;         /* The device's RX queue it polls        */
+    volatile int scheduled;
+    struct napi* next;
+} napi_t;
+
 /* Initialize networking subsystem */
 void net_init(void);
 
@@ -106,20 +314,148 @@ void net_init(void);
 void net_set_ip(ip_addr_t* ip);
 void net_set_mac(mac_addr_t* mac);
 net_device_t* net_get_device(void);
+net_device_t* net_get_loopback(void);
+
+/* Start the RX thread; needs the process table (after process_init). */
+void net_start(void);
+
+/* NAPI registration and scheduling (napi_schedule is IRQ-safe). */
+void napi_add(napi_t* napi);
+void napi_schedule(napi_t* napi);
+void napi_complete(napi_t* napi);
 
-/* Packet operations */
+/* Driver -> stack: one frame received on `dev`, on RX queue
+ * skb->queue; the stack now owns the sk_buff. ARP and IPv4 frames go
+ * to their protocols (IPv4 through an RPS backlog if the device has
+ * RPS), anything else to the backlog. A NETDEV_LOOPBACK device passes
+ * packets with no link header and skb->protocol already set. */
+void net_rx(net_device_t* dev, sk_buff_t* skb);
+
+/* Run `fprog` (include/bpf.h) on every frame `dev` receives, from its
+ * first byte, dropping those it returns 0 for; NULL removes the
+ * filter. Returns 0, or -1 if the program is invalid. */
+int net_dev_attach_filter(net_device_t* dev, const struct bpf_fprog* fprog);
+
+/* Prepend an Ethernet header and transmit. Consumes `skb` either way.
+ * Returns 0 or -1. */
+int net_eth_output(net_device_t* dev, sk_buff_t* skb, const mac_addr_t* dest,
+                   uint16_t ethertype);
+
+/* Hand a frame to the device's driver, counting it. On success the
+ * driver owns `skb`; on -1 (no driver, or the ring is full) the caller
+ * still does and may retry or free it. */
+int net_xmit(net_device_t* dev, sk_buff_t* skb, uint32_t flags);
+
+/* Protocol timers: a wheel advanced by the RX thread every tick while
+ * any timer is armed. Callbacks run there with interrupts disabled.
+ * net_timer_mod() (re-)arms `timer` to fire `ticks` from now. */
+void net_timer_mod(wheel_timer_t* timer, uint32_t ticks);
+void net_timer_del(wheel_timer_t* timer);
+
+/* Oldest backlogged received frame, or NULL. The caller frees it. */
+sk_buff_t* net_receive_skb(void);
+
+/* Packet operations on flat copies: send returns the length sent or
+ * -1; receive takes the oldest backlogged frame and returns its
+ * length, or 0. */
 int net_send_packet(packet_t* packet);
 int net_receive_packet(packet_t* packet);
 
-/* Socket operations */
+/* Socket operations. bind() with port 0 picks an ephemeral port;
+ * recv() blocks until a datagram arrives. For TCP, connect() blocks
+ * until the connection is established, send() until the data is
+ * queued, and recv() returns 0 at the end of the peer's stream. */
 socket_t* net_socket_create(uint8_t protocol);
 int net_socket_bind(socket_t* socket, uint16_t port);
+int net_socket_bind_addr(socket_t* socket, in_addr_t addr, uint16_t port);
 int net_socket_connect(socket_t* socket, ip_addr_t* ip, uint16_t port);
 int net_socket_send(socket_t* socket, const void* data, size_t size);
 int net_socket_recv(socket_t* socket, void* buffer, size_t size);
 void net_socket_close(socket_t* socket);
 
-/* Utility functions */
-uint16_t net_checksum(const void* data, size_t length);
+/* TCP: accept connections on a bound socket, at most `backlog` of them
+ * pending; take the next one (blocking unless MSG_DONTWAIT), with the
+ * peer's address in `peer` (may be NULL). */
+int net_socket_listen(socket_t* socket, int backlog);
+socket_t* net_socket_accept(socket_t* socket, sockaddr_in_t* peer,
+                            uint32_t flags);
+
+/* Socket options (SO_ATTACH_FILTER) and protocol options
+ * (TCP_NODELAY). Returns 0 or -1. */
+int net_socket_setopt(socket_t* socket, int option, int value);
+
+/* Socket option values (SO_ZEROCOPY_DONE), or -1 */
+int net_socket_getopt(socket_t* socket, int option);
+
+/* Send to `to`, or the connected peer if it is NULL, with MSG_* flags:
+ * MSG_DONTWAIT, MSG_ZEROCOPY. Returns the bytes sent, or -1. */
+int net_socket_sendmsg(socket_t* socket, const void* data, size_t size,
+                       const sockaddr_in_t* to, uint32_t flags);
+
+/* Send `count` bytes of a file from `offset` (fewer at its end) with
+ * no copy: packets reference the file's content, which stays pinned
+ * until they are freed. A write to the file meanwhile first moves them
+ * onto a private copy, so what was sent is never changed. Returns the
+ * bytes sent, or -1. */
+struct vfs_node;
+int net_socket_sendfile(socket_t* socket, struct vfs_node* node,
+                        uint32_t offset, uint32_t count);
+
+/* A bare socket for a protocol to hand out for an incoming connection */
+socket_t* net_socket_alloc(uint8_t protocol);
+
+/* Datagram send to `to` / receive with the sender's address (`from`
+ * may be NULL). Return the payload bytes, or -1. A received datagram
+ * longer than `size` is truncated. */
+int net_socket_sendto(socket_t* socket, const void* data, size_t size,
+                      const sockaddr_in_t* to);
+int net_socket_recvfrom(socket_t* socket, void* buffer, size_t size,
+                        sockaddr_in_t* from, uint32_t flags);
+
+/* Batches: send `count` datagrams / receive up to `count`, blocking
+ * only for the first (unless MSG_DONTWAIT). Return how many were
+ * processed, or -1 if none could be. */
+int net_socket_sendmmsg(socket_t* socket, net_mmsg_t* msgs, int count,
+                        uint32_t flags);
+int net_socket_recvmmsg(socket_t* socket, net_mmsg_t* msgs, int count,
+                        uint32_t flags);
+
+/* Protocol -> socket layer: queue a received datagram (data at the
+ * payload, sender in cb[0]/cb[1]) and wake readers. The socket's
+ * filter may trim the datagram or refuse it. Consumes `skb`; returns -1
+ * if it was dropped, the receive queue being full or the filter
+ * refusing it. */
+int net_socket_queue_rcv(socket_t* socket, sk_buff_t* skb);
+
+/* Create a socket and install it as a descriptor of the current
+ * process; read/write map to recv/send and the descriptor can be
+ * polled. Returns fd or -1. */
+int net_socket_open_fd(uint8_t protocol);
+
+/* Install an existing socket (e.g. from accept) as a descriptor; on
+ * failure the socket is closed. Returns fd or -1. */
+int net_socket_install_fd(socket_t* socket);
+
+/* The socket behind a descriptor, or NULL */
+struct file;
+socket_t* net_socket_from_file(struct file* f);
+
+/* Checksum of `len` bytes of a packet starting `offset` bytes in,
+ * across fragments; skb_csum_partial() leaves the sum unfolded so a
+ * pseudo-header can be added. */
+uint32_t skb_csum_partial(const sk_buff_t* skb, uint32_t offset, uint32_t len,
+                          uint32_t sum);
+uint16_t skb_checksum(const sk_buff_t* skb, uint32_t offset, uint32_t len);
+
+/* Address conversions */
+static inline in_addr_t ip_to_in(const ip_addr_t* ip) {
+    return IP4(ip->addr[0], ip->addr[1], ip->addr[2], ip->addr[3]);
+}
+
+/* Parse "a.b.c.d" into `out`. Returns 0 or -1. */
+int inet_parse(const char* s, in_addr_t* out);
+
+/* Format as "a.b.c.d" into `buf` (at least 16 bytes); returns buf. */
+char* inet_format(in_addr_t addr, char* buf);
 
 #endif /* OPENOS_NETWORK_H */
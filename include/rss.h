@@ -0,0 +1,76 @@
+/*
+ * OpenOS - Receive Scaling (RSS and RPS)
+ *
+ * A flow hash keeps the packets of one connection together while
+ * different connections spread out. It is the Toeplitz hash RSS
+ * hardware computes, over (source address, destination address,
+ * source port, destination port) in wire order for TCP and UDP, and
+ * over the addresses alone for anything else, including fragments. The
+ * key is the usual Microsoft one, so values match the RSS verification
+ * suite and what a NIC would report. Instead of a shift and XOR per
+ * input bit, rss_init() expands the key into one 256-entry table per
+ * input byte, and the hash is 12 table lookups.
+ *
+ * RSS: a device with several RX queues picks the queue of a flow with
+ * rss_indir[hash % RSS_INDIR_SIZE], filled round-robin by
+ * net_dev_set_rx_queues(); each queue has its own NAPI context and is
+ * meant to interrupt its own CPU (rxq_cpu). The loopback device works
+ * this way.
+ *
+ * RPS does the same in software for a device with one queue: its
+ * NAPI poll hashes each IPv4 packet and queues it on the backlog of one
+ * of the device's RPS CPUs, whose own NAPI context runs IP input.
+ *
+ * Until the application processors are started and take interrupts,
+ * every NAPI context, per-queue or per-CPU, is polled by the netrx
+ * thread on the boot CPU. The queues still keep flows apart, bound
+ * the work done for one of them per poll, and count per queue.
+ */
+
+#ifndef OPENOS_RSS_H
+#define OPENOS_RSS_H
+
+#include <stdint.h>
+#include "network.h"
+
+#define RSS_KEY_SIZE        40
+
+/* Packets waiting in one CPU's RPS backlog */
+#define RPS_BACKLOG         256
+
+/* Expand the key into the lookup tables and set up the backlogs. */
+void rss_init(void);
+
+/* Toeplitz hash of an IPv4 flow; addresses and ports in network
+ * order. rss_hash_ipv4_addrs() hashes the addresses alone. */
+uint32_t rss_hash_ipv4(in_addr_t saddr, in_addr_t daddr, uint16_t sport,
+                       uint16_t dport);
+uint32_t rss_hash_ipv4_addrs(in_addr_t saddr, in_addr_t daddr);
+
+/* Flow hash of an IPv4 packet with data at the IP header, kept in
+ * skb->hash; 0 if the header is not in the linear part. */
+uint32_t rss_skb_hash(sk_buff_t* skb);
+
+/* RX queue for a flow hash */
+static inline uint32_t rss_select_queue(const net_device_t* dev, uint32_t hash) {
+    return dev->rss_indir[hash % RSS_INDIR_SIZE];
+}
+
+/* Give `dev` `n` RX queues (1..NET_MAX_QUEUES): the indirection table
+ * round-robin over them, queue q steered to CPU q modulo the CPUs
+ * present. */
+void net_dev_set_rx_queues(net_device_t* dev, uint32_t n);
+
+/* Spread `dev`'s IPv4 input over the CPUs in `mask` (bit n: CPU n);
+ * 0 turns RPS off. Returns 0 or -1 (a CPU beyond MAX_CPUS). */
+int rps_set_cpus(net_device_t* dev, uint32_t mask);
+
+/* Called from net_rx() with data at the IP header: queue the packet
+ * on its flow's backlog and return 1, or return 0 to handle it here
+ * (RPS off). A full backlog drops it (and returns 1). */
+int rps_steer(net_device_t* dev, sk_buff_t* skb);
+
+/* Counters of CPU `cpu`'s backlog */
+void rps_get_backlog_stats(uint32_t cpu, net_queue_stats_t* stats);
+
+#endif /* OPENOS_RSS_H */
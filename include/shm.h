@@ -0,0 +1,98 @@
+/*
+ * OpenOS - Shared Memory and Futexes
+ *
+ * A shared memory object is a named run of physically contiguous page
+ * frames, managed like the other IPC objects in include/ipc.h (slab
+ * allocated, one handle per descriptor or attachment, global name).
+ * Processes open it by name (getting a descriptor) and attach it,
+ * which records the mapping in the PCB and returns the address the
+ * pages are visible at. Every process currently runs in the one
+ * identity-mapped directory set up by vmm_init(), so that address is
+ * the same for all of them and survives fork().
+ *
+ * Futexes let code on both sides of such a region sleep on a 32-bit
+ * word without any kernel object: futex_wait() blocks only if the word
+ * still holds the value the caller last saw, futex_wake() wakes
+ * sleepers on the same word. Waiters are keyed by the word's physical
+ * address, so two mappings of the same page meet on one key. Locks and
+ * rings built this way stay entirely in user space until one side
+ * actually has to wait.
+ */
+
+#ifndef OPENOS_SHM_H
+#define OPENOS_SHM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "ipc.h"
+#include "../process/process.h"
+
+#define SHM_MAX_SIZE     (64 * 4096)    /* 256 KiB per object */
+
+/* shm_open() flags */
+#define SHM_CREATE  0x1     /* create the object if the name is unused */
+#define SHM_EXCL    0x2     /* with SHM_CREATE: fail if it exists      */
+
+/* futex operations (SYS_FUTEX) */
+#define FUTEX_WAIT  0
+#define FUTEX_WAKE  1
+
+/* futex_wait() timeout meaning "no deadline", in milliseconds */
+#define FUTEX_FOREVER 0xFFFFFFFFu
+
+typedef struct shm_object {
+    ipc_object_t obj;       /* Handles: descriptors + attachments     */
+    uint8_t  *base;         /* First frame; zero-filled at creation   */
+    uint32_t  pages;
+    uint32_t  size;         /* Requested size in bytes                */
+} shm_object_t;
+
+typedef struct shm_stats {
+    uint32_t objects;       /* Live objects                           */
+    uint32_t pages;         /* Frames held by them                    */
+    uint32_t futex_waits;   /* futex_wait() calls that slept          */
+    uint32_t futex_wakes;   /* Processes woken by futex_wake()        */
+} shm_stats_t;
+
+/* Initialize the object cache and futex hash */
+void shm_init(void);
+
+/* Look up `name`, creating it with `size` bytes if SHM_CREATE is set.
+ * Returns the object with a handle taken, or NULL. */
+shm_object_t *shm_open(const char *name, size_t size, uint32_t flags);
+
+/* Drop a handle; the frames are freed with the last one. */
+void shm_put(shm_object_t *obj);
+
+/* Attach `obj` to process `p`. Returns the address the object is
+ * visible at, or NULL if `p` has no free mapping slot. Attaching an
+ * object twice returns the existing mapping. */
+void *shm_attach(process_t *p, shm_object_t *obj);
+
+/* Detach the object attached at `addr`. Returns 0 or -1. */
+int shm_detach(process_t *p, void *addr);
+
+/* After a PCB copy in fork(): the child shares every attachment. */
+void shm_fork(process_t *child);
+
+/* Detach everything (process exit / kill). */
+void shm_process_cleanup(process_t *p);
+
+/* Open an object and install it in the current process. Returns fd. */
+int shm_open_fd(const char *name, size_t size, uint32_t flags);
+
+/* The object behind a descriptor, or NULL if it is not one. */
+struct file;
+shm_object_t *shm_from_file(struct file *f);
+
+/* Sleep while *addr == val, for at most timeout_ms (FUTEX_FOREVER for
+ * no limit). Returns 0 when woken, -1 if the value had already changed,
+ * the wait timed out, or the caller cannot block. */
+int futex_wait(volatile uint32_t *addr, uint32_t val, uint32_t timeout_ms);
+
+/* Wake up to `count` processes sleeping on `addr`. Returns how many. */
+int futex_wake(volatile uint32_t *addr, int count);
+
+void shm_get_stats(shm_stats_t *stats);
+
+#endif /* OPENOS_SHM_H */
@@ -0,0 +1,229 @@
+/*
+ * OpenOS - Packet Buffers (sk_buff)
+ *
+ * A packet travels through the stack in an sk_buff: a small header
+ * (from a slab cache) describing bytes in one or more 2 KiB data
+ * buffers. The first buffer holds the linear part:
+ *
+ *      head          data               tail            end
+ *       |  headroom   |  linear bytes    |   tailroom    |  shared info
+ *
+ * Layers on the way down prepend their header with skb_push() into the
+ * headroom reserved at allocation, and layers on the way up strip theirs
+ * with skb_pull(), so a frame is never copied to add or remove a
+ * header. Payload that does not fit the linear part is carried in up to
+ * SKB_MAX_FRAGS fragments, each a (buffer, offset, size) slice; the
+ * e1000 sends linear part and fragments with one descriptor each.
+ *
+ * Data buffers are reference counted (the count lives in the shared
+ * info at the end of the buffer), so several sk_buffs may point into
+ * the same buffer, and sk_buffs themselves are reference counted with
+ * skb_get()/skb_free(). Buffers come from a pool of page halves with a
+ * per-CPU cache in front of it: the common allocate/free pair touches
+ * only the current CPU's array.
+ *
+ * A fragment may instead lend memory from outside the pool, through a
+ * reference-counted skb_ext: file content for sendfile, or a user buffer
+ * for a MSG_ZEROCOPY send. Fragments reach the bytes through the
+ * skb_ext's `data`, so its owner can move every reference at once onto
+ * a private copy (skb_ext_privatize()) before the memory changes.
+ *
+ * ip_summed says how far the transport checksum has got. A sender may
+ * leave it CHECKSUM_PARTIAL, with the pseudo-header sum in `csum` and
+ * the checksum field `csum_offset` bytes into the transport header;
+ * IP output finishes it unless the device needs none (loopback). A
+ * receiver skips verification for CHECKSUM_UNNECESSARY.
+ */
+
+#ifndef OPENOS_SKBUFF_H
+#define OPENOS_SKBUFF_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SKB_BUF_SIZE     2048       /* Data buffer, two per page frame     */
+#define SKB_SHINFO_SIZE  16         /* Shared info at the end of a buffer  */
+#define SKB_BUF_USABLE   (SKB_BUF_SIZE - SKB_SHINFO_SIZE)
+#define SKB_HEADROOM     128        /* Reserved for Ethernet + IP + TCP    */
+#define SKB_MAX_FRAGS    16
+
+#define SKB_PCPU_CACHE   32         /* Buffers cached per CPU              */
+#define SKB_PCPU_BATCH   16         /* Moved to/from the pool at a time    */
+#define SKB_POOL_MAX     2048       /* Buffers the pool may grow to (4 MiB) */
+
+/* sk_buff::ip_summed */
+#define CHECKSUM_NONE         0     /* Not computed / not yet verified     */
+#define CHECKSUM_PARTIAL      1     /* Output: still to be finished        */
+#define CHECKSUM_UNNECESSARY  2     /* Input: trusted, skip verification   */
+
+/* Memory lent to the stack from outside the buffer pool. The owner
+ * sets `data`, `len` and `release` and holds the first reference;
+ * `release` runs (interrupts disabled) when the last one is dropped,
+ * after any private copy has been freed. */
+typedef struct skb_ext {
+    uint8_t  *data;                 /* Lent bytes, or the private copy     */
+    uint32_t  len;
+    uint32_t  refs;
+    uint8_t  *copy;                 /* Private copy, once taken            */
+    void    (*release)(struct skb_ext *ext);
+} skb_ext_t;
+
+/* A slice of a data buffer (`buf`) or of lent memory (`ext`, with
+ * `buf` NULL); holds one reference on whichever it is. */
+typedef struct skb_frag {
+    uint8_t   *buf;
+    skb_ext_t *ext;
+    uint32_t   offset;
+    uint16_t   size;
+} skb_frag_t;
+
+struct net_device;
+
+typedef struct sk_buff {
+    struct sk_buff    *next;        /* Queue link                          */
+    struct net_device *dev;         /* Received on / to be sent on         */
+    uint8_t  *head;                 /* Linear data buffer                  */
+    uint8_t  *data;
+    uint8_t  *tail;
+    uint8_t  *end;
+    uint32_t  len;                  /* Linear + fragment bytes             */
+    uint32_t  data_len;             /* Fragment bytes                      */
+    uint16_t  protocol;             /* Ethertype, host order               */
+    uint16_t  nr_frags;
+    uint8_t   ip_summed;            /* CHECKSUM_*                          */
+    uint16_t  csum_offset;          /* CHECKSUM_PARTIAL: field position    */
+    uint32_t  csum;                 /* CHECKSUM_PARTIAL: pseudo-header sum */
+    uint32_t  hash;                 /* Flow hash (include/rss.h), 0: none  */
+    uint16_t  queue;                /* RX queue it arrived on              */
+    uint32_t  users;                /* References to this sk_buff          */
+    uint32_t  cb[4];                /* Scratch for the layer holding it    */
+    skb_frag_t frags[SKB_MAX_FRAGS];
+} sk_buff_t;
+
+/* FIFO of sk_buffs linked through sk_buff::next */
+typedef struct sk_buff_head {
+    sk_buff_t *head;
+    sk_buff_t *tail;
+    uint32_t   qlen;
+} sk_buff_head_t;
+
+typedef struct skb_stats {
+    uint32_t buffers;               /* Data buffers carved so far          */
+    uint32_t pool_free;             /* In the global pool                  */
+    uint32_t cached;                /* In per-CPU caches                   */
+    uint32_t skbs_in_use;           /* Live sk_buff headers                */
+    uint32_t cache_hits;            /* Allocations served by a CPU cache   */
+    uint32_t cache_refills;         /* Batches moved from the pool         */
+    uint32_t alloc_failures;
+} skb_stats_t;
+
+/* Set up the header cache; buffers are carved on demand. */
+void skb_init(void);
+
+/* A new sk_buff with an empty linear buffer and SKB_HEADROOM reserved,
+ * or NULL when out of memory. */
+sk_buff_t *skb_alloc(void);
+
+/* Take / drop a reference. The last skb_free() releases the buffers. */
+sk_buff_t *skb_get(sk_buff_t *skb);
+void skb_free(sk_buff_t *skb);
+
+/* Raw data buffers (SKB_BUF_USABLE bytes) for fragments. A buffer is
+ * returned to the pool when its last reference is dropped. */
+uint8_t *skb_buf_alloc(void);
+void skb_buf_get(uint8_t *buf);
+void skb_buf_put(uint8_t *buf);
+
+/* Take / drop a reference on lent memory */
+void skb_ext_get(skb_ext_t *ext);
+void skb_ext_put(skb_ext_t *ext);
+
+/* Copy the lent bytes and point every fragment at the copy, so the
+ * owner's memory is no longer referenced. Returns 0 (also if already
+ * private) or -1 when out of memory. Interrupts must be disabled. */
+int skb_ext_privatize(skb_ext_t *ext);
+
+static inline uint8_t *skb_frag_address(const skb_frag_t *f) {
+    return (f->ext ? f->ext->data : f->buf) + f->offset;
+}
+
+static inline uint32_t skb_headroom(const sk_buff_t *skb) {
+    return (uint32_t)(skb->data - skb->head);
+}
+
+static inline uint32_t skb_tailroom(const sk_buff_t *skb) {
+    return skb->nr_frags ? 0 : (uint32_t)(skb->end - skb->tail);
+}
+
+/* Bytes in the linear part */
+static inline uint32_t skb_headlen(const sk_buff_t *skb) {
+    return skb->len - skb->data_len;
+}
+
+/* Buffer memory the packet pins, for socket queue accounting */
+static inline uint32_t skb_truesize(const sk_buff_t *skb) {
+    return SKB_BUF_SIZE * (1u + skb->nr_frags);
+}
+
+/* Leave the transport checksum to IP output: the field `offset` bytes
+ * into the packet (data at the transport header) must be zero, and
+ * `sum` is the unfolded pseudo-header sum (0 if there is none). */
+static inline void skb_csum_partial_set(sk_buff_t *skb, uint16_t offset,
+                                        uint32_t sum) {
+    skb->ip_summed   = CHECKSUM_PARTIAL;
+    skb->csum_offset = offset;
+    skb->csum        = sum;
+}
+
+/* Move data and tail on by `n` in an empty sk_buff. */
+void skb_reserve(sk_buff_t *skb, uint32_t n);
+
+/* Extend the linear part at the tail / head by `n` bytes, returning
+ * the start of the new bytes, or NULL if there is not enough room. */
+uint8_t *skb_put(sk_buff_t *skb, uint32_t n);
+uint8_t *skb_push(sk_buff_t *skb, uint32_t n);
+
+/* Strip `n` bytes from the front of the linear part. Returns the new
+ * data pointer, or NULL if the linear part is shorter than `n`. */
+uint8_t *skb_pull(sk_buff_t *skb, uint32_t n);
+
+/* Cut the packet down to its first `len` bytes (e.g. to drop Ethernet
+ * padding), releasing fragments that fall entirely beyond it. */
+void skb_trim(sk_buff_t *skb, uint32_t len);
+
+/* Attach `size` bytes at buf+offset as the next fragment, taking over
+ * the caller's reference on `buf`. Returns 0 or -1 (no slot left). */
+int skb_add_frag(sk_buff_t *skb, uint8_t *buf, uint32_t offset, uint32_t size);
+
+/* Attach `size` bytes of lent memory from `offset` as the next
+ * fragment, taking a new reference on `ext`. Returns 0 or -1. */
+int skb_add_frag_ext(sk_buff_t *skb, skb_ext_t *ext, uint32_t offset,
+                     uint32_t size);
+
+/* Attach `size` bytes of another sk_buff's fragment `f`, from `offset`
+ * into it, taking a new reference on what it points into. */
+int skb_add_frag_ref(sk_buff_t *skb, const skb_frag_t *f, uint32_t offset,
+                     uint32_t size);
+
+/* Append `n` bytes: into the tailroom first, then into new fragment
+ * buffers. Returns 0, or -1 (and appends nothing) if they do not fit. */
+int skb_append_data(sk_buff_t *skb, const void *src, uint32_t n);
+
+/* The same, adding the bytes' one's complement sum (see checksum.h) to
+ * *sum at their offset in the packet, so data is read only once. */
+int skb_append_data_csum(sk_buff_t *skb, const void *src, uint32_t n,
+                         uint32_t *sum);
+
+/* Copy `n` bytes starting `offset` bytes into the packet, gathering
+ * across fragments. Returns 0 or -1 if the range is out of bounds. */
+int skb_copy_bits(const sk_buff_t *skb, uint32_t offset, void *to, uint32_t n);
+
+/* Queues; callers provide their own exclusion (interrupts off). */
+void skb_queue_init(sk_buff_head_t *q);
+void skb_queue_tail(sk_buff_head_t *q, sk_buff_t *skb);
+sk_buff_t *skb_dequeue(sk_buff_head_t *q);
+void skb_queue_purge(sk_buff_head_t *q);
+
+void skb_get_stats(skb_stats_t *stats);
+
+#endif /* OPENOS_SKBUFF_H */
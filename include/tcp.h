@@ -0,0 +1,247 @@
+/*
+ * OpenOS - TCP
+ *
+ * Connections are found by a hash of the 4-tuple; listeners by a hash
+ * of the local port. A listener answers a SYN with a SYN_RECV child
+ * that moves to its accept queue once the handshake completes, and
+ * refuses SYNs while children and queued connections reach the backlog.
+ *
+ * Send side: user writes are copied into a write queue of sk_buffs of
+ * at most one MSS each (small writes are coalesced into the last one
+ * while it is unsent). A segment is transmitted as a fresh sk_buff
+ * holding only the headers, with the queued payload attached as
+ * fragments, so neither the first transmission nor a retransmission
+ * copies data. Lent memory (sendfile, MSG_ZEROCOPY; see skbuff.h) is
+ * queued the same way but by reference, so it is never copied.
+ * Sending is bounded by the peer's window (with RFC 7323 window
+ * scaling) and by a NewReno congestion window: slow start, congestion
+ * avoidance, fast retransmit on three duplicate ACKs and fast
+ * recovery that repairs one hole per partial ACK. With SACK
+ * (RFC 2018) the sender also skips segments the peer already has and
+ * retransmits the next hole on every further duplicate ACK. Small
+ * segments are held back while data is in flight (Nagle) unless
+ * TCP_NODELAY is set.
+ *
+ * Receive side: in-order data goes to the receive queue, anything
+ * beyond a hole to an ordered out-of-order queue that is reported in
+ * SACK blocks. ACKs are delayed until every second full segment or
+ * TCP_DELACK_TICKS, except for out-of-order data and hole fills which
+ * are acknowledged at once. The advertised window never shrinks, and
+ * a reader freeing two segments' worth of space sends a window update.
+ *
+ * Retransmission, delayed-ACK, zero-window probe and TIME_WAIT timers
+ * live on the network timer wheel (net_timer_mod()); the RTO follows
+ * RFC 6298 with Karn's rule, in ticks.
+ *
+ * All connection state is touched with interrupts disabled: by the RX
+ * thread (input and timers) and by socket callers.
+ */
+
+#ifndef OPENOS_TCP_H
+#define OPENOS_TCP_H
+
+#include <stdint.h>
+#include "network.h"
+
+#define TCP_HLEN            20
+#define TCP_MAX_HLEN        60
+
+/* tcp_header_t::flags is (data offset << 12) | these, network order */
+#define TCP_FIN             0x01
+#define TCP_SYN             0x02
+#define TCP_RST             0x04
+#define TCP_PSH             0x08
+#define TCP_ACK             0x10
+
+#define TCP_HASH_SIZE       256     /* Connections, by 4-tuple        */
+#define TCP_LHASH_SIZE      32      /* Listeners, by port             */
+#define TCP_EPHEMERAL_MIN   49152
+#define TCP_EPHEMERAL_MAX   65535
+
+#define TCP_DEFAULT_MSS     536     /* When the peer sends no option  */
+#define TCP_SNDBUF          (128 * 1024)  /* Queued, unacked bytes    */
+#define TCP_RCVBUF          (256 * 1024)  /* Unread bytes             */
+#define TCP_MAX_SACK        4       /* Blocks sent in one ACK         */
+#define TCP_MAX_BACKLOG     64
+
+/* Timers, in ticks (10 ms) */
+#define TCP_RTO_INIT        100
+#define TCP_RTO_MIN         20
+#define TCP_RTO_MAX         6000
+#define TCP_DELACK_TICKS    4
+#define TCP_TIMEWAIT_TICKS  200     /* 2 * MSL, kept short             */
+#define TCP_FIN_TIMEOUT     6000    /* Orphans in FIN_WAIT2            */
+#define TCP_SYN_RETRIES     5
+#define TCP_MAX_RETRIES     10
+
+/* net_socket_setopt() options */
+#define TCP_NODELAY         1
+
+typedef enum {
+    TCP_CLOSED,
+    TCP_LISTEN,
+    TCP_SYN_SENT,
+    TCP_SYN_RECV,
+    TCP_ESTABLISHED,
+    TCP_FIN_WAIT1,
+    TCP_FIN_WAIT2,
+    TCP_CLOSING,
+    TCP_TIME_WAIT,
+    TCP_CLOSE_WAIT,
+    TCP_LAST_ACK,
+} tcp_state_t;
+
+typedef struct tcp_sock {
+    uint8_t          state;
+    uint8_t          nodelay;
+    uint8_t          sack_ok;           /* Both ends sent SACK-permitted  */
+    uint8_t          snd_wscale;        /* Shift for the peer's windows   */
+    uint8_t          rcv_wscale;        /* Shift for ours                 */
+    uint8_t          in_recovery;
+    uint8_t          rtt_timing;        /* rtt_seq is being timed         */
+    uint8_t          retries;           /* Consecutive timeouts           */
+    uint8_t          peer_fin;          /* End of the peer's stream seen  */
+    uint8_t          csum_copy;         /* Route needs checksums: sum
+                                         * payload as it is queued      */
+    int              error;             /* Reset or timed out             */
+    socket_t        *sk;                /* NULL once closed by the user   */
+    struct tcp_sock *parent;            /* Listener of a passive child    */
+    struct tcp_sock *hash_next;
+    in_addr_t        laddr, raddr;
+    uint16_t         lport, rport;      /* Host order                     */
+    uint16_t         mss;               /* Largest segment payload we send */
+
+    /* Send sequence space */
+    uint32_t         iss;
+    uint32_t         snd_una;
+    uint32_t         snd_nxt;
+    uint32_t         snd_max;           /* Highest sequence sent          */
+    uint32_t         snd_wnd;           /* Peer window, scaled            */
+    uint32_t         snd_wl1, snd_wl2;  /* Segment seq/ack of last update */
+    uint32_t         write_seq;         /* Next byte the user writes      */
+    sk_buff_head_t   write_queue;       /* Unacked, then unsent payload   */
+    sk_buff_t       *send_head;         /* First unsent entry, or NULL    */
+    uint32_t         wq_bytes;
+
+    /* Congestion control (bytes) */
+    uint32_t         cwnd;
+    uint32_t         ssthresh;
+    uint32_t         cwnd_acked;        /* Bytes acked toward next +MSS   */
+    uint32_t         dupacks;
+    uint32_t         recover;           /* snd_max when recovery began    */
+    uint32_t         high_sack;         /* Highest SACKed sequence        */
+
+    /* Round trip (ticks) */
+    uint32_t         srtt8;             /* Smoothed RTT << 3              */
+    uint32_t         rttvar4;           /* RTT variation << 2             */
+    uint32_t         rto;
+    uint32_t         rtt_seq;
+    uint64_t         rtt_start;
+
+    /* The same samples timed with the TSC, for reporting only: ticks
+     * are too coarse to tell a LAN round trip from a local one */
+    uint64_t         rtt_start_tsc;
+    uint32_t         srtt_cycles;       /* Smoothed, gain 1/8             */
+    uint32_t         rttvar_cycles;     /* Mean deviation, gain 1/4       */
+
+    uint32_t         retrans;           /* Segments sent again            */
+
+    /* Receive sequence space */
+    uint32_t         irs;
+    uint32_t         rcv_nxt;
+    uint32_t         rcv_adv;           /* Right edge we advertised       */
+    sk_buff_head_t   rcv_queue;         /* In order, unread               */
+    sk_buff_head_t   ooo_queue;         /* Beyond a hole, by sequence     */
+    uint32_t         rcv_bytes;         /* Payload on both queues         */
+    uint32_t         last_ooo_seq;      /* Its SACK block goes first      */
+    uint32_t         segs_unacked;      /* Full segments since last ACK   */
+    uint8_t          ack_pending;
+
+    /* Listener */
+    uint16_t         backlog;
+    uint16_t         syn_children;      /* In SYN_RECV                    */
+    struct tcp_sock *accept_head;       /* Established, not yet accepted  */
+    struct tcp_sock *accept_tail;
+    struct tcp_sock *accept_next;       /* Link on the parent's queue     */
+    uint32_t         accept_len;
+
+    wheel_timer_t    rto_timer;
+    wheel_timer_t    delack_timer;
+    wheel_timer_t    probe_timer;       /* Zero-window probe              */
+    wheel_timer_t    linger_timer;      /* TIME_WAIT and FIN_WAIT2        */
+    uint32_t         probe_backoff;
+} tcp_sock_t;
+
+typedef struct tcp_stats {
+    uint32_t active_opens;
+    uint32_t passive_opens;
+    uint32_t attempt_fails;             /* Refused, timed out, backlog full */
+    uint32_t estab_resets;
+    uint32_t in_segs;
+    uint32_t out_segs;
+    uint32_t in_errs;                   /* Bad header or checksum         */
+    uint32_t in_csum_errs;              /* ... of which checksum          */
+    uint32_t out_rsts;
+    uint32_t retrans_segs;
+    uint32_t fast_retrans;
+    uint32_t rto_timeouts;
+    uint32_t delayed_acks;              /* Sent by the delayed-ACK timer  */
+    uint32_t ooo_segs;
+    uint32_t sack_retrans;              /* Holes repaired from SACK info  */
+    uint32_t window_probes;
+} tcp_stats_t;
+
+void tcp_init(void);
+
+/* Socket layer entry points. Called with the socket open; blocking
+ * ones follow the socket's usual rules (MSG_DONTWAIT, process context).
+ * Return 0 / bytes, or -1. */
+int  tcp_attach(socket_t *sock);
+int  tcp_listen(socket_t *sock, int backlog);
+socket_t *tcp_accept(socket_t *sock, sockaddr_in_t *peer, uint32_t flags);
+int  tcp_connect(socket_t *sock, in_addr_t addr, uint16_t port);
+int  tcp_sendmsg(socket_t *sock, const void *data, size_t size, uint32_t flags);
+
+/* Send the first `size` bytes of `ext` without copying them; the write
+ * queue keeps references until they are acknowledged. */
+int  tcp_send_ext(socket_t *sock, skb_ext_t *ext, uint32_t size, uint32_t flags);
+
+/* Returns bytes read, 0 at end of stream, -1 on error or when nothing
+ * is available and the call may not block. */
+int  tcp_recvmsg(socket_t *sock, void *buffer, size_t size, uint32_t flags);
+int  tcp_setopt(socket_t *sock, int option, int value);
+
+/* EPOLLIN/EPOLLOUT/EPOLLHUP for the socket's connection */
+uint32_t tcp_poll(socket_t *sock);
+
+/* The last reference to the socket is gone: start an orderly close
+ * (or reset if unread data is discarded) and detach. */
+void tcp_release(socket_t *sock);
+
+const char *tcp_state_name(uint8_t state);
+
+/* One connection as netstat shows it. Queues are in bytes; the RTT is
+ * in TSC cycles (0 before the first sample) and the RTO in ticks. */
+typedef struct tcp_conn_info {
+    in_addr_t laddr, raddr;
+    uint16_t  lport, rport;
+    uint8_t   state;
+    uint8_t   orphan;                   /* Closed by the user, finishing  */
+    uint32_t  rcv_queued;               /* Received, not yet read         */
+    uint32_t  snd_queued;               /* Written, not yet acknowledged  */
+    uint32_t  in_flight;                /* Sent, not yet acknowledged     */
+    uint32_t  accept_len;               /* Listener: waiting for accept() */
+    uint32_t  srtt_cycles, rttvar_cycles;
+    uint32_t  rto;
+    uint32_t  cwnd, ssthresh, snd_wnd;
+    uint16_t  mss;
+    uint32_t  retrans;
+} tcp_conn_info_t;
+
+/* Copy up to `max` connections and listeners into `out`; returns how
+ * many. */
+int tcp_snapshot(tcp_conn_info_t *out, int max);
+
+void tcp_get_stats(tcp_stats_t *stats);
+
+#endif /* OPENOS_TCP_H */
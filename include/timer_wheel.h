@@ -0,0 +1,51 @@
+/*
+ * OpenOS - Hashed Timer Wheel
+ *
+ * Timers hash into TIMER_WHEEL_SLOTS buckets by expiry tick, so arming,
+ * re-arming and cancelling are O(1) and each tick only looks at one
+ * bucket. A timer further out than one revolution simply stays in its
+ * bucket until the wheel comes round to the right tick. The owner
+ * advances the wheel with timer_wheel_advance(); callbacks run from
+ * there with interrupts disabled, so they may safely touch state that
+ * is otherwise guarded by irq_save().
+ */
+
+#ifndef OPENOS_TIMER_WHEEL_H
+#define OPENOS_TIMER_WHEEL_H
+
+#include <stdint.h>
+
+#define TIMER_WHEEL_SLOTS   256         /* power of two */
+
+typedef struct wheel_timer {
+    struct wheel_timer  *next;
+    struct wheel_timer **pprev;         /* NULL when not armed */
+    uint64_t             expires;       /* Tick                */
+    void               (*fn)(void *data);
+    void                *data;
+} wheel_timer_t;
+
+typedef struct timer_wheel {
+    wheel_timer_t *slots[TIMER_WHEEL_SLOTS];
+    uint64_t       now;                 /* Last tick processed */
+    uint32_t       pending;             /* Armed timers        */
+} timer_wheel_t;
+
+void timer_wheel_init(timer_wheel_t *wheel, uint64_t now);
+
+void wheel_timer_init(wheel_timer_t *timer, void (*fn)(void *data), void *data);
+
+/* Arm (or re-arm) `timer` to fire at tick `expires`. */
+void timer_wheel_add(timer_wheel_t *wheel, wheel_timer_t *timer, uint64_t expires);
+
+/* Disarm; harmless if it is not armed. */
+void timer_wheel_del(timer_wheel_t *wheel, wheel_timer_t *timer);
+
+static inline int wheel_timer_pending(const wheel_timer_t *timer) {
+    return timer->pprev != 0;
+}
+
+/* Fire every timer due at or before `now`. */
+void timer_wheel_advance(timer_wheel_t *wheel, uint64_t now);
+
+#endif /* OPENOS_TIMER_WHEEL_H */
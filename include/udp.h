@@ -0,0 +1,72 @@
+/*
+ * OpenOS - UDP
+ *
+ * Bound sockets live in a hash table keyed on (local port, local
+ * address). A datagram for port P at address A goes to the socket bound
+ * to (P, A), or failing that to the one bound to (P, INADDR_ANY); both
+ * probes are a single bucket walk. Accepted datagrams are queued on the
+ * socket (net_socket_queue_rcv()) without copying.
+ */
+
+#ifndef OPENOS_UDP_H
+#define OPENOS_UDP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "network.h"
+
+#define UDP_HLEN            8
+#define UDP_HASH_SIZE       64          /* power of two */
+#define UDP_EPHEMERAL_MIN   49152
+#define UDP_EPHEMERAL_MAX   65535
+#define UDP_MAX_PAYLOAD     32768       /* What one sk_buff carries */
+
+typedef struct udp_stats {
+    uint32_t rx_datagrams;          /* Queued on a socket              */
+    uint32_t rx_no_port;            /* Nobody bound to the port        */
+    uint32_t rx_errors;             /* Short, bad length or checksum   */
+    uint32_t rx_csum_errors;        /* ... of which checksum           */
+    uint32_t rx_queue_drops;        /* Queue full, or socket filter    */
+    uint32_t tx_datagrams;
+    uint32_t tx_errors;             /* No route, no memory             */
+} udp_stats_t;
+
+/* Register with the IP layer. */
+void udp_init(void);
+
+/* Bind `sock` to (port, addr); port 0 picks a free ephemeral port.
+ * Returns 0, or -1 if the pair (or an overlapping wildcard) is taken or
+ * the socket is already bound. */
+int udp_bind(socket_t *sock, in_addr_t addr, uint16_t port);
+
+/* Remove `sock` from the port table (on close). */
+void udp_unbind(socket_t *sock);
+
+/* Send `size` bytes from `data` to dst:port, binding an ephemeral port
+ * first if needed. Returns `size` or -1. */
+int udp_sendto(socket_t *sock, const void *data, size_t size, in_addr_t dst,
+               uint16_t port);
+
+/* The same with the first `size` bytes of `ext` as the payload, sent
+ * by reference rather than copied. */
+int udp_sendto_ext(socket_t *sock, skb_ext_t *ext, uint32_t size, in_addr_t dst,
+                   uint16_t port);
+
+void udp_get_stats(udp_stats_t *stats);
+
+/* One bound socket as netstat shows it; queue sizes as charged
+ * against rcvbuf */
+typedef struct udp_sock_info {
+    in_addr_t laddr, raddr;
+    uint16_t  lport, rport;
+    uint32_t  rx_qlen;                  /* Datagrams waiting              */
+    uint32_t  rx_queued;                /* Their buffer bytes             */
+    uint32_t  rcvbuf;
+    uint32_t  rx_drops;
+    uint32_t  rx_filtered;
+} udp_sock_info_t;
+
+/* Copy up to `max` bound sockets into `out`; returns how many. */
+int udp_snapshot(udp_sock_info_t *out, int max);
+
+#endif /* OPENOS_UDP_H */
@@ -31,6 +31,36 @@ static inline int _syscall1(int num, uint32_t a1) {
     return ret;
 }
 
+static inline int _syscall3(int num, uint32_t a1, uint32_t a2, uint32_t a3) {
+    int ret;
+    __asm__ __volatile__("int $0x80"
+                         : "=a"(ret)
+                         : "a"(num), "b"(a1), "c"(a2), "d"(a3)
+                         : "memory");
+    return ret;
+}
+
+static inline int _syscall4(int num, uint32_t a1, uint32_t a2, uint32_t a3,
+                            uint32_t a4) {
+    int ret;
+    __asm__ __volatile__("int $0x80"
+                         : "=a"(ret)
+                         : "a"(num), "b"(a1), "c"(a2), "d"(a3), "S"(a4)
+                         : "memory");
+    return ret;
+}
+
+static inline int _syscall5(int num, uint32_t a1, uint32_t a2, uint32_t a3,
+                            uint32_t a4, uint32_t a5) {
+    int ret;
+    __asm__ __volatile__("int $0x80"
+                         : "=a"(ret)
+                         : "a"(num), "b"(a1), "c"(a2), "d"(a3), "S"(a4),
+                           "D"(a5)
+                         : "memory");
+    return ret;
+}
+
 static inline void u_exit(int code) {
     _syscall1(SYS_EXIT, (uint32_t)code);
     for (;;) { }   /* unreachable */
@@ -43,5 +73,191 @@ static inline int  u_fork(void)            { return _syscall0(SYS_FORK); }
 static inline int  u_yield(void)           { return _syscall0(SYS_YIELD); }
 static inline int  u_sleep(uint32_t ms)    { return _syscall1(SYS_SLEEP, ms); }
 static inline int  u_wait(int *status)     { return _syscall1(SYS_WAIT, (uint32_t)status); }
+static inline int  u_pipe(int fds[2])      { return _syscall1(SYS_PIPE, (uint32_t)fds); }
+static inline int  u_close(int fd)         { return _syscall1(SYS_CLOSE, (uint32_t)fd); }
+
+static inline int u_read(int fd, void *buf, uint32_t n) {
+    return _syscall3(SYS_READ, (uint32_t)fd, (uint32_t)buf, n);
+}
+
+static inline int u_writefd(int fd, const void *buf, uint32_t n) {
+    return _syscall3(SYS_WRITEFD, (uint32_t)fd, (uint32_t)buf, n);
+}
+
+static inline int u_vmsplice(int fd, sys_iovec_t *iov, uint32_t flags) {
+    return _syscall3(SYS_VMSPLICE, (uint32_t)fd, (uint32_t)iov, flags);
+}
+
+static inline int u_mq_open(uint32_t arena, uint32_t max_msg) {
+    return _syscall3(SYS_MQ_OPEN, arena, max_msg, 0);
+}
+
+/* Open the queue called `name`, creating it if nobody has yet. */
+static inline int u_mq_open_named(const char *name, uint32_t arena,
+                                  uint32_t max_msg) {
+    return _syscall3(SYS_MQ_OPEN, arena, max_msg, (uint32_t)name);
+}
+
+static inline int u_mq_send(int fd, const sys_msg_t *m) {
+    return _syscall3(SYS_MQ_SEND, (uint32_t)fd, (uint32_t)m, 0);
+}
+
+static inline int u_mq_recv(int fd, sys_msg_t *m) {
+    return _syscall3(SYS_MQ_RECV, (uint32_t)fd, (uint32_t)m, 0);
+}
+
+static inline int u_ipc_open(void) { return _syscall1(SYS_IPC_OPEN, 0); }
+
+static inline int u_ipc_open_named(const char *name) {
+    return _syscall1(SYS_IPC_OPEN, (uint32_t)name);
+}
+
+/* Synchronous IPC: the four message words travel in ECX/EDX/ESI/EDI
+ * and are replaced in place by the reply / next request. */
+static inline int _syscall_ipc(int num, int fd, uint32_t w[4]) {
+    int ret;
+    __asm__ __volatile__("int $0x80"
+                         : "=a"(ret), "+c"(w[0]), "+d"(w[1]),
+                           "+S"(w[2]), "+D"(w[3])
+                         : "0"(num), "b"(fd)
+                         : "memory");
+    return ret;
+}
+
+static inline int u_ipc_call(int fd, uint32_t w[4]) {
+    return _syscall_ipc(SYS_IPC_CALL, fd, w);
+}
+
+static inline int u_ipc_reply_wait(int fd, uint32_t w[4]) {
+    return _syscall_ipc(SYS_IPC_REPLY_WAIT, fd, w);
+}
+
+/* Shared memory: open (or create) a named object, then map it. */
+static inline int u_shm_open(const char *name, uint32_t size, uint32_t flags) {
+    return _syscall3(SYS_SHM_OPEN, (uint32_t)name, size, flags);
+}
+
+static inline void *u_shm_map(int fd) {
+    int addr = _syscall1(SYS_SHM_MAP, (uint32_t)fd);
+    return (addr == -1) ? (void *)0 : (void *)addr;
+}
+
+static inline int u_shm_unmap(void *addr) {
+    return _syscall1(SYS_SHM_UNMAP, (uint32_t)addr);
+}
+
+/* Futexes: sleep while *addr == val / wake up to `count` sleepers. */
+static inline int u_futex_wait(volatile uint32_t *addr, uint32_t val,
+                               uint32_t timeout_ms) {
+    return _syscall4(SYS_FUTEX, (uint32_t)addr, 0 /* FUTEX_WAIT */, val,
+                     timeout_ms);
+}
+
+static inline int u_futex_wake(volatile uint32_t *addr, int count) {
+    return _syscall4(SYS_FUTEX, (uint32_t)addr, 1 /* FUTEX_WAKE */,
+                     (uint32_t)count, 0);
+}
+
+/* Event polling: epoll_event_t and the EPOLL* bits are in epoll.h. */
+struct epoll_event;
+
+static inline int u_epoll_create(void) { return _syscall0(SYS_EPOLL_CREATE); }
+
+static inline int u_epoll_ctl(int epfd, int op, int fd,
+                              struct epoll_event *ev) {
+    return _syscall4(SYS_EPOLL_CTL, (uint32_t)epfd, (uint32_t)op,
+                     (uint32_t)fd, (uint32_t)ev);
+}
+
+static inline int u_epoll_wait(int epfd, struct epoll_event *events, int max,
+                               uint32_t timeout_ms) {
+    return _syscall4(SYS_EPOLL_WAIT, (uint32_t)epfd, (uint32_t)events,
+                     (uint32_t)max, timeout_ms);
+}
+
+/* Line-at-a-time keyboard input as a descriptor. */
+static inline int u_kbd_open(void) { return _syscall1(SYS_KBD_OPEN, 0); }
+
+/* The same with KBD_* flags: KBD_OPEN_EVENTS for key_event_t records,
+ * KBD_GRAB, KBD_NONBLOCK. */
+static inline int u_kbd_open_flags(uint32_t flags) {
+    return _syscall1(SYS_KBD_OPEN, flags);
+}
+
+static inline int u_socket(int protocol) {
+    return _syscall1(SYS_SOCKET, (uint32_t)protocol);
+}
+
+/* UDP: sockaddr_in_t and net_mmsg_t are in network.h; port 0 binds an
+ * ephemeral port, addr 0 every local address. */
+struct sockaddr_in;
+struct net_mmsg;
+
+static inline int u_bind(int fd, uint16_t port, uint32_t addr) {
+    return _syscall3(SYS_BIND, (uint32_t)fd, port, addr);
+}
+
+static inline int u_sendto(int fd, const void *buf, uint32_t len,
+                           const struct sockaddr_in *to) {
+    return _syscall5(SYS_SENDTO, (uint32_t)fd, (uint32_t)buf, len,
+                     (uint32_t)to, 0);
+}
+
+/* Send on a connected socket with MSG_* flags (MSG_ZEROCOPY: the buffer
+ * must stay unchanged until u_getsockopt(fd, SO_ZEROCOPY_DONE) counts
+ * the send as complete). */
+static inline int u_send(int fd, const void *buf, uint32_t len,
+                         uint32_t flags) {
+    return _syscall5(SYS_SENDTO, (uint32_t)fd, (uint32_t)buf, len, 0, flags);
+}
+
+static inline int u_recvfrom(int fd, void *buf, uint32_t len,
+                             struct sockaddr_in *from, uint32_t flags) {
+    return _syscall5(SYS_RECVFROM, (uint32_t)fd, (uint32_t)buf, len,
+                     (uint32_t)from, flags);
+}
+
+static inline int u_sendmmsg(int fd, struct net_mmsg *msgs, int count,
+                             uint32_t flags) {
+    return _syscall4(SYS_SENDMMSG, (uint32_t)fd, (uint32_t)msgs,
+                     (uint32_t)count, flags);
+}
+
+static inline int u_recvmmsg(int fd, struct net_mmsg *msgs, int count,
+                             uint32_t flags) {
+    return _syscall4(SYS_RECVMMSG, (uint32_t)fd, (uint32_t)msgs,
+                     (uint32_t)count, flags);
+}
+
+/* TCP: read/write move stream data; read returns 0 at end of stream. */
+static inline int u_listen(int fd, int backlog) {
+    return _syscall3(SYS_LISTEN, (uint32_t)fd, (uint32_t)backlog, 0);
+}
+
+static inline int u_accept(int fd, struct sockaddr_in *peer, uint32_t flags) {
+    return _syscall3(SYS_ACCEPT, (uint32_t)fd, (uint32_t)peer, flags);
+}
+
+static inline int u_connect(int fd, uint32_t addr, uint16_t port) {
+    return _syscall3(SYS_CONNECT, (uint32_t)fd, addr, port);
+}
+
+/* SO_ATTACH_FILTER takes a const bpf_fprog_t* (include/bpf.h) as the
+ * value, cast to int. */
+static inline int u_setsockopt(int fd, int option, int value) {
+    return _syscall3(SYS_SETSOCKOPT, (uint32_t)fd, (uint32_t)option,
+                     (uint32_t)value);
+}
+
+static inline int u_getsockopt(int fd, int option) {
+    return _syscall3(SYS_GETSOCKOPT, (uint32_t)fd, (uint32_t)option, 0);
+}
+
+/* Send part of a ramfs file on a socket without copying it */
+static inline int u_sendfile(int fd, const char *path, uint32_t offset,
+                             uint32_t count) {
+    return _syscall4(SYS_SENDFILE, (uint32_t)fd, (uint32_t)path, offset,
+                     count);
+}
 
 #endif /* OPENOS_INCLUDE_USYSCALL_H */
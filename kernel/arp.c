@@ -0,0 +1,266 @@
+/*
+ * OpenOS - ARP Implementation
+ *
+ * The cache is touched from the RX thread (replies, timers) and from
+ * whoever sends (the shell, socket callers), so every walk of it runs
+ * with interrupts disabled. Entries come from a slab cache.
+ */
+
+#include "arp.h"
+#include "string.h"
+#include "../memory/slab.h"
+#include "../drivers/timer.h"
+#include "../arch/x86/cpu.h"
+
+static slab_t      *neigh_slab;
+static neighbour_t *neigh_table[ARP_HASH_SIZE];
+static arp_stats_t  arp_stats;
+
+static const mac_addr_t mac_broadcast = { { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF } };
+
+void arp_init(void) {
+    neigh_slab = slab_create(sizeof(neighbour_t));
+}
+
+static uint32_t neigh_hash(in_addr_t ip) {
+    return (ip * 2654435761u) >> (32 - 5);
+}
+
+static neighbour_t *neigh_lookup(in_addr_t ip) {
+    for (neighbour_t *n = neigh_table[neigh_hash(ip)]; n; n = n->next) {
+        if (n->ip == ip) return n;
+    }
+    return NULL;
+}
+
+static void neigh_unlink(neighbour_t *n) {
+    neighbour_t **link = &neigh_table[neigh_hash(n->ip)];
+    while (*link && *link != n) link = &(*link)->next;
+    if (*link) *link = n->next;
+}
+
+static void neigh_destroy(neighbour_t *n) {
+    neigh_unlink(n);
+    arp_stats.pending_drops += n->pending.qlen;
+    skb_queue_purge(&n->pending);
+    slab_free(neigh_slab, n);
+    arp_stats.entries--;
+}
+
+/* Make room by dropping the resolved entry used longest ago. */
+static int neigh_evict(void) {
+    neighbour_t *victim = NULL;
+    for (int i = 0; i < ARP_HASH_SIZE; i++) {
+        for (neighbour_t *n = neigh_table[i]; n; n = n->next) {
+            if (n->state == NUD_INCOMPLETE) continue;
+            if (!victim || n->used < victim->used) victim = n;
+        }
+    }
+    if (!victim) return -1;
+    neigh_destroy(victim);
+    return 0;
+}
+
+static neighbour_t *neigh_create(net_device_t *dev, in_addr_t ip, uint8_t state) {
+    if (arp_stats.entries >= ARP_MAX_ENTRIES && neigh_evict() < 0) return NULL;
+
+    neighbour_t *n = (neighbour_t *)slab_alloc(neigh_slab);
+    if (!n) return NULL;
+
+    uint64_t now = timer_get_ticks();
+    memset(n, 0, sizeof(*n));
+    n->dev       = dev;
+    n->ip        = ip;
+    n->state     = state;
+    n->confirmed = now;
+    n->used      = now;
+    skb_queue_init(&n->pending);
+
+    uint32_t h = neigh_hash(ip);
+    n->next = neigh_table[h];
+    neigh_table[h] = n;
+    arp_stats.entries++;
+    return n;
+}
+
+static void arp_send(net_device_t *dev, uint16_t op, const mac_addr_t *tha,
+                     in_addr_t tpa) {
+    sk_buff_t *skb = skb_alloc();
+    if (!skb) return;
+
+    arp_header_t *arp = (arp_header_t *)skb_put(skb, sizeof(arp_header_t));
+    arp->htype = htons(1);
+    arp->ptype = htons(ETH_P_IP);
+    arp->hlen  = MAC_ADDR_LEN;
+    arp->plen  = IP_ADDR_LEN;
+    arp->op    = htons(op);
+    arp->sha   = dev->mac;
+    arp->spa   = ip_to_in(&dev->ip);
+    memset(&arp->tha, 0, sizeof(arp->tha));
+    if (op == ARP_OP_REPLY) arp->tha = *tha;
+    arp->tpa   = tpa;
+
+    if (op == ARP_OP_REQUEST) arp_stats.requests_sent++;
+    else                      arp_stats.replies_sent++;
+    net_eth_output(dev, skb, (op == ARP_OP_REQUEST) ? &mac_broadcast : tha,
+                   ETH_P_ARP);
+}
+
+static void neigh_probe(neighbour_t *n) {
+    n->probes++;
+    n->probed = timer_get_ticks();
+    arp_send(n->dev, ARP_OP_REQUEST, NULL, n->ip);
+}
+
+/* The address is known: record it and release the waiting packets. */
+static void neigh_confirm(neighbour_t *n, const mac_addr_t *mac) {
+    n->mac       = *mac;
+    n->state     = NUD_REACHABLE;
+    n->probes    = 0;
+    n->confirmed = timer_get_ticks();
+
+    sk_buff_t *skb;
+    while ((skb = skb_dequeue(&n->pending)) != NULL) {
+        net_eth_output(n->dev, skb, &n->mac, ETH_P_IP);
+    }
+}
+
+void arp_input(net_device_t *dev, sk_buff_t *skb) {
+    if (skb->len < sizeof(arp_header_t)) {
+        skb_free(skb);
+        return;
+    }
+
+    const arp_header_t *arp = (const arp_header_t *)skb->data;
+    in_addr_t self = ip_to_in(&dev->ip);
+    if (arp->htype != htons(1) || arp->ptype != htons(ETH_P_IP) ||
+        arp->hlen != MAC_ADDR_LEN || arp->plen != IP_ADDR_LEN ||
+        arp->spa == INADDR_ANY) {
+        skb_free(skb);
+        return;
+    }
+
+    uint32_t irq = irq_save();
+
+    /* Refresh what we know about the sender; learn it only if the
+     * packet was meant for us (it is about to talk to us anyway). */
+    neighbour_t *n = neigh_lookup(arp->spa);
+    if (n) {
+        neigh_confirm(n, &arp->sha);
+    } else if (arp->tpa == self) {
+        n = neigh_create(dev, arp->spa, NUD_REACHABLE);
+        if (n) n->mac = arp->sha;
+    }
+
+    if (arp->op == htons(ARP_OP_REQUEST) && arp->tpa == self) {
+        arp_send(dev, ARP_OP_REPLY, &arp->sha, arp->spa);
+    }
+
+    irq_restore(irq);
+    skb_free(skb);
+}
+
+/* Directed broadcast of the device's subnet, or the limited one */
+static int arp_is_broadcast(net_device_t *dev, in_addr_t ip) {
+    in_addr_t mask = ip_to_in(&dev->netmask);
+    return ip == INADDR_BROADCAST ||
+           (mask != INADDR_BROADCAST && ip == (ip_to_in(&dev->ip) | ~mask));
+}
+
+int arp_output(net_device_t *dev, sk_buff_t *skb, in_addr_t next_hop) {
+    if (arp_is_broadcast(dev, next_hop)) {
+        return net_eth_output(dev, skb, &mac_broadcast, ETH_P_IP);
+    }
+
+    uint32_t irq = irq_save();
+    uint64_t now = timer_get_ticks();
+    neighbour_t *n = neigh_lookup(next_hop);
+    arp_stats.lookups++;
+
+    if (n && n->state != NUD_INCOMPLETE) {
+        mac_addr_t mac = n->mac;
+        n->used = now;
+        if (n->state == NUD_STALE && now - n->probed >= ARP_RETRY_TICKS) {
+            neigh_probe(n);         /* keep using it while we ask again */
+        }
+        irq_restore(irq);
+        return net_eth_output(dev, skb, &mac, ETH_P_IP);
+    }
+
+    arp_stats.misses++;
+    if (!n) {
+        n = neigh_create(dev, next_hop, NUD_INCOMPLETE);
+        if (!n) {
+            irq_restore(irq);
+            arp_stats.pending_drops++;
+            skb_free(skb);
+            return -1;
+        }
+    }
+
+    if (n->pending.qlen >= ARP_MAX_PENDING) {
+        skb_free(skb_dequeue(&n->pending));     /* oldest goes */
+        arp_stats.pending_drops++;
+    }
+    skb_queue_tail(&n->pending, skb);
+    if (n->probes == 0) neigh_probe(n);
+
+    irq_restore(irq);
+    return 0;
+}
+
+void arp_timer(void) {
+    uint32_t irq = irq_save();
+    uint64_t now = timer_get_ticks();
+
+    for (int i = 0; i < ARP_HASH_SIZE; i++) {
+        neighbour_t *n = neigh_table[i];
+        while (n) {
+            neighbour_t *next = n->next;
+            switch (n->state) {
+            case NUD_INCOMPLETE:
+                if (now - n->probed < ARP_RETRY_TICKS) break;
+                if (n->probes >= ARP_MAX_PROBES) neigh_destroy(n);   /* unreachable */
+                else                             neigh_probe(n);
+                break;
+            case NUD_REACHABLE:
+                if (now - n->confirmed >= ARP_REACHABLE_TICKS) n->state = NUD_STALE;
+                break;
+            case NUD_STALE:
+                if (now - n->used >= ARP_GC_TICKS &&
+                    now - n->confirmed >= ARP_GC_TICKS) {
+                    neigh_destroy(n);
+                }
+                break;
+            }
+            n = next;
+        }
+    }
+    irq_restore(irq);
+}
+
+int arp_snapshot(arp_entry_info_t *out, int max) {
+    int count = 0;
+    uint32_t irq = irq_save();
+    uint64_t now = timer_get_ticks();
+
+    for (int i = 0; i < ARP_HASH_SIZE && count < max; i++) {
+        for (neighbour_t *n = neigh_table[i]; n && count < max; n = n->next) {
+            arp_entry_info_t *e = &out[count++];
+            e->ip        = n->ip;
+            e->mac       = n->mac;
+            e->state     = n->state;
+            e->age_ticks = (uint32_t)(now - n->confirmed);
+            e->pending   = n->pending.qlen;
+        }
+    }
+    irq_restore(irq);
+    return count;
+}
+
+void arp_get_stats(arp_stats_t *stats) {
+    if (!stats) return;
+    uint32_t irq = irq_save();
+    *stats = arp_stats;
+    irq_restore(irq);
+}
@@ -0,0 +1,664 @@
+/*
+ * OpenOS - Packet Filter Implementation
+ */
+
+#include "bpf.h"
+#include "../memory/heap.h"
+
+int bpf_jit_enable = 1;
+
+/* ------------------------------------------------------------------ */
+/* Verifier                                                             */
+/* ------------------------------------------------------------------ */
+
+static int valid_opcode(uint16_t code) {
+    switch (code) {
+        case BPF_LD | BPF_W | BPF_ABS:
+        case BPF_LD | BPF_H | BPF_ABS:
+        case BPF_LD | BPF_B | BPF_ABS:
+        case BPF_LD | BPF_W | BPF_IND:
+        case BPF_LD | BPF_H | BPF_IND:
+        case BPF_LD | BPF_B | BPF_IND:
+        case BPF_LD | BPF_IMM:
+        case BPF_LD | BPF_MEM:
+        case BPF_LD | BPF_W | BPF_LEN:
+        case BPF_LDX | BPF_IMM:
+        case BPF_LDX | BPF_MEM:
+        case BPF_LDX | BPF_W | BPF_LEN:
+        case BPF_LDX | BPF_B | BPF_MSH:
+        case BPF_ST:
+        case BPF_STX:
+        case BPF_ALU | BPF_NEG:
+        case BPF_JMP | BPF_JA:
+        case BPF_RET | BPF_K:
+        case BPF_RET | BPF_A:
+        case BPF_MISC | BPF_TAX:
+        case BPF_MISC | BPF_TXA:
+            return 1;
+    }
+    if (BPF_CLASS(code) == BPF_ALU && !(code & ~0xFFu)) {
+        return BPF_OP(code) <= BPF_XOR && BPF_OP(code) != BPF_NEG;
+    }
+    if (BPF_CLASS(code) == BPF_JMP && !(code & ~0xFFu)) {
+        return BPF_OP(code) >= BPF_JEQ && BPF_OP(code) <= BPF_JSET;
+    }
+    return 0;
+}
+
+/*
+ * Jumps only go forward, so one pass in order sees every path into an
+ * instruction before the instruction itself. init[pc] collects the
+ * scratch words written on every path to pc; reading any other one is
+ * an error, which spares the machine clearing them.
+ */
+int bpf_check(const bpf_insn_t* insns, uint32_t len) {
+    if (!insns || len == 0 || len > BPF_MAXINSNS) return -1;
+
+    uint16_t init[BPF_MAXINSNS];
+    for (uint32_t i = 0; i < len; i++) init[i] = 0xFFFF;
+    init[0] = 0;
+
+    for (uint32_t pc = 0; pc < len; pc++) {
+        const bpf_insn_t* in = &insns[pc];
+        uint16_t code = in->code;
+        uint16_t m = init[pc];
+        if (!valid_opcode(code)) return -1;
+
+        switch (BPF_CLASS(code)) {
+            case BPF_LD:
+            case BPF_LDX:
+                if (BPF_MODE(code) == BPF_MEM &&
+                    (in->k >= BPF_MEMWORDS || !(m & (1u << in->k)))) {
+                    return -1;
+                }
+                break;
+            case BPF_ST:
+            case BPF_STX:
+                if (in->k >= BPF_MEMWORDS) return -1;
+                m |= (uint16_t)(1u << in->k);
+                break;
+            case BPF_ALU:
+                if (BPF_SRC(code) == BPF_K) {
+                    if ((BPF_OP(code) == BPF_DIV || BPF_OP(code) == BPF_MOD) &&
+                        in->k == 0) {
+                        return -1;
+                    }
+                    if ((BPF_OP(code) == BPF_LSH || BPF_OP(code) == BPF_RSH) &&
+                        in->k >= 32) {
+                        return -1;
+                    }
+                }
+                break;
+            case BPF_JMP:
+                if (BPF_OP(code) == BPF_JA) {
+                    if (in->k >= len - pc - 1) return -1;
+                    init[pc + 1 + in->k] &= m;
+                } else {
+                    if (pc + 1 + in->jt >= len || pc + 1 + in->jf >= len) return -1;
+                    init[pc + 1 + in->jt] &= m;
+                    init[pc + 1 + in->jf] &= m;
+                }
+                continue;
+            case BPF_RET:
+                continue;
+        }
+        if (pc + 1 == len) return -1;       /* falls off the end */
+        init[pc + 1] &= m;
+    }
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* Interpreter                                                          */
+/* ------------------------------------------------------------------ */
+
+static inline uint32_t get_be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | p[3];
+}
+
+/* A load beyond the linear part: from the fragments, if it is inside
+ * the packet at all */
+static int load_slow(const sk_buff_t* skb, uint32_t off, uint32_t size,
+                     uint32_t* v) {
+    uint8_t b[4];
+    if (skb_copy_bits(skb, off, b, size) < 0) return -1;
+    if (size == 4)      *v = get_be32(b);
+    else if (size == 2) *v = ((uint32_t)b[0] << 8) | b[1];
+    else                *v = b[0];
+    return 0;
+}
+
+uint32_t bpf_prog_run_interp(const bpf_prog_t* prog, const sk_buff_t* skb) {
+    /* Only verified programs get here, so every opcode has an entry */
+    static const void* const op[256] = {
+        [BPF_LD | BPF_W | BPF_ABS]      = &&ld_w_abs,
+        [BPF_LD | BPF_H | BPF_ABS]      = &&ld_h_abs,
+        [BPF_LD | BPF_B | BPF_ABS]      = &&ld_b_abs,
+        [BPF_LD | BPF_W | BPF_IND]      = &&ld_w_ind,
+        [BPF_LD | BPF_H | BPF_IND]      = &&ld_h_ind,
+        [BPF_LD | BPF_B | BPF_IND]      = &&ld_b_ind,
+        [BPF_LD | BPF_IMM]              = &&ld_imm,
+        [BPF_LD | BPF_MEM]              = &&ld_mem,
+        [BPF_LD | BPF_W | BPF_LEN]      = &&ld_len,
+        [BPF_LDX | BPF_IMM]             = &&ldx_imm,
+        [BPF_LDX | BPF_MEM]             = &&ldx_mem,
+        [BPF_LDX | BPF_W | BPF_LEN]     = &&ldx_len,
+        [BPF_LDX | BPF_B | BPF_MSH]     = &&ldx_msh,
+        [BPF_ST]                        = &&st,
+        [BPF_STX]                       = &&stx,
+        [BPF_ALU | BPF_ADD | BPF_K]     = &&add_k,
+        [BPF_ALU | BPF_SUB | BPF_K]     = &&sub_k,
+        [BPF_ALU | BPF_MUL | BPF_K]     = &&mul_k,
+        [BPF_ALU | BPF_DIV | BPF_K]     = &&div_k,
+        [BPF_ALU | BPF_MOD | BPF_K]     = &&mod_k,
+        [BPF_ALU | BPF_OR | BPF_K]      = &&or_k,
+        [BPF_ALU | BPF_AND | BPF_K]     = &&and_k,
+        [BPF_ALU | BPF_XOR | BPF_K]     = &&xor_k,
+        [BPF_ALU | BPF_LSH | BPF_K]     = &&lsh_k,
+        [BPF_ALU | BPF_RSH | BPF_K]     = &&rsh_k,
+        [BPF_ALU | BPF_ADD | BPF_X]     = &&add_x,
+        [BPF_ALU | BPF_SUB | BPF_X]     = &&sub_x,
+        [BPF_ALU | BPF_MUL | BPF_X]     = &&mul_x,
+        [BPF_ALU | BPF_DIV | BPF_X]     = &&div_x,
+        [BPF_ALU | BPF_MOD | BPF_X]     = &&mod_x,
+        [BPF_ALU | BPF_OR | BPF_X]      = &&or_x,
+        [BPF_ALU | BPF_AND | BPF_X]     = &&and_x,
+        [BPF_ALU | BPF_XOR | BPF_X]     = &&xor_x,
+        [BPF_ALU | BPF_LSH | BPF_X]     = &&lsh_x,
+        [BPF_ALU | BPF_RSH | BPF_X]     = &&rsh_x,
+        [BPF_ALU | BPF_NEG]             = &&neg,
+        [BPF_JMP | BPF_JA]              = &&ja,
+        [BPF_JMP | BPF_JEQ | BPF_K]     = &&jeq_k,
+        [BPF_JMP | BPF_JGT | BPF_K]     = &&jgt_k,
+        [BPF_JMP | BPF_JGE | BPF_K]     = &&jge_k,
+        [BPF_JMP | BPF_JSET | BPF_K]    = &&jset_k,
+        [BPF_JMP | BPF_JEQ | BPF_X]     = &&jeq_x,
+        [BPF_JMP | BPF_JGT | BPF_X]     = &&jgt_x,
+        [BPF_JMP | BPF_JGE | BPF_X]     = &&jge_x,
+        [BPF_JMP | BPF_JSET | BPF_X]    = &&jset_x,
+        [BPF_RET | BPF_K]               = &&ret_k,
+        [BPF_RET | BPF_A]               = &&ret_a,
+        [BPF_MISC | BPF_TAX]            = &&tax,
+        [BPF_MISC | BPF_TXA]            = &&txa,
+    };
+
+    const bpf_insn_t* pc = prog->insns;
+    const uint8_t* data = skb->data;
+    uint32_t headlen = skb_headlen(skb);
+    uint32_t A = 0, X = 0, off;
+    uint32_t mem[BPF_MEMWORDS];
+
+/* The verifier guarantees a valid opcode and that no instruction falls
+ * off the end, so each handler jumps straight to the next one */
+#define NEXT            do { pc++; goto *op[pc->code]; } while (0)
+#define JUMP(cond)      do { pc += (cond) ? pc->jt : pc->jf; NEXT; } while (0)
+
+    goto *op[pc->code];
+
+ld_w_abs:
+    off = pc->k;
+    goto ld_w;
+ld_w_ind:
+    off = X + pc->k;
+    if (off < X) return 0;
+ld_w:
+    if (off < headlen && headlen - off >= 4) A = get_be32(data + off);
+    else if (load_slow(skb, off, 4, &A) < 0) return 0;
+    NEXT;
+ld_h_abs:
+    off = pc->k;
+    goto ld_h;
+ld_h_ind:
+    off = X + pc->k;
+    if (off < X) return 0;
+ld_h:
+    if (off < headlen && headlen - off >= 2) A = ((uint32_t)data[off] << 8) | data[off + 1];
+    else if (load_slow(skb, off, 2, &A) < 0) return 0;
+    NEXT;
+ld_b_abs:
+    off = pc->k;
+    goto ld_b;
+ld_b_ind:
+    off = X + pc->k;
+    if (off < X) return 0;
+ld_b:
+    if (off < headlen) A = data[off];
+    else if (load_slow(skb, off, 1, &A) < 0) return 0;
+    NEXT;
+ldx_msh:
+    off = pc->k;
+    if (off < headlen) X = data[off];
+    else if (load_slow(skb, off, 1, &X) < 0) return 0;
+    X = (X & 0xF) << 2;
+    NEXT;
+ld_imm:     A = pc->k;              NEXT;
+ld_mem:     A = mem[pc->k];         NEXT;
+ld_len:     A = skb->len;           NEXT;
+ldx_imm:    X = pc->k;              NEXT;
+ldx_mem:    X = mem[pc->k];         NEXT;
+ldx_len:    X = skb->len;           NEXT;
+st:         mem[pc->k] = A;         NEXT;
+stx:        mem[pc->k] = X;         NEXT;
+
+add_k:      A += pc->k;             NEXT;
+sub_k:      A -= pc->k;             NEXT;
+mul_k:      A *= pc->k;             NEXT;
+div_k:      A /= pc->k;             NEXT;
+mod_k:      A %= pc->k;             NEXT;
+or_k:       A |= pc->k;             NEXT;
+and_k:      A &= pc->k;             NEXT;
+xor_k:      A ^= pc->k;             NEXT;
+lsh_k:      A <<= pc->k;            NEXT;
+rsh_k:      A >>= pc->k;            NEXT;
+add_x:      A += X;                 NEXT;
+sub_x:      A -= X;                 NEXT;
+mul_x:      A *= X;                 NEXT;
+div_x:      if (!X) return 0; A /= X; NEXT;
+mod_x:      if (!X) return 0; A %= X; NEXT;
+or_x:       A |= X;                 NEXT;
+and_x:      A &= X;                 NEXT;
+xor_x:      A ^= X;                 NEXT;
+lsh_x:      A <<= X & 31;           NEXT;   /* counts modulo 32, as on x86 */
+rsh_x:      A >>= X & 31;           NEXT;
+neg:        A = -A;                 NEXT;
+
+ja:         pc += pc->k;            NEXT;
+jeq_k:      JUMP(A == pc->k);
+jgt_k:      JUMP(A > pc->k);
+jge_k:      JUMP(A >= pc->k);
+jset_k:     JUMP(A & pc->k);
+jeq_x:      JUMP(A == X);
+jgt_x:      JUMP(A > X);
+jge_x:      JUMP(A >= X);
+jset_x:     JUMP(A & X);
+
+ret_k:      return pc->k;
+ret_a:      return A;
+tax:        X = A;                  NEXT;
+txa:        A = X;                  NEXT;
+
+#undef NEXT
+#undef JUMP
+}
+
+/* ------------------------------------------------------------------ */
+/* JIT                                                                  */
+/* ------------------------------------------------------------------ */
+
+/*
+ * Generated code is a cdecl function (skb, data, headlen):
+ *
+ *   EAX = A, EBX = X, ESI = data, EDI = headlen, [EBP + 8] = skb,
+ *   scratch word k at [EBP - 76 + 4k]; ECX and EDX are temporaries.
+ *
+ * Every jump is emitted with a 32-bit displacement, so the size of an
+ * instruction's code does not depend on where its targets are: a first
+ * pass with no image records where each instruction starts (addrs[]),
+ * the second emits the code. addrs[len] is the exit that returns 0,
+ * which the exit returning EAX follows.
+ */
+
+typedef struct jit_ctx {
+    uint8_t* image;             /* NULL: only measure                 */
+    uint32_t pos;
+    uint32_t* addrs;
+    uint32_t len;
+} jit_ctx_t;
+
+/* x86 condition codes; cc ^ 1 is the opposite condition */
+#define CC_B    0x2
+#define CC_AE   0x3
+#define CC_E    0x4
+#define CC_NE   0x5
+#define CC_A    0x7
+
+#define JIT_MEM(k)  ((uint8_t)(-76 + 4 * (int)(k)))
+
+static void emit1(jit_ctx_t* c, uint8_t b) {
+    if (c->image) c->image[c->pos] = b;
+    c->pos++;
+}
+
+static void emit2(jit_ctx_t* c, uint8_t b0, uint8_t b1) {
+    emit1(c, b0);
+    emit1(c, b1);
+}
+
+static void emit3(jit_ctx_t* c, uint8_t b0, uint8_t b1, uint8_t b2) {
+    emit2(c, b0, b1);
+    emit1(c, b2);
+}
+
+static void emit4(jit_ctx_t* c, uint32_t v) {
+    for (int i = 0; i < 4; i++) emit1(c, (uint8_t)(v >> (8 * i)));
+}
+
+/* Opcode byte(s) then a 32-bit immediate */
+static void emit_imm(jit_ctx_t* c, uint8_t op, uint32_t k) {
+    emit1(c, op);
+    emit4(c, k);
+}
+
+/* Displacement from the end of the field to `target` */
+static void emit_rel(jit_ctx_t* c, uint32_t target) {
+    emit4(c, target - (c->pos + 4));
+}
+
+static void emit_jmp(jit_ctx_t* c, uint32_t target) {
+    emit1(c, 0xE9);
+    emit_rel(c, target);
+}
+
+static void emit_jcc(jit_ctx_t* c, uint8_t cc, uint32_t target) {
+    emit2(c, 0x0F, (uint8_t)(0x80 | cc));
+    emit_rel(c, target);
+}
+
+/* A jump within the current instruction's code, to a label further
+ * on: returns where its displacement goes, for jit_patch() */
+static uint32_t emit_jcc_fwd(jit_ctx_t* c, uint8_t cc) {
+    emit2(c, 0x0F, (uint8_t)(0x80 | cc));
+    uint32_t at = c->pos;
+    emit4(c, 0);
+    return at;
+}
+
+static void jit_patch(jit_ctx_t* c, uint32_t at) {
+    if (!c->image) return;
+    uint32_t rel = c->pos - (at + 4);
+    for (int i = 0; i < 4; i++) c->image[at + i] = (uint8_t)(rel >> (8 * i));
+}
+
+/* Called by generated code for loads it cannot do inline: the value,
+ * or bit 32 set if the load is outside the packet */
+static uint64_t jit_load_slow(const sk_buff_t* skb, uint32_t off, uint32_t size) {
+    uint32_t v;
+    if (load_slow(skb, off, size, &v) < 0) return 1ull << 32;
+    return v;
+}
+
+/* A = packet[ECX .. ECX + size), big-endian. Inline when it lies in
+ * the linear part, else through jit_load_slow(). */
+static void emit_load_ecx(jit_ctx_t* c, uint32_t size) {
+    uint32_t fail = c->addrs[c->len];
+
+    emit2(c, 0x39, 0xF9);                       /* cmp ecx, edi       */
+    uint32_t j1 = emit_jcc_fwd(c, CC_AE);
+    emit2(c, 0x89, 0xFA);                       /* mov edx, edi       */
+    emit2(c, 0x29, 0xCA);                       /* sub edx, ecx       */
+    emit3(c, 0x83, 0xFA, (uint8_t)size);        /* cmp edx, size      */
+    uint32_t j2 = emit_jcc_fwd(c, CC_B);
+    if (size == 4) {
+        emit3(c, 0x8B, 0x04, 0x0E);             /* mov eax, [esi+ecx] */
+        emit2(c, 0x0F, 0xC8);                   /* bswap eax          */
+    } else if (size == 2) {
+        emit2(c, 0x0F, 0xB7);                   /* movzx eax, word    */
+        emit2(c, 0x04, 0x0E);
+        emit2(c, 0x66, 0xC1);                   /* rol ax, 8          */
+        emit2(c, 0xC0, 0x08);
+    } else {
+        emit2(c, 0x0F, 0xB6);                   /* movzx eax, byte    */
+        emit2(c, 0x04, 0x0E);
+    }
+    emit1(c, 0xE9);                             /* jmp done           */
+    uint32_t j3 = c->pos;
+    emit4(c, 0);
+
+    jit_patch(c, j1);
+    jit_patch(c, j2);
+    emit2(c, 0x6A, (uint8_t)size);              /* push size          */
+    emit1(c, 0x51);                             /* push ecx           */
+    emit3(c, 0xFF, 0x75, 0x08);                 /* push skb           */
+    emit1(c, 0xE8);                             /* call               */
+    emit4(c, (uint32_t)(uintptr_t)jit_load_slow -
+             ((uint32_t)(uintptr_t)c->image + c->pos + 4));
+    emit3(c, 0x83, 0xC4, 0x0C);                 /* add esp, 12        */
+    emit2(c, 0x85, 0xD2);                       /* test edx, edx      */
+    emit_jcc(c, CC_NE, fail);
+    jit_patch(c, j3);
+}
+
+static void emit_load(jit_ctx_t* c, const bpf_insn_t* in, uint32_t size) {
+    if (BPF_MODE(in->code) == BPF_IND) {
+        emit2(c, 0x89, 0xD9);                   /* mov ecx, ebx       */
+        emit2(c, 0x81, 0xC1);                   /* add ecx, k         */
+        emit4(c, in->k);
+        emit_jcc(c, CC_B, c->addrs[c->len]);    /* wrapped: outside   */
+    } else {
+        emit_imm(c, 0xB9, in->k);               /* mov ecx, k         */
+    }
+    emit_load_ecx(c, size);
+}
+
+static void emit_cond_jump(jit_ctx_t* c, uint32_t pc, const bpf_insn_t* in) {
+    uint8_t cc;
+    switch (BPF_OP(in->code)) {
+        case BPF_JEQ:   cc = CC_E;  break;
+        case BPF_JGT:   cc = CC_A;  break;
+        case BPF_JGE:   cc = CC_AE; break;
+        default:        cc = CC_NE; break;      /* JSET after test    */
+    }
+    int x = BPF_SRC(in->code) == BPF_X;
+    if (BPF_OP(in->code) == BPF_JSET) {
+        if (x) emit2(c, 0x85, 0xD8);            /* test eax, ebx      */
+        else   emit_imm(c, 0xA9, in->k);        /* test eax, k        */
+    } else {
+        if (x) emit2(c, 0x39, 0xD8);            /* cmp eax, ebx       */
+        else   emit_imm(c, 0x3D, in->k);        /* cmp eax, k         */
+    }
+
+    uint32_t t = c->addrs[pc + 1 + in->jt];
+    uint32_t f = c->addrs[pc + 1 + in->jf];
+    if (in->jt == in->jf) {
+        if (in->jt) emit_jmp(c, t);
+    } else if (in->jf == 0) {
+        emit_jcc(c, cc, t);
+    } else if (in->jt == 0) {
+        emit_jcc(c, (uint8_t)(cc ^ 1), f);
+    } else {
+        emit_jcc(c, cc, t);
+        emit_jmp(c, f);
+    }
+}
+
+static void emit_alu(jit_ctx_t* c, const bpf_insn_t* in) {
+    int x = BPF_SRC(in->code) == BPF_X;
+    uint32_t k = in->k;
+
+    switch (BPF_OP(in->code)) {
+        case BPF_ADD:
+            if (x) emit2(c, 0x01, 0xD8); else emit_imm(c, 0x05, k);
+            break;
+        case BPF_SUB:
+            if (x) emit2(c, 0x29, 0xD8); else emit_imm(c, 0x2D, k);
+            break;
+        case BPF_OR:
+            if (x) emit2(c, 0x09, 0xD8); else emit_imm(c, 0x0D, k);
+            break;
+        case BPF_AND:
+            if (x) emit2(c, 0x21, 0xD8); else emit_imm(c, 0x25, k);
+            break;
+        case BPF_XOR:
+            if (x) emit2(c, 0x31, 0xD8); else emit_imm(c, 0x35, k);
+            break;
+        case BPF_MUL:
+            if (x) emit3(c, 0x0F, 0xAF, 0xC3);  /* imul eax, ebx      */
+            else { emit2(c, 0x69, 0xC0); emit4(c, k); }
+            break;
+        case BPF_LSH:
+        case BPF_RSH: {
+            uint8_t modrm = BPF_OP(in->code) == BPF_LSH ? 0xE0 : 0xE8;
+            if (x) {
+                emit2(c, 0x89, 0xD9);           /* mov ecx, ebx       */
+                emit2(c, 0xD3, modrm);          /* shl/shr eax, cl    */
+            } else {
+                emit3(c, 0xC1, modrm, (uint8_t)k);
+            }
+            break;
+        }
+        case BPF_DIV:
+        case BPF_MOD:
+            if (x) {
+                emit2(c, 0x85, 0xDB);           /* test ebx, ebx      */
+                emit_jcc(c, CC_E, c->addrs[c->len]);
+                emit2(c, 0x31, 0xD2);           /* xor edx, edx       */
+                emit2(c, 0xF7, 0xF3);           /* div ebx            */
+            } else {
+                emit2(c, 0x31, 0xD2);
+                emit_imm(c, 0xB9, k);           /* mov ecx, k         */
+                emit2(c, 0xF7, 0xF1);           /* div ecx            */
+            }
+            if (BPF_OP(in->code) == BPF_MOD) emit2(c, 0x89, 0xD0);  /* eax = edx */
+            break;
+        case BPF_NEG:
+            emit2(c, 0xF7, 0xD8);
+            break;
+    }
+}
+
+static void jit_emit(jit_ctx_t* c, const bpf_prog_t* prog) {
+    uint32_t exit_ok = c->addrs[prog->len] + 2;
+
+    emit1(c, 0x55);                             /* push ebp           */
+    emit2(c, 0x89, 0xE5);                       /* mov ebp, esp       */
+    emit1(c, 0x53);                             /* push ebx           */
+    emit1(c, 0x56);                             /* push esi           */
+    emit1(c, 0x57);                             /* push edi           */
+    emit3(c, 0x83, 0xEC, 4 * BPF_MEMWORDS);     /* sub esp, 64        */
+    emit3(c, 0x8B, 0x75, 0x0C);                 /* mov esi, data      */
+    emit3(c, 0x8B, 0x7D, 0x10);                 /* mov edi, headlen   */
+    emit2(c, 0x31, 0xC0);                       /* xor eax, eax       */
+    emit2(c, 0x31, 0xDB);                       /* xor ebx, ebx       */
+
+    for (uint32_t pc = 0; pc < prog->len; pc++) {
+        const bpf_insn_t* in = &prog->insns[pc];
+        c->addrs[pc] = c->pos;
+
+        switch (in->code) {
+            case BPF_LD | BPF_W | BPF_ABS:
+            case BPF_LD | BPF_W | BPF_IND:
+                emit_load(c, in, 4);
+                break;
+            case BPF_LD | BPF_H | BPF_ABS:
+            case BPF_LD | BPF_H | BPF_IND:
+                emit_load(c, in, 2);
+                break;
+            case BPF_LD | BPF_B | BPF_ABS:
+            case BPF_LD | BPF_B | BPF_IND:
+                emit_load(c, in, 1);
+                break;
+            case BPF_LDX | BPF_B | BPF_MSH:
+                emit1(c, 0x50);                 /* push eax           */
+                emit_load(c, in, 1);
+                emit3(c, 0x83, 0xE0, 0x0F);     /* and eax, 0xf       */
+                emit3(c, 0xC1, 0xE0, 2);        /* shl eax, 2         */
+                emit2(c, 0x89, 0xC3);           /* mov ebx, eax       */
+                emit1(c, 0x58);                 /* pop eax            */
+                break;
+            case BPF_LD | BPF_IMM:
+                emit_imm(c, 0xB8, in->k);
+                break;
+            case BPF_LDX | BPF_IMM:
+                emit_imm(c, 0xBB, in->k);
+                break;
+            case BPF_LD | BPF_MEM:
+                emit3(c, 0x8B, 0x45, JIT_MEM(in->k));
+                break;
+            case BPF_LDX | BPF_MEM:
+                emit3(c, 0x8B, 0x5D, JIT_MEM(in->k));
+                break;
+            case BPF_ST:
+                emit3(c, 0x89, 0x45, JIT_MEM(in->k));
+                break;
+            case BPF_STX:
+                emit3(c, 0x89, 0x5D, JIT_MEM(in->k));
+                break;
+            case BPF_LD | BPF_W | BPF_LEN:
+            case BPF_LDX | BPF_W | BPF_LEN:
+                emit3(c, 0x8B, 0x4D, 0x08);     /* mov ecx, skb       */
+                emit2(c, 0x8B, BPF_CLASS(in->code) == BPF_LD ? 0x81 : 0x99);
+                emit4(c, __builtin_offsetof(sk_buff_t, len));
+                break;
+            case BPF_JMP | BPF_JA:
+                emit_jmp(c, c->addrs[pc + 1 + in->k]);
+                break;
+            case BPF_RET | BPF_K:
+                emit_imm(c, 0xB8, in->k);
+                emit_jmp(c, exit_ok);
+                break;
+            case BPF_RET | BPF_A:
+                emit_jmp(c, exit_ok);
+                break;
+            case BPF_MISC | BPF_TAX:
+                emit2(c, 0x89, 0xC3);
+                break;
+            case BPF_MISC | BPF_TXA:
+                emit2(c, 0x89, 0xD8);
+                break;
+            default:
+                if (BPF_CLASS(in->code) == BPF_JMP) emit_cond_jump(c, pc, in);
+                else                                emit_alu(c, in);
+                break;
+        }
+    }
+
+    c->addrs[prog->len] = c->pos;
+    emit2(c, 0x31, 0xC0);                       /* fail: xor eax, eax */
+    emit3(c, 0x8D, 0x65, 0xF4);                 /* lea esp, [ebp-12]  */
+    emit1(c, 0x5F);                             /* pop edi            */
+    emit1(c, 0x5E);                             /* pop esi            */
+    emit1(c, 0x5B);                             /* pop ebx            */
+    emit1(c, 0x5D);                             /* pop ebp            */
+    emit1(c, 0xC3);                             /* ret                */
+}
+
+/* Compile `prog`; on failure it is left to the interpreter. */
+static void bpf_jit_compile(bpf_prog_t* prog) {
+    uint32_t* addrs = (uint32_t*)kmalloc((prog->len + 1) * sizeof(uint32_t));
+    if (!addrs) return;
+    for (uint32_t i = 0; i <= prog->len; i++) addrs[i] = 0;
+
+    jit_ctx_t c = { NULL, 0, addrs, prog->len };
+    jit_emit(&c, prog);
+    uint32_t size = c.pos;
+
+    uint8_t* image = (uint8_t*)kmalloc(size);
+    if (image) {
+        c.image = image;
+        c.pos = 0;
+        jit_emit(&c, prog);
+        if (c.pos == size) {
+            prog->jited = (bpf_jit_fn)(uintptr_t)image;
+            prog->jited_len = size;
+        } else {
+            kfree(image);
+        }
+    }
+    kfree(addrs);
+}
+
+/* ------------------------------------------------------------------ */
+/* Programs                                                             */
+/* ------------------------------------------------------------------ */
+
+bpf_prog_t* bpf_prog_create(const bpf_insn_t* insns, uint32_t len) {
+    if (bpf_check(insns, len) < 0) return NULL;
+
+    bpf_prog_t* prog = (bpf_prog_t*)kmalloc(sizeof(bpf_prog_t) +
+                                            len * sizeof(bpf_insn_t));
+    if (!prog) return NULL;
+    prog->len = len;
+    prog->jited = NULL;
+    prog->jited_len = 0;
+    for (uint32_t i = 0; i < len; i++) prog->insns[i] = insns[i];
+
+    if (bpf_jit_enable) bpf_jit_compile(prog);
+    return prog;
+}
+
+void bpf_prog_destroy(bpf_prog_t* prog) {
+    if (!prog) return;
+    if (prog->jited) kfree((void*)(uintptr_t)prog->jited);
+    kfree(prog);
+}
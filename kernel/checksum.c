@@ -0,0 +1,148 @@
+/*
+ * OpenOS - Internet Checksum Implementation
+ */
+
+#include "checksum.h"
+
+/* Packet bytes are read as words through these, so the compiler may
+ * not assume they do not alias the uint8_t buffers they point into. */
+typedef uint32_t __attribute__((may_alias)) csum_u32;
+typedef uint16_t __attribute__((may_alias)) csum_u16;
+
+static inline uint32_t fold64(uint64_t acc) {
+    acc = (acc & 0xFFFFFFFFu) + (acc >> 32);
+    acc = (acc & 0xFFFFFFFFu) + (acc >> 32);
+    return (uint32_t)acc;
+}
+
+static inline uint32_t add_carry(uint32_t sum, uint32_t v) {
+    uint32_t r = sum + v;
+    return r + (r < v);
+}
+
+uint32_t net_csum_partial(const void* data, size_t length, uint32_t sum) {
+    const uint8_t* p = (const uint8_t*)data;
+    uint64_t acc = 0;
+
+    /* From an odd address, sum the rest from the next (even) one and
+     * swap its bytes back into place; the first byte is added last. */
+    uint32_t first = 0;
+    int odd = (uintptr_t)p & 1;
+    if (odd) {
+        if (length == 0) return sum;
+        first = *p++;
+        length--;
+    }
+    if (((uintptr_t)p & 2) && length >= 2) {
+        acc += *(const csum_u16*)p;
+        p += 2;
+        length -= 2;
+    }
+
+    /* One add-with-carry chain per 32 bytes; the carry out of the last
+     * word goes back in at the end of the chain */
+    uint32_t s32 = 0;
+    while (length >= 32) {
+        __asm__("addl 0(%1), %0\n\t"
+                "adcl 4(%1), %0\n\t"
+                "adcl 8(%1), %0\n\t"
+                "adcl 12(%1), %0\n\t"
+                "adcl 16(%1), %0\n\t"
+                "adcl 20(%1), %0\n\t"
+                "adcl 24(%1), %0\n\t"
+                "adcl 28(%1), %0\n\t"
+                "adcl $0, %0"
+                : "+r"(s32)
+                : "r"(p), "m"(*(const uint8_t (*)[32])p)
+                : "cc");
+        p += 32;
+        length -= 32;
+    }
+    acc += s32;
+    while (length >= 4) {
+        acc += *(const csum_u32*)p;
+        p += 4;
+        length -= 4;
+    }
+    if (length >= 2) {
+        acc += *(const csum_u16*)p;
+        p += 2;
+        length -= 2;
+    }
+    if (length) acc += *p;
+
+    uint32_t r = fold64(acc);
+    if (odd) {
+        r = (r & 0xFFFF) + (r >> 16);
+        r = (r & 0xFFFF) + (r >> 16);
+        r = ((r & 0xFF) << 8) | (r >> 8);
+        r += first;
+    }
+    return add_carry(sum, r);
+}
+
+uint32_t net_csum_copy(void* dst, const void* src, size_t length, uint32_t sum) {
+    const uint8_t* s = (const uint8_t*)src;
+    uint8_t* d = (uint8_t*)dst;
+    uint64_t acc = 0;
+
+    /* x86 loads and stores unaligned words at little extra cost, so
+     * the words are those of the message, wherever it sits. The moves
+     * leave the flags alone, so the adds form one carry chain. */
+    uint32_t s32 = 0;
+    while (length >= 16) {
+        uint32_t t0, t1;
+        __asm__("movl 0(%3), %1\n\t"
+                "movl 4(%3), %2\n\t"
+                "movl %1, 0(%4)\n\t"
+                "movl %2, 4(%4)\n\t"
+                "addl %1, %0\n\t"
+                "adcl %2, %0\n\t"
+                "movl 8(%3), %1\n\t"
+                "movl 12(%3), %2\n\t"
+                "movl %1, 8(%4)\n\t"
+                "movl %2, 12(%4)\n\t"
+                "adcl %1, %0\n\t"
+                "adcl %2, %0\n\t"
+                "adcl $0, %0"
+                : "+r"(s32), "=&r"(t0), "=&r"(t1)
+                : "r"(s), "r"(d), "m"(*(const uint8_t (*)[16])s)
+                : "cc", "memory");
+        s += 16;
+        d += 16;
+        length -= 16;
+    }
+    acc += s32;
+    while (length >= 4) {
+        uint32_t a = *(const csum_u32*)s;
+        *(csum_u32*)d = a;
+        acc += a;
+        s += 4;
+        d += 4;
+        length -= 4;
+    }
+    if (length >= 2) {
+        uint16_t a = *(const csum_u16*)s;
+        *(csum_u16*)d = a;
+        acc += a;
+        s += 2;
+        d += 2;
+        length -= 2;
+    }
+    if (length) {
+        *d = *s;
+        acc += *s;
+    }
+    return add_carry(sum, fold64(acc));
+}
+
+uint16_t net_csum_fold(uint32_t sum) {
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+/* Calculate Internet checksum */
+uint16_t net_checksum(const void* data, size_t length) {
+    return net_csum_fold(net_csum_partial(data, length, 0));
+}
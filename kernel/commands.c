@@ -6,9 +6,13 @@
 #include "shell.h"
 #include "string.h"
 #include "kernel.h"
+#include "printk.h"
 #include "../drivers/console.h"
 #include "../drivers/timer.h"
+#include "../drivers/serial.h"
+#include "../drivers/keyboard.h"
 #include "../arch/x86/ports.h"
+#include "../arch/x86/cpu.h"
 #include "../fs/vfs.h"
 #include "../memory/pmm.h"
 #include "../memory/heap.h"
@@ -23,38 +27,19 @@ const shell_command_t* shell_get_commands(int* count);
 
 /*
  * Helper function to build absolute path from relative path
- * Returns 0 on success, -1 on error
+ * Returns 0 on success, -1 if it does not fit in abs_path (which is then
+ * left empty, so vfs_resolve_path() finds nothing rather than a prefix)
  */
 static int build_absolute_path(const char* relative_path, char* abs_path, size_t abs_path_size) {
-    (void)abs_path_size;  /* Unused - reserved for future bounds checking */
-    
-    vfs_node_t* current = kernel_get_current_directory();
-    
-    /* Build current path first */
-    char current_path[VFS_MAX_PATH_LENGTH];
-    current_path[0] = '\0';
-    
-    if (current && current->parent != current) {
-        vfs_node_t* node = current;
-        char temp[VFS_MAX_PATH_LENGTH];
-        while (node && node->parent != node) {
-            string_copy(temp, "/");
-            string_concat(temp, node->name);
-            string_concat(temp, current_path);
-            string_copy(current_path, temp);
-            node = node->parent;
-        }
-    }
-    
-    if (current_path[0] == '\0') {
-        string_copy(abs_path, "/");
-    } else {
-        string_copy(abs_path, current_path);
+    strbuf_t sb;
+    strbuf_init(&sb, abs_path, abs_path_size);
+    vfs_path_append(&sb, kernel_get_current_directory());
+    strbuf_putc(&sb, '/');
+    strbuf_append(&sb, relative_path);
+    if (sb.overflow) {
+        strbuf_truncate(&sb, 0);
+        return -1;
     }
-    
-    string_concat(abs_path, "/");
-    string_concat(abs_path, relative_path);
-    
     return 0;
 }
 
@@ -77,6 +62,10 @@ void commands_register_all(void) {
     shell_register_command("write", "Write text to a file [write <file> <text...>]", cmd_write);
     shell_register_command("rm", "Remove a file or directory", cmd_rm);
     shell_register_command("meminfo", "Show physical and heap memory usage", cmd_meminfo);
+    shell_register_command("serial", "Show serial port (COM1) output counters", cmd_serial);
+    shell_register_command("kbd", "Keyboard counters, or set the layout: kbd [us|uk|fr|de]", cmd_kbd);
+    shell_register_command("keytest", "Print key events until Esc", cmd_keytest);
+    shell_register_command("dmesg", "Kernel log: dmesg [-n level] [-s] [-b]", cmd_dmesg);
     shell_register_command("reboot", "Reboot the system", cmd_reboot);
     
     /* New feature test commands */
@@ -95,6 +84,35 @@ void commands_register_all(void) {
     shell_register_command("counters", "Run N ring 3 counters [counters <n>]", cmd_counters);
     shell_register_command("psleep", "Sleep the shell [psleep <ms>]", cmd_psleep);
     shell_register_command("sched", "Show scheduler statistics", cmd_sched);
+
+    /* IPC demos and benchmarks */
+    shell_register_command("ipcs", "List IPC objects, names and handle counts", cmd_ipcs);
+    shell_register_command("pipetest", "Run ring 3 pipe()/read()/write() demo", cmd_pipetest);
+    shell_register_command("pipebench", "Measure pipe throughput (1 B - 64 KiB writes)", cmd_pipebench);
+    shell_register_command("mqtest", "Run ring 3 message queue demo", cmd_mqtest);
+    shell_register_command("mqbench", "Measure message queue msgs/s vs payload size", cmd_mqbench);
+    shell_register_command("ipcbench", "Measure call/reply_wait round-trip cycles", cmd_ipcbench);
+    shell_register_command("shmbench", "Ring 3 shared memory ring with futexes", cmd_shmbench);
+    shell_register_command("epolltest", "Run ring 3 epoll event loop demo", cmd_epolltest);
+    shell_register_command("epollbench", "epoll_wait vs polling every pipe", cmd_epollbench);
+
+    /* Network */
+    shell_register_command("lspci", "List PCI devices", cmd_lspci);
+    shell_register_command("netbench", "e1000 loopback packets/s and MB/s", cmd_netbench);
+    shell_register_command("ping", "ICMP echo: ping <ip> [count] [size]", cmd_ping);
+    shell_register_command("arp", "Show the ARP neighbour cache", cmd_arp);
+    shell_register_command("route", "Show the IPv4 routing table", cmd_route);
+    shell_register_command("netqueues", "RX queues and RPS: netqueues [dev cpumask]", cmd_netqueues);
+    shell_register_command("netstat", "Network counters and sockets: netstat [-i|-s|-a]", cmd_netstat);
+    shell_register_command("fragtest", "IPv4 reassembly with options in the first fragment", cmd_fragtest);
+    shell_register_command("udpbench", "UDP datagrams/s to our own address", cmd_udpbench);
+    shell_register_command("tcpbench", "TCP bulk and request/response to ourselves", cmd_tcpbench);
+    shell_register_command("csumbench", "Internet checksum MB/s, 64 B - 64 KiB", cmd_csumbench);
+    shell_register_command("bpfbench", "Packet filter cost: interpreter vs JIT", cmd_bpfbench);
+
+    /* Memory */
+    shell_register_command("membench", "memcpy/memset/memmove MB/s per method", cmd_membench);
+    shell_register_command("strbench", "String functions: byte loops vs word at a time", cmd_strbench);
 }
 
 /*
@@ -257,29 +275,10 @@ void cmd_pwd(int argc, char** argv) {
         return;
     }
     
-    /* Build path by walking up to root */
     char path[VFS_MAX_PATH_LENGTH];
-    char temp[VFS_MAX_PATH_LENGTH];
-    path[0] = '\0';
-    
-    vfs_node_t* node = current;
-    while (node && node->parent != node) {  /* Stop at root (root is its own parent) */
-        /* Prepend current node name */
-        string_copy(temp, "/");
-        string_concat(temp, node->name);
-        string_concat(temp, path);
-        string_copy(path, temp);
-        
-        node = node->parent;
-    }
-    
-    /* If path is empty, we're at root */
-    if (path[0] == '\0') {
-        console_write("/\n");
-    } else {
-        console_write(path);
-        console_write("\n");
-    }
+    vfs_get_path(current, path, sizeof(path));
+    console_write(path);
+    console_write("\n");
 }
 
 /*
@@ -351,29 +350,27 @@ static void ls_list_dir(vfs_node_t* dir, int flag_long, int flag_all,
 
 /*
  * Helper: recursively list directories for -R flag.
- * path_buf must be at least VFS_MAX_PATH_LENGTH bytes.
+ * path holds dir's path; each level appends its child's name to it
+ * and cuts it back afterwards.
  */
 static void ls_recursive(vfs_node_t* dir, int flag_long, int flag_all,
-                         char* path_buf) {
-    ls_list_dir(dir, flag_long, flag_all, 1, path_buf);
+                         strbuf_t* path) {
+    ls_list_dir(dir, flag_long, flag_all, 1, path->buf);
 
     /* Recurse into subdirectories */
+    size_t mark = path->len;
     for (uint32_t i = 0; i < dir->child_count; i++) {
         vfs_node_t* child = dir->children[i];
         if (!child || child->type != NODE_DIRECTORY) continue;
         if (!flag_all && child->name[0] == '.') continue;
 
-        /* Build child path */
-        char child_path[VFS_MAX_PATH_LENGTH];
-        string_copy(child_path, path_buf);
         /* Avoid double slash at root */
-        if (child_path[0] == '/' && child_path[1] == '\0') {
-            string_concat(child_path, child->name);
-        } else {
-            string_concat(child_path, "/");
-            string_concat(child_path, child->name);
+        if (mark != 1 || path->buf[0] != '/') {
+            strbuf_putc(path, '/');
         }
-        ls_recursive(child, flag_long, flag_all, child_path);
+        strbuf_append(path, child->name);
+        ls_recursive(child, flag_long, flag_all, path);
+        strbuf_truncate(path, mark);
     }
 }
 
@@ -453,29 +450,18 @@ void cmd_ls(int argc, char** argv) {
     if (flag_recursive) {
         /* Build starting path string */
         char start_path[VFS_MAX_PATH_LENGTH];
+        strbuf_t path;
+        strbuf_init(&path, start_path, sizeof(start_path));
         if (path_arg) {
-            string_copy(start_path, path_arg);
+            strbuf_append(&path, path_arg);
         } else {
             /* Use current directory path */
-            vfs_node_t* cur = dir;
-            start_path[0] = '\0';
-            if (cur->parent == cur) {
-                string_copy(start_path, "/");
-            } else {
-                char temp[VFS_MAX_PATH_LENGTH];
-                while (cur && cur->parent != cur) {
-                    string_copy(temp, "/");
-                    string_concat(temp, cur->name);
-                    string_concat(temp, start_path);
-                    string_copy(start_path, temp);
-                    cur = cur->parent;
-                }
-                if (start_path[0] == '\0') {
-                    string_copy(start_path, "/");
-                }
+            vfs_path_append(&path, dir);
+            if (path.len == 0) {
+                strbuf_putc(&path, '/');
             }
         }
-        ls_recursive(dir, flag_long, flag_all, start_path);
+        ls_recursive(dir, flag_long, flag_all, &path);
     } else {
         ls_list_dir(dir, flag_long, flag_all, 0, 0);
     }
@@ -812,6 +798,234 @@ void cmd_meminfo(int argc, char** argv) {
     console_write(" block(s)\n");
 }
 
+/*
+ * SERIAL command - COM1 transmit ring and interrupt counters.
+ */
+void cmd_serial(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+
+    if (!serial_is_available()) {
+        console_write("No UART on COM1\n");
+        return;
+    }
+
+    serial_stats_t st;
+    serial_get_stats(&st);
+
+    console_write("COM1 38400 8N1, ");
+    console_write(st.irq_driven ? "interrupt-driven" : "polled");
+    console_write(", ");
+    print_number(st.fifo_size);
+    console_write("-byte TX FIFO\n");
+    console_write("  queued    : ");
+    print_number(st.tx_queued);
+    console_write(" bytes\n");
+    console_write("  sent      : ");
+    print_number(st.tx_bytes);
+    console_write(" bytes in ");
+    print_number(st.tx_bursts);
+    console_write(" FIFO refills\n");
+    console_write("  pending   : ");
+    print_number(st.tx_pending);
+    console_write(" of ");
+    print_number(SERIAL_TX_RING_SIZE);
+    console_write(" bytes\n");
+    console_write("  dropped   : ");
+    print_number(st.tx_dropped);
+    console_write(" bytes (ring full)\n");
+    console_write("  interrupts: ");
+    print_number(st.interrupts);
+    console_write("\n");
+}
+
+void cmd_kbd(int argc, char** argv) {
+    if (argc > 1) {
+        for (uint8_t id = 0; keyboard_layout_name(id); id++) {
+            if (string_compare(argv[1], keyboard_layout_name(id)) == 0) {
+                keyboard_set_layout(id);
+                console_write("Layout: ");
+                console_write(argv[1]);
+                console_write("\n");
+                return;
+            }
+        }
+        console_write("Usage: kbd [us|uk|fr|de]\n");
+        return;
+    }
+
+    keyboard_stats_t st;
+    keyboard_get_stats(&st);
+
+    console_write("Layout: ");
+    console_write(keyboard_layout_name(st.layout));
+    console_write("\n");
+    console_write("  scancodes : ");
+    print_number(st.scancodes);
+    console_write(" (");
+    print_number(st.scancode_drops);
+    console_write(" dropped, ring of ");
+    print_number(KBD_SCANCODE_RING);
+    console_write(")\n");
+    console_write("  events    : ");
+    print_number(st.events);
+    console_write(" (");
+    print_number(st.event_drops);
+    console_write(" dropped by full queues)\n");
+    console_write("  queues    : ");
+    print_number(st.consumers);
+    console_write(" open\n");
+}
+
+/* Append "0x" and two hex digits */
+static void append_hex8(strbuf_t* sb, uint8_t v) {
+    static const char hex[] = "0123456789ABCDEF";
+    strbuf_append(sb, "0x");
+    strbuf_putc(sb, hex[v >> 4]);
+    strbuf_putc(sb, hex[v & 0xF]);
+}
+
+void cmd_keytest(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+
+    struct kbd_consumer* c = keyboard_open_events(KBD_GRAB);
+    if (!c) {
+        console_write("Out of memory\n");
+        return;
+    }
+    console_write("Press keys; Esc quits.\n");
+
+    key_event_t ev;
+    do {
+        if (keyboard_read_event(c, &ev) < 0) {
+            /* Not a process that can sleep: wait for the next IRQ */
+            __asm__ __volatile__("hlt");
+            continue;
+        }
+
+        char line[64];
+        strbuf_t sb;
+        strbuf_init(&sb, line, sizeof(line));
+        strbuf_append(&sb, "key ");
+        append_hex8(&sb, ev.keycode);
+        strbuf_append(&sb, ev.pressed ? " down mods " : " up   mods ");
+        append_hex8(&sb, ev.mods);
+        if (ev.ascii >= ' ' && ev.ascii < 0x7F) {
+            strbuf_append(&sb, " '");
+            strbuf_putc(&sb, ev.ascii);
+            strbuf_putc(&sb, '\'');
+        } else if (ev.ascii) {
+            strbuf_append(&sb, " ");
+            append_hex8(&sb, (uint8_t)ev.ascii);
+        }
+        strbuf_putc(&sb, '\n');
+        console_write(line);
+    } while (!(ev.keycode == KEY_ESC && !ev.pressed));
+
+    keyboard_close_events(c);
+}
+
+/* "[    12.345678] " for a record's TSC */
+static void dmesg_stamp(strbuf_t* sb, uint64_t tsc) {
+    uint32_t us;
+    uint32_t sec = (uint32_t)udiv64(log_tsc_to_us(tsc), 1000000, &us);
+    char digits[12];
+
+    strbuf_putc(sb, '[');
+    itoa((int)sec, digits, 10);
+    for (size_t n = string_length(digits); n < 6; n++) strbuf_putc(sb, ' ');
+    strbuf_append(sb, digits);
+    strbuf_putc(sb, '.');
+    itoa((int)us, digits, 10);
+    for (size_t n = string_length(digits); n < 6; n++) strbuf_putc(sb, '0');
+    strbuf_append(sb, digits);
+    strbuf_append(sb, "] ");
+}
+
+/* Cycles per printk() against a synchronous console_write() of the
+ * same line. The printk()s are LOG_DEBUG, so klogd drops them. */
+static void dmesg_bench(void) {
+    enum { LINES = 16 };
+    const char* line = "dmesg: benchmark line with a number 12345";
+
+    uint64_t t0 = rdtsc();
+    for (int i = 0; i < LINES; i++) {
+        printk(LOG_DEBUG, "dmesg: benchmark line with a number %d", 12345);
+    }
+    uint64_t t1 = rdtsc();
+    for (int i = 0; i < LINES; i++) {
+        console_write(line);
+        console_write("\n");
+    }
+    uint64_t t2 = rdtsc();
+
+    console_write("printk()        : ");
+    print_number((uint32_t)udiv64(t1 - t0, LINES, 0));
+    console_write(" cycles/line\nconsole_write() : ");
+    print_number((uint32_t)udiv64(t2 - t1, LINES, 0));
+    console_write(" cycles/line\n");
+}
+
+/*
+ * DMESG command - Print the kernel log, oldest first.
+ * Usage: dmesg [-n level] [-s] [-b]
+ *   -n  only records at `level` (0 emerg .. 7 debug) or above reach the console
+ *   -s  log counters
+ *   -b  time printk() against writing the console directly
+ */
+void cmd_dmesg(int argc, char** argv) {
+    if (argc >= 2 && string_compare(argv[1], "-n") == 0) {
+        if (argc < 3 || argv[2][0] < '0' || argv[2][0] > '7' || argv[2][1]) {
+            console_write("Usage: dmesg -n <0-7>\n");
+            return;
+        }
+        console_loglevel = argv[2][0] - '0';
+        return;
+    }
+    if (argc >= 2 && string_compare(argv[1], "-s") == 0) {
+        log_stats_t st;
+        log_get_stats(&st);
+        console_write("records   : ");
+        print_number(st.records);
+        console_write("\ntruncated : ");
+        print_number(st.truncated);
+        console_write("\nprinted   : ");
+        print_number(st.flushed);
+        console_write("\nlost      : ");
+        print_number(st.console_lost);
+        console_write(" (overwritten before klogd printed them)\nconsole   : level <= ");
+        print_number((uint32_t)console_loglevel);
+        console_write("\n");
+        return;
+    }
+    if (argc >= 2 && string_compare(argv[1], "-b") == 0) {
+        dmesg_bench();
+        return;
+    }
+    if (argc >= 2) {
+        console_write("Usage: dmesg [-n level] [-s] [-b]\n");
+        return;
+    }
+
+    log_iter_t it;
+    log_record_t r;
+    log_iter_start(&it);
+    while (log_iter_next(&it, &r)) {
+        char stamp[32];
+        strbuf_t sb;
+        strbuf_init(&sb, stamp, sizeof(stamp));
+        dmesg_stamp(&sb, r.tsc);
+        console_write(stamp);
+        console_write(r.text);
+        console_write("\n");
+    }
+    if (it.lost) {
+        print_number(it.lost);
+        console_write(" records overwritten while reading\n");
+    }
+}
+
 /*
  * MKDIR command - Create a new directory.
  * Usage: mkdir <name>
@@ -1081,13 +1295,15 @@ void cmd_test_ipc(int argc, char** argv) {
         console_write("   - Message queue created successfully\n");
         
         const char* msg_data = "Test message";
-        if (msgqueue_send(queue, 1, 100, msg_data, strlen(msg_data) + 1) == 0) {
+        if (msgqueue_send(queue, 1, 100, 0, msg_data, strlen(msg_data) + 1,
+                          MSGQ_NOWAIT) == 0) {
             console_write("   - Sent message to queue\n");
             
-            message_t msg;
-            if (msgqueue_receive(queue, &msg) == 0) {
+            char msg[64];
+            if (msgqueue_receive(queue, msg, sizeof(msg), NULL,
+                                 MSGQ_NOWAIT) > 0) {
                 console_write("   - Received message: ");
-                console_write((const char*)msg.data);
+                console_write(msg);
                 console_write("\n");
             }
         }
@@ -1173,6 +1389,30 @@ void cmd_test_gui(int argc, char** argv) {
         
         console_write("Rendering window...\n");
         gui_render_window(window);
+        gui_render_all();
+
+        /* A small window in front, moved 10 times by a few pixels */
+        window_t* small = gui_create_window(150, 150, 80, 60, "Small");
+        if (small) {
+            gui_render_all();
+            gui_stats_t before, after;
+            gui_get_stats(&before);
+            for (int i = 1; i <= 10; i++) {
+                gui_move_window(small, 150 + i * 4, 150 + i * 2);
+                gui_render_all();
+            }
+            gui_get_stats(&after);
+
+            console_write("Moved an 80x60 window 10 times: ");
+            print_number((after.pixels_copied - before.pixels_copied +
+                          after.pixels_filled - before.pixels_filled) / 10);
+            console_write(" pixels per frame (screen: ");
+            print_number(GUI_WIDTH * GUI_HEIGHT);
+            console_write("), ");
+            print_number((after.pixels_culled - before.pixels_culled) / 10);
+            console_write(" covered pixels skipped\n");
+            gui_destroy_window(small);
+        }
         
         console_write("Hiding window...\n");
         gui_hide_window(window);
@@ -26,6 +26,10 @@ void cmd_touch(int argc, char** argv);
 void cmd_write(int argc, char** argv);
 void cmd_rm(int argc, char** argv);
 void cmd_meminfo(int argc, char** argv);
+void cmd_serial(int argc, char** argv);
+void cmd_kbd(int argc, char** argv);
+void cmd_keytest(int argc, char** argv);
+void cmd_dmesg(int argc, char** argv);
 void cmd_reboot(int argc, char** argv);
 
 /* New feature test commands */
@@ -45,4 +49,33 @@ void cmd_counters(int argc, char** argv);
 void cmd_psleep(int argc, char** argv);
 void cmd_sched(int argc, char** argv);
 
+/* IPC demos and benchmarks (kernel/ipc_commands.c) */
+void cmd_ipcs(int argc, char** argv);
+void cmd_pipetest(int argc, char** argv);
+void cmd_pipebench(int argc, char** argv);
+void cmd_mqtest(int argc, char** argv);
+void cmd_mqbench(int argc, char** argv);
+void cmd_ipcbench(int argc, char** argv);
+void cmd_shmbench(int argc, char** argv);
+void cmd_epolltest(int argc, char** argv);
+void cmd_epollbench(int argc, char** argv);
+
+/* Network commands and benchmarks (kernel/net_commands.c) */
+void cmd_lspci(int argc, char** argv);
+void cmd_netbench(int argc, char** argv);
+void cmd_ping(int argc, char** argv);
+void cmd_arp(int argc, char** argv);
+void cmd_route(int argc, char** argv);
+void cmd_netqueues(int argc, char** argv);
+void cmd_netstat(int argc, char** argv);
+void cmd_fragtest(int argc, char** argv);
+void cmd_udpbench(int argc, char** argv);
+void cmd_tcpbench(int argc, char** argv);
+void cmd_csumbench(int argc, char** argv);
+void cmd_bpfbench(int argc, char** argv);
+
+/* Memory */
+void cmd_membench(int argc, char** argv);
+void cmd_strbench(int argc, char** argv);
+
 #endif /* OPENOS_KERNEL_COMMANDS_H */
@@ -0,0 +1,356 @@
+/*
+ * OpenOS - Event Polling Implementation
+ *
+ * Instances and items come from slab caches. Interest sets and ready
+ * lists are only touched with interrupts disabled: the wake callback
+ * runs inside wait_queue_wake_*(), which may be called from an
+ * interrupt handler (the keyboard, for one).
+ */
+
+#include "../include/epoll.h"
+#include "file.h"
+#include "../memory/slab.h"
+#include "../process/scheduler.h"
+#include "../drivers/timer.h"
+#include "../arch/x86/cpu.h"
+
+static slab_t *eventpoll_slab;
+static slab_t *epitem_slab;
+
+void epoll_init(void) {
+    eventpoll_slab = slab_create(sizeof(eventpoll_t));
+    epitem_slab    = slab_create(sizeof(epitem_t));
+}
+
+/* As for pipes: no blocking before the scheduler runs, or in idle. */
+static int epoll_can_block(void) {
+    return scheduler_active() && process_getpid() != 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* Ready list                                                           */
+/* ------------------------------------------------------------------ */
+
+/* Append `it` to its instance's ready list unless it is already there.
+ * Interrupts must be disabled. */
+static void ep_set_ready(epitem_t *it) {
+    eventpoll_t *ep = it->ep;
+    if (it->ready) return;
+
+    it->ready   = 1;
+    it->rd_next = NULL;
+    if (ep->rd_tail) ep->rd_tail->rd_next = it;
+    else             ep->rd_head = it;
+    ep->rd_tail = it;
+}
+
+/* Take the first item off the ready list. Interrupts must be disabled. */
+static epitem_t *ep_pop_ready(eventpoll_t *ep) {
+    epitem_t *it = ep->rd_head;
+    if (!it) return NULL;
+
+    ep->rd_head = it->rd_next;
+    if (!ep->rd_head) ep->rd_tail = NULL;
+    it->rd_next = NULL;
+    it->ready   = 0;
+    return it;
+}
+
+static void ep_unlink_ready(eventpoll_t *ep, epitem_t *it) {
+    epitem_t *prev = NULL;
+    for (epitem_t *r = ep->rd_head; r; prev = r, r = r->rd_next) {
+        if (r != it) continue;
+        if (prev) prev->rd_next = r->rd_next;
+        else      ep->rd_head = r->rd_next;
+        if (ep->rd_tail == r) ep->rd_tail = prev;
+        break;
+    }
+    it->rd_next = NULL;
+    it->ready   = 0;
+}
+
+static void ep_wake(eventpoll_t *ep) {
+    if (!wait_queue_empty(&ep->wait)) {
+        wait_queue_wake_all(&ep->wait);
+    }
+}
+
+/*
+ * Hook callback: one of the queues the item's object registered was
+ * woken. The hook's key says which events that queue stands for;
+ * wakes for events nobody asked about (and for disarmed one-shot
+ * items) are ignored. Whether the item really is ready is decided by
+ * polling it again in epoll_wait().
+ */
+static void ep_poll_callback(wait_hook_t *hook) {
+    epitem_t *it = (epitem_t *)hook->data;
+    if (!(hook->key & it->event.events)) return;
+
+    ep_set_ready(it);
+    ep_wake(it->ep);
+}
+
+void poll_wait(poll_table_t *pt, wait_queue_t *wq, uint32_t events) {
+    if (!pt || !pt->item || !wq) return;
+
+    epitem_t *it = pt->item;
+    if (it->nhooks >= EPOLL_ITEM_HOOKS) return;
+
+    wait_hook_t *hook = &it->hooks[it->nhooks++];
+    hook->func = ep_poll_callback;
+    hook->data = it;
+    hook->key  = events;
+    wait_queue_add_hook(wq, hook);
+}
+
+/* ------------------------------------------------------------------ */
+/* Interest set                                                         */
+/* ------------------------------------------------------------------ */
+
+static epitem_t *ep_find(eventpoll_t *ep, file_t *f) {
+    for (epitem_t *it = f->epitems; it; it = it->file_next) {
+        if (it->ep == ep) return it;
+    }
+    return NULL;
+}
+
+/* Events an item is armed for: HUP and ERR are always reported. */
+static void ep_set_event(epitem_t *it, const epoll_event_t *ev) {
+    it->event.events = ev->events | EPOLLHUP | EPOLLERR;
+    it->event.data   = ev->data;
+}
+
+/* Interrupts must be disabled. */
+static int ep_insert(eventpoll_t *ep, file_t *f, const epoll_event_t *ev) {
+    epitem_t *it = (epitem_t *)slab_alloc(epitem_slab);
+    if (!it) return -1;
+
+    it->ep        = ep;
+    it->file      = f;
+    it->nhooks    = 0;
+    it->rd_next   = NULL;
+    it->ready     = 0;
+    ep_set_event(it, ev);
+
+    it->prev = NULL;
+    it->next = ep->items;
+    if (ep->items) ep->items->prev = it;
+    ep->items = it;
+    it->file_next = f->epitems;
+    f->epitems = it;
+    ep->count++;
+
+    /* Hooks the item onto the object's queues and reports its state. */
+    poll_table_t pt = { it };
+    if (f->ops->poll(f, &pt) & it->event.events) {
+        ep_set_ready(it);
+        ep_wake(ep);
+    }
+    return 0;
+}
+
+/* Interrupts must be disabled. */
+static void ep_remove(eventpoll_t *ep, epitem_t *it) {
+    for (uint32_t i = 0; i < it->nhooks; i++) {
+        wait_queue_remove_hook(&it->hooks[i]);
+    }
+
+    if (it->prev) it->prev->next = it->next;
+    else          ep->items = it->next;
+    if (it->next) it->next->prev = it->prev;
+
+    epitem_t **link = &it->file->epitems;
+    while (*link && *link != it) link = &(*link)->file_next;
+    if (*link) *link = it->file_next;
+
+    if (it->ready) ep_unlink_ready(ep, it);
+    ep->count--;
+    slab_free(epitem_slab, it);
+}
+
+int epoll_ctl(eventpoll_t *ep, int op, file_t *f, epoll_event_t *ev) {
+    if (!ep || !f) return -1;
+
+    int ret = -1;
+    uint32_t irq = irq_save();
+    epitem_t *it = ep->is_open ? ep_find(ep, f) : NULL;
+
+    switch (op) {
+    case EPOLL_CTL_ADD:
+        if (ep->is_open && !it && ev && f->ops && f->ops->poll) {
+            ret = ep_insert(ep, f, ev);
+        }
+        break;
+    case EPOLL_CTL_MOD:
+        if (it && ev) {
+            ep_set_event(it, ev);
+            if (file_poll(f, NULL) & it->event.events) {
+                ep_set_ready(it);
+                ep_wake(ep);
+            }
+            ret = 0;
+        }
+        break;
+    case EPOLL_CTL_DEL:
+        if (it) {
+            ep_remove(ep, it);
+            ret = 0;
+        }
+        break;
+    }
+
+    irq_restore(irq);
+    return ret;
+}
+
+void epoll_file_release(file_t *f) {
+    uint32_t irq = irq_save();
+    while (f->epitems) {
+        ep_remove(f->epitems->ep, f->epitems);
+    }
+    irq_restore(irq);
+}
+
+/* ------------------------------------------------------------------ */
+/* Waiting                                                              */
+/* ------------------------------------------------------------------ */
+
+/*
+ * Move up to `max` ready items into `events`. Each item on the ready
+ * list is polled once: items no longer ready drop off, level-triggered
+ * ones that are go back on the tail for the next call, edge-triggered
+ * and one-shot ones wait for their next wake-up. Interrupts must be
+ * disabled.
+ */
+static int ep_collect(eventpoll_t *ep, epoll_event_t *events, int max) {
+    int n = 0;
+    epitem_t *last = ep->rd_tail;
+
+    while (n < max) {
+        epitem_t *it = ep_pop_ready(ep);
+        if (!it) break;
+
+        uint32_t mask = file_poll(it->file, NULL) & it->event.events;
+        if (mask) {
+            events[n].events = mask;
+            events[n].data   = it->event.data;
+            n++;
+
+            if (it->event.events & EPOLLONESHOT) {
+                it->event.events &= EPOLLET | EPOLLONESHOT;   /* disarm */
+            } else if (!(it->event.events & EPOLLET)) {
+                ep_set_ready(it);
+            }
+        }
+        if (it == last) break;
+    }
+    return n;
+}
+
+static void ep_put(eventpoll_t *ep) {
+    if (--ep->refs == 0) {
+        slab_free(eventpoll_slab, ep);
+    }
+}
+
+int epoll_wait(eventpoll_t *ep, epoll_event_t *events, int max,
+               uint32_t timeout_ms) {
+    if (!ep || !events || max <= 0) return -1;
+    if (max > EPOLL_MAX_EVENTS) max = EPOLL_MAX_EVENTS;
+
+    /* 100 Hz timer: round the timeout up to whole ticks. */
+    uint64_t deadline = timer_get_ticks() + (timeout_ms / 10) +
+                        ((timeout_ms % 10) ? 1 : 0);
+    int n;
+
+    uint32_t irq = irq_save();
+    ep->refs++;                 /* survive a close while we sleep */
+    for (;;) {
+        if (!ep->is_open) {
+            n = -1;
+            break;
+        }
+        n = ep_collect(ep, events, max);
+        if (n > 0 || timeout_ms == EPOLL_NOWAIT || !epoll_can_block()) break;
+
+        if (timeout_ms == EPOLL_FOREVER) {
+            wait_queue_sleep(&ep->wait);
+            continue;
+        }
+        uint64_t now = timer_get_ticks();
+        if (now >= deadline) break;
+        wait_queue_sleep_timeout(&ep->wait, (uint32_t)(deadline - now));
+    }
+    ep_put(ep);
+    irq_restore(irq);
+
+    return n;
+}
+
+/* ------------------------------------------------------------------ */
+/* Instances                                                            */
+/* ------------------------------------------------------------------ */
+
+eventpoll_t *epoll_create(void) {
+    eventpoll_t *ep = (eventpoll_t *)slab_alloc(eventpoll_slab);
+    if (!ep) return NULL;
+
+    ep->items   = NULL;
+    ep->rd_head = NULL;
+    ep->rd_tail = NULL;
+    ep->count   = 0;
+    ep->refs    = 1;
+    ep->is_open = 1;
+    wait_queue_init(&ep->wait);
+    return ep;
+}
+
+void epoll_close(eventpoll_t *ep) {
+    if (!ep) return;
+
+    uint32_t irq = irq_save();
+    ep->is_open = 0;
+    while (ep->items) {
+        ep_remove(ep, ep->items);
+    }
+    wait_queue_wake_all(&ep->wait);
+    ep_put(ep);
+    irq_restore(irq);
+}
+
+static void epoll_file_release_ep(file_t *f) {
+    epoll_close((eventpoll_t *)f->object);
+}
+
+static const file_ops_t epoll_file_ops = {
+    .read    = NULL,
+    .write   = NULL,
+    .release = epoll_file_release_ep,
+    .poll    = NULL,            /* no nesting */
+};
+
+eventpoll_t *epoll_from_file(file_t *f) {
+    if (!f || f->ops != &epoll_file_ops) return NULL;
+    return (eventpoll_t *)f->object;
+}
+
+int epoll_open_fd(void) {
+    process_t *self = process_current();
+    if (!self) return -1;
+
+    eventpoll_t *ep = epoll_create();
+    if (!ep) return -1;
+
+    file_t *f = file_alloc(&epoll_file_ops, ep, FILE_READ);
+    if (!f) {
+        epoll_close(ep);
+        return -1;
+    }
+
+    int fd = fd_install(self, f);
+    if (fd < 0) {
+        file_put(f);            /* closes the instance */
+        return -1;
+    }
+    return fd;
+}
@@ -0,0 +1,115 @@
+/*
+ * OpenOS - Open Files and File Descriptors Implementation
+ */
+
+#include "file.h"
+#include "../include/epoll.h"
+#include "../memory/heap.h"
+#include "../arch/x86/cpu.h"
+
+file_t *file_alloc(const file_ops_t *ops, void *object, uint32_t flags) {
+    file_t *f = (file_t *)kmalloc(sizeof(file_t));
+    if (!f) return 0;
+
+    f->ops      = ops;
+    f->object   = object;
+    f->flags    = flags;
+    f->refcount = 1;
+    f->epitems  = 0;
+    return f;
+}
+
+void file_get(file_t *f) {
+    if (!f) return;
+    uint32_t irq = irq_save();
+    f->refcount++;
+    irq_restore(irq);
+}
+
+void file_put(file_t *f) {
+    if (!f) return;
+
+    uint32_t irq = irq_save();
+    int last = (--f->refcount == 0);
+    irq_restore(irq);
+
+    if (last) {
+        if (f->epitems) {
+            epoll_file_release(f);
+        }
+        if (f->ops && f->ops->release) {
+            f->ops->release(f);
+        }
+        kfree(f);
+    }
+}
+
+int file_read(file_t *f, void *buf, size_t n) {
+    if (!f || !(f->flags & FILE_READ) || !f->ops || !f->ops->read) return -1;
+    return f->ops->read(f, buf, n);
+}
+
+int file_write(file_t *f, const void *buf, size_t n) {
+    if (!f || !(f->flags & FILE_WRITE) || !f->ops || !f->ops->write) return -1;
+    return f->ops->write(f, buf, n);
+}
+
+uint32_t file_poll(file_t *f, struct poll_table *pt) {
+    if (!f || !f->ops || !f->ops->poll) return 0;
+    return f->ops->poll(f, pt);
+}
+
+/* ------------------------------------------------------------------ */
+/* Descriptor table                                                     */
+/* ------------------------------------------------------------------ */
+
+int fd_install(process_t *p, file_t *f) {
+    if (!p || !f) return -1;
+
+    uint32_t irq = irq_save();
+    for (int fd = 0; fd < PROCESS_MAX_FDS; fd++) {
+        if (!p->fds[fd]) {
+            p->fds[fd] = f;
+            irq_restore(irq);
+            return fd;
+        }
+    }
+    irq_restore(irq);
+    return -1;
+}
+
+file_t *fd_get(process_t *p, int fd) {
+    if (!p || fd < 0 || fd >= PROCESS_MAX_FDS) return 0;
+    return p->fds[fd];
+}
+
+int fd_close(process_t *p, int fd) {
+    if (!p || fd < 0 || fd >= PROCESS_MAX_FDS) return -1;
+
+    uint32_t irq = irq_save();
+    file_t *f = p->fds[fd];
+    p->fds[fd] = 0;
+    irq_restore(irq);
+
+    if (!f) return -1;
+    file_put(f);
+    return 0;
+}
+
+void fd_close_all(process_t *p) {
+    if (!p) return;
+    for (int fd = 0; fd < PROCESS_MAX_FDS; fd++) {
+        if (p->fds[fd]) {
+            fd_close(p, fd);
+        }
+    }
+}
+
+void fd_table_fork(process_t *child) {
+    if (!child) return;
+    for (int fd = 0; fd < PROCESS_MAX_FDS; fd++) {
+        if (child->fds[fd]) {
+            file_get(child->fds[fd]);
+        }
+    }
+}
@@ -0,0 +1,79 @@
+/*
+ * OpenOS - Open Files and File Descriptors
+ *
+ * A file_t is a reference-counted handle onto some kernel object
+ * (a pipe end, a message queue, ...) with a small operations table. Each process
+ * owns a fixed table of PROCESS_MAX_FDS file pointers; a descriptor is
+ * simply an index into it. fork() shares the parent's open files with
+ * the child (each gains a reference), and process_exit() closes
+ * everything still open.
+ */
+
+#ifndef OPENOS_KERNEL_FILE_H
+#define OPENOS_KERNEL_FILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../process/process.h"
+
+/* Access mode flags */
+#define FILE_READ    0x1
+#define FILE_WRITE   0x2
+
+struct file;
+struct poll_table;
+struct epitem;
+
+/*
+ * Per-object operations. Any entry may be NULL if unsupported.
+ * poll returns the EPOLL* bits that hold right now and, given a poll
+ * table, registers the wait queues that signal changes (epoll.h).
+ */
+typedef struct file_ops {
+    int      (*read)(struct file *f, void *buf, size_t n);
+    int      (*write)(struct file *f, const void *buf, size_t n);
+    void     (*release)(struct file *f);     /* last reference dropped */
+    uint32_t (*poll)(struct file *f, struct poll_table *pt);
+} file_ops_t;
+
+typedef struct file {
+    const file_ops_t *ops;
+    void             *object;    /* e.g. pipe_t*                   */
+    uint32_t          flags;     /* FILE_READ / FILE_WRITE         */
+    uint32_t          refcount;
+    struct epitem    *epitems;   /* Interest sets watching it      */
+} file_t;
+
+/* Allocate a file with one reference. Returns NULL on OOM. */
+file_t *file_alloc(const file_ops_t *ops, void *object, uint32_t flags);
+
+/* Take / drop a reference. The last file_put() calls ops->release. */
+void file_get(file_t *f);
+void file_put(file_t *f);
+
+/* Generic I/O through the ops table. Return -1 if unsupported. */
+int file_read(file_t *f, void *buf, size_t n);
+int file_write(file_t *f, const void *buf, size_t n);
+
+/* Readiness through the ops table; 0 if the file cannot be polled. */
+uint32_t file_poll(file_t *f, struct poll_table *pt);
+
+/* ---- Descriptor table -------------------------------------------- */
+
+/* Install `f` at the lowest free descriptor of `p`. Returns fd or -1.
+ * The table takes over the caller's reference. */
+int fd_install(process_t *p, file_t *f);
+
+/* Look up a descriptor. Returns NULL if invalid or closed. */
+file_t *fd_get(process_t *p, int fd);
+
+/* Close a descriptor. Returns 0 on success, -1 if it was not open. */
+int fd_close(process_t *p, int fd);
+
+/* Close every descriptor of `p` (process exit). */
+void fd_close_all(process_t *p);
+
+/* After a PCB copy in fork(): take a reference on every shared file. */
+void fd_table_fork(process_t *child);
+
+#endif /* OPENOS_KERNEL_FILE_H */
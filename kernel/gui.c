@@ -3,35 +3,125 @@
  */
 
 #include "gui.h"
-#include "console.h"
+#include "printk.h"
 #include "string.h"
 #include "../memory/heap.h"
 
 /* Global GUI state */
 static gui_state_t gui;
+static gui_stats_t stats;
 
 /* Simulated framebuffer (in kernel memory) */
 static uint32_t framebuffer_data[GUI_WIDTH * GUI_HEIGHT];
 
+/* Something to draw on: the framebuffer or a window's backing store */
+typedef struct canvas {
+    uint32_t* pixels;
+    int width, height;
+} canvas_t;
+
 /* Initialize GUI subsystem */
 void gui_init(void) {
     if (gui.initialized) return;
     
-    console_write("GUI: Initializing windowing system...\n");
+    printk(LOG_INFO, "GUI: Initializing windowing system...\n");
     
     gui.framebuffer = framebuffer_data;
     gui.width = GUI_WIDTH;
     gui.height = GUI_HEIGHT;
     gui.window_list = NULL;
     gui.next_window_id = 1;
+    gui.damage_count = 0;
     gui.initialized = 1;
     
     /* Clear screen to black */
     gui_clear_screen(COLOR_BLACK);
+    gui_render_all();
     
-    console_write("GUI: 800x600x32 framebuffer initialized\n");
+    printk(LOG_INFO, "GUI: 800x600x32 framebuffer initialized\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* Rectangles                                                           */
+/* ------------------------------------------------------------------ */
+
+static uint32_t rect_area(const rect_t* r) {
+    return (uint32_t)r->width * (uint32_t)r->height;
+}
+
+/* Overlap of `a` and `b` in `out`; returns 0 if there is none */
+static int rect_intersect(const rect_t* a, const rect_t* b, rect_t* out) {
+    int x0 = a->x > b->x ? a->x : b->x;
+    int y0 = a->y > b->y ? a->y : b->y;
+    int x1 = a->x + a->width < b->x + b->width ? a->x + a->width : b->x + b->width;
+    int y1 = a->y + a->height < b->y + b->height ? a->y + a->height : b->y + b->height;
+    if (x0 >= x1 || y0 >= y1) return 0;
+    out->x = x0;
+    out->y = y0;
+    out->width = x1 - x0;
+    out->height = y1 - y0;
+    return 1;
+}
+
+/* Smallest rectangle holding both */
+static rect_t rect_union(const rect_t* a, const rect_t* b) {
+    int x0 = a->x < b->x ? a->x : b->x;
+    int y0 = a->y < b->y ? a->y : b->y;
+    int x1 = a->x + a->width > b->x + b->width ? a->x + a->width : b->x + b->width;
+    int y1 = a->y + a->height > b->y + b->height ? a->y + a->height : b->y + b->height;
+    rect_t u = { x0, y0, x1 - x0, y1 - y0 };
+    return u;
+}
+
+/* ------------------------------------------------------------------ */
+/* Canvas drawing: clipped once per call, then whole rows               */
+/* ------------------------------------------------------------------ */
+
+static void canvas_fill(canvas_t* c, int x, int y, int width, int height,
+                        uint32_t color) {
+    rect_t bounds = { 0, 0, c->width, c->height };
+    rect_t want = { x, y, width, height };
+    rect_t r;
+    if (!rect_intersect(&bounds, &want, &r)) return;
+
+    for (int row = r.y; row < r.y + r.height; row++) {
+        uint32_t* p = &c->pixels[row * c->width + r.x];
+        for (int i = 0; i < r.width; i++) {
+            p[i] = color;
+        }
+    }
 }
 
+static void canvas_frame(canvas_t* c, const rect_t* r, uint32_t color) {
+    canvas_fill(c, r->x, r->y, r->width, 1, color);
+    canvas_fill(c, r->x, r->y + r->height - 1, r->width, 1, color);
+    canvas_fill(c, r->x, r->y, 1, r->height, color);
+    canvas_fill(c, r->x + r->width - 1, r->y, 1, r->height, color);
+}
+
+/* Simple 8x8 bitmap font simulation: a box per character, 9 pixels apart */
+static void canvas_text(canvas_t* c, int x, int y, const char* text,
+                        uint32_t color) {
+    for (; *text; text++, x += 9) {
+        rect_t glyph = { x, y, 8, 8 };
+        canvas_frame(c, &glyph, color);
+    }
+}
+
+static canvas_t screen_canvas(void) {
+    canvas_t c = { gui.framebuffer, gui.width, gui.height };
+    return c;
+}
+
+static canvas_t window_canvas(window_t* window) {
+    canvas_t c = { window->pixels, window->rect.width, window->rect.height };
+    return c;
+}
+
+/* ------------------------------------------------------------------ */
+/* Screen drawing primitives                                            */
+/* ------------------------------------------------------------------ */
+
 /* Draw a single pixel */
 void gui_draw_pixel(int x, int y, uint32_t color) {
     if (x < 0 || x >= gui.width || y < 0 || y >= gui.height) return;
@@ -41,29 +131,15 @@ void gui_draw_pixel(int x, int y, uint32_t color) {
 /* Draw a rectangle outline */
 void gui_draw_rect(rect_t* rect, uint32_t color) {
     if (!rect) return;
-    
-    /* Top and bottom edges */
-    for (int x = rect->x; x < rect->x + rect->width; x++) {
-        gui_draw_pixel(x, rect->y, color);
-        gui_draw_pixel(x, rect->y + rect->height - 1, color);
-    }
-    
-    /* Left and right edges */
-    for (int y = rect->y; y < rect->y + rect->height; y++) {
-        gui_draw_pixel(rect->x, y, color);
-        gui_draw_pixel(rect->x + rect->width - 1, y, color);
-    }
+    canvas_t c = screen_canvas();
+    canvas_frame(&c, rect, color);
 }
 
 /* Draw a filled rectangle */
 void gui_draw_filled_rect(rect_t* rect, uint32_t color) {
     if (!rect) return;
-    
-    for (int y = rect->y; y < rect->y + rect->height; y++) {
-        for (int x = rect->x; x < rect->x + rect->width; x++) {
-            gui_draw_pixel(x, y, color);
-        }
-    }
+    canvas_t c = screen_canvas();
+    canvas_fill(&c, rect->x, rect->y, rect->width, rect->height, color);
 }
 
 /* Draw a line (simple DDA algorithm) */
@@ -92,26 +168,180 @@ void gui_draw_line(int x1, int y1, int x2, int y2, uint32_t color) {
 /* Draw text (simple 8x8 bitmap font simulation) */
 void gui_draw_text(int x, int y, const char* text, uint32_t color) {
     if (!text) return;
-    
-    int offset_x = x;
-    while (*text) {
-        /* Simple character rendering - just draw a box for now */
-        for (int dy = 0; dy < 8; dy++) {
-            for (int dx = 0; dx < 8; dx++) {
-                if ((dx == 0 || dx == 7 || dy == 0 || dy == 7)) {
-                    gui_draw_pixel(offset_x + dx, y + dy, color);
-                }
+    canvas_t c = screen_canvas();
+    canvas_text(&c, x, y, text, color);
+}
+
+/* ------------------------------------------------------------------ */
+/* Damage                                                               */
+/* ------------------------------------------------------------------ */
+
+/* Is one rectangle for both cheaper than two? Yes when the union holds
+ * little (at most a quarter of their size) that is in neither. */
+static int damage_should_merge(const rect_t* a, const rect_t* b) {
+    rect_t u = rect_union(a, b);
+    rect_t both;
+    uint32_t covered = rect_area(a) + rect_area(b);
+    if (rect_intersect(a, b, &both)) covered -= rect_area(&both);
+    return rect_area(&u) - covered <= (rect_area(a) + rect_area(b)) / 4;
+}
+
+static void damage_remove(int i) {
+    gui.damage[i] = gui.damage[--gui.damage_count];
+}
+
+void gui_damage(const rect_t* rect) {
+    if (!rect) return;
+
+    rect_t screen = { 0, 0, gui.width, gui.height };
+    rect_t r;
+    if (!rect_intersect(&screen, rect, &r)) return;
+
+    /* Fold `r` into pending damage it overlaps or adjoins; the result
+     * may in turn take in others, so start over after each merge */
+    int i = 0;
+    while (i < gui.damage_count) {
+        if (damage_should_merge(&gui.damage[i], &r)) {
+            r = rect_union(&gui.damage[i], &r);
+            damage_remove(i);
+            stats.damage_merged++;
+            i = 0;
+            continue;
+        }
+        i++;
+    }
+
+    if (gui.damage_count == GUI_MAX_DAMAGE) {
+        /* Full: merge with whichever grows least */
+        int best = 0;
+        uint32_t best_growth = 0xFFFFFFFFu;
+        for (i = 0; i < gui.damage_count; i++) {
+            rect_t u = rect_union(&gui.damage[i], &r);
+            uint32_t growth = rect_area(&u) - rect_area(&gui.damage[i]);
+            if (growth < best_growth) {
+                best_growth = growth;
+                best = i;
+            }
+        }
+        r = rect_union(&gui.damage[best], &r);
+        damage_remove(best);
+        stats.damage_merged++;
+        gui_damage(&r);
+        return;
+    }
+    gui.damage[gui.damage_count++] = r;
+}
+
+/* Damage part of a window, given in window coordinates */
+static void window_damage(window_t* window, int x, int y, int width, int height) {
+    if (window->state != WINDOW_VISIBLE) return;
+    rect_t all = { 0, 0, window->rect.width, window->rect.height };
+    rect_t want = { x, y, width, height };
+    rect_t r;
+    if (!rect_intersect(&all, &want, &r)) return;
+    r.x += window->rect.x;
+    r.y += window->rect.y;
+    gui_damage(&r);
+}
+
+/* ------------------------------------------------------------------ */
+/* Compositor                                                           */
+/* ------------------------------------------------------------------ */
+
+static void copy_from_window(const window_t* window, const rect_t* r) {
+    const uint32_t* src = &window->pixels[(r->y - window->rect.y) * window->rect.width +
+                                          (r->x - window->rect.x)];
+    uint32_t* dst = &gui.framebuffer[r->y * gui.width + r->x];
+    for (int row = 0; row < r->height; row++) {
+        memcpy(dst, src, (size_t)r->width * sizeof(uint32_t));
+        src += window->rect.width;
+        dst += gui.width;
+    }
+    stats.pixels_copied += rect_area(r);
+}
+
+/*
+ * Paint `r` from the front-most window that overlaps it, then hand the
+ * up to four strips around that overlap (above, below, left, right) to
+ * the windows behind. Pixels a window covers never reach the ones
+ * behind it; what no window covers gets the desktop color.
+ */
+static void composite(const rect_t* r, const window_t* window) {
+    for (; window; window = window->next) {
+        rect_t in;
+        if (window->state != WINDOW_VISIBLE ||
+            !rect_intersect(r, &window->rect, &in)) {
+            continue;
+        }
+        copy_from_window(window, &in);
+
+        const window_t* behind = window->next;
+        int r_bottom  = r->y + r->height;
+        int in_bottom = in.y + in.height;
+        if (in.y > r->y) {
+            rect_t above = { r->x, r->y, r->width, in.y - r->y };
+            composite(&above, behind);
+        }
+        if (in_bottom < r_bottom) {
+            rect_t below = { r->x, in_bottom, r->width, r_bottom - in_bottom };
+            composite(&below, behind);
+        }
+        if (in.x > r->x) {
+            rect_t left = { r->x, in.y, in.x - r->x, in.height };
+            composite(&left, behind);
+        }
+        if (in.x + in.width < r->x + r->width) {
+            rect_t right = { in.x + in.width, in.y,
+                             r->x + r->width - (in.x + in.width), in.height };
+            composite(&right, behind);
+        }
+        return;
+    }
+
+    canvas_t c = screen_canvas();
+    canvas_fill(&c, r->x, r->y, r->width, r->height, gui.desktop_color);
+    stats.pixels_filled += rect_area(r);
+}
+
+/* Composite the damaged regions */
+void gui_render_all(void) {
+    if (gui.damage_count == 0) return;
+
+    stats.frames++;
+    for (int i = 0; i < gui.damage_count; i++) {
+        const rect_t* r = &gui.damage[i];
+        uint32_t before = stats.pixels_copied;
+        uint32_t exposed = 0;
+        composite(r, gui.window_list);
+
+        /* What the windows had in this rectangle but did not show */
+        for (window_t* w = gui.window_list; w; w = w->next) {
+            rect_t in;
+            if (w->state == WINDOW_VISIBLE && rect_intersect(r, &w->rect, &in)) {
+                exposed += rect_area(&in);
             }
         }
-        offset_x += 9;
-        text++;
+        stats.pixels_culled += exposed - (stats.pixels_copied - before);
     }
+    stats.damage_rects += (uint32_t)gui.damage_count;
+    gui.damage_count = 0;
 }
 
-/* Create a new window */
+/* ------------------------------------------------------------------ */
+/* Windows                                                              */
+/* ------------------------------------------------------------------ */
+
+/* Create a new window, in front of the others */
 window_t* gui_create_window(int x, int y, int width, int height, const char* title) {
+    if (width <= 0 || height <= 0) return NULL;
+
     window_t* window = (window_t*)kmalloc(sizeof(window_t));
     if (!window) return NULL;
+    window->pixels = (uint32_t*)kmalloc((size_t)width * (size_t)height * sizeof(uint32_t));
+    if (!window->pixels) {
+        kfree(window);
+        return NULL;
+    }
     
     window->id = gui.next_window_id++;
     window->rect.x = x;
@@ -131,15 +361,12 @@ window_t* gui_create_window(int x, int y, int width, int height, const char* tit
     /* Add to window list */
     window->next = gui.window_list;
     gui.window_list = window;
-    
+
+    gui_render_window(window);
     return window;
 }
 
-/* Destroy a window */
-void gui_destroy_window(window_t* window) {
-    if (!window) return;
-    
-    /* Remove from window list */
+static void window_unlink(window_t* window) {
     window_t** current = &gui.window_list;
     while (*current) {
         if (*current == window) {
@@ -148,61 +375,106 @@ void gui_destroy_window(window_t* window) {
         }
         current = &(*current)->next;
     }
+}
+
+/* Destroy a window */
+void gui_destroy_window(window_t* window) {
+    if (!window) return;
     
+    window_damage(window, 0, 0, window->rect.width, window->rect.height);
+    window_unlink(window);
+    
+    kfree(window->pixels);
     kfree(window);
 }
 
 /* Show window */
 void gui_show_window(window_t* window) {
-    if (window) {
+    if (window && window->state != WINDOW_VISIBLE) {
         window->state = WINDOW_VISIBLE;
+        window_damage(window, 0, 0, window->rect.width, window->rect.height);
     }
 }
 
 /* Hide window */
 void gui_hide_window(window_t* window) {
-    if (window) {
+    if (window && window->state == WINDOW_VISIBLE) {
+        window_damage(window, 0, 0, window->rect.width, window->rect.height);
         window->state = WINDOW_HIDDEN;
     }
 }
 
+/* Move a window: where it was and where it is now need compositing */
+void gui_move_window(window_t* window, int x, int y) {
+    if (!window || (window->rect.x == x && window->rect.y == y)) return;
+
+    window_damage(window, 0, 0, window->rect.width, window->rect.height);
+    window->rect.x = x;
+    window->rect.y = y;
+    window_damage(window, 0, 0, window->rect.width, window->rect.height);
+}
+
+/* Bring a window to the front */
+void gui_raise_window(window_t* window) {
+    if (!window || gui.window_list == window) return;
+
+    window_unlink(window);
+    window->next = gui.window_list;
+    gui.window_list = window;
+    window_damage(window, 0, 0, window->rect.width, window->rect.height);
+}
+
 /* Render a single window */
 void gui_render_window(window_t* window) {
-    if (!window || window->state != WINDOW_VISIBLE) return;
+    if (!window) return;
+    canvas_t c = window_canvas(window);
+    rect_t all = { 0, 0, window->rect.width, window->rect.height };
     
     /* Draw window background */
-    gui_draw_filled_rect(&window->rect, window->bg_color);
+    canvas_fill(&c, 0, 0, all.width, all.height, window->bg_color);
     
     /* Draw window border */
-    gui_draw_rect(&window->rect, COLOR_BLACK);
+    canvas_frame(&c, &all, COLOR_BLACK);
     
     /* Draw title bar */
-    rect_t title_bar = {
-        window->rect.x,
-        window->rect.y,
-        window->rect.width,
-        20
-    };
-    gui_draw_filled_rect(&title_bar, COLOR_BLUE);
+    canvas_fill(&c, 0, 0, all.width, GUI_TITLE_HEIGHT, COLOR_BLUE);
     
     /* Draw title text */
     if (window->title[0]) {
-        gui_draw_text(window->rect.x + 5, window->rect.y + 6, window->title, COLOR_WHITE);
+        canvas_text(&c, 5, 6, window->title, COLOR_WHITE);
     }
+
+    window_damage(window, 0, 0, all.width, all.height);
 }
 
-/* Render all windows */
-void gui_render_all(void) {
-    window_t* window = gui.window_list;
-    while (window) {
-        gui_render_window(window);
-        window = window->next;
-    }
+void gui_window_fill_rect(window_t* window, rect_t* rect, uint32_t color) {
+    if (!window || !rect) return;
+
+    rect_t all = { 0, 0, window->rect.width, window->rect.height };
+    rect_t r;
+    if (!rect_intersect(&all, rect, &r)) return;
+
+    canvas_t c = window_canvas(window);
+    canvas_fill(&c, r.x, r.y, r.width, r.height, color);
+    window_damage(window, r.x, r.y, r.width, r.height);
 }
 
-/* Clear screen */
+void gui_window_draw_text(window_t* window, int x, int y, const char* text,
+                          uint32_t color) {
+    if (!window || !text || !*text) return;
+
+    canvas_t c = window_canvas(window);
+    canvas_text(&c, x, y, text, color);
+    window_damage(window, x, y, (int)string_length(text) * 9, 8);
+}
+
+/* Clear screen: the desktop shows `color` from the next frame on */
 void gui_clear_screen(uint32_t color) {
-    for (int i = 0; i < gui.width * gui.height; i++) {
-        gui.framebuffer[i] = color;
-    }
+    gui.desktop_color = color;
+    rect_t all = { 0, 0, gui.width, gui.height };
+    gui_damage(&all);
+}
+
+void gui_get_stats(gui_stats_t* out) {
+    *out = stats;
 }
@@ -0,0 +1,189 @@
+/*
+ * OpenOS - ICMP Implementation
+ */
+
+#include "icmp.h"
+#include "ip.h"
+#include "string.h"
+#include "../drivers/timer.h"
+#include "../process/process.h"
+#include "../process/scheduler.h"
+#include "../arch/x86/cpu.h"
+
+#define ICMP_PING_ID    0x4F53          /* "OS" */
+
+/* The one outstanding echo request */
+static struct {
+    int          active;
+    volatile int answered;
+    uint16_t     seq;
+    uint64_t     sent_tsc;
+    uint64_t     rtt_cycles;
+    uint32_t     bytes;
+    uint8_t      ttl;
+    wait_queue_t wait;
+} ping;
+
+static icmp_stats_t icmp_stats;
+
+static void icmp_echo_reply(sk_buff_t *skb, const ip_header_t *iph) {
+    icmp_header_t *icmp = (icmp_header_t *)skb->data;
+    in_addr_t to = iph->src_ip;     /* ip_output() overwrites the header */
+
+    /* Only the type and code change, so a checksum that was verified
+     * on the way in is updated in place (RFC 1624). One that arrived
+     * unchecked (over lo) may not be valid and is recomputed if the
+     * reply needs it. */
+    uint16_t before = (uint16_t)(icmp->type | (icmp->code << 8));
+    icmp->type = ICMP_ECHO_REPLY;
+    icmp->code = 0;
+    if (skb->ip_summed == CHECKSUM_UNNECESSARY) {
+        icmp->checksum = 0;
+        skb_csum_partial_set(skb, offsetof(icmp_header_t, checksum), 0);
+    } else {
+        uint16_t check = icmp->checksum;
+        net_csum_replace16(&check, before, ICMP_ECHO_REPLY);
+        icmp->checksum = check;
+    }
+
+    icmp_stats.echo_replies++;
+    ip_output(skb, to, PROTO_ICMP);
+}
+
+static void icmp_echo_answered(sk_buff_t *skb, const ip_header_t *iph) {
+    const icmp_header_t *icmp = (const icmp_header_t *)skb->data;
+    uint64_t now = rdtsc();
+
+    uint32_t irq = irq_save();
+    if (ping.active && !ping.answered && icmp->id == htons(ICMP_PING_ID) &&
+        icmp->seq == htons(ping.seq)) {
+        ping.rtt_cycles = now - ping.sent_tsc;
+        ping.bytes      = skb->len - sizeof(icmp_header_t);
+        ping.ttl        = iph->ttl;
+        ping.answered   = 1;
+        icmp_stats.pings_answered++;
+        if (!wait_queue_empty(&ping.wait)) wait_queue_wake_all(&ping.wait);
+    }
+    irq_restore(irq);
+    skb_free(skb);
+}
+
+static void icmp_rcv(sk_buff_t *skb, const ip_header_t *iph) {
+    icmp_stats.rx_messages++;
+
+    if (skb_headlen(skb) < sizeof(icmp_header_t)) {
+        icmp_stats.rx_errors++;
+        skb_free(skb);
+        return;
+    }
+    if (skb->ip_summed != CHECKSUM_UNNECESSARY && skb_checksum(skb, 0, skb->len) != 0) {
+        icmp_stats.rx_errors++;
+        icmp_stats.rx_csum_errors++;
+        skb_free(skb);
+        return;
+    }
+
+    switch (((const icmp_header_t *)skb->data)->type) {
+    case ICMP_ECHO_REQUEST:
+        icmp_stats.echo_requests++;
+        icmp_echo_reply(skb, iph);
+        break;
+    case ICMP_ECHO_REPLY:
+        icmp_echo_answered(skb, iph);
+        break;
+    default:
+        skb_free(skb);
+        break;
+    }
+}
+
+void icmp_init(void) {
+    wait_queue_init(&ping.wait);
+    ip_register_protocol(PROTO_ICMP, icmp_rcv);
+}
+
+/* Echo request carrying `size` bytes of a counting pattern */
+static sk_buff_t *icmp_build_echo(uint16_t seq, uint32_t size) {
+    sk_buff_t *skb = skb_alloc();
+    if (!skb) return NULL;
+
+    icmp_header_t *icmp = (icmp_header_t *)skb_put(skb, sizeof(icmp_header_t));
+    icmp->type     = ICMP_ECHO_REQUEST;
+    icmp->code     = 0;
+    icmp->checksum = 0;
+    icmp->id       = htons(ICMP_PING_ID);
+    icmp->seq      = htons(seq);
+
+    uint8_t pattern[256];
+    for (uint32_t i = 0; i < sizeof(pattern); i++) pattern[i] = (uint8_t)i;
+    while (size) {
+        uint32_t n = (size < sizeof(pattern)) ? size : sizeof(pattern);
+        if (skb_append_data(skb, pattern, n) < 0) {
+            skb_free(skb);
+            return NULL;
+        }
+        size -= n;
+    }
+
+    skb_csum_partial_set(skb, offsetof(icmp_header_t, checksum), 0);
+    return skb;
+}
+
+int icmp_ping(in_addr_t dst, uint16_t seq, uint32_t size, uint32_t timeout_ms,
+              icmp_ping_result_t *result) {
+    if (size > ICMP_PING_MAX_DATA || !scheduler_active() ||
+        process_getpid() == 0) {
+        return -1;
+    }
+
+    sk_buff_t *skb = icmp_build_echo(seq, size);
+    if (!skb) return -1;
+
+    uint32_t irq = irq_save();
+    if (ping.active) {
+        irq_restore(irq);
+        skb_free(skb);
+        return -1;
+    }
+    ping.active   = 1;
+    ping.answered = 0;
+    ping.seq      = seq;
+    ping.sent_tsc = rdtsc();
+    icmp_stats.pings_sent++;
+    irq_restore(irq);
+
+    int rc = -1;
+    if (ip_output(skb, dst, PROTO_ICMP) == 0) {
+        /* 100 Hz timer: round the timeout up to whole ticks. */
+        uint64_t deadline = timer_get_ticks() + (timeout_ms / 10) +
+                            ((timeout_ms % 10) ? 1 : 0);
+        irq = irq_save();
+        for (;;) {
+            if (ping.answered) break;
+            uint64_t now = timer_get_ticks();
+            if (now >= deadline) break;
+            wait_queue_sleep_timeout(&ping.wait, (uint32_t)(deadline - now));
+        }
+        if (ping.answered) {
+            if (result) {
+                result->rtt_cycles = ping.rtt_cycles;
+                result->bytes      = ping.bytes;
+                result->ttl        = ping.ttl;
+            }
+            rc = 0;
+        }
+        irq_restore(irq);
+    }
+
+    irq = irq_save();
+    ping.active = 0;
+    irq_restore(irq);
+    return rc;
+}
+
+void icmp_get_stats(icmp_stats_t *stats) {
+    if (!stats) return;
+    uint32_t irq = irq_save();
+    *stats = icmp_stats;
+    irq_restore(irq);
+}
@@ -0,0 +1,501 @@
+/*
+ * OpenOS - IPv4 Implementation
+ */
+
+#include "ip.h"
+#include "arp.h"
+#include "string.h"
+#include "../drivers/timer.h"
+#include "../arch/x86/cpu.h"
+
+/* A datagram being reassembled; fragments are linked through
+ * sk_buff::next in offset order and keep their IP headers. */
+typedef struct ipq {
+    int        used;
+    in_addr_t  src;
+    in_addr_t  dst;
+    uint16_t   id;
+    uint8_t    proto;
+    sk_buff_t *frags;
+    uint32_t   count;
+    uint32_t   total;           /* Payload length; 0 until the last fragment */
+    uint32_t   received;        /* Payload bytes held                        */
+    uint64_t   started;
+} ipq_t;
+
+static route_t            routes[IP_MAX_ROUTES];     /* Longest prefix first */
+static int                route_count;
+static ip_proto_handler_t protocols[256];
+static ipq_t              reasm[IP_REASM_SLOTS];
+static uint16_t           next_id;
+static ip_stats_t         ip_stats;
+
+static in_addr_t prefix_to_mask(uint8_t prefix) {
+    return prefix ? htonl(0xFFFFFFFFu << (32 - prefix)) : 0;
+}
+
+static uint8_t mask_to_prefix(in_addr_t mask) {
+    uint32_t m = ntohl(mask);
+    uint8_t prefix = 0;
+    while (m & 0x80000000u) {
+        prefix++;
+        m <<= 1;
+    }
+    return prefix;
+}
+
+static uint32_t ip_hlen(const ip_header_t *iph) {
+    return (uint32_t)(iph->version_ihl & 0x0F) * 4;
+}
+
+/* The header checksum is left 0 for a device that needs none */
+static void ip_fill_header(ip_header_t *iph, const net_device_t *dev,
+                           in_addr_t src, in_addr_t dst, uint8_t proto,
+                           uint32_t tot_len, uint16_t id, uint16_t flags_offset) {
+    iph->version_ihl  = 0x45;
+    iph->tos          = 0;
+    iph->total_length = htons((uint16_t)tot_len);
+    iph->id           = htons(id);
+    iph->flags_offset = htons(flags_offset);
+    iph->ttl          = IP_DEFAULT_TTL;
+    iph->protocol     = proto;
+    iph->checksum     = 0;
+    iph->src_ip       = src;
+    iph->dst_ip       = dst;
+    if (!(dev->flags & NETDEV_NO_CSUM)) {
+        iph->checksum = net_checksum(iph, IP_HLEN);
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* Routing                                                              */
+/* ------------------------------------------------------------------ */
+
+void ip_init(net_device_t *dev, in_addr_t gateway) {
+    in_addr_t mask = ip_to_in(&dev->netmask);
+    ip_route_add(ip_to_in(&dev->ip) & mask, mask_to_prefix(mask), INADDR_ANY, dev);
+    if (gateway != INADDR_ANY) {
+        ip_route_add(INADDR_ANY, 0, gateway, dev);
+    }
+}
+
+int ip_route_add(in_addr_t dest, uint8_t prefix, in_addr_t gateway,
+                 net_device_t *dev) {
+    if (prefix > 32 || !dev) return -1;
+
+    uint32_t irq = irq_save();
+    if (route_count >= IP_MAX_ROUTES) {
+        irq_restore(irq);
+        return -1;
+    }
+
+    /* Keep the table sorted by prefix length so the first match wins */
+    int pos = route_count;
+    while (pos > 0 && routes[pos - 1].prefix < prefix) {
+        routes[pos] = routes[pos - 1];
+        pos--;
+    }
+    route_t *r = &routes[pos];
+    r->mask    = prefix_to_mask(prefix);
+    r->dest    = dest & r->mask;
+    r->gateway = gateway;
+    r->dev     = dev;
+    r->prefix  = prefix;
+    route_count++;
+
+    irq_restore(irq);
+    return 0;
+}
+
+int ip_route_lookup(in_addr_t dst, route_t *out) {
+    int rc = -1;
+    uint32_t irq = irq_save();
+    for (int i = 0; i < route_count; i++) {
+        if ((dst & routes[i].mask) == routes[i].dest) {
+            *out = routes[i];
+            rc = 0;
+            break;
+        }
+    }
+    irq_restore(irq);
+    return rc;
+}
+
+/* Packets to one of our own addresses (routed to lo) come from that
+ * address; anything else from the outgoing device's. */
+static in_addr_t route_source(const route_t *r, in_addr_t dst) {
+    return (r->dev->flags & NETDEV_LOOPBACK) ? dst : ip_to_in(&r->dev->ip);
+}
+
+int ip_route_source(in_addr_t dst, in_addr_t *src, net_device_t **dev) {
+    route_t r;
+    if (ip_route_lookup(dst, &r) < 0) return -1;
+    *src = route_source(&r, dst);
+    if (dev) *dev = r.dev;
+    return 0;
+}
+
+int ip_route_get(int index, route_t *out) {
+    int rc = -1;
+    uint32_t irq = irq_save();
+    if (index >= 0 && index < route_count) {
+        *out = routes[index];
+        rc = 0;
+    }
+    irq_restore(irq);
+    return rc;
+}
+
+void ip_register_protocol(uint8_t proto, ip_proto_handler_t handler) {
+    protocols[proto] = handler;
+}
+
+/* ------------------------------------------------------------------ */
+/* Reassembly                                                           */
+/* ------------------------------------------------------------------ */
+
+static uint32_t frag_offset(const sk_buff_t *skb) {
+    const ip_header_t *iph = (const ip_header_t *)skb->data;
+    return (uint32_t)(ntohs(iph->flags_offset) & IP_OFFSET_MASK) * 8;
+}
+
+static uint32_t frag_payload(const sk_buff_t *skb) {
+    return skb->len - ip_hlen((const ip_header_t *)skb->data);
+}
+
+static void ipq_kill(ipq_t *q) {
+    sk_buff_t *skb = q->frags;
+    while (skb) {
+        sk_buff_t *next = skb->next;
+        skb->next = NULL;
+        skb_free(skb);
+        skb = next;
+    }
+    q->frags = NULL;
+    q->used  = 0;
+}
+
+static ipq_t *ipq_find(const ip_header_t *iph) {
+    ipq_t *free_slot = NULL;
+    ipq_t *oldest = NULL;
+
+    for (int i = 0; i < IP_REASM_SLOTS; i++) {
+        ipq_t *q = &reasm[i];
+        if (!q->used) {
+            if (!free_slot) free_slot = q;
+            continue;
+        }
+        if (q->src == iph->src_ip && q->dst == iph->dst_ip &&
+            q->id == iph->id && q->proto == iph->protocol) {
+            return q;
+        }
+        if (!oldest || q->started < oldest->started) oldest = q;
+    }
+
+    if (!free_slot) {
+        ip_stats.reasm_failed++;
+        ipq_kill(oldest);
+        free_slot = oldest;
+    }
+
+    ipq_t *q = free_slot;
+    memset(q, 0, sizeof(*q));
+    q->used    = 1;
+    q->src     = iph->src_ip;
+    q->dst     = iph->dst_ip;
+    q->id      = iph->id;
+    q->proto   = iph->protocol;
+    q->started = timer_get_ticks();
+    return q;
+}
+
+/* Attach the payload of fragment `f` to `head` as fragments. */
+static int ipq_attach(sk_buff_t *head, sk_buff_t *f) {
+    uint32_t hlen = ip_hlen((const ip_header_t *)f->data);
+    uint32_t linear = skb_headlen(f) - hlen;
+
+    if (linear) {
+        skb_buf_get(f->head);
+        if (skb_add_frag(head, f->head, (uint32_t)(f->data - f->head) + hlen,
+                         linear) < 0) {
+            skb_buf_put(f->head);
+            return -1;
+        }
+    }
+    for (uint32_t i = 0; i < f->nr_frags; i++) {
+        if (skb_add_frag_ref(head, &f->frags[i], 0, f->frags[i].size) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Build the datagram out of a complete queue; NULL on failure. */
+static sk_buff_t *ipq_complete(ipq_t *q) {
+    sk_buff_t *head = q->frags;
+    sk_buff_t *f = head->next;
+    head->next = NULL;
+    q->frags = f;
+
+    while (f) {
+        if (ipq_attach(head, f) < 0) {
+            skb_free(head);
+            return NULL;
+        }
+        q->frags = f->next;
+        f->next = NULL;
+        skb_free(f);
+        f = q->frags;
+    }
+
+    ip_header_t *iph = (ip_header_t *)head->data;
+    iph->total_length = htons((uint16_t)head->len);
+    iph->flags_offset = 0;
+    iph->checksum     = 0;
+    iph->checksum     = net_checksum(iph, ip_hlen(iph));
+    return head;
+}
+
+/* Queue a fragment; returns the whole datagram once the last piece is
+ * in, NULL otherwise (the fragment is kept or dropped). */
+static sk_buff_t *ip_reassemble(sk_buff_t *skb) {
+    const ip_header_t *iph = (const ip_header_t *)skb->data;
+    int more = (ntohs(iph->flags_offset) & IP_FLAG_MF) != 0;
+    uint32_t off = frag_offset(skb);
+    uint32_t len = frag_payload(skb);
+
+    if (len == 0 || (more && (len & 7)) || off + len > 0xFFFF - IP_HLEN) {
+        ip_stats.rx_hdr_errors++;
+        skb_free(skb);
+        return NULL;
+    }
+
+    uint32_t irq = irq_save();
+    ipq_t *q = ipq_find(iph);
+
+    if (!more) {
+        if (q->total && q->total != off + len) goto fail;
+        q->total = off + len;
+    }
+    if (q->total && off + len > q->total) goto fail;
+
+    /* Insert in offset order; any overlap condemns the datagram */
+    sk_buff_t **link = &q->frags;
+    uint32_t prev_end = 0;
+    while (*link && frag_offset(*link) < off) {
+        prev_end = frag_offset(*link) + frag_payload(*link);
+        link = &(*link)->next;
+    }
+    if (prev_end > off || (*link && off + len > frag_offset(*link))) goto fail;
+    if (++q->count > SKB_MAX_FRAGS + 1) goto fail;
+
+    skb->next = *link;
+    *link = skb;
+    q->received += len;
+
+    sk_buff_t *done = NULL;
+    if (q->total && q->received == q->total) {
+        done = ipq_complete(q);
+        ipq_kill(q);
+        if (done) ip_stats.reasm_ok++;
+        else      ip_stats.reasm_failed++;
+    }
+    irq_restore(irq);
+    return done;
+
+fail:
+    ip_stats.reasm_failed++;
+    ipq_kill(q);
+    irq_restore(irq);
+    skb_free(skb);
+    return NULL;
+}
+
+void ip_timer(void) {
+    uint32_t irq = irq_save();
+    uint64_t now = timer_get_ticks();
+    for (int i = 0; i < IP_REASM_SLOTS; i++) {
+        if (reasm[i].used && now - reasm[i].started >= IP_REASM_TIMEOUT_TICKS) {
+            ip_stats.reasm_timeouts++;
+            ipq_kill(&reasm[i]);
+        }
+    }
+    irq_restore(irq);
+}
+
+/* ------------------------------------------------------------------ */
+/* Input / output                                                       */
+/* ------------------------------------------------------------------ */
+
+/* Only packets for one of our addresses are routed to lo, so whatever
+ * arrives there is local. */
+static int ip_is_local(net_device_t *dev, in_addr_t dst) {
+    if (dev->flags & NETDEV_LOOPBACK) return 1;
+
+    in_addr_t self = ip_to_in(&dev->ip);
+    in_addr_t mask = ip_to_in(&dev->netmask);
+    return dst == self || dst == INADDR_BROADCAST ||
+           (mask != INADDR_BROADCAST && dst == (self | ~mask));
+}
+
+void ip_input(net_device_t *dev, sk_buff_t *skb) {
+    ip_stats.rx_packets++;
+
+    const ip_header_t *iph = (const ip_header_t *)skb->data;
+    uint32_t hlen = (skb_headlen(skb) >= IP_HLEN) ? ip_hlen(iph) : 0;
+    if (hlen < IP_HLEN || (iph->version_ihl >> 4) != 4 || skb_headlen(skb) < hlen) {
+        ip_stats.rx_hdr_errors++;
+        skb_free(skb);
+        return;
+    }
+    if (skb->ip_summed != CHECKSUM_UNNECESSARY && net_checksum(iph, hlen) != 0) {
+        ip_stats.rx_hdr_errors++;
+        ip_stats.rx_csum_errors++;
+        skb_free(skb);
+        return;
+    }
+
+    uint32_t tot_len = ntohs(iph->total_length);
+    if (tot_len < hlen || tot_len > skb->len) {
+        ip_stats.rx_hdr_errors++;
+        skb_free(skb);
+        return;
+    }
+    skb_trim(skb, tot_len);         /* Ethernet pads short frames */
+
+    if (!ip_is_local(dev, iph->dst_ip)) {
+        ip_stats.rx_not_local++;
+        skb_free(skb);
+        return;
+    }
+
+    if (ntohs(iph->flags_offset) & (IP_FLAG_MF | IP_OFFSET_MASK)) {
+        ip_stats.reasm_frags++;
+        skb = ip_reassemble(skb);
+        if (!skb) return;
+        /* The header is now the first fragment's, whose options (those
+         * not copied into later fragments) can make it longer */
+        iph = (const ip_header_t *)skb->data;
+        hlen = ip_hlen(iph);
+    }
+
+    ip_proto_handler_t handler = protocols[iph->protocol];
+    if (!handler) {
+        ip_stats.rx_no_proto++;
+        skb_free(skb);
+        return;
+    }
+    skb_pull(skb, hlen);
+    ip_stats.rx_delivered++;
+    handler(skb, iph);
+}
+
+static uint16_t ip_next_id(void) {
+    uint32_t irq = irq_save();
+    uint16_t id = next_id++;
+    irq_restore(irq);
+    return id;
+}
+
+/* Hand a packet to the link layer: ARP for the next hop, or straight
+ * to a device without one. Consumes `skb`. */
+static int ip_finish_output(net_device_t *dev, sk_buff_t *skb,
+                            in_addr_t next_hop) {
+    if (!(dev->flags & NETDEV_LOOPBACK)) return arp_output(dev, skb, next_hop);
+
+    skb->protocol = ETH_P_IP;
+    if (net_xmit(dev, skb, 0) < 0) {
+        skb_free(skb);
+        return -1;
+    }
+    return 0;
+}
+
+/* Fill in a transport checksum left CHECKSUM_PARTIAL; data is at the
+ * transport header. A zero result is sent as 0xFFFF, which is the same
+ * value in ones' complement and keeps UDP from reading "no checksum". */
+static void ip_csum_finish(sk_buff_t *skb) {
+    uint16_t csum = net_csum_fold(skb_csum_partial(skb, 0, skb->len, skb->csum));
+    uint16_t *field = (uint16_t *)(skb->data + skb->csum_offset);
+    *field = csum ? csum : 0xFFFF;
+    skb->ip_summed = CHECKSUM_NONE;
+}
+
+/* Split a payload too large for the MTU into fresh sk_buffs of at most
+ * `mtu` bytes each; the original is freed. */
+static int ip_fragment(sk_buff_t *skb, const route_t *r, in_addr_t src,
+                       in_addr_t dst, uint8_t proto, uint32_t mtu) {
+    uint32_t piece = (mtu - IP_HLEN) & ~7u;
+    uint32_t total = skb->len;
+    uint16_t id = ip_next_id();
+    in_addr_t next_hop = r->gateway ? r->gateway : dst;
+    int rc = 0;
+
+    for (uint32_t off = 0; off < total; off += piece) {
+        uint32_t n = (total - off < piece) ? total - off : piece;
+        sk_buff_t *f = skb_alloc();
+        if (!f) {
+            rc = -1;
+            break;
+        }
+        skb_copy_bits(skb, off, skb_put(f, n), n);
+        uint16_t fo = (uint16_t)(off / 8);
+        if (off + n < total) fo |= IP_FLAG_MF;
+        ip_fill_header((ip_header_t *)skb_push(f, IP_HLEN), r->dev, src, dst,
+                       proto, IP_HLEN + n, id, fo);
+
+        ip_stats.tx_frags++;
+        ip_stats.tx_packets++;
+        if (ip_finish_output(r->dev, f, next_hop) < 0) rc = -1;
+    }
+
+    skb_free(skb);
+    return rc;
+}
+
+int ip_output(sk_buff_t *skb, in_addr_t dst, uint8_t proto) {
+    route_t r;
+    if (ip_route_lookup(dst, &r) < 0 || skb->len + IP_HLEN > 0xFFFF) {
+        ip_stats.tx_no_route++;
+        skb_free(skb);
+        return -1;
+    }
+
+    in_addr_t src = route_source(&r, dst);
+    uint32_t mtu = r.dev->mtu ? r.dev->mtu : ETH_MTU;
+    int fragment = skb->len + IP_HLEN > mtu;
+    if (skb->ip_summed == CHECKSUM_PARTIAL &&
+        (fragment || !(r.dev->flags & NETDEV_NO_CSUM))) {
+        ip_csum_finish(skb);
+    }
+    if (fragment) {
+        return ip_fragment(skb, &r, src, dst, proto, mtu);
+    }
+
+    ip_header_t *iph = (ip_header_t *)skb_push(skb, IP_HLEN);
+    if (!iph) {
+        skb_free(skb);
+        return -1;
+    }
+    ip_fill_header(iph, r.dev, src, dst, proto, skb->len, ip_next_id(), 0);
+    skb->hash = 0;          /* A reused request carries the reverse flow's */
+    ip_stats.tx_packets++;
+    return ip_finish_output(r.dev, skb, r.gateway ? r.gateway : dst);
+}
+
+uint32_t ip_pseudo_csum(in_addr_t src, in_addr_t dst, uint8_t proto,
+                        uint32_t len) {
+    /* Addresses are in network order, so their halves are already the
+     * 16-bit words net_csum_partial() would read from the wire. */
+    uint64_t sum = (uint64_t)(src & 0xFFFF) + (src >> 16) +
+                   (dst & 0xFFFF) + (dst >> 16) +
+                   htons(proto) + htons((uint16_t)len);
+    return (uint32_t)sum;
+}
+
+void ip_get_stats(ip_stats_t *stats) {
+    if (!stats) return;
+    uint32_t irq = irq_save();
+    *stats = ip_stats;
+    irq_restore(irq);
+}
@@ -3,150 +3,1558 @@
  */
 
 #include "ipc.h"
-#include "console.h"
+#include "epoll.h"
+#include "printk.h"
 #include "string.h"
+#include "file.h"
+#include "../fs/vfs.h"
+#include "../memory/heap.h"
+#include "../memory/slab.h"
+#include "../memory/pmm.h"
+#include "../memory/vmm.h"
+#include "../process/scheduler.h"
+#include "../drivers/timer.h"
+#include "../arch/x86/cpu.h"
 
-/* Static storage for pipes and message queues */
-#define MAX_PIPES 32
-#define MAX_MSG_QUEUES 32
+/* Object caches; each type's live objects are also on a list */
+static slab_t* pipe_slab;
+static slab_t* msgq_slab;
+static slab_t* endpoint_slab;
+static ipc_object_t* ipc_live[IPC_OBJ_TYPES];
+
+/* Global names: chained hash of named objects */
+#define IPC_NAME_BUCKETS 64
+static ipc_object_t* ipc_names[IPC_NAME_BUCKETS];
 
-static pipe_t pipes[MAX_PIPES];
-static msg_queue_t msg_queues[MAX_MSG_QUEUES];
 static int ipc_initialized = 0;
 
+static void pipe_cow_break(uint32_t page);
+static void pipe_file_break(vfs_node_t* node);
+static const ipc_object_ops_t pipe_obj_ops;
+static const ipc_object_ops_t msgq_obj_ops;
+static const ipc_object_ops_t endpoint_obj_ops;
+
 /* Initialize IPC subsystem */
 void ipc_init(void) {
     if (ipc_initialized) return;
     
-    /* Initialize all pipes */
-    for (int i = 0; i < MAX_PIPES; i++) {
-        pipes[i].is_open = 0;
-        pipes[i].read_pos = 0;
-        pipes[i].write_pos = 0;
-        pipes[i].count = 0;
+    pipe_slab = slab_create(sizeof(pipe_t));
+    msgq_slab = slab_create(sizeof(msg_queue_t));
+    endpoint_slab = slab_create(sizeof(ipc_endpoint_t));
+
+    for (int i = 0; i < IPC_OBJ_TYPES; i++) {
+        ipc_live[i] = NULL;
     }
-    
-    /* Initialize all message queues */
-    for (int i = 0; i < MAX_MSG_QUEUES; i++) {
-        msg_queues[i].is_open = 0;
-        msg_queues[i].head = 0;
-        msg_queues[i].tail = 0;
-        msg_queues[i].count = 0;
+    for (int i = 0; i < IPC_NAME_BUCKETS; i++) {
+        ipc_names[i] = NULL;
     }
     
+    /* Let gifted pages and spliced files tell us before they change */
+    vmm_set_cow_break_handler(pipe_cow_break);
+    vfs_add_pin_break_handler(pipe_file_break);
+    
     ipc_initialized = 1;
-    console_write("IPC: Pipes and message queues initialized\n");
+    printk(LOG_INFO, "IPC: Pipes and message queues initialized\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* Objects and names                                                    */
+/* ------------------------------------------------------------------ */
+
+void ipc_object_setup(ipc_object_t* obj, uint32_t type,
+                      const ipc_object_ops_t* ops) {
+    obj->ops = ops;
+    obj->type = type;
+    obj->handles = 1;
+    obj->refs = 1;
+    obj->name[0] = '\0';
+    obj->name_next = NULL;
+
+    uint32_t irq = irq_save();
+    obj->prev = NULL;
+    obj->next = ipc_live[type];
+    if (obj->next) obj->next->prev = obj;
+    ipc_live[type] = obj;
+    irq_restore(irq);
+}
+
+void ipc_object_get(ipc_object_t* obj) {
+    uint32_t irq = irq_save();
+    obj->refs++;
+    irq_restore(irq);
+}
+
+void ipc_object_put(ipc_object_t* obj) {
+    uint32_t irq = irq_save();
+    if (--obj->refs > 0) {
+        irq_restore(irq);
+        return;
+    }
+
+    if (obj->prev) obj->prev->next = obj->next;
+    else           ipc_live[obj->type] = obj->next;
+    if (obj->next) obj->next->prev = obj->prev;
+    irq_restore(irq);
+
+    obj->ops->free(obj);
+}
+
+void ipc_object_open(ipc_object_t* obj) {
+    uint32_t irq = irq_save();
+    obj->handles++;
+    obj->refs++;
+    irq_restore(irq);
+}
+
+static uint32_t ipc_name_hash(const char* name) {
+    uint32_t h = 2166136261u;               /* FNV-1a */
+    while (*name) {
+        h ^= (uint8_t)*name++;
+        h *= 16777619u;
+    }
+    return h % IPC_NAME_BUCKETS;
+}
+
+/* Unpublish an object's name. Interrupts must be disabled. */
+static void ipc_name_unbind(ipc_object_t* obj) {
+    if (!obj->name[0]) return;
+
+    ipc_object_t** link = &ipc_names[ipc_name_hash(obj->name)];
+    while (*link && *link != obj) link = &(*link)->name_next;
+    if (*link) *link = obj->name_next;
+    obj->name_next = NULL;
+    obj->name[0] = '\0';
+}
+
+void ipc_object_close(ipc_object_t* obj) {
+    uint32_t irq = irq_save();
+    if (obj->handles == 0) {
+        irq_restore(irq);
+        return;
+    }
+    if (--obj->handles == 0) {
+        ipc_name_unbind(obj);
+        obj->ops->shutdown(obj);
+    }
+    irq_restore(irq);
+
+    ipc_object_put(obj);
+}
+
+/* Find a named object. Interrupts must be disabled. */
+static ipc_object_t* ipc_name_find(const char* name) {
+    for (ipc_object_t* o = ipc_names[ipc_name_hash(name)]; o; o = o->name_next) {
+        if (strcmp(o->name, name) == 0) return o;
+    }
+    return NULL;
+}
+
+int ipc_name_bind(ipc_object_t* obj, const char* name) {
+    if (!obj || !name || !name[0] || strlen(name) >= IPC_NAME_MAX) return -1;
+
+    uint32_t irq = irq_save();
+    if (obj->name[0] || obj->handles == 0 || ipc_name_find(name)) {
+        irq_restore(irq);
+        return -1;
+    }
+    strcpy(obj->name, name);
+    uint32_t b = ipc_name_hash(name);
+    obj->name_next = ipc_names[b];
+    ipc_names[b] = obj;
+    irq_restore(irq);
+    return 0;
+}
+
+ipc_object_t* ipc_name_open(const char* name, uint32_t type) {
+    if (!name || !name[0]) return NULL;
+
+    uint32_t irq = irq_save();
+    ipc_object_t* obj = ipc_name_find(name);
+    if (obj && obj->type == type) {
+        ipc_object_open(obj);
+    } else {
+        obj = NULL;
+    }
+    irq_restore(irq);
+    return obj;
 }
 
-/* Create a new pipe */
+ipc_object_t* ipc_object_first(uint32_t type) {
+    return (type < IPC_OBJ_TYPES) ? ipc_live[type] : NULL;
+}
+
+/* ------------------------------------------------------------------ */
+/* Pipes                                                                */
+/* ------------------------------------------------------------------ */
+
+/* Round a requested capacity to something sane. */
+static size_t pipe_clamp_capacity(size_t capacity) {
+    if (capacity == 0) return PIPE_BUF_SIZE;
+    if (capacity > PIPE_MAX_SIZE) return PIPE_MAX_SIZE;
+    return capacity;
+}
+
+/* Create a new pipe with the default capacity */
 pipe_t* pipe_create(uint32_t reader_pid, uint32_t writer_pid) {
-    for (int i = 0; i < MAX_PIPES; i++) {
-        if (!pipes[i].is_open) {
-            pipes[i].is_open = 1;
-            pipes[i].reader_pid = reader_pid;
-            pipes[i].writer_pid = writer_pid;
-            pipes[i].read_pos = 0;
-            pipes[i].write_pos = 0;
-            pipes[i].count = 0;
-            return &pipes[i];
+    return pipe_create_sized(reader_pid, writer_pid, PIPE_BUF_SIZE);
+}
+
+/* Create a new pipe whose ring holds `capacity` bytes */
+pipe_t* pipe_create_sized(uint32_t reader_pid, uint32_t writer_pid, size_t capacity) {
+    capacity = pipe_clamp_capacity(capacity);
+
+    pipe_t* pipe = (pipe_t*)slab_alloc(pipe_slab);
+    if (!pipe) return NULL;
+
+    uint8_t* buffer = (uint8_t*)kmalloc(capacity);
+    if (!buffer) {
+        slab_free(pipe_slab, pipe);
+        return NULL;
+    }
+
+    pipe->is_open = 1;
+    pipe->buffer = buffer;
+    pipe->capacity = capacity;
+    pipe->reader_pid = reader_pid;
+    pipe->writer_pid = writer_pid;
+    pipe->read_pos = 0;
+    pipe->write_pos = 0;
+    pipe->count = 0;
+    pipe->readers = 1;
+    pipe->writers = 1;
+    pipe->flags = 0;
+    pipe->ring_in = 0;
+    pipe->ring_out = 0;
+    pipe->seg_head = 0;
+    pipe->seg_count = 0;
+    pipe->view = 0;
+    wait_queue_init(&pipe->read_wait);
+    wait_queue_init(&pipe->write_wait);
+    ipc_object_setup(&pipe->obj, IPC_OBJ_PIPE, &pipe_obj_ops);
+    return pipe;
+}
+
+/*
+ * Blocking is only possible once the scheduler runs, and never for the
+ * idle process (it must always stay runnable).
+ */
+static int pipe_can_block(const pipe_t* pipe) {
+    return !(pipe->flags & PIPE_NONBLOCK) && scheduler_active() &&
+           process_getpid() != 0;
+}
+
+/* Copy up to n bytes into the ring: at most two memcpy() chunks. */
+static size_t pipe_ring_put(pipe_t* pipe, const uint8_t* src, size_t n) {
+    size_t space = pipe->capacity - pipe->count;
+    if (n > space) n = space;
+
+    size_t first = pipe->capacity - pipe->write_pos;
+    if (first > n) first = n;
+
+    memcpy(pipe->buffer + pipe->write_pos, src, first);
+    if (n > first) {
+        memcpy(pipe->buffer, src + first, n - first);
+    }
+
+    pipe->write_pos += n;
+    if (pipe->write_pos >= pipe->capacity) pipe->write_pos -= pipe->capacity;
+    pipe->count += n;
+    pipe->ring_in += n;
+    return n;
+}
+
+/* Drop n bytes from the front of the ring without copying them. */
+static void pipe_ring_skip(pipe_t* pipe, size_t n) {
+    pipe->read_pos += n;
+    if (pipe->read_pos >= pipe->capacity) pipe->read_pos -= pipe->capacity;
+    pipe->count -= n;
+    pipe->ring_out += n;
+}
+
+/* Copy up to n bytes out of the ring: at most two memcpy() chunks. */
+static size_t pipe_ring_get(pipe_t* pipe, uint8_t* dst, size_t n) {
+    if (n > pipe->count) n = pipe->count;
+
+    size_t first = pipe->capacity - pipe->read_pos;
+    if (first > n) first = n;
+
+    memcpy(dst, pipe->buffer + pipe->read_pos, first);
+    if (n > first) {
+        memcpy(dst + first, pipe->buffer, n - first);
+    }
+
+    pipe_ring_skip(pipe, n);
+    return n;
+}
+
+/* ------------------------------------------------------------------ */
+/* Segments (zero-copy page references)                                 */
+/* ------------------------------------------------------------------ */
+
+/* Is any pipe still holding a gifted reference to `page`? */
+static int pipe_page_gifted(uint32_t page) {
+    for (ipc_object_t* o = ipc_live[IPC_OBJ_PIPE]; o; o = o->next) {
+        pipe_t* pipe = (pipe_t*)o;
+        if (!pipe->is_open) continue;
+        for (uint32_t k = 0; k < pipe->seg_count; k++) {
+            pipe_seg_t* seg = &pipe->segs[(pipe->seg_head + k) % PIPE_MAX_SEGS];
+            if (seg->kind == PIPE_SEG_GIFT && seg->page == page) return 1;
         }
     }
-    return NULL; /* No free pipes */
+    return 0;
 }
 
-/* Write data to pipe */
-int pipe_write(pipe_t* pipe, const void* data, size_t size) {
+/*
+ * Replace a segment's external bytes with a private page copy, placed
+ * at the same offset within the page. Returns -1 if no page is free,
+ * in which case the segment keeps sharing.
+ */
+static int pipe_seg_privatize(pipe_seg_t* seg) {
+    uint8_t* copy = (uint8_t*)pmm_alloc_page();
+    if (!copy) return -1;
+
+    size_t off = (uint32_t)seg->data & (PAGE_SIZE - 1);
+    if (off + seg->len > PAGE_SIZE) off = 0;
+    memcpy(copy + off, seg->data, seg->len);
+
+    if (seg->kind == PIPE_SEG_FILE) {
+        vfs_unpin(seg->node);
+        seg->node = NULL;
+    }
+    seg->kind = PIPE_SEG_PAGE;
+    seg->page = (uint32_t)copy;
+    seg->data = copy + off;
+    return 0;
+}
+
+/* Give back whatever a segment references. Interrupts must be disabled. */
+static void pipe_seg_release(pipe_seg_t* seg) {
+    switch (seg->kind) {
+    case PIPE_SEG_GIFT:
+        seg->kind = 0;          /* so the scan below skips this one */
+        if (!pipe_page_gifted(seg->page)) {
+            vmm_cow_unprotect((void*)seg->page);
+        }
+        break;
+    case PIPE_SEG_FILE:
+        vfs_unpin(seg->node);
+        break;
+    case PIPE_SEG_PAGE:
+        pmm_free_page((void*)seg->page);
+        break;
+    }
+    seg->kind = 0;
+    seg->node = NULL;
+}
+
+/* The head segment, if every ring byte queued before it has been read. */
+static pipe_seg_t* pipe_ready_seg(pipe_t* pipe) {
+    if (pipe->seg_count == 0) return NULL;
+    pipe_seg_t* seg = &pipe->segs[pipe->seg_head];
+    return (seg->mark == pipe->ring_out) ? seg : NULL;
+}
+
+/* Ring bytes readable before the next segment is due. */
+static size_t pipe_ring_ready(const pipe_t* pipe) {
+    if (pipe->seg_count == 0) return pipe->count;
+    return pipe->segs[pipe->seg_head].mark - pipe->ring_out;
+}
+
+static int pipe_has_data(const pipe_t* pipe) {
+    return pipe->count > 0 || pipe->seg_count > 0;
+}
+
+/* Consume n bytes from the front of the stream (the ready segment or
+ * the ring) without copying. Interrupts must be disabled. */
+static void pipe_advance(pipe_t* pipe, size_t n) {
+    pipe_seg_t* seg = pipe_ready_seg(pipe);
+    if (!seg) {
+        pipe_ring_skip(pipe, n);
+        return;
+    }
+
+    seg->data += n;
+    seg->len -= n;
+    if (seg->len == 0) {
+        pipe->seg_head = (pipe->seg_head + 1) % PIPE_MAX_SEGS;
+        pipe->seg_count--;
+        pipe_seg_release(seg);
+    }
+}
+
+/* Consume the bytes lent out by the last pipe_read_view(). */
+static void pipe_drop_view(pipe_t* pipe) {
+    if (pipe->view == 0) return;
+    pipe_advance(pipe, pipe->view);
+    pipe->view = 0;
+    if (!wait_queue_empty(&pipe->write_wait)) {
+        wait_queue_wake_all(&pipe->write_wait);
+    }
+}
+
+/* Queue a segment at the tail. Interrupts must be disabled and a slot
+ * must be free. */
+static pipe_seg_t* pipe_seg_push(pipe_t* pipe, const uint8_t* data, size_t len,
+                                 uint32_t kind) {
+    pipe_seg_t* seg =
+        &pipe->segs[(pipe->seg_head + pipe->seg_count) % PIPE_MAX_SEGS];
+    seg->data = data;
+    seg->len = len;
+    seg->mark = pipe->ring_in;
+    seg->kind = kind;
+    seg->page = (uint32_t)data & ~(uint32_t)(PAGE_SIZE - 1);
+    seg->node = NULL;
+    pipe->seg_count++;
+
+    if (!wait_queue_empty(&pipe->read_wait)) {
+        wait_queue_wake_all(&pipe->read_wait);
+    }
+    return seg;
+}
+
+/*
+ * Wait until a segment slot is free. Returns 0 when one is, -1 on a
+ * broken pipe or when the caller may not block. Interrupts must be
+ * disabled.
+ */
+static int pipe_wait_seg_slot(pipe_t* pipe) {
+    for (;;) {
+        if (!pipe->is_open || pipe->readers == 0) return -1;
+        if (pipe->seg_count < PIPE_MAX_SEGS) return 0;
+        if (!pipe_can_block(pipe)) return -1;
+        wait_queue_sleep(&pipe->write_wait);
+    }
+}
+
+/* vmm callback: a gifted page is about to be written. */
+static void pipe_cow_break(uint32_t page) {
+    for (ipc_object_t* o = ipc_live[IPC_OBJ_PIPE]; o; o = o->next) {
+        pipe_t* pipe = (pipe_t*)o;
+        if (!pipe->is_open) continue;
+        for (uint32_t k = 0; k < pipe->seg_count; k++) {
+            pipe_seg_t* seg = &pipe->segs[(pipe->seg_head + k) % PIPE_MAX_SEGS];
+            if (seg->kind == PIPE_SEG_GIFT && seg->page == page) {
+                pipe_seg_privatize(seg);
+            }
+        }
+    }
+}
+
+/* vfs callback: a pinned file is about to be written. */
+static void pipe_file_break(vfs_node_t* node) {
+    for (ipc_object_t* o = ipc_live[IPC_OBJ_PIPE]; o; o = o->next) {
+        pipe_t* pipe = (pipe_t*)o;
+        if (!pipe->is_open) continue;
+        for (uint32_t k = 0; k < pipe->seg_count; k++) {
+            pipe_seg_t* seg = &pipe->segs[(pipe->seg_head + k) % PIPE_MAX_SEGS];
+            if (seg->kind == PIPE_SEG_FILE && seg->node == node) {
+                pipe_seg_privatize(seg);
+            }
+        }
+    }
+}
+
+/*
+ * Write data to pipe
+ *
+ * Blocks until all `size` bytes are in the ring, unless the pipe is
+ * non-blocking or every reader has gone away, in which case the bytes
+ * written so far are returned (-1 if none could be written).
+ */
+static int do_pipe_write(pipe_t* pipe, const void* data, size_t size) {
     if (!pipe || !pipe->is_open || !data) return -1;
-    
+
     const uint8_t* src = (const uint8_t*)data;
     size_t written = 0;
-    
-    while (written < size && pipe->count < PIPE_BUF_SIZE) {
-        pipe->buffer[pipe->write_pos] = src[written];
-        pipe->write_pos = (pipe->write_pos + 1) % PIPE_BUF_SIZE;
-        pipe->count++;
-        written++;
+    int failed = 0;
+
+    uint32_t irq = irq_save();
+    while (written < size) {
+        if (!pipe->is_open || pipe->readers == 0) {
+            failed = 1;                 /* Broken pipe */
+            break;
+        }
+        if (pipe->count == pipe->capacity) {
+            if (!pipe_can_block(pipe)) {
+                failed = 1;             /* Would block */
+                break;
+            }
+            wait_queue_sleep(&pipe->write_wait);
+            continue;
+        }
+
+        written += pipe_ring_put(pipe, src + written, size - written);
+        if (!wait_queue_empty(&pipe->read_wait)) {
+            wait_queue_wake_all(&pipe->read_wait);
+        }
     }
-    
-    return written;
+    irq_restore(irq);
+
+    if (written == 0 && failed) return -1;
+    return (int)written;
 }
 
-/* Read data from pipe */
-int pipe_read(pipe_t* pipe, void* buffer, size_t size) {
+/*
+ * Wait for readable data. Returns 1 when there is some, otherwise the
+ * value the read should return: 0 at EOF, -1 if the pipe is empty but
+ * still has writers and the read may not sleep (PIPE_NONBLOCK, or a
+ * caller that cannot block), so that it is never mistaken for EOF.
+ * Interrupts must be disabled.
+ */
+static int pipe_wait_data(pipe_t* pipe) {
+    while (!pipe_has_data(pipe)) {
+        if (!pipe->is_open || pipe->writers == 0) {
+            return 0;                   /* EOF */
+        }
+        if (!pipe_can_block(pipe)) {
+            return -1;
+        }
+        wait_queue_sleep(&pipe->read_wait);
+    }
+    return 1;
+}
+
+/*
+ * Read data from pipe
+ *
+ * Blocks while the pipe is empty and a writer is still open, then
+ * returns whatever is available (up to `size`), ring bytes and
+ * segments alike. Returns 0 at EOF and -1 if a read that cannot
+ * block (non-blocking, or no process to put to sleep) finds the pipe
+ * empty.
+ */
+static int do_pipe_read(pipe_t* pipe, void* buffer, size_t size) {
     if (!pipe || !pipe->is_open || !buffer) return -1;
-    
+    if (size == 0) return 0;
+
     uint8_t* dst = (uint8_t*)buffer;
-    size_t read = 0;
-    
-    while (read < size && pipe->count > 0) {
-        dst[read] = pipe->buffer[pipe->read_pos];
-        pipe->read_pos = (pipe->read_pos + 1) % PIPE_BUF_SIZE;
-        pipe->count--;
-        read++;
+
+    uint32_t irq = irq_save();
+    pipe_drop_view(pipe);
+
+    int ready = pipe_wait_data(pipe);
+    if (ready <= 0) {
+        irq_restore(irq);
+        return ready;
     }
-    
-    return read;
+
+    size_t done = 0;
+    while (done < size) {
+        size_t n;
+        pipe_seg_t* seg = pipe_ready_seg(pipe);
+        if (seg) {
+            n = seg->len;
+            if (n > size - done) n = size - done;
+            memcpy(dst + done, seg->data, n);
+            pipe_advance(pipe, n);
+        } else {
+            n = pipe_ring_ready(pipe);
+            if (n == 0) break;
+            if (n > size - done) n = size - done;
+            pipe_ring_get(pipe, dst + done, n);
+        }
+        done += n;
+    }
+
+    if (!wait_queue_empty(&pipe->write_wait)) {
+        wait_queue_wake_all(&pipe->write_wait);
+    }
+    irq_restore(irq);
+
+    return (int)done;
 }
 
-/* Close pipe */
-void pipe_close(pipe_t* pipe) {
+/* Lend the reader the next contiguous run of data */
+static int do_pipe_read_view(pipe_t* pipe, const void** data) {
+    if (!pipe || !pipe->is_open || !data) return -1;
+
+    uint32_t irq = irq_save();
+    pipe_drop_view(pipe);
+
+    int ready = pipe_wait_data(pipe);
+    if (ready <= 0) {
+        irq_restore(irq);
+        return ready;
+    }
+
+    size_t n;
+    pipe_seg_t* seg = pipe_ready_seg(pipe);
+    if (seg) {
+        *data = seg->data;
+        n = seg->len;
+    } else {
+        *data = pipe->buffer + pipe->read_pos;
+        n = pipe_ring_ready(pipe);
+        if (n > pipe->capacity - pipe->read_pos) {
+            n = pipe->capacity - pipe->read_pos;
+        }
+    }
+    pipe->view = n;
+    irq_restore(irq);
+
+    return (int)n;
+}
+
+/* Queue page references to `buf`, or copy it without SPLICE_F_GIFT */
+static int do_pipe_vmsplice(pipe_t* pipe, const void* buf, size_t len, uint32_t flags) {
+    if (!(flags & SPLICE_F_GIFT)) {
+        return do_pipe_write(pipe, buf, len);
+    }
+    if (!pipe || !pipe->is_open || !buf) return -1;
+
+    const uint8_t* src = (const uint8_t*)buf;
+    size_t queued = 0;
+    int failed = 0;
+
+    uint32_t irq = irq_save();
+    while (queued < len) {
+        if (pipe_wait_seg_slot(pipe) < 0) {
+            failed = 1;
+            break;
+        }
+
+        /* One segment per page, so each can be protected on its own. */
+        const uint8_t* p = src + queued;
+        size_t n = PAGE_SIZE - ((uint32_t)p & (PAGE_SIZE - 1));
+        if (n > len - queued) n = len - queued;
+
+        pipe_seg_t* seg = pipe_seg_push(pipe, p, n, PIPE_SEG_GIFT);
+        if (vmm_cow_protect((void*)seg->page) < 0 &&
+            pipe_seg_privatize(seg) < 0) {
+            /* Neither protectable nor copyable: take it back. */
+            pipe->seg_count--;
+            seg->kind = 0;
+            failed = 1;
+            break;
+        }
+        queued += n;
+    }
+    irq_restore(irq);
+
+    if (queued == 0 && failed) return -1;
+    return (int)queued;
+}
+
+/* Queue a pinned reference to part of a ramfs file */
+static int do_pipe_splice_from_file(pipe_t* pipe, vfs_node_t* node,
+                                    uint32_t offset, size_t len) {
+    if (!pipe || !pipe->is_open || !node || node->type != NODE_FILE) return -1;
+    if (offset >= node->length) return 0;
+    if (len > node->length - offset) len = node->length - offset;
+    if (len == 0) return 0;
+
+    uint32_t irq = irq_save();
+    if (pipe_wait_seg_slot(pipe) < 0) {
+        irq_restore(irq);
+        return -1;
+    }
+    pipe_seg_t* seg = pipe_seg_push(pipe, node->content + offset, len,
+                                    PIPE_SEG_FILE);
+    seg->node = node;
+    vfs_pin(node);
+    irq_restore(irq);
+
+    return (int)len;
+}
+
+/* Move up to `len` bytes of pipe data into a ramfs file */
+static int do_pipe_splice_to_file(pipe_t* pipe, vfs_node_t* node,
+                                  uint32_t offset, size_t len) {
+    if (!pipe || !pipe->is_open || !node || node->type != NODE_FILE) return -1;
+    if (offset >= VFS_MAX_FILE_SIZE) return -1;
+    if (len > VFS_MAX_FILE_SIZE - offset) len = VFS_MAX_FILE_SIZE - offset;
+
+    uint32_t irq = irq_save();
+    pipe_drop_view(pipe);
+
+    int ready = pipe_wait_data(pipe);
+    if (ready <= 0) {
+        irq_restore(irq);
+        return ready;
+    }
+
+    /* The file may itself be spliced into this pipe: detach first so
+     * the source bytes cannot be overwritten mid-copy. */
+    if (node->pins > 0) {
+        pipe_file_break(node);
+    }
+
+    size_t done = 0;
+    while (done < len) {
+        const uint8_t* src;
+        size_t n;
+        pipe_seg_t* seg = pipe_ready_seg(pipe);
+        if (seg) {
+            src = seg->data;
+            n = seg->len;
+        } else {
+            src = pipe->buffer + pipe->read_pos;
+            n = pipe_ring_ready(pipe);
+            if (n > pipe->capacity - pipe->read_pos) {
+                n = pipe->capacity - pipe->read_pos;
+            }
+        }
+        if (n == 0) break;
+        if (n > len - done) n = len - done;
+
+        /* ramfs keeps content inline, so this is the one copy. */
+        vfs_write(node, offset + done, n, src);
+        pipe_advance(pipe, n);
+        done += n;
+    }
+
+    if (!wait_queue_empty(&pipe->write_wait)) {
+        wait_queue_wake_all(&pipe->write_wait);
+    }
+    irq_restore(irq);
+
+    return (int)done;
+}
+
+/* Set pipe flags (PIPE_NONBLOCK) */
+void pipe_set_flags(pipe_t* pipe, uint32_t flags) {
     if (pipe) {
-        pipe->is_open = 0;
+        pipe->flags = flags;
     }
 }
 
-/* Create a new message queue */
-msg_queue_t* msgqueue_create(uint32_t owner_pid) {
-    for (int i = 0; i < MAX_MSG_QUEUES; i++) {
-        if (!msg_queues[i].is_open) {
-            msg_queues[i].is_open = 1;
-            msg_queues[i].owner_pid = owner_pid;
-            msg_queues[i].head = 0;
-            msg_queues[i].tail = 0;
-            msg_queues[i].count = 0;
-            return &msg_queues[i];
+/* Last handle gone: release the buffer and segments. Interrupts are
+ * disabled. */
+static void pipe_shutdown(ipc_object_t* obj) {
+    pipe_t* pipe = (pipe_t*)obj;
+    uint8_t* buffer = pipe->buffer;
+
+    pipe->is_open = 0;
+    pipe->readers = 0;
+    pipe->writers = 0;
+    pipe->buffer = NULL;
+    pipe->count = 0;
+    pipe->view = 0;
+
+    /* With is_open clear, gift releases only see other pipes' pages. */
+    while (pipe->seg_count > 0) {
+        pipe_seg_release(&pipe->segs[pipe->seg_head]);
+        pipe->seg_head = (pipe->seg_head + 1) % PIPE_MAX_SEGS;
+        pipe->seg_count--;
+    }
+
+    /* Anyone still blocked re-checks is_open and bails out. */
+    wait_queue_wake_all(&pipe->read_wait);
+    wait_queue_wake_all(&pipe->write_wait);
+
+    kfree(buffer);
+}
+
+static void pipe_free(ipc_object_t* obj) {
+    slab_free(pipe_slab, obj);
+}
+
+static const ipc_object_ops_t pipe_obj_ops = {
+    .kind     = "pipe",
+    .shutdown = pipe_shutdown,
+    .free     = pipe_free,
+};
+
+/* Close one end of a pipe; the pipe shuts down once both ends are closed */
+void pipe_close_end(pipe_t* pipe, int end) {
+    if (!pipe || !pipe->is_open) return;
+
+    uint32_t irq = irq_save();
+    if (end == PIPE_END_READ) {
+        if (pipe->readers > 0) pipe->readers--;
+        /* Writers blocked on a full ring must see the broken pipe. */
+        wait_queue_wake_all(&pipe->write_wait);
+    } else {
+        if (pipe->writers > 0) pipe->writers--;
+        /* Readers blocked on an empty ring must see EOF. */
+        wait_queue_wake_all(&pipe->read_wait);
+    }
+
+    int last = (pipe->readers == 0 && pipe->writers == 0);
+    irq_restore(irq);
+
+    if (last) ipc_object_close(&pipe->obj);
+}
+
+/* Close pipe (both ends) */
+void pipe_close(pipe_t* pipe) {
+    if (!pipe || !pipe->is_open) return;
+    ipc_object_close(&pipe->obj);
+}
+
+/*
+ * Public entry points for operations that may sleep: each pins the
+ * pipe so it stays valid if it is shut down while the caller waits.
+ */
+int pipe_write(pipe_t* pipe, const void* data, size_t size) {
+    if (!pipe) return -1;
+    ipc_object_get(&pipe->obj);
+    int ret = do_pipe_write(pipe, data, size);
+    ipc_object_put(&pipe->obj);
+    return ret;
+}
+
+int pipe_read(pipe_t* pipe, void* buffer, size_t size) {
+    if (!pipe) return -1;
+    ipc_object_get(&pipe->obj);
+    int ret = do_pipe_read(pipe, buffer, size);
+    ipc_object_put(&pipe->obj);
+    return ret;
+}
+
+int pipe_read_view(pipe_t* pipe, const void** data) {
+    if (!pipe) return -1;
+    ipc_object_get(&pipe->obj);
+    int ret = do_pipe_read_view(pipe, data);
+    ipc_object_put(&pipe->obj);
+    return ret;
+}
+
+int pipe_vmsplice(pipe_t* pipe, const void* buf, size_t len, uint32_t flags) {
+    if (!pipe) return -1;
+    ipc_object_get(&pipe->obj);
+    int ret = do_pipe_vmsplice(pipe, buf, len, flags);
+    ipc_object_put(&pipe->obj);
+    return ret;
+}
+
+int pipe_splice_from_file(pipe_t* pipe, vfs_node_t* node,
+                          uint32_t offset, size_t len) {
+    if (!pipe) return -1;
+    ipc_object_get(&pipe->obj);
+    int ret = do_pipe_splice_from_file(pipe, node, offset, len);
+    ipc_object_put(&pipe->obj);
+    return ret;
+}
+
+int pipe_splice_to_file(pipe_t* pipe, vfs_node_t* node,
+                        uint32_t offset, size_t len) {
+    if (!pipe) return -1;
+    ipc_object_get(&pipe->obj);
+    int ret = do_pipe_splice_to_file(pipe, node, offset, len);
+    ipc_object_put(&pipe->obj);
+    return ret;
+}
+
+/* ------------------------------------------------------------------ */
+/* Pipes as file descriptors                                            */
+/* ------------------------------------------------------------------ */
+
+static int pipe_file_read(file_t* f, void* buf, size_t n) {
+    return pipe_read((pipe_t*)f->object, buf, n);
+}
+
+static int pipe_file_write(file_t* f, const void* buf, size_t n) {
+    return pipe_write((pipe_t*)f->object, buf, n);
+}
+
+static void pipe_file_release(file_t* f) {
+    pipe_t* pipe = (pipe_t*)f->object;
+    pipe_close_end(pipe, (f->flags & FILE_WRITE) ? PIPE_END_WRITE : PIPE_END_READ);
+    ipc_object_put(&pipe->obj);
+}
+
+/* Read end: data or EOF; write end: ring space or no readers left. */
+static uint32_t pipe_file_poll(file_t* f, poll_table_t* pt) {
+    pipe_t* pipe = (pipe_t*)f->object;
+    uint32_t mask = 0;
+
+    if (f->flags & FILE_READ) {
+        poll_wait(pt, &pipe->read_wait, EPOLLIN | EPOLLHUP);
+        if (pipe_has_data(pipe)) mask |= EPOLLIN;
+        if (!pipe->is_open || pipe->writers == 0) mask |= EPOLLHUP;
+    } else {
+        poll_wait(pt, &pipe->write_wait, EPOLLOUT | EPOLLERR);
+        if (!pipe->is_open || pipe->readers == 0) mask |= EPOLLERR;
+        else if (pipe->count < pipe->capacity) mask |= EPOLLOUT;
+    }
+    return mask;
+}
+
+static const file_ops_t pipe_file_ops = {
+    .read    = pipe_file_read,
+    .write   = pipe_file_write,
+    .release = pipe_file_release,
+    .poll    = pipe_file_poll,
+};
+
+pipe_t* pipe_from_file(file_t* f) {
+    if (!f || f->ops != &pipe_file_ops) return NULL;
+    return (pipe_t*)f->object;
+}
+
+/* Create a pipe and a file for each end */
+int pipe_open_files(file_t* files[2], size_t capacity) {
+    process_t* self = process_current();
+    uint32_t pid = self ? self->pid : 0;
+    if (!files) return -1;
+
+    pipe_t* pipe = pipe_create_sized(pid, pid, capacity);
+    if (!pipe) return -1;
+
+    file_t* rf = file_alloc(&pipe_file_ops, pipe, FILE_READ);
+    file_t* wf = file_alloc(&pipe_file_ops, pipe, FILE_WRITE);
+    if (!rf || !wf) {
+        if (rf) kfree(rf);
+        if (wf) kfree(wf);
+        pipe_close(pipe);
+        return -1;
+    }
+
+    /* Each end's file pins the pipe until it is released. */
+    ipc_object_get(&pipe->obj);
+    ipc_object_get(&pipe->obj);
+
+    files[0] = rf;
+    files[1] = wf;
+    return 0;
+}
+
+/* Create a pipe and install both ends in the current process */
+int pipe_open_fds(int fds[2], size_t capacity) {
+    process_t* self = process_current();
+    if (!fds || !self) return -1;
+
+    file_t* files[2];
+    if (pipe_open_files(files, capacity) < 0) return -1;
+    file_t* rf = files[0];
+    file_t* wf = files[1];
+
+    int rfd = fd_install(self, rf);
+    if (rfd < 0) {
+        file_put(rf);           /* drops the read end */
+        file_put(wf);           /* drops the write end, frees the pipe */
+        return -1;
+    }
+    int wfd = fd_install(self, wf);
+    if (wfd < 0) {
+        fd_close(self, rfd);    /* drops the read end */
+        file_put(wf);           /* drops the write end, frees the pipe */
+        return -1;
+    }
+
+    fds[0] = rfd;
+    fds[1] = wfd;
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* Message queues                                                       */
+/* ------------------------------------------------------------------ */
+
+/*
+ * Arena block header. Free blocks use `size` and `next` (free list);
+ * queued messages also fill in the rest and link through `next` on
+ * their priority FIFO. The payload follows the header.
+ */
+typedef struct msg_block {
+    uint32_t size;              /* Whole block, header included */
+    struct msg_block* next;
+    uint32_t sender_pid;
+    uint32_t type;
+    uint32_t priority;
+    uint32_t len;               /* Payload bytes */
+} msg_block_t;
+
+#define MSG_ALIGN      8
+#define MSG_HDR_SIZE   ((sizeof(msg_block_t) + MSG_ALIGN - 1) & ~(MSG_ALIGN - 1))
+#define MSG_MIN_BLOCK  (MSG_HDR_SIZE + MSG_ALIGN)
+
+static size_t msg_block_size(size_t payload) {
+    return (MSG_HDR_SIZE + payload + MSG_ALIGN - 1) & ~(size_t)(MSG_ALIGN - 1);
+}
+
+/* First-fit allocation from the arena. Interrupts must be disabled. */
+static msg_block_t* msgq_alloc(msg_queue_t* queue, size_t need) {
+    msg_block_t* prev = NULL;
+    for (msg_block_t* b = queue->free_list; b; prev = b, b = b->next) {
+        if (b->size < need) continue;
+
+        msg_block_t* rest = b->next;
+        if (b->size - need >= MSG_MIN_BLOCK) {
+            /* Split: the tail stays free in b's place. */
+            msg_block_t* tail = (msg_block_t*)((uint8_t*)b + need);
+            tail->size = b->size - need;
+            tail->next = b->next;
+            rest = tail;
+            b->size = need;
         }
+        if (prev) prev->next = rest;
+        else      queue->free_list = rest;
+
+        queue->bytes += b->size;
+        return b;
+    }
+    return NULL;
+}
+
+/* Is there a free block of at least `need` bytes? Interrupts must be
+ * disabled. */
+static int msgq_has_room(const msg_queue_t* queue, size_t need) {
+    for (const msg_block_t* b = queue->free_list; b; b = b->next) {
+        if (b->size >= need) return 1;
+    }
+    return 0;
+}
+
+/* Return a block to the arena, merging with adjacent free blocks.
+ * Interrupts must be disabled. */
+static void msgq_free(msg_queue_t* queue, msg_block_t* b) {
+    queue->bytes -= b->size;
+
+    msg_block_t* prev = NULL;
+    msg_block_t* next = queue->free_list;
+    while (next && next < b) {
+        prev = next;
+        next = next->next;
+    }
+
+    if (next && (uint8_t*)b + b->size == (uint8_t*)next) {
+        b->size += next->size;
+        next = next->next;
+    }
+    b->next = next;
+
+    if (prev && (uint8_t*)prev + prev->size == (uint8_t*)b) {
+        prev->size += b->size;
+        prev->next = b->next;
+    } else if (prev) {
+        prev->next = b;
+    } else {
+        queue->free_list = b;
+    }
+}
+
+/* As for pipes: no blocking before the scheduler runs, or in idle. */
+static int ipc_can_block(void) {
+    return scheduler_active() && process_getpid() != 0;
+}
+
+/* Absolute tick deadline for a millisecond timeout (100 Hz timer). */
+static uint64_t msgq_deadline(uint32_t timeout_ms) {
+    return timer_get_ticks() + (timeout_ms / 10) + ((timeout_ms % 10) ? 1 : 0);
+}
+
+/*
+ * Sleep on `wq` until woken or the deadline passes. Returns 0 to
+ * retry, -1 when the caller should give up. Interrupts must be
+ * disabled.
+ */
+static int msgq_wait(wait_queue_t* wq, uint32_t timeout_ms, uint64_t deadline) {
+    if (timeout_ms == MSGQ_NOWAIT || !ipc_can_block()) return -1;
+    if (timeout_ms == MSGQ_FOREVER) {
+        wait_queue_sleep(wq);
+        return 0;
+    }
+
+    uint64_t now = timer_get_ticks();
+    if (now >= deadline) return -1;
+    wait_queue_sleep_timeout(wq, (uint32_t)(deadline - now));
+    return 0;
+}
+
+/* Create a new message queue with the default arena */
+msg_queue_t* msgqueue_create(uint32_t owner_pid) {
+    return msgqueue_create_sized(owner_pid, MSGQ_DEFAULT_ARENA,
+                                 MSGQ_DEFAULT_MSG_MAX);
+}
+
+/* Create a new message queue with an `arena_size`-byte arena */
+msg_queue_t* msgqueue_create_sized(uint32_t owner_pid, size_t arena_size,
+                                   size_t max_msg) {
+    if (arena_size == 0) arena_size = MSGQ_DEFAULT_ARENA;
+    if (arena_size > MSGQ_MAX_ARENA) arena_size = MSGQ_MAX_ARENA;
+    arena_size &= ~(size_t)(MSG_ALIGN - 1);
+    if (arena_size < MSG_MIN_BLOCK) return NULL;
+
+    /* A single message must always be able to fit. */
+    if (max_msg == 0) max_msg = MSGQ_DEFAULT_MSG_MAX;
+    if (msg_block_size(max_msg) > arena_size) {
+        max_msg = arena_size - MSG_HDR_SIZE;
+    }
+
+    msg_queue_t* queue = (msg_queue_t*)slab_alloc(msgq_slab);
+    if (!queue) return NULL;
+
+    uint8_t* arena = (uint8_t*)kmalloc(arena_size);
+    if (!arena) {
+        slab_free(msgq_slab, queue);
+        return NULL;
     }
-    return NULL; /* No free message queues */
+
+    queue->is_open = 1;
+    queue->owner_pid = owner_pid;
+    queue->arena = arena;
+    queue->arena_size = arena_size;
+    queue->max_msg = max_msg;
+    queue->free_list = (msg_block_t*)arena;
+    queue->free_list->size = arena_size;
+    queue->free_list->next = NULL;
+    for (int p = 0; p < MSGQ_PRIORITIES; p++) {
+        queue->head[p] = NULL;
+        queue->tail[p] = NULL;
+    }
+    queue->prio_map = 0;
+    queue->count = 0;
+    queue->bytes = 0;
+    wait_queue_init(&queue->send_wait);
+    wait_queue_init(&queue->recv_wait);
+    ipc_object_setup(&queue->obj, IPC_OBJ_MSGQ, &msgq_obj_ops);
+    return queue;
 }
 
 /* Send message to queue */
-int msgqueue_send(msg_queue_t* queue, uint32_t sender_pid, uint32_t type, const void* data, size_t size) {
-    if (!queue || !queue->is_open || size > MSG_MAX_SIZE) return -1;
-    if (queue->count >= MSG_QUEUE_SIZE) return -1; /* Queue full */
-    
-    message_t* msg = &queue->messages[queue->tail];
-    msg->sender_pid = sender_pid;
-    msg->type = type;
-    msg->size = size;
-    
-    if (data && size > 0) {
-        memcpy(msg->data, data, size);
+static int do_msgqueue_send(msg_queue_t* queue, uint32_t sender_pid,
+                            uint32_t type, uint32_t priority,
+                            const void* data, size_t size,
+                            uint32_t timeout_ms) {
+    if (!queue || !queue->is_open) return -1;
+    if (size > queue->max_msg || (size > 0 && !data)) return -1;
+    if (priority >= MSGQ_PRIORITIES) priority = MSGQ_PRIORITIES - 1;
+
+    size_t need = msg_block_size(size);
+    uint64_t deadline = msgq_deadline(timeout_ms);
+
+    uint32_t irq = irq_save();
+    msg_block_t* b;
+    while (!(b = msgq_alloc(queue, need))) {
+        if (msgq_wait(&queue->send_wait, timeout_ms, deadline) < 0 ||
+            !queue->is_open) {
+            irq_restore(irq);
+            return -1;
+        }
     }
-    
-    queue->tail = (queue->tail + 1) % MSG_QUEUE_SIZE;
+
+    b->next = NULL;
+    b->sender_pid = sender_pid;
+    b->type = type;
+    b->priority = priority;
+    b->len = size;
+    if (size > 0) {
+        memcpy((uint8_t*)b + MSG_HDR_SIZE, data, size);
+    }
+
+    if (queue->tail[priority]) queue->tail[priority]->next = b;
+    else                       queue->head[priority] = b;
+    queue->tail[priority] = b;
+    queue->prio_map |= 1u << priority;
     queue->count++;
-    
+
+    /* One message satisfies one receiver. */
+    if (!wait_queue_empty(&queue->recv_wait)) {
+        wait_queue_wake_one(&queue->recv_wait);
+    }
+    irq_restore(irq);
+
     return 0;
 }
 
-/* Receive message from queue */
-int msgqueue_receive(msg_queue_t* queue, message_t* msg) {
-    if (!queue || !queue->is_open || !msg) return -1;
-    if (queue->count == 0) return -1; /* Queue empty */
-    
-    /* Copy message */
-    memcpy(msg, &queue->messages[queue->head], sizeof(message_t));
-    
-    queue->head = (queue->head + 1) % MSG_QUEUE_SIZE;
+/* Receive the highest-priority message, copying only its payload */
+static int do_msgqueue_receive(msg_queue_t* queue, void* buf,
+                               size_t bufsize, msg_info_t* info,
+                               uint32_t timeout_ms) {
+    if (!queue || !queue->is_open) return -1;
+
+    uint64_t deadline = msgq_deadline(timeout_ms);
+
+    uint32_t irq = irq_save();
+    while (queue->prio_map == 0) {
+        if (msgq_wait(&queue->recv_wait, timeout_ms, deadline) < 0 ||
+            !queue->is_open) {
+            irq_restore(irq);
+            return -1;
+        }
+    }
+
+    uint32_t prio = 31 - (uint32_t)__builtin_clz(queue->prio_map);
+    msg_block_t* b = queue->head[prio];
+    if (b->len > bufsize || (b->len > 0 && !buf)) {
+        irq_restore(irq);
+        return -1;              /* Too small: leave it queued */
+    }
+
+    queue->head[prio] = b->next;
+    if (!queue->head[prio]) {
+        queue->tail[prio] = NULL;
+        queue->prio_map &= ~(1u << prio);
+    }
     queue->count--;
-    
-    return 0;
+
+    int len = (int)b->len;
+    if (len > 0) {
+        memcpy(buf, (uint8_t*)b + MSG_HDR_SIZE, b->len);
+    }
+    if (info) {
+        info->sender_pid = b->sender_pid;
+        info->type = b->type;
+        info->priority = b->priority;
+        info->size = b->len;
+    }
+    msgq_free(queue, b);
+
+    /* Freed space may fit more than one waiting sender. */
+    if (!wait_queue_empty(&queue->send_wait)) {
+        wait_queue_wake_all(&queue->send_wait);
+    }
+    irq_restore(irq);
+
+    return len;
+}
+
+/* Last handle gone: discard queued messages and fail any waiters.
+ * Interrupts are disabled. */
+static void msgqueue_shutdown(ipc_object_t* obj) {
+    msg_queue_t* queue = (msg_queue_t*)obj;
+    uint8_t* arena = queue->arena;
+    queue->is_open = 0;
+    queue->arena = NULL;
+    queue->free_list = NULL;
+    queue->prio_map = 0;
+    queue->count = 0;
+
+    /* Blocked senders and receivers re-check is_open and fail. */
+    wait_queue_wake_all(&queue->send_wait);
+    wait_queue_wake_all(&queue->recv_wait);
+
+    kfree(arena);
 }
 
-/* Close message queue */
+static void msgqueue_free(ipc_object_t* obj) {
+    slab_free(msgq_slab, obj);
+}
+
+static const ipc_object_ops_t msgq_obj_ops = {
+    .kind     = "msgq",
+    .shutdown = msgqueue_shutdown,
+    .free     = msgqueue_free,
+};
+
+/* Drop a handle; the last one closes the queue */
 void msgqueue_close(msg_queue_t* queue) {
-    if (queue) {
-        queue->is_open = 0;
+    if (!queue || !queue->is_open) return;
+    ipc_object_close(&queue->obj);
+}
+
+/* Sending and receiving may sleep: pin the queue meanwhile. */
+int msgqueue_send(msg_queue_t* queue, uint32_t sender_pid, uint32_t type,
+                  uint32_t priority, const void* data, size_t size,
+                  uint32_t timeout_ms) {
+    if (!queue) return -1;
+    ipc_object_get(&queue->obj);
+    int ret = do_msgqueue_send(queue, sender_pid, type, priority, data, size,
+                               timeout_ms);
+    ipc_object_put(&queue->obj);
+    return ret;
+}
+
+int msgqueue_receive(msg_queue_t* queue, void* buf, size_t bufsize,
+                     msg_info_t* info, uint32_t timeout_ms) {
+    if (!queue) return -1;
+    ipc_object_get(&queue->obj);
+    int ret = do_msgqueue_receive(queue, buf, bufsize, info, timeout_ms);
+    ipc_object_put(&queue->obj);
+    return ret;
+}
+
+/* ------------------------------------------------------------------ */
+/* Message queues as file descriptors                                   */
+/* ------------------------------------------------------------------ */
+
+static int msgqueue_file_read(file_t* f, void* buf, size_t n) {
+    return msgqueue_receive((msg_queue_t*)f->object, buf, n, NULL,
+                            MSGQ_FOREVER);
+}
+
+static int msgqueue_file_write(file_t* f, const void* buf, size_t n) {
+    if (msgqueue_send((msg_queue_t*)f->object, process_getpid(), 0, 0,
+                      buf, n, MSGQ_FOREVER) < 0) {
+        return -1;
+    }
+    return (int)n;
+}
+
+static void msgqueue_file_release(file_t* f) {
+    msgqueue_close((msg_queue_t*)f->object);
+}
+
+/* Free arena blocks are never smaller than an empty message, so any
+ * free block means a send can go through. */
+static uint32_t msgqueue_file_poll(file_t* f, poll_table_t* pt) {
+    msg_queue_t* queue = (msg_queue_t*)f->object;
+    uint32_t mask = 0;
+
+    poll_wait(pt, &queue->recv_wait, EPOLLIN | EPOLLHUP);
+    poll_wait(pt, &queue->send_wait, EPOLLOUT | EPOLLHUP);
+    if (!queue->is_open) return EPOLLHUP;
+
+    /* Writable only if a message of max_msg bytes would fit, so that no
+     * send of an allowed size fails after EPOLLOUT */
+    uint32_t irq = irq_save();
+    if (queue->count > 0) mask |= EPOLLIN;
+    if (msgq_has_room(queue, msg_block_size(queue->max_msg))) mask |= EPOLLOUT;
+    irq_restore(irq);
+    return mask;
+}
+
+static const file_ops_t msgqueue_file_ops = {
+    .read    = msgqueue_file_read,
+    .write   = msgqueue_file_write,
+    .release = msgqueue_file_release,
+    .poll    = msgqueue_file_poll,
+};
+
+msg_queue_t* msgqueue_from_file(file_t* f) {
+    if (!f || f->ops != &msgqueue_file_ops) return NULL;
+    return (msg_queue_t*)f->object;
+}
+
+/* Open a named queue, or create one, and install it in the current process */
+int msgqueue_open_fd(const char* name, size_t arena_size, size_t max_msg) {
+    process_t* self = process_current();
+    if (!self) return -1;
+
+    int named = (name && name[0]);
+    msg_queue_t* queue = NULL;
+
+    uint32_t irq = irq_save();
+    if (named) {
+        queue = (msg_queue_t*)ipc_name_open(name, IPC_OBJ_MSGQ);
+    }
+    if (!queue) {
+        queue = msgqueue_create_sized(self->pid, arena_size, max_msg);
+        if (queue && named && ipc_name_bind(&queue->obj, name) < 0) {
+            msgqueue_close(queue);      /* name held by another type */
+            queue = NULL;
+        }
+    }
+    irq_restore(irq);
+    if (!queue) return -1;
+
+    file_t* f = file_alloc(&msgqueue_file_ops, queue, FILE_READ | FILE_WRITE);
+    if (!f) {
+        msgqueue_close(queue);
+        return -1;
+    }
+
+    int fd = fd_install(self, f);
+    if (fd < 0) {
+        file_put(f);            /* closes the queue */
+        return -1;
+    }
+    return fd;
+}
+
+/* ------------------------------------------------------------------ */
+/* Synchronous call / reply                                             */
+/* ------------------------------------------------------------------ */
+
+static void ipc_copy_words(uint32_t* dst, const uint32_t* src) {
+    for (int i = 0; i < IPC_MSG_WORDS; i++) {
+        dst[i] = src[i];
+    }
+}
+
+/* Create a rendezvous endpoint */
+ipc_endpoint_t* ipc_endpoint_create(uint32_t owner_pid) {
+    ipc_endpoint_t* ep = (ipc_endpoint_t*)slab_alloc(endpoint_slab);
+    if (!ep) return NULL;
+
+    ep->is_open = 1;
+    ep->owner_pid = owner_pid;
+    ep->server = NULL;
+    wait_queue_init(&ep->callers);
+    ipc_object_setup(&ep->obj, IPC_OBJ_ENDPOINT, &endpoint_obj_ops);
+    return ep;
+}
+
+/* Last handle gone: blocked clients and the server fail with -1.
+ * Interrupts are disabled. */
+static void ipc_endpoint_shutdown(ipc_object_t* obj) {
+    ipc_endpoint_t* ep = (ipc_endpoint_t*)obj;
+    ep->is_open = 0;
+
+    process_t* p;
+    while ((p = wait_queue_dequeue(&ep->callers)) != NULL) {
+        p->ipc_status = -1;
+        scheduler_unblock(p);
+    }
+    if (ep->server) {
+        p = ep->server;
+        ep->server = NULL;
+        p->ipc_reply_to = NULL;
+        scheduler_unblock(p);
+    }
+}
+
+static void ipc_endpoint_free(ipc_object_t* obj) {
+    slab_free(endpoint_slab, obj);
+}
+
+static const ipc_object_ops_t endpoint_obj_ops = {
+    .kind     = "endpoint",
+    .shutdown = ipc_endpoint_shutdown,
+    .free     = ipc_endpoint_free,
+};
+
+/* Drop a handle; the last one closes the endpoint */
+void ipc_endpoint_close(ipc_endpoint_t* ep) {
+    if (!ep || !ep->is_open) return;
+    ipc_object_close(&ep->obj);
+}
+
+/* Send a request and wait for the reply */
+int ipc_call(ipc_endpoint_t* ep, ipc_msg_t* msg) {
+    process_t* self = process_current();
+    if (!ep || !ep->is_open || !msg || !ipc_can_block()) return -1;
+
+    uint32_t irq = irq_save();
+    self->ipc_buf = msg->w;
+    self->ipc_status = 0;
+
+    process_t* server = ep->server;
+    if (server) {
+        /* Fast path: the server is waiting, run it right now. */
+        ep->server = NULL;
+        ipc_copy_words(server->ipc_buf, msg->w);
+        server->ipc_reply_to = self;
+        self->state = PROCESS_STATE_BLOCKED;
+        scheduler_handoff(server);
+    } else {
+        /* Server busy: it copies our words when it gets to us. */
+        wait_queue_sleep(&ep->callers);
+    }
+
+    /* Back here once the reply is in msg (or the rendezvous broke). */
+    int status = self->ipc_status;
+    self->ipc_buf = NULL;
+    irq_restore(irq);
+    return status;
+}
+
+/* Reply to the current caller, then wait for the next call */
+int ipc_reply_wait(ipc_endpoint_t* ep, ipc_msg_t* msg) {
+    process_t* self = process_current();
+    if (!ep || !msg || !ipc_can_block()) return -1;
+
+    uint32_t irq = irq_save();
+
+    process_t* client = self->ipc_reply_to;
+    self->ipc_reply_to = NULL;
+    if (client) {
+        ipc_copy_words(client->ipc_buf, msg->w);
+    }
+
+    if (!ep->is_open) {
+        if (client) scheduler_unblock(client);
+        irq_restore(irq);
+        return -1;
+    }
+
+    self->ipc_buf = msg->w;
+
+    process_t* next = wait_queue_dequeue(&ep->callers);
+    if (next) {
+        /* Another client is already queued: serve it without blocking;
+         * the one we replied to runs when the scheduler gets to it. */
+        ipc_copy_words(msg->w, next->ipc_buf);
+        self->ipc_reply_to = next;
+        if (client) scheduler_unblock(client);
+        irq_restore(irq);
+        return (int)next->pid;
+    }
+
+    /* Nothing pending: wait on the endpoint and run the client. */
+    ep->server = self;
+    self->state = PROCESS_STATE_BLOCKED;
+    if (client) {
+        scheduler_handoff(client);
+    } else {
+        scheduler_block_current();
+    }
+
+    /* Woken by ipc_call() (reply_to set) or by close (reply_to NULL). */
+    int pid = self->ipc_reply_to ? (int)self->ipc_reply_to->pid : -1;
+    irq_restore(irq);
+    return pid;
+}
+
+void ipc_process_cleanup(process_t* p) {
+    if (!p) return;
+
+    uint32_t irq = irq_save();
+
+    /* A server going away: nobody is waiting on the endpoint any more,
+     * and the caller it was serving gets an error. */
+    for (ipc_object_t* o = ipc_live[IPC_OBJ_ENDPOINT]; o; o = o->next) {
+        ipc_endpoint_t* ep = (ipc_endpoint_t*)o;
+        if (ep->server == p) ep->server = NULL;
+    }
+    if (p->ipc_reply_to) {
+        process_t* client = p->ipc_reply_to;
+        p->ipc_reply_to = NULL;
+        client->ipc_status = -1;
+        scheduler_unblock(client);
+    }
+
+    /* A client going away: its server must not reply into it. */
+    for (int i = 0; i < PROCESS_MAX; i++) {
+        process_t* q = process_table_entry(i);
+        if (q && q->ipc_reply_to == p) q->ipc_reply_to = NULL;
+    }
+    irq_restore(irq);
+}
+
+/* ------------------------------------------------------------------ */
+/* Endpoints as file descriptors                                        */
+/* ------------------------------------------------------------------ */
+
+static void ipc_endpoint_file_release(file_t* f) {
+    ipc_endpoint_close((ipc_endpoint_t*)f->object);
+}
+
+static const file_ops_t ipc_endpoint_file_ops = {
+    .read    = NULL,
+    .write   = NULL,
+    .release = ipc_endpoint_file_release,
+};
+
+ipc_endpoint_t* ipc_endpoint_from_file(file_t* f) {
+    if (!f || f->ops != &ipc_endpoint_file_ops) return NULL;
+    return (ipc_endpoint_t*)f->object;
+}
+
+/* Open a named endpoint, or create one, and install it in the current process */
+int ipc_endpoint_open_fd(const char* name) {
+    process_t* self = process_current();
+    if (!self) return -1;
+
+    int named = (name && name[0]);
+    ipc_endpoint_t* ep = NULL;
+
+    uint32_t irq = irq_save();
+    if (named) {
+        ep = (ipc_endpoint_t*)ipc_name_open(name, IPC_OBJ_ENDPOINT);
+    }
+    if (!ep) {
+        ep = ipc_endpoint_create(self->pid);
+        if (ep && named && ipc_name_bind(&ep->obj, name) < 0) {
+            ipc_endpoint_close(ep);     /* name held by another type */
+            ep = NULL;
+        }
+    }
+    irq_restore(irq);
+    if (!ep) return -1;
+
+    file_t* f = file_alloc(&ipc_endpoint_file_ops, ep, FILE_READ | FILE_WRITE);
+    if (!f) {
+        ipc_endpoint_close(ep);
+        return -1;
+    }
+
+    int fd = fd_install(self, f);
+    if (fd < 0) {
+        file_put(f);            /* closes the endpoint */
+        return -1;
     }
+    return fd;
 }
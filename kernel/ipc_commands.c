@@ -0,0 +1,661 @@
+/*
+ * OpenOS - IPC Shell Commands and Benchmarks
+ *
+ *   ipcs      - list live IPC objects with their names and handle counts
+ *   pipetest  - launch a ring 3 program that talks through pipe()
+ *   pipebench - pipe throughput (MB/s) for 1 B .. 64 KiB writes, copied
+ *               and zero-copy (vmsplice gift + pipe_read_view)
+ *   mqtest    - launch a ring 3 program using the message queue syscalls
+ *   mqbench   - message queue messages/second vs payload size
+ *   ipcbench  - call/reply_wait ping-pong round-trip cycles, against the
+ *               same ping-pong over two message queues
+ *   shmbench  - ring 3 producer/consumer over a shared memory SPSC ring
+ *               with futex sleeps, messages/second
+ *   epolltest - launch a ring 3 event loop serving a pipe, a message
+ *               queue and the keyboard through one epoll instance
+ *   epollbench - cycles to find the one ready pipe among N with
+ *               epoll_wait(), against polling all N
+ *
+ * Benchmarks time with the TSC, calibrated against the PIT by
+ * timer_get_tsc_khz(), and run the consumer as a separate kernel
+ * thread so every transfer goes through the real blocking paths.
+ */
+
+#include "commands.h"
+#include "shell.h"
+#include "string.h"
+#include "user_programs.h"
+#include "../include/ipc.h"
+#include "../include/shm.h"
+#include "../include/epoll.h"
+#include "file.h"
+#include "../drivers/console.h"
+#include "../drivers/timer.h"
+#include "../process/process.h"
+#include "../process/scheduler.h"
+#include "../arch/x86/cpu.h"
+
+/* ------------------------------------------------------------------ */
+/* Local formatting helpers                                             */
+/* ------------------------------------------------------------------ */
+
+static void write_dec(uint32_t v) {
+    char buf[12];
+    int pos = 0;
+    do {
+        buf[pos++] = (char)('0' + (v % 10));
+        v /= 10;
+    } while (v > 0);
+    while (pos > 0) console_put_char(buf[--pos]);
+}
+
+static void write_dec_pad(uint32_t v, int width) {
+    uint32_t t = v;
+    int digits = 0;
+    do { digits++; t /= 10; } while (t > 0);
+    for (int i = digits; i < width; i++) console_put_char(' ');
+    write_dec(v);
+}
+
+/* Print a value held in tenths as "N.N". */
+static void write_tenths(uint32_t v, int width) {
+    write_dec_pad(v / 10, width - 2);
+    console_put_char('.');
+    console_put_char((char)('0' + v % 10));
+}
+
+/* Scale a 64-bit cycle count down until it fits a 32-bit divisor,
+ * shifting `num` by the same amount. */
+static uint32_t scale_cycles(uint64_t *num, uint64_t cycles) {
+    while (cycles > 0xFFFFFFFFull) {
+        cycles >>= 1;
+        *num >>= 1;
+    }
+    return cycles ? (uint32_t)cycles : 1;
+}
+
+/* Throughput in tenths of MB/s for `bytes` moved in `cycles`. */
+static uint32_t rate_mb_x10(uint64_t bytes, uint64_t cycles, uint32_t khz) {
+    /* bytes * 10 * (khz * 1000) / cycles / 2^20 */
+    uint64_t num = ((bytes * 10) >> 10) * khz;
+    uint32_t div = scale_cycles(&num, cycles);
+    return (uint32_t)(udiv64(num, div, 0) * 1000 >> 10);
+}
+
+/* Operations per second for `ops` done in `cycles`. */
+static uint32_t rate_per_sec(uint32_t ops, uint64_t cycles, uint32_t khz) {
+    uint64_t num = (uint64_t)ops * khz * 1000;
+    uint32_t div = scale_cycles(&num, cycles);
+    return (uint32_t)udiv64(num, div, 0);
+}
+
+/* Cycles per operation. */
+static uint32_t per_op(uint64_t cycles, uint32_t ops) {
+    return ops ? (uint32_t)udiv64(cycles, ops, 0) : 0;
+}
+
+/* Wait for a specific child of the shell to exit. */
+static void wait_for_child(uint32_t pid) {
+    int got;
+    do {
+        got = process_wait(0);
+    } while (got >= 0 && (uint32_t)got != pid);
+}
+
+/* ------------------------------------------------------------------ */
+/* ipcs                                                                 */
+/* ------------------------------------------------------------------ */
+
+static void write_pad(const char *s, int width) {
+    int n = (int)strlen(s);
+    console_write(s);
+    for (int i = n; i < width; i++) console_put_char(' ');
+}
+
+void cmd_ipcs(int argc, char **argv) {
+    (void)argc; (void)argv;
+
+    console_write("\n  type      name                handles  refs\n");
+    console_write("  ----      ----                -------  ----\n");
+
+    uint32_t total = 0;
+    uint32_t irq = irq_save();
+    for (uint32_t type = 1; type < IPC_OBJ_TYPES; type++) {
+        for (ipc_object_t *o = ipc_object_first(type); o; o = o->next) {
+            console_write("  ");
+            write_pad(o->ops->kind, 10);
+            write_pad(o->name[0] ? o->name : "-", 20);
+            write_dec_pad(o->handles, 7);
+            write_dec_pad(o->refs, 6);
+            console_write("\n");
+            total++;
+        }
+    }
+    irq_restore(irq);
+
+    write_dec(total);
+    console_write(" object(s)\n\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* pipetest                                                             */
+/* ------------------------------------------------------------------ */
+
+void cmd_pipetest(int argc, char **argv) {
+    (void)argc; (void)argv;
+    process_t *p = process_create_user("pipetest", uprog_pipetest,
+                                       PRIORITY_NORMAL);
+    if (!p) {
+        console_write("pipetest: failed to create user process\n");
+        return;
+    }
+    console_write("Launched ring 3 pipe demo as pid ");
+    write_dec(p->pid);
+    console_write("\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* pipebench                                                            */
+/* ------------------------------------------------------------------ */
+
+#define PIPEBENCH_BYTES       (4u * 1024u * 1024u)
+#define PIPEBENCH_SMALL_BYTES (512u * 1024u)   /* for 1-byte writes */
+
+/* Page aligned so vmsplice() gifts whole pages. */
+static uint8_t pipebench_wbuf[PIPE_MAX_SIZE] __attribute__((aligned(4096)));
+static uint8_t pipebench_rbuf[PIPE_MAX_SIZE];
+
+/* Consumer thread: drain until EOF, then release the read end. */
+static void pipebench_reader(void *arg) {
+    pipe_t *pipe = (pipe_t *)arg;
+    while (pipe_read(pipe, pipebench_rbuf, sizeof(pipebench_rbuf)) > 0) {
+    }
+    pipe_close_end(pipe, PIPE_END_READ);
+}
+
+/* Zero-copy consumer: borrow each run of data in place. */
+static void pipebench_view_reader(void *arg) {
+    pipe_t *pipe = (pipe_t *)arg;
+    const void *data;
+    while (pipe_read_view(pipe, &data) > 0) {
+    }
+    pipe_close_end(pipe, PIPE_END_READ);
+}
+
+/* Push `total` bytes through a fresh pipe in `chunk`-sized writes and
+ * return the elapsed cycles, or 0 on failure. */
+static uint64_t pipebench_run(uint32_t chunk, uint32_t total, int zero_copy) {
+    pipe_t *pipe = pipe_create_sized(process_getpid(), process_getpid(),
+                                     PIPE_MAX_SIZE);
+    if (!pipe) {
+        console_write("pipebench: pipe_create failed\n");
+        return 0;
+    }
+    process_t *reader = process_create("pipebench",
+                                       zero_copy ? pipebench_view_reader
+                                                 : pipebench_reader,
+                                       pipe, PRIORITY_HIGH);
+    if (!reader) {
+        pipe_close(pipe);
+        console_write("pipebench: process_create failed\n");
+        return 0;
+    }
+    uint32_t reader_pid = reader->pid;
+
+    uint64_t start = rdtsc();
+    for (uint32_t sent = 0; sent < total; sent += chunk) {
+        if (zero_copy) {
+            pipe_vmsplice(pipe, pipebench_wbuf, chunk, SPLICE_F_GIFT);
+        } else {
+            pipe_write(pipe, pipebench_wbuf, chunk);
+        }
+    }
+    pipe_close_end(pipe, PIPE_END_WRITE);
+    wait_for_child(reader_pid);
+    return rdtsc() - start;
+}
+
+static void pipebench_row(uint32_t chunk, uint32_t total, uint64_t cycles,
+                          uint32_t khz) {
+    console_write("  ");
+    write_dec_pad(chunk, 10);
+    console_write("   ");
+    write_dec_pad(total / 1024, 9);
+    console_write("   ");
+    write_tenths(rate_mb_x10(total, cycles, khz), 6);
+    console_write("   ");
+    write_dec_pad(per_op(cycles, total / chunk), 12);
+    console_write("\n");
+}
+
+void cmd_pipebench(int argc, char **argv) {
+    (void)argc; (void)argv;
+    static const uint32_t sizes[] = { 1, 64, 4096, 65536 };
+    static const uint32_t zc_sizes[] = { 4096, 65536 };
+
+    if (!scheduler_active()) {
+        console_write("pipebench: scheduler not running\n");
+        return;
+    }
+
+    uint32_t khz = timer_get_tsc_khz();
+    if (khz == 0) {
+        console_write("pipebench: TSC calibration failed\n");
+        return;
+    }
+
+    console_write("\nPipe throughput (");
+    write_dec(PIPE_MAX_SIZE / 1024);
+    console_write(" KiB ring, reader thread drains until EOF)\n");
+    console_write("  write size   total KiB     MB/s   cycles/write\n");
+    console_write("  ----------   ---------   ------   ------------\n");
+
+    for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        uint32_t chunk = sizes[i];
+        uint32_t total = (chunk == 1) ? PIPEBENCH_SMALL_BYTES : PIPEBENCH_BYTES;
+        uint64_t cycles = pipebench_run(chunk, total, 0);
+        if (!cycles) return;
+        pipebench_row(chunk, total, cycles, khz);
+    }
+
+    console_write("\nZero-copy (vmsplice SPLICE_F_GIFT -> pipe_read_view)\n");
+    console_write("  write size   total KiB     MB/s   cycles/write\n");
+    console_write("  ----------   ---------   ------   ------------\n");
+
+    for (uint32_t i = 0; i < sizeof(zc_sizes) / sizeof(zc_sizes[0]); i++) {
+        uint32_t chunk = zc_sizes[i];
+        uint64_t cycles = pipebench_run(chunk, PIPEBENCH_BYTES, 1);
+        if (!cycles) return;
+        pipebench_row(chunk, PIPEBENCH_BYTES, cycles, khz);
+    }
+    console_write("\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* mqtest                                                               */
+/* ------------------------------------------------------------------ */
+
+void cmd_mqtest(int argc, char **argv) {
+    (void)argc; (void)argv;
+    process_t *p = process_create_user("mqtest", uprog_mqtest,
+                                       PRIORITY_NORMAL);
+    if (!p) {
+        console_write("mqtest: failed to create user process\n");
+        return;
+    }
+    console_write("Launched ring 3 message queue demo as pid ");
+    write_dec(p->pid);
+    console_write("\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* mqbench                                                              */
+/* ------------------------------------------------------------------ */
+
+#define MQBENCH_MESSAGES 20000u
+
+static uint8_t mqbench_sbuf[MSGQ_DEFAULT_MSG_MAX];
+static uint8_t mqbench_rbuf[MSGQ_DEFAULT_MSG_MAX];
+
+/* Consumer thread: take exactly MQBENCH_MESSAGES messages. */
+static void mqbench_receiver(void *arg) {
+    msg_queue_t *queue = (msg_queue_t *)arg;
+    for (uint32_t i = 0; i < MQBENCH_MESSAGES; i++) {
+        if (msgqueue_receive(queue, mqbench_rbuf, sizeof(mqbench_rbuf),
+                             0, MSGQ_FOREVER) < 0) {
+            break;
+        }
+    }
+}
+
+void cmd_mqbench(int argc, char **argv) {
+    (void)argc; (void)argv;
+    static const uint32_t sizes[] = { 8, 64, 256, 1024, 4096 };
+
+    if (!scheduler_active()) {
+        console_write("mqbench: scheduler not running\n");
+        return;
+    }
+
+    uint32_t khz = timer_get_tsc_khz();
+    if (khz == 0) {
+        console_write("mqbench: TSC calibration failed\n");
+        return;
+    }
+
+    console_write("\nMessage queue throughput (");
+    write_dec(MQBENCH_MESSAGES);
+    console_write(" messages, ");
+    write_dec(MSGQ_DEFAULT_ARENA / 1024);
+    console_write(" KiB arena, receiver thread)\n");
+    console_write("  payload B      msgs/s     MB/s   cycles/msg\n");
+    console_write("  ---------   ---------   ------   ----------\n");
+
+    for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        uint32_t size = sizes[i];
+
+        msg_queue_t *queue = msgqueue_create(process_getpid());
+        if (!queue) {
+            console_write("mqbench: msgqueue_create failed\n");
+            return;
+        }
+        process_t *receiver = process_create("mqbench", mqbench_receiver,
+                                             queue, PRIORITY_HIGH);
+        if (!receiver) {
+            msgqueue_close(queue);
+            console_write("mqbench: process_create failed\n");
+            return;
+        }
+        uint32_t receiver_pid = receiver->pid;
+
+        uint64_t start = rdtsc();
+        for (uint32_t n = 0; n < MQBENCH_MESSAGES; n++) {
+            msgqueue_send(queue, process_getpid(), 0, n & 3,
+                          mqbench_sbuf, size, MSGQ_FOREVER);
+        }
+        wait_for_child(receiver_pid);
+        uint64_t cycles = rdtsc() - start;
+        msgqueue_close(queue);
+
+        console_write("  ");
+        write_dec_pad(size, 9);
+        console_write("   ");
+        write_dec_pad(rate_per_sec(MQBENCH_MESSAGES, cycles, khz), 9);
+        console_write("   ");
+        write_tenths(rate_mb_x10((uint64_t)size * MQBENCH_MESSAGES, cycles,
+                                 khz), 6);
+        console_write("   ");
+        write_dec_pad(per_op(cycles, MQBENCH_MESSAGES), 10);
+        console_write("\n");
+    }
+    console_write("\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* ipcbench                                                             */
+/* ------------------------------------------------------------------ */
+
+#define IPCBENCH_ROUNDS 100000u
+
+/* Rendezvous server: answer every call with w[0] + 1. */
+static void ipcbench_server(void *arg) {
+    ipc_endpoint_t *ep = (ipc_endpoint_t *)arg;
+    ipc_msg_t m;
+    m.w[0] = m.w[1] = m.w[2] = m.w[3] = 0;
+    while (ipc_reply_wait(ep, &m) >= 0) {
+        m.w[0]++;
+    }
+}
+
+static msg_queue_t *ipcbench_req;
+static msg_queue_t *ipcbench_rep;
+
+/* Queue server: the same echo over a request and a reply queue. */
+static void ipcbench_queue_server(void *arg) {
+    (void)arg;
+    uint32_t w;
+    while (msgqueue_receive(ipcbench_req, &w, sizeof(w), 0,
+                            MSGQ_FOREVER) >= 0) {
+        w++;
+        msgqueue_send(ipcbench_rep, process_getpid(), 0, 0, &w, sizeof(w),
+                      MSGQ_FOREVER);
+    }
+}
+
+static void ipcbench_row(const char *label, uint32_t rounds, uint32_t errors,
+                         uint64_t cycles, uint32_t khz) {
+    console_write(label);
+    write_dec_pad(per_op(cycles, rounds), 10);
+    console_write("   ");
+    write_dec_pad(rate_per_sec(rounds, cycles, khz), 10);
+    if (errors) {
+        console_write("   (");
+        write_dec(errors);
+        console_write(" bad replies)");
+    }
+    console_write("\n");
+}
+
+void cmd_ipcbench(int argc, char **argv) {
+    (void)argc; (void)argv;
+
+    if (!scheduler_active()) {
+        console_write("ipcbench: scheduler not running\n");
+        return;
+    }
+
+    uint32_t khz = timer_get_tsc_khz();
+    if (khz == 0) {
+        console_write("ipcbench: TSC calibration failed\n");
+        return;
+    }
+
+    console_write("\nPing-pong with a server thread (");
+    write_dec(IPCBENCH_ROUNDS);
+    console_write(" round trips)\n");
+    console_write("  mechanism                    cycles/rt   round trips/s\n");
+    console_write("  ---------                    ---------   -------------\n");
+
+    /* call / reply_wait with direct handoff */
+    ipc_endpoint_t *ep = ipc_endpoint_create(process_getpid());
+    if (!ep) {
+        console_write("ipcbench: ipc_endpoint_create failed\n");
+        return;
+    }
+    process_t *server = process_create("ipcserver", ipcbench_server, ep,
+                                       PRIORITY_HIGH);
+    if (!server) {
+        ipc_endpoint_close(ep);
+        console_write("ipcbench: process_create failed\n");
+        return;
+    }
+    uint32_t server_pid = server->pid;
+
+    uint32_t errors = 0;
+    ipc_msg_t m;
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < IPCBENCH_ROUNDS; i++) {
+        m.w[0] = i;
+        if (ipc_call(ep, &m) < 0 || m.w[0] != i + 1) errors++;
+    }
+    uint64_t cycles = rdtsc() - start;
+    ipc_endpoint_close(ep);
+    wait_for_child(server_pid);
+    ipcbench_row("  call/reply_wait (handoff)   ", IPCBENCH_ROUNDS, errors,
+                 cycles, khz);
+
+    /* The same exchange through two message queues */
+    ipcbench_req = msgqueue_create(process_getpid());
+    ipcbench_rep = msgqueue_create(process_getpid());
+    if (!ipcbench_req || !ipcbench_rep) {
+        msgqueue_close(ipcbench_req);
+        msgqueue_close(ipcbench_rep);
+        console_write("ipcbench: msgqueue_create failed\n");
+        return;
+    }
+    server = process_create("ipcserver", ipcbench_queue_server, 0,
+                            PRIORITY_HIGH);
+    if (!server) {
+        msgqueue_close(ipcbench_req);
+        msgqueue_close(ipcbench_rep);
+        console_write("ipcbench: process_create failed\n");
+        return;
+    }
+    server_pid = server->pid;
+
+    errors = 0;
+    start = rdtsc();
+    for (uint32_t i = 0; i < IPCBENCH_ROUNDS; i++) {
+        uint32_t w = i;
+        msgqueue_send(ipcbench_req, process_getpid(), 0, 0, &w, sizeof(w),
+                      MSGQ_FOREVER);
+        if (msgqueue_receive(ipcbench_rep, &w, sizeof(w), 0,
+                             MSGQ_FOREVER) < 0 || w != i + 1) {
+            errors++;
+        }
+    }
+    cycles = rdtsc() - start;
+    msgqueue_close(ipcbench_req);
+    msgqueue_close(ipcbench_rep);
+    wait_for_child(server_pid);
+    ipcbench_row("  message queues (2 copies)   ", IPCBENCH_ROUNDS, errors,
+                 cycles, khz);
+
+    console_write("\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* shmbench                                                             */
+/* ------------------------------------------------------------------ */
+
+void cmd_shmbench(int argc, char **argv) {
+    (void)argc; (void)argv;
+
+    uint32_t khz = timer_get_tsc_khz();
+    if (khz == 0) {
+        console_write("shmbench: TSC calibration failed\n");
+        return;
+    }
+
+    shm_stats_t before, after;
+    shm_get_stats(&before);
+
+    uint64_t start = rdtsc();
+    process_t *p = process_create_user("shmbench", uprog_shmbench,
+                                       PRIORITY_NORMAL);
+    if (!p) {
+        console_write("shmbench: failed to create user process\n");
+        return;
+    }
+    wait_for_child(p->pid);
+    uint64_t cycles = rdtsc() - start;
+
+    shm_get_stats(&after);
+
+    console_write("\nSPSC ring in shared memory, ");
+    write_dec(SHMBENCH_MESSAGES);
+    console_write(" messages through ");
+    write_dec(SHMBENCH_SLOTS);
+    console_write(" slots\n");
+    console_write("  cycles/message:  ");
+    write_dec(per_op(cycles, SHMBENCH_MESSAGES));
+    console_write("\n  messages/s:      ");
+    write_dec(rate_per_sec(SHMBENCH_MESSAGES, cycles, khz));
+    console_write("\n  futex waits:     ");
+    write_dec(after.futex_waits - before.futex_waits);
+    console_write("\n  futex wakes:     ");
+    write_dec(after.futex_wakes - before.futex_wakes);
+    console_write("\n\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* epolltest                                                            */
+/* ------------------------------------------------------------------ */
+
+void cmd_epolltest(int argc, char **argv) {
+    (void)argc; (void)argv;
+    process_t *p = process_create_user("epolltest", uprog_epolltest,
+                                       PRIORITY_NORMAL);
+    if (!p) {
+        console_write("epolltest: failed to create user process\n");
+        return;
+    }
+    console_write("Launched ring 3 epoll demo as pid ");
+    write_dec(p->pid);
+    console_write(" (lines typed meanwhile are keyboard events)\n");
+    wait_for_child(p->pid);
+}
+
+/* ------------------------------------------------------------------ */
+/* epollbench                                                           */
+/* ------------------------------------------------------------------ */
+
+#define EPOLLBENCH_ROUNDS   20000u
+#define EPOLLBENCH_MAX_FDS  256
+
+static file_t *epollbench_files[EPOLLBENCH_MAX_FDS][2];
+
+/*
+ * One round: make pipe `i` readable, find it, drain it. The finding
+ * is timed, once through epoll_wait() and once by polling every read
+ * end in turn, which is what a caller without epoll has to do.
+ */
+static void epollbench_run(uint32_t nfds) {
+    uint32_t made = 0;
+    for (; made < nfds; made++) {
+        if (pipe_open_files(epollbench_files[made], 64) < 0) break;
+    }
+    eventpoll_t *ep = epoll_create();
+    if (made < nfds || !ep) {
+        console_write("epollbench: out of memory\n");
+        nfds = made;
+    }
+
+    for (uint32_t k = 0; ep && k < nfds; k++) {
+        epoll_event_t ev = { EPOLLIN, k };
+        epoll_ctl(ep, EPOLL_CTL_ADD, epollbench_files[k][0], &ev);
+    }
+
+    uint8_t byte = 0;
+    uint32_t errors = 0;
+    uint64_t epoll_cycles = 0, scan_cycles = 0;
+    epoll_event_t events[4];
+
+    for (uint32_t r = 0; ep && r < EPOLLBENCH_ROUNDS; r++) {
+        uint32_t i = (r * 7) % nfds;
+
+        file_write(epollbench_files[i][1], &byte, 1);
+        uint64_t t0 = rdtsc();
+        int n = epoll_wait(ep, events, 4, EPOLL_NOWAIT);
+        epoll_cycles += rdtsc() - t0;
+        if (n != 1 || events[0].data != i) errors++;
+        file_read(epollbench_files[i][0], &byte, 1);
+
+        file_write(epollbench_files[i][1], &byte, 1);
+        t0 = rdtsc();
+        uint32_t found = nfds;
+        for (uint32_t k = 0; k < nfds; k++) {
+            if (file_poll(epollbench_files[k][0], NULL) & EPOLLIN) {
+                found = k;
+                break;
+            }
+        }
+        scan_cycles += rdtsc() - t0;
+        if (found != i) errors++;
+        file_read(epollbench_files[i][0], &byte, 1);
+    }
+
+    if (ep) {
+        write_dec_pad(nfds, 7);
+        write_dec_pad(per_op(epoll_cycles, EPOLLBENCH_ROUNDS), 15);
+        write_dec_pad(per_op(scan_cycles, EPOLLBENCH_ROUNDS), 15);
+        if (errors) {
+            console_write("   (");
+            write_dec(errors);
+            console_write(" errors)");
+        }
+        console_write("\n");
+    }
+
+    for (uint32_t k = 0; k < nfds; k++) {
+        file_put(epollbench_files[k][0]);
+        file_put(epollbench_files[k][1]);
+    }
+    epoll_close(ep);
+}
+
+void cmd_epollbench(int argc, char **argv) {
+    (void)argc; (void)argv;
+
+    console_write("\nFinding the one ready pipe among N (");
+    write_dec(EPOLLBENCH_ROUNDS);
+    console_write(" rounds)\n");
+    console_write("  pipes  epoll_wait cyc   poll-all cyc\n");
+    console_write("  -----  --------------   ------------\n");
+
+    static const uint32_t sizes[] = { 1, 16, 64, EPOLLBENCH_MAX_FDS };
+    for (uint32_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        epollbench_run(sizes[s]);
+    }
+    console_write("\n");
+}
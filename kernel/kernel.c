@@ -8,16 +8,23 @@
 #include "kernel.h"
 #include "shell.h"
 #include "syscall.h"
+#include "string.h"
+#include "printk.h"
 #include "../arch/x86/gdt.h"
 #include "../arch/x86/idt.h"
 #include "../arch/x86/pic.h"
 #include "../arch/x86/isr.h"
 #include "../arch/x86/exceptions.h"
+#include "../arch/x86/cpu.h"
 #include "../drivers/keyboard.h"
 #include "../drivers/timer.h"
 #include "../drivers/console.h"
+#include "../drivers/serial.h"
+#include "../drivers/pci.h"
 #include "../fs/vfs.h"
 #include "../include/ipc.h"
+#include "../include/shm.h"
+#include "../include/epoll.h"
 #include "../include/smp.h"
 #include "../include/gui.h"
 #include "../include/network.h"
@@ -45,6 +52,12 @@ void kernel_set_current_directory(vfs_node_t* dir) {
 
 /* Kernel entry point called from boot.S */
 void kmain(struct multiboot_info *mboot) {
+    uint64_t boot_tsc = rdtsc();
+
+    /* Pick the memcpy()/memset() methods this CPU does best */
+    string_init();
+    printk_init();
+
     /* Initialize console */
     console_init();
     
@@ -126,8 +139,10 @@ void kmain(struct multiboot_info *mboot) {
     }
 
     /* Initialize IPC mechanisms */
-    console_write("[10/15] Initializing IPC (pipes, message queues)...\n");
+    console_write("[10/15] Initializing IPC (pipes, message queues, shared memory, epoll)...\n");
     ipc_init();
+    shm_init();
+    epoll_init();
     
     /* Initialize SMP support */
     console_write("[11/15] Initializing multi-core SMP...\n");
@@ -138,7 +153,8 @@ void kmain(struct multiboot_info *mboot) {
     gui_init();
     
     /* Initialize Networking stack */
-    console_write("[13/15] Initializing networking stack...\n");
+    console_write("[13/15] Scanning PCI, initializing networking stack...\n");
+    pci_init();
     net_init();
     
     /* Initialize Shell scripting */
@@ -149,12 +165,17 @@ void kmain(struct multiboot_info *mboot) {
     console_write("[15/15] Initializing processes, scheduler, syscalls...\n");
     process_init();
     syscall_init();
+    net_start();
+    keyboard_start();
 
     /* Enable interrupts */
     __asm__ __volatile__("sti");
     
     /* Now that interrupts are enabled, unmask the timer IRQ */
     pic_unmask_irq(0);
+
+    /* Serial output drains from the THRE interrupt from here on */
+    serial_start_irq();
     
     console_write("\n*** System Ready ***\n");
     console_write("- Exception handling: Active\n");
@@ -168,6 +189,32 @@ void kmain(struct multiboot_info *mboot) {
     console_write("- Network: TCP/IP stack initialized\n\n");
     console_write("Type 'help' for available commands.\n\n");
 
+    /* Time to a usable shell, which serial logging used to dominate.
+     * Next to it, what writing the same COM1 output a byte at a time
+     * would cost at line rate: the busy-wait this boot no longer does. */
+    {
+        uint64_t end = rdtsc();     /* Before any TSC calibration below */
+        char line[128];
+        strbuf_t sb;
+        serial_stats_t st;
+        uint32_t khz = timer_get_tsc_khz();
+        serial_get_stats(&st);
+        strbuf_init(&sb, line, sizeof(line));
+        strbuf_append(&sb, "Boot took ");
+        strbuf_append_uint(&sb, khz ? (uint32_t)udiv64(end - boot_tsc, khz, 0) : 0);
+        strbuf_append(&sb, " ms.");
+        if (serial_is_available()) {
+            strbuf_append(&sb, " Polled serial would add ");
+            strbuf_append_uint(&sb, (uint32_t)udiv64((uint64_t)st.tx_queued * 10 * 1000,
+                                                     SERIAL_BAUD, 0));
+            strbuf_append(&sb, " ms for its ");
+            strbuf_append_uint(&sb, st.tx_queued);
+            strbuf_append(&sb, " bytes.");
+        }
+        strbuf_append(&sb, "\n\n");
+        console_write(line);
+    }
+
     /*
      * Launch the interactive shell as a proper high-priority process,
      * then start preemptive scheduling. kmain's own context (adopted
@@ -178,6 +225,9 @@ void kmain(struct multiboot_info *mboot) {
     process_create("shell", shell_task, 0, PRIORITY_HIGH);
     scheduler_start();
 
+    /* Kernel log lines go to the console from klogd from now on */
+    printk_start();
+
     for (;;) {
         __asm__ __volatile__("hlt");
     }
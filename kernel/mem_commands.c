@@ -0,0 +1,409 @@
+/*
+ * OpenOS - Memory Shell Commands and Benchmarks
+ *
+ *   membench  - memcpy() and memset() MB/s from 16 B to 4 MiB for each
+ *               method they choose between (byte loop, rep movsd/stosd,
+ *               rep movsb/stosb, MOVNTI) and for the dispatcher itself,
+ *               with aligned and misaligned buffers; then memmove() on
+ *               overlapping ranges, both directions
+ *   strbench  - cycles per call of strlen/strcmp/strchr, byte loops vs.
+ *               the word-at-a-time versions, and of building a path from
+ *               its components with string_concat() vs. a strbuf_t
+ *
+ * Every method is first checked against the byte loop over many sizes,
+ * offsets and overlaps. Timing uses the TSC, calibrated against the PIT
+ * by timer_get_tsc_khz().
+ */
+
+#include "commands.h"
+#include "string.h"
+#include "../drivers/console.h"
+#include "../drivers/timer.h"
+#include "../memory/pmm.h"
+#include "../arch/x86/cpu.h"
+
+/* ------------------------------------------------------------------ */
+/* Local formatting helpers                                             */
+/* ------------------------------------------------------------------ */
+
+static void write_dec(uint32_t v) {
+    char buf[12];
+    int pos = 0;
+    do {
+        buf[pos++] = (char)('0' + (v % 10));
+        v /= 10;
+    } while (v > 0);
+    while (pos > 0) console_put_char(buf[--pos]);
+}
+
+static void write_dec_pad(uint32_t v, int width) {
+    uint32_t t = v;
+    int digits = 0;
+    do { digits++; t /= 10; } while (t > 0);
+    for (int i = digits; i < width; i++) console_put_char(' ');
+    write_dec(v);
+}
+
+/* Sizes as "16 B", "4 KiB", "1 MiB", right-aligned in `width` */
+static void write_size(uint32_t size, int width) {
+    const char *unit = " B  ";
+    if (size >= (1u << 20) && !(size & ((1u << 20) - 1))) {
+        size >>= 20;
+        unit = " MiB";
+    } else if (size >= 1024 && !(size & 1023)) {
+        size >>= 10;
+        unit = " KiB";
+    }
+    write_dec_pad(size, width - 4);
+    console_write(unit);
+}
+
+/* Throughput in MB/s for `bytes` moved in `cycles`. */
+static uint32_t rate_mb(uint64_t bytes, uint64_t cycles, uint32_t khz) {
+    uint64_t num = (bytes >> 10) * khz;
+    while (cycles > 0xFFFFFFFFull) {
+        cycles >>= 1;
+        num >>= 1;
+    }
+    uint32_t div = cycles ? (uint32_t)cycles : 1;
+    return (uint32_t)(udiv64(num, div, 0) * 1000 >> 10);
+}
+
+/* ------------------------------------------------------------------ */
+/* membench                                                             */
+/* ------------------------------------------------------------------ */
+
+#define MEMBENCH_MAX        (4u << 20)
+#define MEMBENCH_PAGES      (MEMBENCH_MAX / 4096 + 1)  /* + room to misalign */
+#define MEMBENCH_BYTES      (16u << 20) /* Moved per cell (at least) */
+
+typedef void *(*membench_copy_fn)(void *dest, const void *src, size_t n);
+typedef void *(*membench_fill_fn)(void *ptr, int value, size_t num);
+
+static const char *const membench_copy_names[] = {
+    "bytes", "movsd", "movsb", "movnti", "memcpy",
+};
+static const char *const membench_fill_names[] = {
+    "bytes", "stosd", "stosb", "movnti", "memset",
+};
+static const membench_copy_fn membench_copies[] = {
+    memcpy_bytes, memcpy_movsd, memcpy_movsb, memcpy_nt, memcpy,
+};
+static const membench_fill_fn membench_fills[] = {
+    memset_bytes, memset_stosd, memset_stosb, memset_nt, memset,
+};
+#define MEMBENCH_METHODS    5
+#define MEMBENCH_NT         3           /* Index of the SSE2 method */
+
+static const uint32_t membench_sizes[] = {
+    16, 64, 256, 1024, 4096, 65536, 262144, 1u << 20, 4u << 20,
+};
+
+static uint8_t *membench_src;
+static uint8_t *membench_dst;
+
+static int membench_usable(int m) {
+    return m != MEMBENCH_NT || (mem_features & MEM_SSE2);
+}
+
+static void membench_pattern(uint8_t *p, uint32_t len, uint32_t seed) {
+    for (uint32_t i = 0; i < len; i++) p[i] = (uint8_t)(i * 167 + seed + (i >> 9));
+}
+
+static int membench_same(const uint8_t *a, const uint8_t *b, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        if (a[i] != b[i]) return 0;
+    }
+    return 1;
+}
+
+/* Each method against the byte loop, and the guard bytes around the
+ * destination untouched */
+static int membench_verify(void) {
+    uint8_t *want = membench_dst + MEMBENCH_MAX / 2;
+    for (uint32_t len = 0; len < 600; len += (len < 80) ? 1 : 37) {
+        for (uint32_t so = 0; so < 4; so++) {
+            for (uint32_t d_o = 0; d_o < 4; d_o++) {
+                const uint8_t *s = membench_src + so;
+                for (int m = 0; m < MEMBENCH_METHODS; m++) {
+                    if (!membench_usable(m)) continue;
+                    uint8_t *d = membench_dst + 8 + d_o;
+                    memset_bytes(d - 8, 0xA5, len + 16);
+                    membench_copies[m](d, s, len);
+                    if (!membench_same(d, s, len) || d[-1] != 0xA5 || d[len] != 0xA5) {
+                        return -1;
+                    }
+                    memset_bytes(d - 8, 0xA5, len + 16);
+                    membench_fills[m](d, 0x3C + m, len);
+                    for (uint32_t i = 0; i < len; i++) {
+                        if (d[i] != (uint8_t)(0x3C + m)) return -1;
+                    }
+                    if (d[-1] != 0xA5 || d[len] != 0xA5) return -1;
+                }
+            }
+        }
+    }
+
+    /* memmove: every shift in both directions over a 300-byte window,
+     * against a copy made through a separate buffer */
+    for (uint32_t len = 0; len < 300; len += 7) {
+        for (int32_t shift = -40; shift <= 40; shift++) {
+            uint8_t *base = membench_dst + 64;
+            membench_pattern(base - 64, len + 128, (uint32_t)shift);
+            memcpy_bytes(want, base - 64, len + 128);
+            memcpy_bytes(want + 64 + shift, base, len);
+            memmove(base + shift, base, len);
+            if (!membench_same(base - 64, want, len + 128)) return -1;
+        }
+    }
+    return 0;
+}
+
+static uint64_t membench_run(int m, int fill, uint32_t size, uint32_t so,
+                             uint32_t d_o, uint32_t rounds) {
+    uint8_t *d = membench_dst + d_o;
+    const uint8_t *s = membench_src + so;
+    uint64_t start = rdtsc();
+    if (fill) {
+        membench_fill_fn f = membench_fills[m];
+        for (uint32_t i = 0; i < rounds; i++) f(d, (int)i, size);
+    } else {
+        membench_copy_fn f = membench_copies[m];
+        for (uint32_t i = 0; i < rounds; i++) f(d, s, size);
+    }
+    return rdtsc() - start;
+}
+
+static void membench_table(int fill, uint32_t so, uint32_t d_o, uint32_t khz) {
+    console_write(fill ? "\nmemset, MB/s, dest" : "\nmemcpy, MB/s, src");
+    if (!fill) {
+        console_write(" +");
+        write_dec(so);
+        console_write(", dest");
+    }
+    console_write(" +");
+    write_dec(d_o);
+    console_write("\n\n      size");
+    for (int m = 0; m < MEMBENCH_METHODS; m++) {
+        const char *name = fill ? membench_fill_names[m] : membench_copy_names[m];
+        for (int pad = (int)strlen(name); pad < 9; pad++) console_put_char(' ');
+        console_write(name);
+    }
+    console_put_char('\n');
+
+    for (uint32_t i = 0; i < sizeof(membench_sizes) / sizeof(membench_sizes[0]); i++) {
+        uint32_t size = membench_sizes[i];
+        uint32_t rounds = MEMBENCH_BYTES / size;
+        write_size(size, 10);
+        for (int m = 0; m < MEMBENCH_METHODS; m++) {
+            if (!membench_usable(m)) {
+                console_write("        -");
+                continue;
+            }
+            /* The byte loop gets a quarter of the work */
+            uint32_t r = (m == 0 && rounds > 4) ? rounds / 4 : rounds;
+            uint64_t cycles = membench_run(m, fill, size, so, d_o, r);
+            write_dec_pad(rate_mb((uint64_t)r * size, cycles, khz), 9);
+        }
+        console_put_char('\n');
+    }
+}
+
+/* memmove of `size` bytes by `shift` within the destination buffer */
+static void membench_move(int32_t shift, uint32_t size, uint32_t khz) {
+    uint32_t rounds = MEMBENCH_BYTES / size;
+    uint8_t *base = membench_dst + 64;
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < rounds; i++) memmove(base + shift, base, size);
+    uint64_t cycles = rdtsc() - start;
+
+    console_write("  ");
+    write_size(size, 10);
+    console_write(shift < 0 ? " down by " : "   up by ");
+    write_dec_pad((uint32_t)(shift < 0 ? -shift : shift), 2);
+    write_dec_pad(rate_mb((uint64_t)rounds * size, cycles, khz), 9);
+    console_write(" MB/s\n");
+}
+
+void cmd_membench(int argc, char **argv) {
+    (void)argc; (void)argv;
+
+    uint32_t khz = timer_get_tsc_khz();
+    if (khz == 0) {
+        console_write("membench: TSC calibration failed\n");
+        return;
+    }
+    membench_src = (uint8_t *)pmm_alloc_pages(MEMBENCH_PAGES);
+    membench_dst = (uint8_t *)pmm_alloc_pages(MEMBENCH_PAGES);
+    if (!membench_src || !membench_dst) {
+        console_write("membench: not enough contiguous memory\n");
+        goto out;
+    }
+    membench_pattern(membench_src, MEMBENCH_PAGES * 4096, 0);
+
+    if (membench_verify() < 0) {
+        console_write("membench: a method disagrees with the byte loop\n");
+        goto out;
+    }
+
+    console_write("\nCPU: ");
+    console_write((mem_features & MEM_ERMS) ? "ERMS" : "no ERMS");
+    console_write((mem_features & MEM_SSE2) ? ", SSE2" : ", no SSE2");
+    console_write("; memcpy/memset use a loop below ");
+    write_dec(MEM_SMALL);
+    console_write(" B");
+    if (mem_features & MEM_SSE2) {
+        console_write(" and MOVNTI from ");
+        write_dec(MEM_NT_MIN >> 10);
+        console_write(" KiB");
+    }
+    console_write("\n");
+
+    membench_table(0, 0, 0, khz);
+    membench_table(0, 1, 3, khz);
+    membench_table(1, 0, 0, khz);
+    membench_table(1, 0, 3, khz);
+
+    console_write("\nmemmove, overlapping\n\n");
+    membench_move(-4, 4096, khz);
+    membench_move(4, 4096, khz);
+    membench_move(-16, 65536, khz);
+    membench_move(16, 65536, khz);
+    console_put_char('\n');
+
+out:
+    if (membench_src) pmm_free_pages(membench_src, MEMBENCH_PAGES);
+    if (membench_dst) pmm_free_pages(membench_dst, MEMBENCH_PAGES);
+    membench_src = membench_dst = NULL;
+}
+
+/* ------------------------------------------------------------------ */
+/* strbench                                                             */
+/* ------------------------------------------------------------------ */
+
+#define STRBENCH_ROUNDS     20000
+#define STRBENCH_MAX        1024
+#define STRBENCH_DEPTH      12          /* Path components */
+#define STRBENCH_PATH       256
+
+static char strbench_a[STRBENCH_MAX + 8];
+static char strbench_b[STRBENCH_MAX + 8];
+static char strbench_c[STRBENCH_MAX + 8];
+static volatile uint32_t strbench_sink;
+
+/* The loops the word-at-a-time versions replaced */
+static size_t strlen_bytes(const char *s) {
+    size_t n = 0;
+    while (s[n]) n++;
+    return n;
+}
+
+static int strcmp_bytes(const char *a, const char *b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *(const unsigned char *)a - *(const unsigned char *)b;
+}
+
+static const char *strchr_bytes(const char *s, char c) {
+    for (; *s; s++) {
+        if (*s == c) return s;
+    }
+    return NULL;
+}
+
+/* Cycles per call of one operation; 0-2 are the byte loops */
+static uint32_t strbench_run(int op, const char *a, const char *b) {
+    uint32_t sum = 0;
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < STRBENCH_ROUNDS; i++) {
+        switch (op) {
+        case 0: sum += strlen_bytes(a); break;
+        case 1: sum += (uint32_t)strcmp_bytes(a, b); break;
+        case 2: sum += (uint32_t)(uintptr_t)strchr_bytes(a, '!'); break;
+        case 3: sum += string_length(a); break;
+        case 4: sum += (uint32_t)strcmp(a, b); break;
+        default: sum += (uint32_t)(uintptr_t)strchr(a, '!'); break;
+        }
+    }
+    uint64_t cycles = rdtsc() - start;
+    strbench_sink = sum;
+    return (uint32_t)udiv64(cycles, STRBENCH_ROUNDS, 0);
+}
+
+/* The path of a node STRBENCH_DEPTH levels down, built the way the
+ * shell used to (prepending each parent with copy + concat) and with a
+ * strbuf_t appending from the root */
+static uint32_t strbench_path(int builder) {
+    static const char *const names[STRBENCH_DEPTH] = {
+        "home", "user", "projects", "openos", "kernel", "net",
+        "drivers", "e1000", "rings", "tx", "descriptors", "entry",
+    };
+    char path[STRBENCH_PATH];
+    char temp[STRBENCH_PATH];
+    uint32_t sum = 0;
+
+    uint64_t start = rdtsc();
+    for (uint32_t r = 0; r < STRBENCH_ROUNDS / 10; r++) {
+        if (builder) {
+            strbuf_t sb;
+            strbuf_init(&sb, path, sizeof(path));
+            for (int i = 0; i < STRBENCH_DEPTH; i++) {
+                strbuf_putc(&sb, '/');
+                strbuf_append(&sb, names[i]);
+            }
+            sum += sb.len;
+        } else {
+            path[0] = '\0';
+            for (int i = STRBENCH_DEPTH - 1; i >= 0; i--) {
+                string_copy(temp, "/");
+                string_concat(temp, names[i]);
+                string_concat(temp, path);
+                string_copy(path, temp);
+            }
+            sum += path[1];
+        }
+    }
+    uint64_t cycles = rdtsc() - start;
+    strbench_sink = sum;
+    return (uint32_t)udiv64(cycles, STRBENCH_ROUNDS / 10, 0);
+}
+
+void cmd_strbench(int argc, char **argv) {
+    (void)argc; (void)argv;
+
+    static const uint32_t lens[] = { 7, 32, 128, 1024 };
+    console_write("\nCycles per call, byte loop / word at a time; strcmp +1 has the\n"
+                  "second string one byte off the first's alignment\n\n");
+    console_write("    length        strlen           strcmp        strcmp +1           strchr\n");
+    for (uint32_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+        uint32_t len = lens[i];
+        for (uint32_t j = 0; j < len; j++) {
+            strbench_a[j] = (char)('a' + j % 26);
+            strbench_b[j] = strbench_a[j];
+            strbench_c[j + 1] = strbench_a[j];
+        }
+        strbench_a[len] = strbench_b[len] = strbench_c[len + 1] = '\0';
+
+        /* strlen, strcmp, strcmp +1, strchr (for a byte not there) */
+        static const int ops[4] = { 0, 1, 1, 2 };
+        write_dec_pad(len, 10);
+        for (int k = 0; k < 4; k++) {
+            const char *b = (k == 2) ? strbench_c + 1 : strbench_b;
+            write_dec_pad(strbench_run(ops[k], strbench_a, b), 7);
+            console_write(" /");
+            write_dec_pad(strbench_run(ops[k] + 3, strbench_a, b), 5);
+            console_write("   ");
+        }
+        console_put_char('\n');
+    }
+
+    console_write("\nPath of ");
+    write_dec(STRBENCH_DEPTH);
+    console_write(" components: copy + concat ");
+    write_dec(strbench_path(0));
+    console_write(" cycles, strbuf ");
+    write_dec(strbench_path(1));
+    console_write(" cycles\n\n");
+}
@@ -0,0 +1,1669 @@
+/*
+ * OpenOS - Network Shell Commands and Benchmarks
+ *
+ *   lspci     - list the PCI functions found at boot
+ *   netbench  - e1000 frames/second and MB/s through the real TX and RX
+ *               rings, with the PHY in loopback so every frame sent
+ *               comes back through the interrupt + NAPI receive path;
+ *               also shows the sk_buff pool and per-CPU cache counters
+ *   ping      - ICMP echo round-trip times, e.g. to the QEMU gateway
+ *   arp       - the neighbour cache
+ *   route     - the IPv4 routing table
+ *   netqueues - per-RX-queue counters of each device and of the RPS
+ *               backlogs; `netqueues <dev> <mask>` sets the device's
+ *               RPS CPUs
+ *   netstat   - device counters (-i), protocol counters (-s) and the
+ *               TCP connections and UDP sockets with their queues,
+ *               RTT and retransmits (-a); all three by default
+ *   fragtest  - reassembly of a UDP datagram sent to lo in two
+ *               fragments, the first carrying IP options; with the first
+ *               arriving last and arriving first
+ *   udpbench  - UDP datagrams/second to our own address, one call per
+ *               datagram vs. sendmmsg/recvmmsg batches
+ *   tcpbench  - TCP to our own address: bulk MB/s with copying writes,
+ *               MSG_ZEROCOPY writes and sendfile() of a ramfs file, and
+ *               request/response transactions/second with and without
+ *               TCP_NODELAY
+ *   csumbench - Internet checksum MB/s over 64 B - 64 KiB: the plain
+ *               16-bit loop vs. net_csum_partial(), and memcpy + sum vs.
+ *               the fused net_csum_copy()
+ *   bpfbench  - packet filter cycles/packet, interpreted vs. JIT, for
+ *               filters like tcpdump's; then a filter on lo's RX hook
+ *               and one on a UDP socket, at work
+ *
+ * Timing uses the TSC, calibrated against the PIT by timer_get_tsc_khz().
+ */
+
+#include "commands.h"
+#include "shell.h"
+#include "string.h"
+#include "../include/network.h"
+#include "../include/arp.h"
+#include "../include/ip.h"
+#include "../include/icmp.h"
+#include "../include/udp.h"
+#include "../include/tcp.h"
+#include "../include/rss.h"
+#include "../include/bpf.h"
+#include "../fs/vfs.h"
+#include "../drivers/console.h"
+#include "../drivers/timer.h"
+#include "../drivers/pci.h"
+#include "../drivers/e1000.h"
+#include "../arch/x86/irq.h"
+#include "../process/process.h"
+#include "../process/scheduler.h"
+#include "../arch/x86/cpu.h"
+
+/* ------------------------------------------------------------------ */
+/* Local formatting helpers                                             */
+/* ------------------------------------------------------------------ */
+
+static void write_dec(uint32_t v) {
+    char buf[12];
+    int pos = 0;
+    do {
+        buf[pos++] = (char)('0' + (v % 10));
+        v /= 10;
+    } while (v > 0);
+    while (pos > 0) console_put_char(buf[--pos]);
+}
+
+static void write_dec_pad(uint32_t v, int width) {
+    uint32_t t = v;
+    int digits = 0;
+    do { digits++; t /= 10; } while (t > 0);
+    for (int i = digits; i < width; i++) console_put_char(' ');
+    write_dec(v);
+}
+
+/* Print a value held in tenths as "N.N". */
+static void write_tenths(uint32_t v, int width) {
+    write_dec_pad(v / 10, width - 2);
+    console_put_char('.');
+    console_put_char((char)('0' + v % 10));
+}
+
+static void write_hex(uint32_t v, int digits) {
+    static const char hex[] = "0123456789abcdef";
+    for (int i = digits - 1; i >= 0; i--) {
+        console_put_char(hex[(v >> (i * 4)) & 0xF]);
+    }
+}
+
+/* Scale a 64-bit cycle count down until it fits a 32-bit divisor,
+ * shifting `num` by the same amount. */
+static uint32_t scale_cycles(uint64_t *num, uint64_t cycles) {
+    while (cycles > 0xFFFFFFFFull) {
+        cycles >>= 1;
+        *num >>= 1;
+    }
+    return cycles ? (uint32_t)cycles : 1;
+}
+
+/* Throughput in tenths of MB/s for `bytes` moved in `cycles`. */
+static uint32_t rate_mb_x10(uint64_t bytes, uint64_t cycles, uint32_t khz) {
+    uint64_t num = ((bytes * 10) >> 10) * khz;
+    uint32_t div = scale_cycles(&num, cycles);
+    return (uint32_t)(udiv64(num, div, 0) * 1000 >> 10);
+}
+
+/* Operations per second for `ops` done in `cycles`. */
+static uint32_t rate_per_sec(uint32_t ops, uint64_t cycles, uint32_t khz) {
+    uint64_t num = (uint64_t)ops * khz * 1000;
+    uint32_t div = scale_cycles(&num, cycles);
+    return (uint32_t)udiv64(num, div, 0);
+}
+
+static int parse_uint(const char *s, uint32_t *out) {
+    if (!s || !*s) return -1;
+    uint32_t v = 0;
+    for (int i = 0; s[i]; i++) {
+        if (s[i] < '0' || s[i] > '9') return -1;
+        v = v * 10 + (uint32_t)(s[i] - '0');
+    }
+    *out = v;
+    return 0;
+}
+
+static void write_ip(in_addr_t addr) {
+    char buf[16];
+    console_write(inet_format(addr, buf));
+}
+
+/* ------------------------------------------------------------------ */
+/* lspci                                                                */
+/* ------------------------------------------------------------------ */
+
+void cmd_lspci(int argc, char **argv) {
+    (void)argc; (void)argv;
+
+    console_write("\n  slot     vendor:device  class  irq\n");
+    console_write("  ----     -------------  -----  ---\n");
+    for (int i = 0; i < pci_device_count(); i++) {
+        pci_device_t *d = pci_get(i);
+        console_write("  ");
+        write_hex(d->bus, 2);
+        console_put_char(':');
+        write_hex(d->slot, 2);
+        console_put_char('.');
+        write_hex(d->func, 1);
+        console_write("  ");
+        write_hex(d->vendor, 4);
+        console_put_char(':');
+        write_hex(d->device, 4);
+        console_write("      ");
+        write_hex(d->class_code, 2);
+        write_hex(d->subclass, 2);
+        console_write("   ");
+        if (d->irq_line < IRQ_LINES) write_dec_pad(d->irq_line, 3);
+        else                         console_write("  -");
+        console_write("\n");
+    }
+    console_write("\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* netbench                                                             */
+/* ------------------------------------------------------------------ */
+
+#define NETBENCH_BATCH      32          /* Frames per TX doorbell        */
+#define NETBENCH_ETHERTYPE  0x88B5      /* IEEE local experimental       */
+#define NETBENCH_IDLE_TICKS 100         /* Give up after 1 s w/o frames  */
+
+static uint8_t netbench_frame[MAX_PACKET_SIZE];
+
+/* Take what the RX thread has queued, as a socket reader would. */
+static void netbench_drain(void) {
+    sk_buff_t *skb;
+    while ((skb = net_receive_skb()) != NULL) {
+        skb_free(skb);
+    }
+}
+
+static void netbench_run(net_device_t *dev, uint32_t size, uint32_t frames,
+                         uint32_t khz) {
+    /* Addressed to ourselves so the receive filter accepts it */
+    eth_header_t *eth = (eth_header_t *)netbench_frame;
+    eth->dest = dev->mac;
+    eth->src  = dev->mac;
+    eth->type = (uint16_t)((NETBENCH_ETHERTYPE >> 8) | (NETBENCH_ETHERTYPE << 8));
+    for (uint32_t i = sizeof(eth_header_t); i < size; i++) {
+        netbench_frame[i] = (uint8_t)i;
+    }
+
+    net_dev_stats_t before = dev->stats;
+    e1000_stats_t nic_before;
+    e1000_get_stats(&nic_before);
+
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < frames; i++) {
+        /* One copy in, as a socket send makes; the NIC reads it in place */
+        sk_buff_t *skb = skb_alloc();
+        while (!skb) {
+            netbench_drain();
+            scheduler_yield();
+            skb = skb_alloc();
+        }
+        memcpy(skb_put(skb, size), netbench_frame, size);
+
+        int last = ((i + 1) % NETBENCH_BATCH == 0) || (i + 1 == frames);
+        while (net_xmit(dev, skb, last ? 0 : NET_XMIT_MORE) < 0) {
+            netbench_drain();
+            scheduler_yield();
+        }
+        if (last) netbench_drain();
+    }
+    uint64_t tx_cycles = rdtsc() - start;
+
+    /* Wait for the loopback copies, as long as they keep coming */
+    uint32_t seen = 0;
+    uint64_t idle_until = timer_get_ticks() + NETBENCH_IDLE_TICKS;
+    for (;;) {
+        netbench_drain();
+        uint32_t got = dev->stats.rx_packets - before.rx_packets;
+        if (got >= frames) break;
+        if (got != seen) {
+            seen = got;
+            idle_until = timer_get_ticks() + NETBENCH_IDLE_TICKS;
+        } else if (timer_get_ticks() >= idle_until) {
+            break;
+        }
+        scheduler_yield();
+    }
+    uint64_t rx_cycles = rdtsc() - start;
+
+    e1000_stats_t nic_after;
+    e1000_get_stats(&nic_after);
+    uint32_t rx = dev->stats.rx_packets - before.rx_packets;
+
+    write_dec_pad(size, 6);
+    write_dec_pad(frames, 8);
+    write_dec_pad(rx, 8);
+    write_dec_pad(rate_per_sec(frames, tx_cycles, khz), 10);
+    write_tenths(rate_mb_x10((uint64_t)frames * size, tx_cycles, khz), 8);
+    write_dec_pad(rate_per_sec(rx, rx_cycles, khz), 10);
+    write_tenths(rate_mb_x10((uint64_t)rx * size, rx_cycles, khz), 8);
+    write_dec_pad(nic_after.irqs - nic_before.irqs, 7);
+    write_dec_pad(dev->stats.rx_polls - before.rx_polls, 7);
+    write_dec_pad(nic_after.tx_doorbells - nic_before.tx_doorbells, 7);
+    console_write("\n");
+}
+
+void cmd_netbench(int argc, char **argv) {
+    (void)argc; (void)argv;
+    static const uint32_t sizes[]  = { 60, 590, 1514 };
+    static const uint32_t counts[] = { 50000, 30000, 20000 };
+
+    if (!e1000_present()) {
+        console_write("netbench: no e1000 NIC (run QEMU with -nic model=e1000)\n");
+        return;
+    }
+    if (!scheduler_active()) {
+        console_write("netbench: scheduler not running\n");
+        return;
+    }
+    uint32_t khz = timer_get_tsc_khz();
+    if (khz == 0) {
+        console_write("netbench: TSC calibration failed\n");
+        return;
+    }
+    if (e1000_set_loopback(1) < 0) {
+        console_write("netbench: cannot put the PHY in loopback\n");
+        return;
+    }
+
+    net_device_t *dev = net_get_device();
+    console_write("\ne1000 PHY loopback (");
+    write_dec(NETBENCH_BATCH);
+    console_write(" frames per TX doorbell, NAPI budget ");
+    write_dec(NAPI_BUDGET);
+    console_write(")\n");
+    console_write("  size  frames  rx'ed   TX pkt/s    MB/s   RX pkt/s    MB/s   irqs  polls  bells\n");
+    console_write("  ----  ------  -----   --------    ----   --------    ----   ----  -----  -----\n");
+    for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        netbench_run(dev, sizes[i], counts[i], khz);
+    }
+    netbench_drain();
+    e1000_set_loopback(0);
+
+    e1000_stats_t st;
+    e1000_get_stats(&st);
+    console_write("\nRX missed (no buffers): ");
+    write_dec(st.rx_missed);
+    console_write(", backlog drops: ");
+    write_dec(dev->stats.rx_dropped);
+    console_write(", TX ring full: ");
+    write_dec(st.tx_ring_full);
+
+    skb_stats_t sk;
+    skb_get_stats(&sk);
+    console_write("\nskb pool: ");
+    write_dec(sk.buffers);
+    console_write(" buffers (");
+    write_dec(sk.pool_free);
+    console_write(" free, ");
+    write_dec(sk.cached);
+    console_write(" in CPU caches), ");
+    write_dec(sk.skbs_in_use);
+    console_write(" skbs live, cache hits ");
+    write_dec(sk.cache_hits);
+    console_write(", refills ");
+    write_dec(sk.cache_refills);
+    console_write("\n\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* ping / arp / route                                                   */
+/* ------------------------------------------------------------------ */
+
+#define PING_DEFAULT_COUNT  4
+#define PING_DEFAULT_SIZE   56
+#define PING_TIMEOUT_MS     1000
+#define PING_INTERVAL_MS    1000
+
+/* Print microseconds as milliseconds with three decimals. */
+static void write_usec_ms(uint32_t us) {
+    write_dec(us / 1000);
+    console_put_char('.');
+    console_put_char((char)('0' + (us / 100) % 10));
+    console_put_char((char)('0' + (us / 10) % 10));
+    console_put_char((char)('0' + us % 10));
+}
+
+void cmd_ping(int argc, char **argv) {
+    in_addr_t dst;
+    uint32_t count = PING_DEFAULT_COUNT;
+    uint32_t size = PING_DEFAULT_SIZE;
+
+    if (argc < 2 || inet_parse(argv[1], &dst) < 0 ||
+        (argc > 2 && (parse_uint(argv[2], &count) < 0 || count == 0)) ||
+        (argc > 3 && (parse_uint(argv[3], &size) < 0 || size > ICMP_PING_MAX_DATA))) {
+        console_write("Usage: ping <a.b.c.d> [count] [size <= 8192]\n");
+        return;
+    }
+    if (!scheduler_active()) {
+        console_write("ping: scheduler not running\n");
+        return;
+    }
+
+    uint32_t khz = timer_get_tsc_khz();
+    if (khz == 0) khz = 1;
+
+    console_write("PING ");
+    write_ip(dst);
+    console_write(": ");
+    write_dec(size);
+    console_write(" data bytes\n");
+
+    uint32_t received = 0;
+    uint32_t min_us = 0xFFFFFFFFu, max_us = 0;
+    uint64_t sum_us = 0;
+
+    for (uint32_t seq = 1; seq <= count; seq++) {
+        icmp_ping_result_t r;
+        if (icmp_ping(dst, (uint16_t)seq, size, PING_TIMEOUT_MS, &r) < 0) {
+            console_write("Request timeout for icmp_seq ");
+            write_dec(seq);
+            console_write("\n");
+        } else {
+            uint64_t num = r.rtt_cycles * 1000;
+            uint32_t us = (uint32_t)udiv64(num, khz, 0);
+            received++;
+            sum_us += us;
+            if (us < min_us) min_us = us;
+            if (us > max_us) max_us = us;
+
+            write_dec(r.bytes + (uint32_t)sizeof(icmp_header_t));
+            console_write(" bytes from ");
+            write_ip(dst);
+            console_write(": icmp_seq=");
+            write_dec(seq);
+            console_write(" ttl=");
+            write_dec(r.ttl);
+            console_write(" time=");
+            write_usec_ms(us);
+            console_write(" ms\n");
+        }
+        if (seq < count) process_sleep(PING_INTERVAL_MS);
+    }
+
+    console_write("--- ");
+    write_ip(dst);
+    console_write(" ping statistics ---\n");
+    write_dec(count);
+    console_write(" packets transmitted, ");
+    write_dec(received);
+    console_write(" received, ");
+    write_dec((count - received) * 100 / count);
+    console_write("% packet loss\n");
+    if (received) {
+        console_write("rtt min/avg/max = ");
+        write_usec_ms(min_us);
+        console_put_char('/');
+        write_usec_ms((uint32_t)udiv64(sum_us, received, 0));
+        console_put_char('/');
+        write_usec_ms(max_us);
+        console_write(" ms\n");
+    }
+}
+
+void cmd_arp(int argc, char **argv) {
+    (void)argc; (void)argv;
+    static const char *states[] = { "?", "incomplete", "reachable", "stale" };
+    static arp_entry_info_t entries[ARP_MAX_ENTRIES];
+
+    int n = arp_snapshot(entries, ARP_MAX_ENTRIES);
+    console_write("\n  address           hw address          state        age  queued\n");
+    console_write("  -------           ----------          -----        ---  ------\n");
+    for (int i = 0; i < n; i++) {
+        arp_entry_info_t *e = &entries[i];
+        char buf[16];
+        const char *ip = inet_format(e->ip, buf);
+        console_write("  ");
+        console_write(ip);
+        for (int pad = (int)strlen(ip); pad < 18; pad++) console_put_char(' ');
+        if (e->state == NUD_INCOMPLETE) {
+            console_write("(incomplete)       ");
+        } else {
+            for (int b = 0; b < MAC_ADDR_LEN; b++) {
+                write_hex(e->mac.addr[b], 2);
+                console_put_char(b < MAC_ADDR_LEN - 1 ? ':' : ' ');
+            }
+            console_write(" ");
+        }
+        const char *st = states[e->state <= NUD_STALE ? e->state : 0];
+        console_write(st);
+        for (int pad = (int)strlen(st); pad < 10; pad++) console_put_char(' ');
+        write_dec_pad(e->age_ticks / 100, 5);
+        console_write("s");
+        write_dec_pad(e->pending, 7);
+        console_write("\n");
+    }
+
+    arp_stats_t st;
+    arp_get_stats(&st);
+    console_write("\n");
+    write_dec(st.entries);
+    console_write(" entries, ");
+    write_dec(st.lookups);
+    console_write(" lookups (");
+    write_dec(st.misses);
+    console_write(" misses), ");
+    write_dec(st.requests_sent);
+    console_write(" requests and ");
+    write_dec(st.replies_sent);
+    console_write(" replies sent, ");
+    write_dec(st.pending_drops);
+    console_write(" queued packets dropped\n\n");
+}
+
+void cmd_route(int argc, char **argv) {
+    (void)argc; (void)argv;
+
+    console_write("\n  destination         gateway           iface\n");
+    console_write("  -----------         -------           -----\n");
+    route_t r;
+    for (int i = 0; ip_route_get(i, &r) == 0; i++) {
+        char buf[16];
+        const char *dest = inet_format(r.dest, buf);
+        console_write("  ");
+        console_write(dest);
+        console_put_char('/');
+        write_dec(r.prefix);
+        int width = (int)strlen(dest) + 1 + (r.prefix >= 10 ? 2 : 1);
+        for (int pad = width; pad < 20; pad++) console_put_char(' ');
+        const char *gw = r.gateway ? inet_format(r.gateway, buf) : "*";
+        console_write(gw);
+        for (int pad = (int)strlen(gw); pad < 18; pad++) console_put_char(' ');
+        console_write(r.dev->name);
+        console_write("\n");
+    }
+
+    ip_stats_t st;
+    ip_get_stats(&st);
+    console_write("\nIP: ");
+    write_dec(st.rx_packets);
+    console_write(" received (");
+    write_dec(st.rx_delivered);
+    console_write(" delivered, ");
+    write_dec(st.rx_hdr_errors);
+    console_write(" bad headers), ");
+    write_dec(st.tx_packets);
+    console_write(" sent (");
+    write_dec(st.tx_frags);
+    console_write(" fragments, ");
+    write_dec(st.tx_no_route);
+    console_write(" unroutable)\n    reassembly: ");
+    write_dec(st.reasm_frags);
+    console_write(" fragments, ");
+    write_dec(st.reasm_ok);
+    console_write(" ok, ");
+    write_dec(st.reasm_failed);
+    console_write(" failed, ");
+    write_dec(st.reasm_timeouts);
+    console_write(" timed out\n\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* netqueues                                                            */
+/* ------------------------------------------------------------------ */
+
+static void write_queue_stats(const net_queue_stats_t *q) {
+    write_dec_pad(q->packets, 10);
+    write_dec_pad((uint32_t)(q->bytes >> 10), 10);
+    console_write(" KiB");
+    write_dec_pad(q->dropped, 8);
+    write_dec_pad(q->polls, 9);
+    console_write("\n");
+}
+
+static void netqueues_show(net_device_t *dev) {
+    console_write("\n");
+    console_write(dev->name);
+    console_write(": ");
+    write_dec(dev->num_rx_queues);
+    console_write(dev->num_rx_queues == 1 ? " RX queue" : " RX queues (RSS)");
+    if (dev->rps_len) {
+        console_write(", RPS to CPUs 0x");
+        write_hex(dev->rps_cpus, 4);
+    }
+    console_write("\n  queue  cpu   packets     bytes       dropped    polls\n");
+    for (uint32_t q = 0; q < dev->num_rx_queues; q++) {
+        write_dec_pad(q, 7);
+        write_dec_pad(dev->rxq_cpu[q], 5);
+        write_queue_stats(&dev->rxq[q]);
+    }
+}
+
+/* Hex CPU mask, with or without 0x */
+static int parse_mask(const char *s, uint32_t *out) {
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) s += 2;
+    if (!*s || strlen(s) > 8) return -1;
+    uint32_t v = 0;
+    for (; *s; s++) {
+        char c = *s;
+        uint32_t d;
+        if (c >= '0' && c <= '9') d = (uint32_t)(c - '0');
+        else if (c >= 'a' && c <= 'f') d = (uint32_t)(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') d = (uint32_t)(c - 'A' + 10);
+        else return -1;
+        v = (v << 4) | d;
+    }
+    *out = v;
+    return 0;
+}
+
+void cmd_netqueues(int argc, char **argv) {
+    net_device_t *devs[2] = { net_get_device(), net_get_loopback() };
+
+    if (argc > 1) {
+        net_device_t *dev = NULL;
+        for (int i = 0; i < 2; i++) {
+            if (devs[i] && strcmp(argv[1], devs[i]->name) == 0) dev = devs[i];
+        }
+        uint32_t mask;
+        if (!dev || argc != 3 || parse_mask(argv[2], &mask) < 0 ||
+            rps_set_cpus(dev, mask) < 0) {
+            console_write("Usage: netqueues [<dev> <rps cpu mask, hex; 0: off>]\n");
+            return;
+        }
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (devs[i]) netqueues_show(devs[i]);
+    }
+
+    console_write("\nRPS backlogs:\n    cpu   packets     bytes       dropped    polls\n");
+    for (uint32_t c = 0; c < MAX_CPUS; c++) {
+        net_queue_stats_t st;
+        rps_get_backlog_stats(c, &st);
+        if (!st.packets && !st.dropped && !st.polls) continue;
+        write_dec_pad(c, 7);
+        write_queue_stats(&st);
+    }
+    console_write("\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* netstat                                                              */
+/* ------------------------------------------------------------------ */
+
+#define NETSTAT_MAX_CONNS   64
+
+static tcp_conn_info_t netstat_tcp[NETSTAT_MAX_CONNS];
+static udp_sock_info_t netstat_udp[NETSTAT_MAX_CONNS];
+
+/* "addr:port" padded to `width`; a wildcard part prints as '*' */
+static void write_endpoint(in_addr_t addr, uint16_t port, int width) {
+    char buf[16];
+    const char *a = addr ? inet_format(addr, buf) : "*";
+    console_write(a);
+    console_put_char(':');
+    int len = (int)strlen(a) + 1;
+    if (port) {
+        write_dec(port);
+        for (uint32_t t = port; t; t /= 10) len++;
+    } else {
+        console_put_char('*');
+        len++;
+    }
+    for (; len < width; len++) console_put_char(' ');
+}
+
+static void netstat_dev(const net_device_t *dev) {
+    net_dev_stats_t st = dev->stats;    /* Counters only grow: no lock */
+    console_write("  ");
+    console_write(dev->name);
+    for (int pad = (int)strlen(dev->name); pad < 6; pad++) console_put_char(' ');
+    console_write(" RX");
+    write_dec_pad(st.rx_packets, 11);
+    write_dec_pad((uint32_t)(st.rx_bytes >> 10), 10);
+    console_write(" KiB");
+    write_dec_pad(st.rx_errors, 8);
+    write_dec_pad(st.rx_dropped, 9);
+    write_dec_pad(st.rx_filtered, 10);
+    if (!dev->is_up) console_write("  (down)");
+    console_write("\n        TX");
+    write_dec_pad(st.tx_packets, 11);
+    write_dec_pad((uint32_t)(st.tx_bytes >> 10), 10);
+    console_write(" KiB");
+    write_dec_pad(st.tx_errors, 8);
+    write_dec_pad(st.tx_dropped, 9);
+    console_write("\n");
+}
+
+static void netstat_interfaces(void) {
+    console_write("\nInterfaces:\n  iface        packets     bytes      errors  dropped  filtered\n");
+    net_device_t *devs[2] = { net_get_device(), net_get_loopback() };
+    for (int i = 0; i < 2; i++) {
+        if (devs[i]) netstat_dev(devs[i]);
+    }
+}
+
+static void netstat_protocols(void) {
+    ip_stats_t ip;
+    icmp_stats_t icmp;
+    udp_stats_t udp;
+    tcp_stats_t tcp;
+    ip_get_stats(&ip);
+    icmp_get_stats(&icmp);
+    udp_get_stats(&udp);
+    tcp_get_stats(&tcp);
+
+    console_write("\nIP:   ");
+    write_dec(ip.rx_packets);
+    console_write(" received, ");
+    write_dec(ip.rx_delivered);
+    console_write(" delivered, ");
+    write_dec(ip.rx_hdr_errors);
+    console_write(" bad headers (");
+    write_dec(ip.rx_csum_errors);
+    console_write(" checksum), ");
+    write_dec(ip.rx_not_local);
+    console_write(" not ours, ");
+    write_dec(ip.rx_no_proto);
+    console_write(" unknown protocol\n      ");
+    write_dec(ip.tx_packets);
+    console_write(" sent, ");
+    write_dec(ip.tx_no_route);
+    console_write(" unroutable; ");
+    write_dec(ip.reasm_ok);
+    console_write(" reassembled, ");
+    write_dec(ip.reasm_failed + ip.reasm_timeouts);
+    console_write(" reassembly failures\n");
+
+    console_write("ICMP: ");
+    write_dec(icmp.rx_messages);
+    console_write(" received, ");
+    write_dec(icmp.rx_errors);
+    console_write(" errors (");
+    write_dec(icmp.rx_csum_errors);
+    console_write(" checksum), ");
+    write_dec(icmp.echo_requests);
+    console_write(" echo requests, ");
+    write_dec(icmp.pings_sent);
+    console_write(" pings sent\n");
+
+    console_write("UDP:  ");
+    write_dec(udp.rx_datagrams);
+    console_write(" received, ");
+    write_dec(udp.rx_errors);
+    console_write(" errors (");
+    write_dec(udp.rx_csum_errors);
+    console_write(" checksum), ");
+    write_dec(udp.rx_no_port);
+    console_write(" to no port, ");
+    write_dec(udp.rx_queue_drops);
+    console_write(" queue drops\n      ");
+    write_dec(udp.tx_datagrams);
+    console_write(" sent, ");
+    write_dec(udp.tx_errors);
+    console_write(" send errors\n");
+
+    console_write("TCP:  ");
+    write_dec(tcp.in_segs);
+    console_write(" segments received, ");
+    write_dec(tcp.in_errs);
+    console_write(" bad (");
+    write_dec(tcp.in_csum_errs);
+    console_write(" checksum), ");
+    write_dec(tcp.out_segs);
+    console_write(" sent, ");
+    write_dec(tcp.out_rsts);
+    console_write(" resets sent\n      ");
+    write_dec(tcp.retrans_segs);
+    console_write(" retransmitted (");
+    write_dec(tcp.fast_retrans);
+    console_write(" fast, ");
+    write_dec(tcp.sack_retrans);
+    console_write(" from SACK, ");
+    write_dec(tcp.rto_timeouts);
+    console_write(" timeouts), ");
+    write_dec(tcp.ooo_segs);
+    console_write(" out of order\n      ");
+    write_dec(tcp.active_opens);
+    console_write(" active opens, ");
+    write_dec(tcp.passive_opens);
+    console_write(" passive, ");
+    write_dec(tcp.attempt_fails);
+    console_write(" failed, ");
+    write_dec(tcp.estab_resets);
+    console_write(" reset\n");
+}
+
+/* Cycles as milliseconds with three decimals */
+static void write_cycles_ms(uint32_t cycles, uint32_t khz) {
+    write_usec_ms((uint32_t)udiv64((uint64_t)cycles * 1000, khz, 0));
+}
+
+static void netstat_sockets(void) {
+    uint32_t khz = timer_get_tsc_khz();
+    if (khz == 0) khz = 1;
+
+    int n = tcp_snapshot(netstat_tcp, NETSTAT_MAX_CONNS);
+    console_write("\nTCP:  local                  remote                 state       recv-q  send-q\n");
+    for (int i = 0; i < n; i++) {
+        const tcp_conn_info_t *c = &netstat_tcp[i];
+        console_write("      ");
+        write_endpoint(c->laddr, c->lport, 23);
+        write_endpoint(c->raddr, c->rport, 23);
+        const char *state = tcp_state_name(c->state);
+        console_write(state);
+        for (int pad = (int)strlen(state); pad < 11; pad++) console_put_char(' ');
+        write_dec_pad(c->state == TCP_LISTEN ? c->accept_len : c->rcv_queued, 7);
+        write_dec_pad(c->snd_queued, 8);
+        if (c->orphan) console_write("  (closed)");
+        console_write("\n");
+        if (c->state == TCP_LISTEN) continue;
+
+        console_write("        rtt ");
+        if (c->srtt_cycles) {
+            write_cycles_ms(c->srtt_cycles, khz);
+            console_write(" +/- ");
+            write_cycles_ms(c->rttvar_cycles, khz);
+            console_write(" ms");
+        } else {
+            console_write("-");
+        }
+        console_write(", rto ");
+        write_dec(c->rto * 10);
+        console_write(" ms, cwnd ");
+        write_dec(c->cwnd);
+        if (c->ssthresh != 0xFFFFFFFFu) {
+            console_write(", ssthresh ");
+            write_dec(c->ssthresh);
+        }
+        console_write(", in flight ");
+        write_dec(c->in_flight);
+        console_write(", peer wnd ");
+        write_dec(c->snd_wnd);
+        console_write(", retrans ");
+        write_dec(c->retrans);
+        console_write("\n");
+    }
+    if (n == NETSTAT_MAX_CONNS) console_write("      ...\n");
+
+    n = udp_snapshot(netstat_udp, NETSTAT_MAX_CONNS);
+    console_write("\nUDP:  local                  remote                 recv-q   bytes  rcvbuf  drops filtered\n");
+    for (int i = 0; i < n; i++) {
+        const udp_sock_info_t *u = &netstat_udp[i];
+        console_write("      ");
+        write_endpoint(u->laddr, u->lport, 23);
+        write_endpoint(u->raddr, u->rport, 23);
+        write_dec_pad(u->rx_qlen, 6);
+        write_dec_pad(u->rx_queued, 8);
+        write_dec_pad(u->rcvbuf, 8);
+        write_dec_pad(u->rx_drops, 7);
+        write_dec_pad(u->rx_filtered, 9);
+        console_write("\n");
+    }
+    if (n == NETSTAT_MAX_CONNS) console_write("      ...\n");
+}
+
+void cmd_netstat(int argc, char **argv) {
+    int show = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-i") == 0)      show |= 1;
+        else if (strcmp(argv[i], "-s") == 0) show |= 2;
+        else if (strcmp(argv[i], "-a") == 0) show |= 4;
+        else {
+            console_write("Usage: netstat [-i] [-s] [-a]\n");
+            return;
+        }
+    }
+    if (!show) show = 7;
+
+    if (show & 1) netstat_interfaces();
+    if (show & 2) netstat_protocols();
+    if (show & 4) netstat_sockets();
+    console_write("\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* udpbench                                                             */
+/* ------------------------------------------------------------------ */
+
+#define UDPBENCH_PORT       9000
+#define UDPBENCH_DATAGRAMS  20000
+#define UDPBENCH_BATCH      32
+
+static uint8_t udpbench_tx[UDP_MAX_PAYLOAD];
+static uint8_t udpbench_rx[UDPBENCH_BATCH][1472];
+
+/* Send and drain UDPBENCH_DATAGRAMS datagrams of `size` bytes in rounds
+ * of UDPBENCH_BATCH; returns the cycles taken and the count received.
+ * Datagrams to our own address are delivered by the RX thread, so each
+ * round waits for its first one and takes the rest as they are. */
+static uint64_t udpbench_run(socket_t *tx, socket_t *rx, in_addr_t self,
+                             uint32_t size, int batched, uint32_t *received) {
+    static net_mmsg_t msgs[UDPBENCH_BATCH];
+    sockaddr_in_t to = { self, UDPBENCH_PORT, 0 };
+    uint32_t got = 0;
+
+    uint64_t start = rdtsc();
+    for (uint32_t done = 0; done < UDPBENCH_DATAGRAMS; done += UDPBENCH_BATCH) {
+        if (batched) {
+            for (int i = 0; i < UDPBENCH_BATCH; i++) {
+                msgs[i].buf  = udpbench_tx;
+                msgs[i].len  = size;
+                msgs[i].addr = to;
+            }
+            net_socket_sendmmsg(tx, msgs, UDPBENCH_BATCH, 0);
+            for (int i = 0; i < UDPBENCH_BATCH; i++) {
+                msgs[i].buf = udpbench_rx[i];
+                msgs[i].len = sizeof(udpbench_rx[i]);
+            }
+            int n = net_socket_recvmmsg(rx, msgs, UDPBENCH_BATCH, 0);
+            if (n > 0) got += (uint32_t)n;
+        } else {
+            for (int i = 0; i < UDPBENCH_BATCH; i++) {
+                net_socket_sendto(tx, udpbench_tx, size, &to);
+            }
+            for (int i = 0; i < UDPBENCH_BATCH; i++) {
+                if (net_socket_recvfrom(rx, udpbench_rx[i], sizeof(udpbench_rx[i]),
+                                        NULL, i ? MSG_DONTWAIT : 0) < 0) {
+                    break;
+                }
+                got++;
+            }
+        }
+    }
+    *received = got;
+    return rdtsc() - start;
+}
+
+/* ------------------------------------------------------------------ */
+/* fragtest                                                             */
+/* ------------------------------------------------------------------ */
+
+#define FRAGTEST_PORT   5003
+#define FRAGTEST_ID     0x4F53
+#define FRAGTEST_PIECE  24          /* IP payload bytes per fragment     */
+#define FRAGTEST_OPTS   8           /* Options in the first fragment     */
+
+/* One fragment of `dgram` to `addr`, with `opts` bytes of IP options
+ * (NOPs, then End of Options List) */
+static sk_buff_t *fragtest_frag(net_device_t *dev, in_addr_t addr, uint16_t id,
+                                const uint8_t *dgram, uint32_t off, int more,
+                                uint32_t opts) {
+    sk_buff_t *skb = skb_alloc();
+    if (!skb) return NULL;
+
+    uint32_t hlen = IP_HLEN + opts;
+    uint8_t *p = skb_put(skb, hlen + FRAGTEST_PIECE);
+    ip_header_t *iph = (ip_header_t *)p;
+    iph->version_ihl  = (uint8_t)(0x40 | (hlen / 4));
+    iph->tos          = 0;
+    iph->total_length = htons((uint16_t)(hlen + FRAGTEST_PIECE));
+    iph->id           = htons(id);
+    iph->flags_offset = htons((uint16_t)((more ? IP_FLAG_MF : 0) | (off / 8)));
+    iph->ttl          = IP_DEFAULT_TTL;
+    iph->protocol     = PROTO_UDP;
+    iph->checksum     = 0;
+    iph->src_ip       = addr;
+    iph->dst_ip       = addr;
+    if (opts) {
+        memset(p + IP_HLEN, 1, opts - 1);
+        p[hlen - 1] = 0;
+    }
+    memcpy(p + hlen, dgram + off, FRAGTEST_PIECE);
+    iph->checksum = net_checksum(iph, hlen);
+    skb->dev = dev;
+    return skb;
+}
+
+/* Send `dgram` to lo as two fragments, the first (with options) last
+ * or first, and check what the socket gets */
+static void fragtest_run(net_device_t *lo, socket_t *rx, const uint8_t *dgram,
+                         uint32_t size, int first_last) {
+    in_addr_t addr = ip_to_in(&lo->ip);
+    uint16_t id = (uint16_t)(FRAGTEST_ID + first_last);
+    sk_buff_t *first = fragtest_frag(lo, addr, id, dgram, 0, 1, FRAGTEST_OPTS);
+    sk_buff_t *last  = fragtest_frag(lo, addr, id, dgram, FRAGTEST_PIECE, 0, 0);
+
+    console_write(first_last ? "fragtest: first fragment last:  "
+                             : "fragtest: first fragment first: ");
+    if (!first || !last) {
+        console_write("out of sk_buffs\n");
+        if (first) skb_free(first);
+        if (last) skb_free(last);
+        return;
+    }
+    ip_input(lo, first_last ? last : first);
+    ip_input(lo, first_last ? first : last);
+
+    uint8_t got[64];
+    int n = net_socket_recvfrom(rx, got, sizeof(got), NULL, MSG_DONTWAIT);
+    int ok = n == (int)(size - UDP_HLEN);
+    for (int i = 0; ok && i < n; i++) {
+        ok = got[i] == dgram[UDP_HLEN + i];
+    }
+
+    if (ok) {
+        console_write("ok, ");
+        write_dec((uint32_t)n);
+        console_write(" bytes past ");
+        write_dec(FRAGTEST_OPTS);
+        console_write(" bytes of options\n");
+    } else if (n < 0) {
+        console_write("FAILED, nothing delivered\n");
+    } else {
+        console_write("FAILED, ");
+        write_dec((uint32_t)n);
+        console_write(" bytes delivered, data differs\n");
+    }
+}
+
+void cmd_fragtest(int argc, char **argv) {
+    (void)argc; (void)argv;
+
+    net_device_t *lo = net_get_loopback();
+    socket_t *rx = net_socket_create(PROTO_UDP);
+    if (!lo || !rx || net_socket_bind(rx, FRAGTEST_PORT) < 0) {
+        console_write("fragtest: cannot set up socket\n");
+        if (rx) net_socket_close(rx);
+        return;
+    }
+
+    /* UDP header (no checksum) and 40 bytes of data, in two pieces */
+    uint8_t dgram[2 * FRAGTEST_PIECE];
+    udp_header_t *uh = (udp_header_t *)dgram;
+    uh->src_port = htons(FRAGTEST_PORT);
+    uh->dst_port = htons(FRAGTEST_PORT);
+    uh->length   = htons(sizeof(dgram));
+    uh->checksum = 0;
+    for (uint32_t i = UDP_HLEN; i < sizeof(dgram); i++) dgram[i] = (uint8_t)(i * 7);
+
+    fragtest_run(lo, rx, dgram, sizeof(dgram), 1);
+    fragtest_run(lo, rx, dgram, sizeof(dgram), 0);
+    net_socket_close(rx);
+}
+
+void cmd_udpbench(int argc, char **argv) {
+    (void)argc; (void)argv;
+    static const uint32_t sizes[] = { 16, 512, 1472 };
+
+    uint32_t khz = timer_get_tsc_khz();
+    if (khz == 0) {
+        console_write("udpbench: TSC calibration failed\n");
+        return;
+    }
+
+    socket_t *rx = net_socket_create(PROTO_UDP);
+    socket_t *tx = net_socket_create(PROTO_UDP);
+    if (!rx || !tx || net_socket_bind(rx, UDPBENCH_PORT) < 0) {
+        console_write("udpbench: cannot set up sockets\n");
+        if (rx) net_socket_close(rx);
+        if (tx) net_socket_close(tx);
+        return;
+    }
+    for (uint32_t i = 0; i < sizeof(udpbench_tx); i++) udpbench_tx[i] = (uint8_t)i;
+
+    in_addr_t self = ip_to_in(&net_get_device()->ip);
+    console_write("\nUDP to ");
+    write_ip(self);
+    console_write(":");
+    write_dec(UDPBENCH_PORT);
+    console_write(" (");
+    write_dec(UDPBENCH_DATAGRAMS);
+    console_write(" datagrams, rounds of ");
+    write_dec(UDPBENCH_BATCH);
+    console_write(")\n");
+    console_write("  size  calls              dgrams/s     MB/s  cycles/dgram  received\n");
+    console_write("  ----  -----              --------     ----  ------------  --------\n");
+
+    for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        for (int batched = 0; batched < 2; batched++) {
+            uint32_t received;
+            uint64_t cycles = udpbench_run(tx, rx, self, sizes[i], batched,
+                                           &received);
+            write_dec_pad(sizes[i], 6);
+            console_write(batched ? "  sendmmsg/recvmmsg " : "  sendto/recvfrom   ");
+            write_dec_pad(rate_per_sec(received, cycles, khz), 9);
+            console_write("  ");
+            write_tenths(rate_mb_x10((uint64_t)received * sizes[i], cycles, khz), 7);
+            uint64_t num = cycles;
+            uint32_t per = (uint32_t)udiv64(num, received ? received : 1, 0);
+            write_dec_pad(per, 14);
+            write_dec_pad(received, 10);
+            console_write("\n");
+        }
+    }
+
+    udp_stats_t st;
+    udp_get_stats(&st);
+    console_write("\nUDP: ");
+    write_dec(st.rx_datagrams);
+    console_write(" datagrams queued, ");
+    write_dec(st.rx_queue_drops);
+    console_write(" dropped (queue full), ");
+    write_dec(st.rx_errors);
+    console_write(" bad, ");
+    write_dec(st.rx_no_port);
+    console_write(" to closed ports\n\n");
+
+    net_socket_close(tx);
+    net_socket_close(rx);
+}
+
+/* ------------------------------------------------------------------ */
+/* tcpbench                                                             */
+/* ------------------------------------------------------------------ */
+
+#define TCPBENCH_BULK_PORT  5001
+#define TCPBENCH_RR_PORT    5002
+#define TCPBENCH_BULK_BYTES (8u << 20)
+#define TCPBENCH_WRITE      16384
+#define TCPBENCH_RR_SIZE    64
+#define TCPBENCH_RR_FIRST   16          /* Request written as 16 + 48 bytes */
+#define TCPBENCH_RR_TICKS   100         /* Each request/response run: 1 s  */
+#define TCPBENCH_FILE       "tcpbench.dat"
+
+/* How the bulk sender hands over its data */
+#define TCPBENCH_COPY       0
+#define TCPBENCH_ZEROCOPY   1
+#define TCPBENCH_SENDFILE   2
+
+static uint8_t  tcpbench_tx[TCPBENCH_WRITE];
+static uint8_t  tcpbench_rx[TCPBENCH_WRITE];
+static uint32_t tcpbench_received;
+static int      tcpbench_nodelay;
+
+static void wait_for_child(uint32_t pid) {
+    int got;
+    do {
+        got = process_wait(0);
+    } while (got >= 0 && (uint32_t)got != pid);
+}
+
+/* Read exactly `len` bytes; returns 0, or -1 at end of stream */
+static int tcpbench_read_full(socket_t *s, uint8_t *buf, uint32_t len) {
+    uint32_t got = 0;
+    while (got < len) {
+        int n = net_socket_recv(s, buf + got, len - got);
+        if (n <= 0) return -1;
+        got += (uint32_t)n;
+    }
+    return 0;
+}
+
+/* Bulk server: drain one connection to the end of its stream */
+static void tcpbench_sink(void *arg) {
+    socket_t *s = net_socket_accept((socket_t *)arg, NULL, 0);
+    if (!s) return;
+
+    uint32_t total = 0;
+    int n;
+    while ((n = net_socket_recv(s, tcpbench_rx, sizeof(tcpbench_rx))) > 0) {
+        total += (uint32_t)n;
+    }
+    tcpbench_received = total;
+    net_socket_close(s);
+}
+
+/* Request/response server: answer each request with as many bytes */
+static void tcpbench_echo(void *arg) {
+    static uint8_t req[TCPBENCH_RR_SIZE];
+    socket_t *s = net_socket_accept((socket_t *)arg, NULL, 0);
+    if (!s) return;
+
+    net_socket_setopt(s, TCP_NODELAY, tcpbench_nodelay);
+    while (tcpbench_read_full(s, req, sizeof(req)) == 0) {
+        if (net_socket_send(s, req, sizeof(req)) < 0) break;
+    }
+    net_socket_close(s);
+}
+
+/* Listen on `port` and start `server` on it. Returns the listener, or
+ * NULL with nothing left behind. */
+static socket_t *tcpbench_serve(uint16_t port, process_entry_t server,
+                                uint32_t *pid) {
+    socket_t *l = net_socket_create(PROTO_TCP);
+    if (!l) return NULL;
+    if (net_socket_bind(l, port) < 0 || net_socket_listen(l, 1) < 0) {
+        net_socket_close(l);
+        return NULL;
+    }
+    process_t *p = process_create("tcpserver", server, l, PRIORITY_HIGH);
+    if (!p) {
+        net_socket_close(l);
+        return NULL;
+    }
+    *pid = p->pid;
+    return l;
+}
+
+static socket_t *tcpbench_connect(in_addr_t self, uint16_t port) {
+    socket_t *c = net_socket_create(PROTO_TCP);
+    ip_addr_t ip = { { (uint8_t)self, (uint8_t)(self >> 8),
+                       (uint8_t)(self >> 16), (uint8_t)(self >> 24) } };
+    if (c && net_socket_connect(c, &ip, port) < 0) {
+        net_socket_close(c);
+        return NULL;
+    }
+    return c;
+}
+
+/* Wait up to a second for `sends` MSG_ZEROCOPY sends to complete;
+ * returns how many did. */
+static uint32_t tcpbench_zc_wait(socket_t *c, uint32_t sends) {
+    uint64_t end = timer_get_ticks() + 100;
+    int done;
+    while ((done = net_socket_getopt(c, SO_ZEROCOPY_DONE)) >= 0 &&
+           (uint32_t)done < sends && timer_get_ticks() < end) {
+        process_sleep(10);
+    }
+    return done < 0 ? 0 : (uint32_t)done;
+}
+
+static void tcpbench_bulk(in_addr_t self, uint32_t khz, int mode,
+                          vfs_node_t *file) {
+    static const char *const names[] = {
+        "-byte writes:        ",
+        "-byte MSG_ZEROCOPY:  ",
+        "-byte sendfile:      ",
+    };
+    uint32_t chunk = (mode == TCPBENCH_SENDFILE) ? file->length : TCPBENCH_WRITE;
+    uint32_t pid;
+    socket_t *l = tcpbench_serve(TCPBENCH_BULK_PORT, tcpbench_sink, &pid);
+    if (!l) {
+        console_write("  bulk: cannot start the server\n");
+        return;
+    }
+    tcpbench_received = 0;
+
+    uint64_t start = rdtsc();
+    socket_t *c = tcpbench_connect(self, TCPBENCH_BULK_PORT);
+    uint32_t sent = 0, sends = 0, completed = 0;
+    while (c && sent < TCPBENCH_BULK_BYTES) {
+        int n;
+        if (mode == TCPBENCH_SENDFILE) {
+            n = net_socket_sendfile(c, file, 0, chunk);
+        } else {
+            n = net_socket_sendmsg(c, tcpbench_tx, chunk, NULL,
+                                   mode == TCPBENCH_ZEROCOPY ? MSG_ZEROCOPY : 0);
+        }
+        if (n <= 0) break;
+        sent += (uint32_t)n;
+        sends++;
+    }
+    if (c && mode == TCPBENCH_ZEROCOPY) completed = tcpbench_zc_wait(c, sends);
+    if (c) net_socket_close(c);
+    else   net_socket_close(l);     /* the server gives up on accept */
+    wait_for_child(pid);
+    uint64_t cycles = rdtsc() - start;
+    if (c) net_socket_close(l);
+
+    console_write("  bulk, ");
+    write_dec_pad(chunk, 5);
+    console_write(names[mode]);
+    write_tenths(rate_mb_x10(tcpbench_received, cycles, khz), 7);
+    console_write(" MB/s  (");
+    write_dec(tcpbench_received);
+    console_write(" of ");
+    write_dec(TCPBENCH_BULK_BYTES);
+    console_write(" bytes");
+    if (mode == TCPBENCH_ZEROCOPY) {
+        console_write(", ");
+        write_dec(completed);
+        console_write(" of ");
+        write_dec(sends);
+        console_write(" sends completed");
+    }
+    console_write(")\n");
+}
+
+/* A ramfs file of VFS_MAX_FILE_SIZE bytes for the sendfile run */
+static vfs_node_t *tcpbench_file(void) {
+    vfs_node_t *root = vfs_get_root();
+    vfs_node_t *file = vfs_find_node(root, TCPBENCH_FILE);
+    if (!file) {
+        file = vfs_create_node(TCPBENCH_FILE, NODE_FILE);
+        if (!file) return NULL;
+        if (vfs_add_child(root, file) != 0) return NULL;
+    }
+    if (vfs_write(file, 0, VFS_MAX_FILE_SIZE, tcpbench_tx) != VFS_MAX_FILE_SIZE) {
+        return NULL;
+    }
+    return file;
+}
+
+static void tcpbench_rr(in_addr_t self, uint32_t khz, int nodelay) {
+    static uint8_t rsp[TCPBENCH_RR_SIZE];
+    uint32_t pid;
+    tcpbench_nodelay = nodelay;
+    socket_t *l = tcpbench_serve(TCPBENCH_RR_PORT, tcpbench_echo, &pid);
+    if (!l) {
+        console_write("  request/response: cannot start the server\n");
+        return;
+    }
+
+    socket_t *c = tcpbench_connect(self, TCPBENCH_RR_PORT);
+    uint32_t done = 0;
+    uint64_t start = rdtsc();
+    if (c) {
+        net_socket_setopt(c, TCP_NODELAY, nodelay);
+        uint64_t end = timer_get_ticks() + TCPBENCH_RR_TICKS;
+        while (timer_get_ticks() < end) {
+            if (net_socket_send(c, tcpbench_tx, TCPBENCH_RR_FIRST) < 0 ||
+                net_socket_send(c, tcpbench_tx + TCPBENCH_RR_FIRST,
+                                TCPBENCH_RR_SIZE - TCPBENCH_RR_FIRST) < 0 ||
+                tcpbench_read_full(c, rsp, sizeof(rsp)) < 0) {
+                break;
+            }
+            done++;
+        }
+    }
+    uint64_t cycles = rdtsc() - start;
+    if (c) net_socket_close(c);
+    else   net_socket_close(l);
+    wait_for_child(pid);
+    if (c) net_socket_close(l);
+
+    console_write(nodelay ? "  request/response, TCP_NODELAY: "
+                          : "  request/response, Nagle:       ");
+    write_dec_pad(rate_per_sec(done, cycles, khz), 8);
+    console_write(" trans/s ");
+    uint64_t us = udiv64(cycles * 1000, khz, 0);
+    write_dec_pad((uint32_t)udiv64(us, done ? done : 1, 0), 8);
+    console_write(" us each\n");
+}
+
+void cmd_tcpbench(int argc, char **argv) {
+    (void)argc; (void)argv;
+
+    uint32_t khz = timer_get_tsc_khz();
+    if (khz == 0) {
+        console_write("tcpbench: TSC calibration failed\n");
+        return;
+    }
+    if (!scheduler_active()) {
+        console_write("tcpbench: scheduler not running\n");
+        return;
+    }
+    for (uint32_t i = 0; i < sizeof(tcpbench_tx); i++) tcpbench_tx[i] = (uint8_t)i;
+
+    in_addr_t self = ip_to_in(&net_get_device()->ip);
+    tcp_stats_t before, after;
+    tcp_get_stats(&before);
+
+    console_write("\nTCP to ");
+    write_ip(self);
+    console_write(" (requests of ");
+    write_dec(TCPBENCH_RR_SIZE);
+    console_write(" bytes written as ");
+    write_dec(TCPBENCH_RR_FIRST);
+    console_write(" + ");
+    write_dec(TCPBENCH_RR_SIZE - TCPBENCH_RR_FIRST);
+    console_write(")\n");
+    tcpbench_bulk(self, khz, TCPBENCH_COPY, NULL);
+    tcpbench_bulk(self, khz, TCPBENCH_ZEROCOPY, NULL);
+    vfs_node_t *file = tcpbench_file();
+    if (file) {
+        tcpbench_bulk(self, khz, TCPBENCH_SENDFILE, file);
+
+        /* Packets still holding the file move to a copy, then it goes */
+        vfs_write(file, 0, 1, tcpbench_tx);
+        vfs_remove_child(vfs_get_root(), TCPBENCH_FILE);
+    }
+    tcpbench_rr(self, khz, 0);
+    tcpbench_rr(self, khz, 1);
+
+    tcp_get_stats(&after);
+    console_write("\nTCP: ");
+    write_dec(after.out_segs - before.out_segs);
+    console_write(" segments sent, ");
+    write_dec(after.retrans_segs - before.retrans_segs);
+    console_write(" retransmitted, ");
+    write_dec(after.delayed_acks - before.delayed_acks);
+    console_write(" delayed ACKs, ");
+    write_dec(after.ooo_segs - before.ooo_segs);
+    console_write(" out of order\n\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* csumbench                                                            */
+/* ------------------------------------------------------------------ */
+
+#define CSUMBENCH_MAX       65536
+#define CSUMBENCH_BYTES     (4u << 20)  /* Summed per size and method */
+
+static uint8_t csumbench_src[CSUMBENCH_MAX + 8];
+static uint8_t csumbench_dst[CSUMBENCH_MAX + 8];
+
+/* The straightforward loop: one 16-bit word at a time */
+static uint32_t csum16_ref(const uint8_t *p, uint32_t len) {
+    uint32_t acc = 0;
+    while (len > 1) {
+        acc += (uint32_t)(p[0] | (p[1] << 8));
+        p += 2;
+        len -= 2;
+    }
+    if (len) acc += *p;
+    while (acc >> 16) acc = (acc & 0xFFFF) + (acc >> 16);
+    return acc;
+}
+
+/* Compare every method with the reference at all alignments */
+static int csumbench_verify(void) {
+    for (uint32_t len = 0; len < 300; len++) {
+        for (uint32_t off = 0; off < 4; off++) {
+            const uint8_t *p = csumbench_src + off;
+            uint16_t want = (uint16_t)~csum16_ref(p, len);
+            if (net_csum_fold(net_csum_partial(p, len, 0)) != want) return -1;
+            uint8_t *d = csumbench_dst + ((off + 1) & 3);
+            if (net_csum_fold(net_csum_copy(d, p, len, 0)) != want) return -1;
+            for (uint32_t i = 0; i < len; i++) {
+                if (d[i] != p[i]) return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static volatile uint32_t csumbench_sink;
+
+static uint64_t csumbench_run(int method, uint32_t size) {
+    uint32_t rounds = CSUMBENCH_BYTES / size;
+    uint32_t sum = 0;
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < rounds; i++) {
+        switch (method) {
+        case 0: sum += csum16_ref(csumbench_src, size); break;
+        case 1: sum += net_csum_partial(csumbench_src, size, 0); break;
+        case 2:
+            memcpy(csumbench_dst, csumbench_src, size);
+            sum += net_csum_partial(csumbench_dst, size, 0);
+            break;
+        default: sum += net_csum_copy(csumbench_dst, csumbench_src, size, 0); break;
+        }
+    }
+    uint64_t cycles = rdtsc() - start;
+    csumbench_sink = sum;
+    return cycles;
+}
+
+void cmd_csumbench(int argc, char **argv) {
+    (void)argc; (void)argv;
+
+    uint32_t khz = timer_get_tsc_khz();
+    if (khz == 0) {
+        console_write("csumbench: TSC calibration failed\n");
+        return;
+    }
+    for (uint32_t i = 0; i < sizeof(csumbench_src); i++) {
+        csumbench_src[i] = (uint8_t)(i * 131 + (i >> 8));
+    }
+    if (csumbench_verify() < 0) {
+        console_write("csumbench: checksum mismatch against the 16-bit loop\n");
+        return;
+    }
+
+    console_write("\nInternet checksum, MB/s (");
+    write_dec(CSUMBENCH_BYTES >> 20);
+    console_write(" MiB per cell)\n\n");
+    console_write("     size    16-bit   partial   memcpy+sum   fused copy\n");
+    console_write("    -----   -------   -------   ----------   ----------\n");
+    for (uint32_t size = 64; size <= CSUMBENCH_MAX; size <<= 2) {
+        uint32_t bytes = (CSUMBENCH_BYTES / size) * size;
+        console_write("   ");
+        write_dec_pad(size, 6);
+        for (int m = 0; m < 4; m++) {
+            uint64_t cycles = csumbench_run(m, size);
+            write_tenths(rate_mb_x10(bytes, cycles, khz), m < 2 ? 10 : 13);
+        }
+        console_put_char('\n');
+    }
+    console_put_char('\n');
+}
+
+/* ------------------------------------------------------------------ */
+/* bpfbench                                                             */
+/* ------------------------------------------------------------------ */
+
+#define BPFBENCH_RUNS       20000
+#define BPFBENCH_PORT       9100
+#define BPFBENCH_DGRAMS     64
+
+/* What tcpdump -dd compiles for "udp dst port 53" on Ethernet */
+static const bpf_insn_t bpf_udp53[] = {
+    BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 0, 8),
+    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 23),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, PROTO_UDP, 0, 6),
+    BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 20),
+    BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, IP_OFFSET_MASK, 4, 0),
+    BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 14),
+    BPF_STMT(BPF_LD | BPF_H | BPF_IND, 16),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 53, 0, 1),
+    BPF_STMT(BPF_RET | BPF_K, 0xFFFF),
+    BPF_STMT(BPF_RET | BPF_K, 0),
+};
+
+/* "tcp and host 10.0.2.2 and port 80" */
+static const bpf_insn_t bpf_tcp_host_port[] = {
+    BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 0, 14),
+    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 23),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, PROTO_TCP, 0, 12),
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 26),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0x0A000202, 2, 0),
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 30),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0x0A000202, 0, 8),
+    BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 20),
+    BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, IP_OFFSET_MASK, 6, 0),
+    BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 14),
+    BPF_STMT(BPF_LD | BPF_H | BPF_IND, 14),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 80, 2, 0),
+    BPF_STMT(BPF_LD | BPF_H | BPF_IND, 16),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 80, 0, 1),
+    BPF_STMT(BPF_RET | BPF_K, 0xFFFF),
+    BPF_STMT(BPF_RET | BPF_K, 0),
+};
+
+static const bpf_insn_t bpf_accept[] = {
+    BPF_STMT(BPF_RET | BPF_K, 0xFFFFFFFF),
+};
+
+/* On lo, from the IP header: drop UDP to BPFBENCH_PORT */
+static const bpf_insn_t bpf_lo_drop_port[] = {
+    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 9),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, PROTO_UDP, 0, 5),
+    BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 6),
+    BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, IP_OFFSET_MASK, 3, 0),
+    BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),
+    BPF_STMT(BPF_LD | BPF_H | BPF_IND, 2),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, BPFBENCH_PORT, 1, 0),
+    BPF_STMT(BPF_RET | BPF_K, 0xFFFFFFFF),
+    BPF_STMT(BPF_RET | BPF_K, 0),
+};
+
+/* On a socket, from the payload: keep the first 4 bytes of datagrams
+ * starting with 'A', drop the rest */
+static const bpf_insn_t bpf_sock_a[] = {
+    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 0),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 'A', 0, 1),
+    BPF_STMT(BPF_RET | BPF_K, 4),
+    BPF_STMT(BPF_RET | BPF_K, 0),
+};
+
+/* A 64-byte Ethernet + IPv4 frame to dst:dport from src:sport */
+static sk_buff_t *bpfbench_frame(uint8_t proto, in_addr_t src, in_addr_t dst,
+                                 uint16_t sport, uint16_t dport) {
+    uint8_t f[64];
+    memset(f, 0, sizeof(f));
+    eth_header_t *eth = (eth_header_t *)f;
+    eth->type = htons(ETH_P_IP);
+    ip_header_t *iph = (ip_header_t *)(f + ETH_HLEN);
+    iph->version_ihl = 0x45;
+    iph->total_length = htons(sizeof(f) - ETH_HLEN);
+    iph->ttl = IP_DEFAULT_TTL;
+    iph->protocol = proto;
+    iph->src_ip = src;
+    iph->dst_ip = dst;
+    uint16_t *ports = (uint16_t *)(f + ETH_HLEN + IP_HLEN);
+    ports[0] = htons(sport);
+    ports[1] = htons(dport);
+
+    sk_buff_t *skb = skb_alloc();
+    if (skb && skb_append_data(skb, f, sizeof(f)) < 0) {
+        skb_free(skb);
+        skb = NULL;
+    }
+    return skb;
+}
+
+static volatile uint32_t bpfbench_sink;
+
+/* Cycles per run of `prog` on `skb`, interpreted or as compiled */
+static uint32_t bpfbench_run(const bpf_prog_t *prog, const sk_buff_t *skb,
+                             int jit, uint32_t *verdict) {
+    uint32_t v = 0;
+    uint32_t irq = irq_save();
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < BPFBENCH_RUNS; i++) {
+        v += jit ? bpf_prog_run(prog, skb) : bpf_prog_run_interp(prog, skb);
+    }
+    uint64_t cycles = rdtsc() - start;
+    irq_restore(irq);
+    bpfbench_sink = v;
+    *verdict = jit ? bpf_prog_run(prog, skb) : bpf_prog_run_interp(prog, skb);
+    return (uint32_t)udiv64(cycles, BPFBENCH_RUNS, 0);
+}
+
+/* Send `n` datagrams of 16 bytes starting with `first` to ourselves */
+static void bpfbench_send(socket_t *tx, uint32_t n, char first) {
+    static const sockaddr_in_t to = { IP4(127, 0, 0, 1), BPFBENCH_PORT, 0 };
+    char msg[16];
+    memset(msg, first, sizeof(msg));
+    for (uint32_t i = 0; i < n; i++) net_socket_sendto(tx, msg, sizeof(msg), &to);
+}
+
+/* Datagrams waiting on `rx` once lo has delivered; `total` gets their
+ * combined size */
+static uint32_t bpfbench_drain(socket_t *rx, uint32_t *total) {
+    char buf[64];
+    uint32_t got = 0;
+    int n;
+    process_sleep(50);
+    *total = 0;
+    while ((n = net_socket_recvfrom(rx, buf, sizeof(buf), NULL, MSG_DONTWAIT)) >= 0) {
+        got++;
+        *total += (uint32_t)n;
+    }
+    return got;
+}
+
+static void bpfbench_hooks(void) {
+    socket_t *rx = net_socket_create(PROTO_UDP);
+    socket_t *tx = net_socket_create(PROTO_UDP);
+    if (!rx || !tx || net_socket_bind(rx, BPFBENCH_PORT) < 0) {
+        console_write("bpfbench: cannot set up sockets\n");
+        if (rx) net_socket_close(rx);
+        if (tx) net_socket_close(tx);
+        return;
+    }
+
+    net_device_t *lo = net_get_loopback();
+    bpf_fprog_t drop = { sizeof(bpf_lo_drop_port) / sizeof(bpf_insn_t), bpf_lo_drop_port };
+    uint32_t filtered = lo->stats.rx_filtered, bytes;
+    net_dev_attach_filter(lo, &drop);
+    bpfbench_send(tx, BPFBENCH_DGRAMS, 'A');
+    uint32_t got = bpfbench_drain(rx, &bytes);
+    net_dev_attach_filter(lo, NULL);
+    console_write("lo RX filter dropping UDP to port ");
+    write_dec(BPFBENCH_PORT);
+    console_write(": ");
+    write_dec(lo->stats.rx_filtered - filtered);
+    console_write(" of ");
+    write_dec(BPFBENCH_DGRAMS);
+    console_write(" dropped, ");
+    write_dec(got);
+    console_write(" reached the socket\n");
+
+    bpf_fprog_t only_a = { sizeof(bpf_sock_a) / sizeof(bpf_insn_t), bpf_sock_a };
+    net_socket_setopt(rx, SO_ATTACH_FILTER, (int)(uintptr_t)&only_a);
+    bpfbench_send(tx, BPFBENCH_DGRAMS / 2, 'A');
+    bpfbench_send(tx, BPFBENCH_DGRAMS / 2, 'B');
+    got = bpfbench_drain(rx, &bytes);
+    console_write("Socket filter keeping 4 bytes of 'A' datagrams: ");
+    write_dec(got);
+    console_write(" of ");
+    write_dec(BPFBENCH_DGRAMS);
+    console_write(" received, ");
+    write_dec(bytes);
+    console_write(" bytes, ");
+    write_dec(rx->rx_filtered);
+    console_write(" refused\n\n");
+
+    net_socket_close(tx);
+    net_socket_close(rx);
+}
+
+void cmd_bpfbench(int argc, char **argv) {
+    (void)argc; (void)argv;
+    static const struct {
+        const char *name;
+        const bpf_insn_t *insns;
+        uint32_t len;
+    } filters[] = {
+        { "accept all         ", bpf_accept, sizeof(bpf_accept) / sizeof(bpf_insn_t) },
+        { "udp dst port 53    ", bpf_udp53, sizeof(bpf_udp53) / sizeof(bpf_insn_t) },
+        { "tcp host+port 80   ", bpf_tcp_host_port,
+          sizeof(bpf_tcp_host_port) / sizeof(bpf_insn_t) },
+    };
+
+    sk_buff_t *pkts[3] = {
+        bpfbench_frame(PROTO_UDP, IP4(10, 0, 2, 15), IP4(10, 0, 2, 3), 40000, 53),
+        bpfbench_frame(PROTO_TCP, IP4(10, 0, 2, 2), IP4(10, 0, 2, 15), 80, 40000),
+        bpfbench_frame(PROTO_TCP, IP4(10, 0, 2, 9), IP4(10, 0, 2, 15), 22, 40000),
+    };
+    static const char *pkt_names[3] = { "UDP :53", "TCP 10.0.2.2:80", "TCP :22" };
+
+    console_write("\nFilter cost, cycles/packet (");
+    write_dec(BPFBENCH_RUNS);
+    console_write(" runs each)\n\n");
+    console_write("  filter              insns  JIT bytes  packet            interp   JIT  verdict\n");
+    console_write("  ------              -----  ---------  ------            ------   ---  -------\n");
+
+    for (uint32_t f = 0; f < sizeof(filters) / sizeof(filters[0]); f++) {
+        int saved = bpf_jit_enable;
+        bpf_jit_enable = 1;
+        bpf_prog_t *prog = bpf_prog_create(filters[f].insns, filters[f].len);
+        bpf_jit_enable = saved;
+        if (!prog) {
+            console_write("bpfbench: filter rejected\n");
+            continue;
+        }
+        for (int p = 0; p < 3; p++) {
+            if (!pkts[p]) continue;
+            uint32_t vi, vj;
+            uint32_t ci = bpfbench_run(prog, pkts[p], 0, &vi);
+            uint32_t cj = prog->jited ? bpfbench_run(prog, pkts[p], 1, &vj) : 0;
+            console_write("  ");
+            console_write(p == 0 ? filters[f].name : "                   ");
+            if (p == 0) {
+                write_dec_pad(prog->len, 5);
+                write_dec_pad(prog->jited_len, 11);
+            } else {
+                console_write("                ");
+            }
+            console_write("  ");
+            console_write(pkt_names[p]);
+            for (int pad = (int)strlen(pkt_names[p]); pad < 16; pad++) console_put_char(' ');
+            write_dec_pad(ci, 8);
+            write_dec_pad(cj, 6);
+            console_write(vi ? "  accept" : "  drop");
+            if (prog->jited && vi != vj) console_write("  (JIT DIFFERS)");
+            console_write("\n");
+        }
+        bpf_prog_destroy(prog);
+    }
+    for (int p = 0; p < 3; p++) {
+        if (pkts[p]) skb_free(pkts[p]);
+    }
+    console_write("\n");
+
+    bpfbench_hooks();
+}
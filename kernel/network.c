@@ -3,22 +3,72 @@
  */
 
 #include "network.h"
-#include "console.h"
+#include "epoll.h"
+#include "printk.h"
 #include "string.h"
+#include "file.h"
+#include "arp.h"
+#include "ip.h"
+#include "icmp.h"
+#include "udp.h"
+#include "tcp.h"
+#include "rss.h"
+#include "bpf.h"
+#include "../memory/slab.h"
+#include "../fs/vfs.h"
+#include "../drivers/e1000.h"
+#include "../drivers/loopback.h"
+#include "../drivers/timer.h"
+#include "../process/scheduler.h"
+#include "../arch/x86/cpu.h"
 
-/* Global network device */
+/* Global network device, and lo for traffic to ourselves */
 static net_device_t net_dev;
+static net_device_t lo_dev;
 static int net_initialized = 0;
 
-/* Socket storage */
-#define MAX_SOCKETS 32
-static socket_t sockets[MAX_SOCKETS];
+/* Frames received but not yet taken by net_receive_skb(). Filled by
+ * the RX thread, so both ends run with interrupts disabled. */
+static sk_buff_head_t rx_backlog;
+
+/* NAPI contexts and the thread that polls them */
+static napi_t* napi_list;
+static wait_queue_t napi_wait;
+
+/* Protocol timers, and the tick the RX thread sleeps until (0 while
+ * it is running) so arming an earlier timer knows to wake it */
+static timer_wheel_t net_timers;
+static uint64_t rx_sleep_until;
+
+/* Sockets come from a slab cache; ids only label them */
+static slab_t* socket_slab;
+static uint32_t next_socket_id;
+
+/*
+ * Memory a send lent to the stack (see skbuff.h): a MSG_ZEROCOPY
+ * buffer, on its socket's list until counted, or file content for
+ * sendfile, pinned and on file_lends until released or moved to a
+ * private copy.
+ */
+typedef struct net_lend {
+    skb_ext_t ext;
+    socket_t* socket;           /* Zero-copy: NULL once orphaned      */
+    vfs_node_t* node;           /* sendfile: NULL once unpinned       */
+    uint8_t done;               /* Zero-copy: buffer no longer used   */
+    uint8_t queued;             /* On the socket's list               */
+    struct net_lend* next;
+} net_lend_t;
+
+static slab_t* lend_slab;
+static net_lend_t* file_lends;
+
+static void net_file_break(vfs_node_t* node);
 
 /* Initialize networking subsystem */
 void net_init(void) {
     if (net_initialized) return;
     
-    console_write("NET: Initializing networking stack...\n");
+    printk(LOG_INFO, "NET: Initializing networking stack...\n");
     
     /* Initialize network device */
     strncpy(net_dev.name, "eth0", sizeof(net_dev.name));
@@ -32,21 +82,270 @@ void net_init(void) {
     net_dev.mac.addr[4] = 0x44;
     net_dev.mac.addr[5] = 0x55;
     
-    /* Set default IP address (192.168.1.100) */
-    net_dev.ip.addr[0] = 192;
-    net_dev.ip.addr[1] = 168;
-    net_dev.ip.addr[2] = 1;
-    net_dev.ip.addr[3] = 100;
+    /* QEMU user-mode networking defaults: 10.0.2.15/24, gateway
+     * 10.0.2.2 (see ip_init()) */
+    net_dev.ip.addr[0] = 10;
+    net_dev.ip.addr[1] = 0;
+    net_dev.ip.addr[2] = 2;
+    net_dev.ip.addr[3] = 15;
+    for (int i = 0; i < 3; i++) net_dev.netmask.addr[i] = 255;
+    net_dev.netmask.addr[3] = 0;
+    net_dev.mtu = ETH_MTU;
+    net_dev_set_rx_queues(&net_dev, 1);
     
-    /* Initialize sockets */
-    for (int i = 0; i < MAX_SOCKETS; i++) {
-        sockets[i].is_open = 0;
+    socket_slab = slab_create(sizeof(socket_t));
+    lend_slab = slab_create(sizeof(net_lend_t));
+    vfs_add_pin_break_handler(net_file_break);
+
+    wait_queue_init(&napi_wait);
+    skb_init();
+    skb_queue_init(&rx_backlog);
+    timer_wheel_init(&net_timers, timer_get_ticks());
+    rss_init();
+
+    /* Probe for hardware; without it eth0 stays up but cannot send. */
+    if (e1000_init(&net_dev) == 0) {
+        printk(LOG_INFO, "NET: eth0 is an Intel e1000\n");
+    } else {
+        printk(LOG_WARNING, "NET: no supported NIC found, eth0 has no driver\n");
     }
-    
+
     net_dev.is_up = 1;
+    loopback_init(&lo_dev);
+    arp_init();
+    ip_init(&net_dev, IP4(10, 0, 2, 2));
+
+    /* 127/8, and our own address, never reach the NIC */
+    ip_init(&lo_dev, INADDR_ANY);
+    ip_route_add(ip_to_in(&net_dev.ip), 32, INADDR_ANY, &lo_dev);
+    icmp_init();
+    udp_init();
+    tcp_init();
     net_initialized = 1;
     
-    console_write("NET: eth0 up at 192.168.1.100\n");
+    printk(LOG_INFO, "NET: eth0 up at 10.0.2.15/24, gateway 10.0.2.2\n");
+    printk(LOG_INFO, "NET: lo up at 127.0.0.1/8\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* NAPI                                                                 */
+/* ------------------------------------------------------------------ */
+
+void napi_add(napi_t* napi) {
+    uint32_t irq = irq_save();
+    napi->scheduled = 0;
+    napi->next = napi_list;
+    napi_list = napi;
+    irq_restore(irq);
+}
+
+/* Called from interrupt handlers with the device's interrupts masked. */
+void napi_schedule(napi_t* napi) {
+    if (napi->scheduled) return;
+    napi->scheduled = 1;
+    if (!wait_queue_empty(&napi_wait)) {
+        wait_queue_wake_all(&napi_wait);
+    }
+}
+
+void napi_complete(napi_t* napi) {
+    napi->scheduled = 0;
+}
+
+static int napi_pending(void) {
+    for (napi_t* n = napi_list; n; n = n->next) {
+        if (n->scheduled) return 1;
+    }
+    return 0;
+}
+
+/*
+ * RX thread: sleeps until an interrupt schedules a context, then polls
+ * every scheduled one. A context that used its whole budget stays
+ * scheduled (its interrupts still masked) and is polled again after
+ * the other threads have had a turn. Protocol input runs here, called
+ * from the drivers' poll functions through net_rx(), and so do the
+ * protocol timers, every NET_TIMER_TICKS.
+ */
+static void net_rx_task(void* arg) {
+    (void)arg;
+    uint64_t next_timer = timer_get_ticks() + NET_TIMER_TICKS;
+
+    for (;;) {
+        uint32_t irq = irq_save();
+        while (!napi_pending()) {
+            uint64_t now = timer_get_ticks();
+            if (now >= next_timer || (net_timers.pending && now > net_timers.now)) {
+                break;
+            }
+            rx_sleep_until = net_timers.pending ? now + 1 : next_timer;
+            wait_queue_sleep_timeout(&napi_wait, (uint32_t)(rx_sleep_until - now));
+        }
+        rx_sleep_until = 0;
+        irq_restore(irq);
+
+        uint64_t now = timer_get_ticks();
+        timer_wheel_advance(&net_timers, now);
+        if (now >= next_timer) {
+            arp_timer();
+            ip_timer();
+            next_timer = now + NET_TIMER_TICKS;
+        }
+
+        for (napi_t* n = napi_list; n; n = n->next) {
+            if (!n->scheduled) continue;
+            if (n->dev) {
+                n->dev->stats.rx_polls++;
+                n->dev->rxq[n->queue].polls++;
+            }
+            n->poll(n, NAPI_BUDGET);
+        }
+        if (napi_pending()) scheduler_yield();
+    }
+}
+
+void net_timer_mod(wheel_timer_t* timer, uint32_t ticks) {
+    uint32_t irq = irq_save();
+    uint64_t expires = timer_get_ticks() + ticks;
+    timer_wheel_add(&net_timers, timer, expires);
+    if (rx_sleep_until && expires < rx_sleep_until &&
+        !wait_queue_empty(&napi_wait)) {
+        wait_queue_wake_all(&napi_wait);
+    }
+    irq_restore(irq);
+}
+
+void net_timer_del(wheel_timer_t* timer) {
+    timer_wheel_del(&net_timers, timer);
+}
+
+void net_start(void) {
+    if (napi_list) {
+        process_create("netrx", net_rx_task, 0, PRIORITY_HIGH);
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* Data path                                                            */
+/* ------------------------------------------------------------------ */
+
+/* Filters run with interrupts disabled, so once one has been swapped
+ * out nothing can still be running it. */
+static int filter_replace(bpf_prog_t** slot, const bpf_fprog_t* fprog) {
+    bpf_prog_t* prog = NULL;
+    if (fprog) {
+        prog = bpf_prog_create(fprog->insns, fprog->len);
+        if (!prog) return -1;
+    }
+    uint32_t irq = irq_save();
+    bpf_prog_t* old = *slot;
+    *slot = prog;
+    irq_restore(irq);
+    bpf_prog_destroy(old);
+    return 0;
+}
+
+int net_dev_attach_filter(net_device_t* dev, const bpf_fprog_t* fprog) {
+    if (!dev) return -1;
+    return filter_replace(&dev->rx_filter, fprog);
+}
+
+/* 0 if the device's filter dropped `skb` */
+static int net_rx_filter(net_device_t* dev, sk_buff_t* skb) {
+    uint32_t irq = irq_save();
+    const bpf_prog_t* prog = dev->rx_filter;
+    uint32_t keep = prog ? bpf_prog_run(prog, skb) : 1;
+    if (keep == 0) dev->stats.rx_filtered++;
+    irq_restore(irq);
+    if (keep == 0) skb_free(skb);
+    return keep != 0;
+}
+
+void net_rx(net_device_t* dev, sk_buff_t* skb) {
+    dev->stats.rx_packets++;
+    dev->stats.rx_bytes += skb->len;
+    dev->rxq[skb->queue].packets++;
+    dev->rxq[skb->queue].bytes += skb->len;
+    skb->dev = dev;
+    if (dev->rx_filter && !net_rx_filter(dev, skb)) return;
+
+    if (dev->flags & NETDEV_LOOPBACK) {
+        if (skb->protocol == ETH_P_IP) {
+            ip_input(dev, skb);
+            return;
+        }
+    } else if (skb->len < ETH_HLEN) {
+        dev->stats.rx_errors++;
+        skb_free(skb);
+        return;
+    } else {
+        const eth_header_t* eth = (const eth_header_t*)skb->data;
+        skb->protocol = ntohs(eth->type);
+        if (skb->protocol == ETH_P_ARP) {
+            skb_pull(skb, ETH_HLEN);
+            arp_input(dev, skb);
+            return;
+        }
+        if (skb->protocol == ETH_P_IP) {
+            skb_pull(skb, ETH_HLEN);
+            if (rps_steer(dev, skb)) return;
+            ip_input(dev, skb);
+            return;
+        }
+    }
+
+    uint32_t irq = irq_save();
+    if (rx_backlog.qlen >= NET_RX_BACKLOG) {
+        dev->stats.rx_dropped++;
+        skb_free(skb);
+    } else {
+        skb_queue_tail(&rx_backlog, skb);
+    }
+    irq_restore(irq);
+}
+
+int net_xmit(net_device_t* dev, sk_buff_t* skb, uint32_t flags) {
+    /* The MTU plus whatever link header and trailer the device adds */
+    if (!dev) return -1;
+    if (!dev->is_up || !skb || skb->len == 0 ||
+        skb->len > dev->mtu + (MAX_PACKET_SIZE - ETH_MTU)) {
+        dev->stats.tx_errors++;
+        return -1;
+    }
+
+    uint32_t len = skb->len;        /* the driver may free skb at once */
+    if (!dev->xmit || dev->xmit(dev, skb, flags) < 0) {
+        dev->stats.tx_dropped++;
+        return -1;
+    }
+    dev->stats.tx_packets++;
+    dev->stats.tx_bytes += len;
+    return 0;
+}
+
+int net_eth_output(net_device_t* dev, sk_buff_t* skb, const mac_addr_t* dest,
+                   uint16_t ethertype) {
+    eth_header_t* eth = (eth_header_t*)skb_push(skb, ETH_HLEN);
+    if (!eth) {
+        skb_free(skb);
+        return -1;
+    }
+    eth->dest = *dest;
+    eth->src  = dev->mac;
+    eth->type = htons(ethertype);
+
+    if (net_xmit(dev, skb, 0) < 0) {
+        skb_free(skb);
+        return -1;
+    }
+    return 0;
+}
+
+sk_buff_t* net_receive_skb(void) {
+    uint32_t irq = irq_save();
+    sk_buff_t* skb = skb_dequeue(&rx_backlog);
+    irq_restore(irq);
+    return skb;
 }
 
 /* Set IP address */
@@ -68,95 +367,652 @@ net_device_t* net_get_device(void) {
     return &net_dev;
 }
 
-/* Send packet (stub) */
+net_device_t* net_get_loopback(void) {
+    return &lo_dev;
+}
+
+/* Send packet: copy a flat frame into an sk_buff */
 int net_send_packet(packet_t* packet) {
-    if (!packet || !net_dev.is_up) return -1;
-    
-    /* TODO: Implement actual packet transmission */
+    if (!packet || !net_dev.is_up || packet->length > MAX_PACKET_SIZE) return -1;
+
+    sk_buff_t* skb = skb_alloc();
+    if (!skb) return -1;
+    if (skb_append_data(skb, packet->data, packet->length) < 0 ||
+        net_xmit(&net_dev, skb, 0) < 0) {
+        skb_free(skb);
+        return -1;
+    }
     return packet->length;
 }
 
-/* Receive packet (stub) */
+/* Receive packet: oldest backlogged frame as a flat copy, without
+ * blocking */
 int net_receive_packet(packet_t* packet) {
     if (!packet || !net_dev.is_up) return -1;
-    
-    /* TODO: Implement actual packet reception */
-    return 0;
+
+    sk_buff_t* skb = net_receive_skb();
+    if (!skb) return 0;
+
+    packet->length = skb->len;
+    skb_copy_bits(skb, 0, packet->data, skb->len);
+    skb_free(skb);
+    return packet->length;
+}
+
+/* ------------------------------------------------------------------ */
+/* Sockets                                                              */
+/* ------------------------------------------------------------------ */
+
+static int socket_can_block(void) {
+    return scheduler_active() && process_getpid() != 0;
+}
+
+/* A lent buffer with the caller's reference, or NULL */
+static net_lend_t* lend_alloc(const void* data, uint32_t len,
+                              void (*release)(skb_ext_t*)) {
+    net_lend_t* l = (net_lend_t*)slab_alloc(lend_slab);
+    if (!l) return NULL;
+    memset(l, 0, sizeof(*l));
+    l->ext.data = (uint8_t*)data;
+    l->ext.len = len;
+    l->ext.refs = 1;
+    l->ext.release = release;
+    return l;
+}
+
+/* Count completed zero-copy sends off the front of the list, so
+ * zc_done never passes one still in use. Interrupts disabled. */
+static void zc_advance(socket_t* socket) {
+    net_lend_t* l;
+    int moved = 0;
+    while ((l = socket->zc_head) != NULL && l->done) {
+        socket->zc_head = l->next;
+        if (!socket->zc_head) socket->zc_tail = NULL;
+        l->queued = 0;
+        socket->zc_done++;
+        moved = 1;
+        if (l->ext.refs == 0) slab_free(lend_slab, l);
+    }
+    if (moved && !wait_queue_empty(&socket->tx_wait)) {
+        wait_queue_wake_all(&socket->tx_wait);
+    }
+}
+
+/* skb_ext release: the last packet using a zero-copy buffer is gone */
+static void zc_release(skb_ext_t* ext) {
+    net_lend_t* l = (net_lend_t*)ext;
+    l->done = 1;
+    if (l->queued) zc_advance(l->socket);
+    else           slab_free(lend_slab, l);
+}
+
+/* Close: copy what is still lent, so the owner may reuse its buffers.
+ * Interrupts disabled. */
+static void zc_privatize(socket_t* socket) {
+    for (net_lend_t* l = socket->zc_head; l; l = l->next) {
+        if (!l->done && skb_ext_privatize(&l->ext) == 0) l->done = 1;
+    }
+    zc_advance(socket);
+}
+
+/* The socket is being freed: lends still in use free themselves. */
+static void zc_orphan(socket_t* socket) {
+    uint32_t irq = irq_save();
+    net_lend_t* l = socket->zc_head;
+    while (l) {
+        net_lend_t* next = l->next;
+        l->socket = NULL;
+        l->queued = 0;
+        if (l->ext.refs == 0) slab_free(lend_slab, l);
+        l = next;
+    }
+    socket->zc_head = socket->zc_tail = NULL;
+    irq_restore(irq);
+}
+
+/* Interrupts disabled */
+static void file_lend_unpin(net_lend_t* l) {
+    net_lend_t** link = &file_lends;
+    while (*link && *link != l) link = &(*link)->next;
+    if (*link) *link = l->next;
+    vfs_unpin(l->node);
+    l->node = NULL;
+}
+
+static void file_release(skb_ext_t* ext) {
+    net_lend_t* l = (net_lend_t*)ext;
+    if (l->node) file_lend_unpin(l);
+    slab_free(lend_slab, l);
+}
+
+/* vfs callback: a pinned file is about to be written. Packets still
+ * to be sent or resent move onto a copy of what was sent. */
+static void net_file_break(vfs_node_t* node) {
+    uint32_t irq = irq_save();
+    net_lend_t* l = file_lends;
+    while (l) {
+        net_lend_t* next = l->next;
+        if (l->node == node && skb_ext_privatize(&l->ext) == 0) {
+            file_lend_unpin(l);
+        }
+        l = next;
+    }
+    irq_restore(irq);
+}
+
+static void socket_hold(socket_t* socket) {
+    uint32_t irq = irq_save();
+    socket->refs++;
+    irq_restore(irq);
+}
+
+/* The last reference also lets go of a TCP connection, which may carry
+ * on closing by itself */
+static void socket_put(socket_t* socket) {
+    uint32_t irq = irq_save();
+    int last = (--socket->refs == 0);
+    irq_restore(irq);
+    if (!last) return;
+    zc_orphan(socket);
+    if (socket->tcp) tcp_release(socket);
+    bpf_prog_destroy(socket->filter);
+    slab_free(socket_slab, socket);
+}
+
+socket_t* net_socket_alloc(uint8_t protocol) {
+    socket_t* socket = (socket_t*)slab_alloc(socket_slab);
+    if (!socket) return NULL;
+
+    memset(socket, 0, sizeof(*socket));
+    uint32_t irq = irq_save();
+    socket->id = next_socket_id++;
+    irq_restore(irq);
+    socket->protocol = protocol;
+    socket->is_open = 1;
+    socket->refs = 1;
+    socket->rcvbuf = SOCK_RCVBUF_DEFAULT;
+    skb_queue_init(&socket->rx_queue);
+    wait_queue_init(&socket->rx_wait);
+    wait_queue_init(&socket->tx_wait);
+    return socket;
 }
 
 /* Create a socket */
 socket_t* net_socket_create(uint8_t protocol) {
-    for (int i = 0; i < MAX_SOCKETS; i++) {
-        if (!sockets[i].is_open) {
-            sockets[i].id = i;
-            sockets[i].protocol = protocol;
-            sockets[i].local_port = 0;
-            sockets[i].remote_port = 0;
-            sockets[i].is_open = 1;
-            return &sockets[i];
-        }
+    socket_t* socket = net_socket_alloc(protocol);
+    if (socket && protocol == PROTO_TCP && tcp_attach(socket) < 0) {
+        slab_free(socket_slab, socket);
+        return NULL;
     }
-    return NULL;
+    return socket;
 }
 
 /* Bind socket to port */
 int net_socket_bind(socket_t* socket, uint16_t port) {
+    return net_socket_bind_addr(socket, INADDR_ANY, port);
+}
+
+int net_socket_bind_addr(socket_t* socket, in_addr_t addr, uint16_t port) {
     if (!socket || !socket->is_open) return -1;
-    
+
+    if (socket->protocol == PROTO_UDP) {
+        return udp_bind(socket, addr, port);
+    }
+    if (socket->local_port) return -1;
+    socket->local_addr = addr;
     socket->local_port = port;
     return 0;
 }
 
-/* Connect socket to remote host */
+/* Connect socket to remote host: for UDP, set the default destination */
 int net_socket_connect(socket_t* socket, ip_addr_t* ip, uint16_t port) {
     if (!socket || !socket->is_open || !ip) return -1;
-    
-    memcpy(&socket->remote_ip, ip, sizeof(ip_addr_t));
+
+    if (socket->protocol == PROTO_TCP) {
+        socket_hold(socket);
+        int r = tcp_connect(socket, ip_to_in(ip), port);
+        socket_put(socket);
+        return r;
+    }
+    socket->remote_addr = ip_to_in(ip);
     socket->remote_port = port;
+    if (socket->protocol == PROTO_UDP && !socket->local_port) {
+        return udp_bind(socket, INADDR_ANY, 0);
+    }
     return 0;
 }
 
+/* Send `size` bytes from `data`, or of `ext` by reference, to `to` or
+ * the connected peer */
+static int socket_send(socket_t* socket, const void* data, skb_ext_t* ext,
+                       size_t size, const sockaddr_in_t* to, uint32_t flags) {
+    if (socket->protocol == PROTO_TCP) {
+        socket_hold(socket);
+        int n = ext ? tcp_send_ext(socket, ext, (uint32_t)size, flags)
+                    : tcp_sendmsg(socket, data, size, flags);
+        socket_put(socket);
+        return n;
+    }
+    if (socket->protocol != PROTO_UDP) return -1;
+
+    in_addr_t addr = to ? to->addr : socket->remote_addr;
+    uint16_t port = to ? to->port : socket->remote_port;
+    if (!port) return -1;
+    return ext ? udp_sendto_ext(socket, ext, (uint32_t)size, addr, port)
+               : udp_sendto(socket, data, size, addr, port);
+}
+
+/* MSG_ZEROCOPY: lend `data` for the send, or copy it if it is short.
+ * Either way a send that succeeds takes the next id, and completes
+ * once the last reference to the lent buffer is dropped. */
+static int socket_send_zerocopy(socket_t* socket, const void* data,
+                                size_t size, const sockaddr_in_t* to,
+                                uint32_t flags) {
+    net_lend_t* l = lend_alloc(data, (uint32_t)size, zc_release);
+    if (!l) return -1;
+
+    /* Our reference keeps the send from completing before it is queued */
+    int n = socket_send(socket, data, (size >= NET_ZEROCOPY_MIN) ? &l->ext : NULL,
+                        size, to, flags);
+
+    uint32_t irq = irq_save();
+    if (n > 0) {
+        l->socket = socket;
+        l->queued = 1;
+        if (socket->zc_tail) socket->zc_tail->next = l;
+        else                 socket->zc_head = l;
+        socket->zc_tail = l;
+        socket->zc_next++;
+    }
+    skb_ext_put(&l->ext);
+    irq_restore(irq);
+    return n;
+}
+
+int net_socket_sendmsg(socket_t* socket, const void* data, size_t size,
+                       const sockaddr_in_t* to, uint32_t flags) {
+    if (!socket || !socket->is_open || !data) return -1;
+
+    if (flags & MSG_ZEROCOPY) {
+        return socket_send_zerocopy(socket, data, size, to, flags);
+    }
+    return socket_send(socket, data, NULL, size, to, flags);
+}
+
 /* Send data through socket */
 int net_socket_send(socket_t* socket, const void* data, size_t size) {
-    if (!socket || !socket->is_open || !data) return -1;
-    
-    /* TODO: Implement actual socket send */
-    return size;
+    return net_socket_sendmsg(socket, data, size, NULL, 0);
+}
+
+int net_socket_sendto(socket_t* socket, const void* data, size_t size,
+                      const sockaddr_in_t* to) {
+    if (!socket || !to || socket->protocol != PROTO_UDP) return -1;
+    return net_socket_sendmsg(socket, data, size, to, 0);
+}
+
+int net_socket_sendfile(socket_t* socket, vfs_node_t* node, uint32_t offset,
+                        uint32_t count) {
+    if (!socket || !socket->is_open || !node || node->type != NODE_FILE) {
+        return -1;
+    }
+    if (offset >= node->length) return 0;
+    if (count > node->length - offset) count = node->length - offset;
+
+    net_lend_t* l = lend_alloc(node->content + offset, count, file_release);
+    if (!l) return -1;
+
+    uint32_t irq = irq_save();
+    vfs_pin(node);
+    l->node = node;
+    l->next = file_lends;
+    file_lends = l;
+    irq_restore(irq);
+
+    int n = socket_send(socket, NULL, &l->ext, count, NULL, 0);
+    skb_ext_put(&l->ext);
+    return n;
+}
+
+int net_socket_queue_rcv(socket_t* socket, sk_buff_t* skb) {
+    uint32_t irq = irq_save();
+    if (socket->filter) {
+        uint32_t keep = bpf_prog_run(socket->filter, skb);
+        if (keep == 0) {
+            socket->rx_filtered++;
+            irq_restore(irq);
+            skb_free(skb);
+            return -1;
+        }
+        if (keep < skb->len) skb_trim(skb, keep);
+    }
+
+    uint32_t truesize = skb_truesize(skb);
+    if (!socket->is_open || socket->rx_queued + truesize > socket->rcvbuf) {
+        socket->rx_drops++;
+        irq_restore(irq);
+        skb_free(skb);
+        return -1;
+    }
+    skb_queue_tail(&socket->rx_queue, skb);
+    socket->rx_queued += truesize;
+    if (!wait_queue_empty(&socket->rx_wait)) {
+        wait_queue_wake_all(&socket->rx_wait);
+    }
+    irq_restore(irq);
+    return 0;
+}
+
+/* Interrupts must be disabled. */
+static sk_buff_t* socket_dequeue(socket_t* socket) {
+    sk_buff_t* skb = skb_dequeue(&socket->rx_queue);
+    if (skb) socket->rx_queued -= skb_truesize(skb);
+    return skb;
+}
+
+/* Next datagram, sleeping for one unless told not to. Interrupts must
+ * be disabled. */
+static sk_buff_t* socket_wait_dequeue(socket_t* socket, uint32_t flags) {
+    sk_buff_t* skb;
+    socket->refs++;             /* survive a close while we sleep */
+    while (!(skb = socket_dequeue(socket))) {
+        if (!socket->is_open || (flags & MSG_DONTWAIT) || !socket_can_block()) {
+            break;
+        }
+        wait_queue_sleep(&socket->rx_wait);
+    }
+    socket_put(socket);
+    return skb;
+}
+
+/* Copy a datagram out and free it; returns the bytes copied. */
+static int socket_copy_out(sk_buff_t* skb, void* buffer, size_t size,
+                           sockaddr_in_t* from) {
+    uint32_t n = (size < skb->len) ? (uint32_t)size : skb->len;
+    skb_copy_bits(skb, 0, buffer, n);
+    if (from) {
+        from->addr = skb->cb[0];
+        from->port = (uint16_t)skb->cb[1];
+        from->reserved = 0;
+    }
+    skb_free(skb);
+    return (int)n;
 }
 
 /* Receive data from socket */
 int net_socket_recv(socket_t* socket, void* buffer, size_t size) {
-    if (!socket || !socket->is_open || !buffer) return -1;
-    
-    /* TODO: Implement actual socket receive */
-    (void)size;  /* Parameter reserved for future implementation */
-    return 0;
+    return net_socket_recvfrom(socket, buffer, size, NULL, 0);
+}
+
+int net_socket_recvfrom(socket_t* socket, void* buffer, size_t size,
+                        sockaddr_in_t* from, uint32_t flags) {
+    if (!socket || !buffer) return -1;
+
+    if (socket->protocol == PROTO_TCP) {
+        socket_hold(socket);
+        int n = tcp_recvmsg(socket, buffer, size, flags);
+        socket_put(socket);
+        if (n >= 0 && from) {
+            from->addr = socket->remote_addr;
+            from->port = socket->remote_port;
+            from->reserved = 0;
+        }
+        return n;
+    }
+
+    uint32_t irq = irq_save();
+    sk_buff_t* skb = socket_wait_dequeue(socket, flags);
+    irq_restore(irq);
+
+    return skb ? socket_copy_out(skb, buffer, size, from) : -1;
+}
+
+int net_socket_sendmmsg(socket_t* socket, net_mmsg_t* msgs, int count,
+                        uint32_t flags) {
+    (void)flags;
+    if (!msgs || count <= 0) return -1;
+
+    int sent = 0;
+    while (sent < count) {
+        net_mmsg_t* m = &msgs[sent];
+        int n = net_socket_sendto(socket, m->buf, m->len, &m->addr);
+        if (n < 0) break;
+        m->result = (uint32_t)n;
+        sent++;
+    }
+    return sent ? sent : -1;
+}
+
+int net_socket_recvmmsg(socket_t* socket, net_mmsg_t* msgs, int count,
+                        uint32_t flags) {
+    if (!socket || !msgs || count <= 0) return -1;
+    if (count > NET_MMSG_MAX) count = NET_MMSG_MAX;
+
+    /* Take the whole batch off the queue in one go, then copy */
+    sk_buff_t* batch[NET_MMSG_MAX];
+    int n = 0;
+    uint32_t irq = irq_save();
+    batch[0] = socket_wait_dequeue(socket, flags);
+    if (batch[0]) {
+        n = 1;
+        while (n < count && (batch[n] = socket_dequeue(socket)) != NULL) n++;
+    }
+    irq_restore(irq);
+
+    for (int i = 0; i < n; i++) {
+        msgs[i].result = (uint32_t)socket_copy_out(batch[i], msgs[i].buf,
+                                                   msgs[i].len, &msgs[i].addr);
+    }
+    return n ? n : -1;
 }
 
-/* Close socket */
+/* Close socket: receivers still asleep in it are woken and fail */
 void net_socket_close(socket_t* socket) {
-    if (socket) {
-        socket->is_open = 0;
+    if (!socket) return;
+
+    uint32_t irq = irq_save();
+    if (!socket->is_open) {
+        irq_restore(irq);
+        return;
     }
+    socket->is_open = 0;
+    zc_privatize(socket);
+    if (socket->protocol == PROTO_UDP) udp_unbind(socket);
+    skb_queue_purge(&socket->rx_queue);
+    socket->rx_queued = 0;
+    if (!wait_queue_empty(&socket->rx_wait)) {
+        wait_queue_wake_all(&socket->rx_wait);
+    }
+    if (!wait_queue_empty(&socket->tx_wait)) {
+        wait_queue_wake_all(&socket->tx_wait);
+    }
+    irq_restore(irq);
+    socket_put(socket);
 }
 
-/* Calculate Internet checksum */
-uint16_t net_checksum(const void* data, size_t length) {
-    const uint16_t* ptr = (const uint16_t*)data;
-    uint32_t sum = 0;
-    
-    while (length > 1) {
-        sum += *ptr++;
-        length -= 2;
+int net_socket_listen(socket_t* socket, int backlog) {
+    if (!socket || !socket->is_open || socket->protocol != PROTO_TCP) return -1;
+    return tcp_listen(socket, backlog);
+}
+
+socket_t* net_socket_accept(socket_t* socket, sockaddr_in_t* peer,
+                            uint32_t flags) {
+    if (!socket || !socket->is_open || socket->protocol != PROTO_TCP) {
+        return NULL;
     }
-    
-    if (length > 0) {
-        sum += *(uint8_t*)ptr;
+    socket_hold(socket);
+    socket_t* child = tcp_accept(socket, peer, flags);
+    socket_put(socket);
+    return child;
+}
+
+int net_socket_setopt(socket_t* socket, int option, int value) {
+    if (!socket || !socket->is_open) return -1;
+
+    /* Filtering a byte stream's segments would only force retransmits,
+     * so filters are for datagram sockets */
+    switch (option) {
+        case SO_ATTACH_FILTER:
+            if (socket->protocol != PROTO_UDP || !value) return -1;
+            return filter_replace(&socket->filter,
+                                  (const bpf_fprog_t*)(uintptr_t)value);
+        case SO_DETACH_FILTER:
+            return filter_replace(&socket->filter, NULL);
     }
-    
-    while (sum >> 16) {
-        sum = (sum & 0xFFFF) + (sum >> 16);
+    if (socket->protocol != PROTO_TCP) return -1;
+    return tcp_setopt(socket, option, value);
+}
+
+int net_socket_getopt(socket_t* socket, int option) {
+    if (!socket || !socket->is_open) return -1;
+
+    switch (option) {
+        case SO_ZEROCOPY_DONE: {
+            uint32_t irq = irq_save();
+            socket->zc_reported = socket->zc_done;
+            irq_restore(irq);
+            return (int)socket->zc_reported;
+        }
+        default:
+            return -1;
     }
-    
-    return ~sum;
+}
+
+/* Socket descriptors */
+static int socket_file_read(file_t* f, void* buf, size_t n) {
+    return net_socket_recv((socket_t*)f->object, buf, n);
+}
+
+static int socket_file_write(file_t* f, const void* buf, size_t n) {
+    return net_socket_send((socket_t*)f->object, buf, n);
+}
+
+static void socket_file_release(file_t* f) {
+    net_socket_close((socket_t*)f->object);
+}
+
+/* UDP sends never block, so EPOLLOUT is always set on an open UDP
+ * socket and EPOLLIN follows the receive queue; TCP asks the
+ * connection. EPOLLPRI: zero-copy completions to collect. */
+static uint32_t socket_file_poll(file_t* f, poll_table_t* pt) {
+    socket_t* socket = (socket_t*)f->object;
+    poll_wait(pt, &socket->rx_wait, EPOLLIN | EPOLLHUP);
+    poll_wait(pt, &socket->tx_wait, EPOLLOUT | EPOLLPRI);
+    if (!socket->is_open || !net_dev.is_up) return EPOLLHUP;
+
+    uint32_t events;
+    if (socket->protocol == PROTO_TCP) {
+        events = tcp_poll(socket);
+    } else {
+        events = EPOLLOUT;
+        if (socket->rx_queue.qlen) events |= EPOLLIN;
+    }
+    if (socket->zc_done != socket->zc_reported) events |= EPOLLPRI;
+    return events;
+}
+
+static const file_ops_t socket_file_ops = {
+    .read    = socket_file_read,
+    .write   = socket_file_write,
+    .release = socket_file_release,
+    .poll    = socket_file_poll,
+};
+
+socket_t* net_socket_from_file(file_t* f) {
+    if (!f || f->ops != &socket_file_ops) return NULL;
+    return (socket_t*)f->object;
+}
+
+int net_socket_open_fd(uint8_t protocol) {
+    if (!process_current()) return -1;
+
+    socket_t* socket = net_socket_create(protocol);
+    if (!socket) return -1;
+    return net_socket_install_fd(socket);
+}
+
+int net_socket_install_fd(socket_t* socket) {
+    process_t* self = process_current();
+    if (!self) {
+        net_socket_close(socket);
+        return -1;
+    }
+
+    file_t* f = file_alloc(&socket_file_ops, socket, FILE_READ | FILE_WRITE);
+    if (!f) {
+        net_socket_close(socket);
+        return -1;
+    }
+
+    int fd = fd_install(self, f);
+    if (fd < 0) {
+        file_put(f);            /* closes the socket */
+        return -1;
+    }
+    return fd;
+}
+
+uint32_t skb_csum_partial(const sk_buff_t* skb, uint32_t offset, uint32_t len,
+                          uint32_t sum) {
+    uint32_t pos = 0;           /* Bytes summed so far */
+    uint32_t headlen = skb_headlen(skb);
+
+    if (offset < headlen) {
+        uint32_t chunk = headlen - offset;
+        if (chunk > len) chunk = len;
+        sum = net_csum_block_add(sum, net_csum_partial(skb->data + offset, chunk, 0), 0);
+        pos = chunk;
+        offset = 0;
+    } else {
+        offset -= headlen;
+    }
+
+    for (uint32_t i = 0; i < skb->nr_frags && pos < len; i++) {
+        const skb_frag_t* f = &skb->frags[i];
+        if (offset >= f->size) {
+            offset -= f->size;
+            continue;
+        }
+        uint32_t chunk = f->size - offset;
+        if (chunk > len - pos) chunk = len - pos;
+        uint32_t part = net_csum_partial(skb_frag_address(f) + offset, chunk, 0);
+        sum = net_csum_block_add(sum, part, pos);
+        pos += chunk;
+        offset = 0;
+    }
+    return sum;
+}
+
+uint16_t skb_checksum(const sk_buff_t* skb, uint32_t offset, uint32_t len) {
+    return net_csum_fold(skb_csum_partial(skb, offset, len, 0));
+}
+
+int inet_parse(const char* s, in_addr_t* out) {
+    uint32_t parts[4];
+    for (int i = 0; i < 4; i++) {
+        if (*s < '0' || *s > '9') return -1;
+        uint32_t v = 0;
+        while (*s >= '0' && *s <= '9') {
+            v = v * 10 + (uint32_t)(*s++ - '0');
+            if (v > 255) return -1;
+        }
+        parts[i] = v;
+        if (i < 3 && *s++ != '.') return -1;
+    }
+    if (*s) return -1;
+
+    *out = IP4(parts[0], parts[1], parts[2], parts[3]);
+    return 0;
+}
+
+char* inet_format(in_addr_t addr, char* buf) {
+    char* p = buf;
+    for (int i = 0; i < 4; i++) {
+        uint32_t v = (addr >> (i * 8)) & 0xFF;
+        if (v >= 100) *p++ = (char)('0' + v / 100);
+        if (v >= 10)  *p++ = (char)('0' + (v / 10) % 10);
+        *p++ = (char)('0' + v % 10);
+        if (i < 3) *p++ = '.';
+    }
+    *p = '\0';
+    return buf;
 }
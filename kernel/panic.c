@@ -6,10 +6,14 @@
 
 #include "panic.h"
 #include "../drivers/console.h"
+#include "../drivers/serial.h"
+#include "printk.h"
 
 /* Kernel panic - halts the system with an error message */
 void kernel_panic(const char* message) {
     __asm__ __volatile__("cli");  /* Disable interrupts */
+    serial_panic();               /* No THRE interrupts from here on */
+    printk_panic();               /* Whatever klogd had not printed yet */
     
     console_set_color(0x0F, 0x04);  /* White text on red background */
     console_write("\n\n*** KERNEL PANIC ***\n");
@@ -26,6 +30,8 @@ void kernel_panic(const char* message) {
 void kernel_panic_ext(const char* message, const char* file, int line) {
     (void)line;  /* Unused: Line number formatting requires sprintf, not yet implemented */
     __asm__ __volatile__("cli");  /* Disable interrupts */
+    serial_panic();               /* No THRE interrupts from here on */
+    printk_panic();               /* Whatever klogd had not printed yet */
     
     console_set_color(0x0F, 0x04);  /* White text on red background */
     console_write("\n\n*** KERNEL PANIC ***\n");
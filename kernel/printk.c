@@ -0,0 +1,315 @@
+/*
+ * OpenOS - Kernel Log (printk) Implementation
+ */
+
+#include "printk.h"
+#include "string.h"
+#include "../drivers/console.h"
+#include "../drivers/timer.h"
+#include "../arch/x86/cpu.h"
+#include "../process/process.h"
+#include "../process/waitqueue.h"
+
+typedef struct log_ring {
+    uint32_t head;              /* Next position to claim              */
+    log_record_t rec[LOG_RING_SIZE];
+} log_ring_t;
+
+static log_ring_t log_rings[MAX_CPUS];
+static uint64_t   log_boot_tsc;
+static log_stats_t stats;
+
+int console_loglevel = LOG_INFO;
+
+/* klogd's place in the rings; only the flusher of the moment moves it */
+static log_iter_t   console_iter;
+static int          flushing;
+static wait_queue_t klog_wait;
+static int          klogd_running;
+static int          log_sync = 1;   /* printk() flushes inline          */
+
+void printk_init(void) {
+    log_boot_tsc = rdtsc();
+    wait_queue_init(&klog_wait);
+}
+
+/* ------------------------------------------------------------------ */
+/* Formatting                                                           */
+/* ------------------------------------------------------------------ */
+
+static void put_num(strbuf_t* sb, uint32_t v, uint32_t base, int upper,
+                    int neg, int width, char pad) {
+    const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char tmp[12];
+    int n = 0;
+    do {
+        tmp[n++] = digits[v % base];
+        v /= base;
+    } while (v);
+    int len = n + neg;
+    if (neg && pad == '0') strbuf_putc(sb, '-');
+    for (; width > len; width--) strbuf_putc(sb, pad);
+    if (neg && pad != '0') strbuf_putc(sb, '-');
+    while (n) strbuf_putc(sb, tmp[--n]);
+}
+
+static void log_format(strbuf_t* sb, const char* fmt, va_list ap) {
+    for (const char* p = fmt; *p; p++) {
+        if (*p != '%') {
+            /* Copy the literal run in one go */
+            const char* q = p;
+            while (q[1] && q[1] != '%') q++;
+            strbuf_append_n(sb, p, (size_t)(q - p + 1));
+            p = q;
+            continue;
+        }
+        p++;
+        char pad = ' ';
+        int width = 0;
+        if (*p == '0') {
+            pad = '0';
+            p++;
+        }
+        while (*p >= '0' && *p <= '9') width = width * 10 + (*p++ - '0');
+        while (*p == 'l') p++;
+
+        switch (*p) {
+        case 's': {
+            const char* s = va_arg(ap, const char*);
+            if (!s) s = "(null)";
+            size_t len = string_length(s);
+            for (int w = width; w > (int)len; w--) strbuf_putc(sb, ' ');
+            strbuf_append_n(sb, s, len);
+            break;
+        }
+        case 'c':
+            strbuf_putc(sb, (char)va_arg(ap, int));
+            break;
+        case 'd':
+        case 'i': {
+            int v = va_arg(ap, int);
+            put_num(sb, v < 0 ? 0u - (uint32_t)v : (uint32_t)v, 10, 0, v < 0,
+                    width, pad);
+            break;
+        }
+        case 'u':
+            put_num(sb, va_arg(ap, uint32_t), 10, 0, 0, width, pad);
+            break;
+        case 'x':
+        case 'X':
+            put_num(sb, va_arg(ap, uint32_t), 16, *p == 'X', 0, width, pad);
+            break;
+        case 'p':
+            strbuf_append(sb, "0x");
+            put_num(sb, (uint32_t)va_arg(ap, void*), 16, 0, 0, 8, '0');
+            break;
+        case '%':
+            strbuf_putc(sb, '%');
+            break;
+        case '\0':
+            return;
+        default:
+            strbuf_putc(sb, '%');
+            strbuf_putc(sb, *p);
+            break;
+        }
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* Readers                                                              */
+/* ------------------------------------------------------------------ */
+
+enum { READ_OK, READ_NOT_YET, READ_LOST };
+
+/* Copy the record at `pos`, validating it against a concurrent writer:
+ * the sequence number must say `pos` both before and after the copy. */
+static int log_read(const log_ring_t* ring, uint32_t pos, log_record_t* out) {
+    const log_record_t* r = &ring->rec[pos & (LOG_RING_SIZE - 1)];
+    uint32_t seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+    if (seq != pos + 1) {
+        /* 0 or an older lap: the writer of `pos` has not finished.
+         * Anything newer: it has been lapped already. */
+        return (seq == 0 || (int32_t)(seq - (pos + 1)) < 0) ? READ_NOT_YET
+                                                            : READ_LOST;
+    }
+    memcpy(out, r, sizeof(*out));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&r->seq, __ATOMIC_RELAXED) != seq) return READ_LOST;
+    return READ_OK;
+}
+
+void log_iter_start(log_iter_t* it) {
+    it->lost = 0;
+    for (uint32_t c = 0; c < MAX_CPUS; c++) {
+        uint32_t head = __atomic_load_n(&log_rings[c].head, __ATOMIC_ACQUIRE);
+        it->pos[c] = head > LOG_RING_SIZE ? head - LOG_RING_SIZE : 0;
+    }
+}
+
+int log_iter_next(log_iter_t* it, log_record_t* out) {
+    log_record_t r;
+    int best = -1;
+
+    for (uint32_t c = 0; c < MAX_CPUS; c++) {
+        const log_ring_t* ring = &log_rings[c];
+        for (;;) {
+            uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+            if (it->pos[c] == head) break;
+            if (head - it->pos[c] > LOG_RING_SIZE) {
+                it->lost += head - LOG_RING_SIZE - it->pos[c];
+                it->pos[c] = head - LOG_RING_SIZE;
+            }
+            int st = log_read(ring, it->pos[c], &r);
+            if (st == READ_NOT_YET) break;
+            if (st == READ_LOST) {
+                it->lost++;
+                it->pos[c]++;
+                continue;
+            }
+            if (best < 0 || r.tsc < out->tsc) {
+                *out = r;
+                best = (int)c;
+            }
+            break;
+        }
+    }
+    if (best < 0) return 0;
+    it->pos[best]++;
+    return 1;
+}
+
+uint64_t log_tsc_to_us(uint64_t tsc) {
+    uint32_t khz = timer_get_tsc_khz();
+    if (!khz || tsc < log_boot_tsc) return 0;
+    return udiv64((tsc - log_boot_tsc) * 1000, khz, 0);
+}
+
+/* ------------------------------------------------------------------ */
+/* Console flush                                                        */
+/* ------------------------------------------------------------------ */
+
+static int log_pending(void);
+
+/* Print new records on the console. Only one flusher runs at a time; a
+ * printk() from an interrupt during a flush leaves its record for the
+ * flusher already running, which looks again after letting go. */
+static void log_flush(void) {
+    do {
+        uint32_t irq = irq_save();
+        if (flushing) {
+            irq_restore(irq);
+            return;
+        }
+        flushing = 1;
+        irq_restore(irq);
+
+        log_record_t r;
+        while (log_iter_next(&console_iter, &r)) {
+            if (console_iter.lost) {
+                char line[48];
+                strbuf_t sb;
+                strbuf_init(&sb, line, sizeof(line));
+                strbuf_append(&sb, "klog: ");
+                strbuf_append_uint(&sb, console_iter.lost);
+                strbuf_append(&sb, " messages lost\n");
+                stats.console_lost += console_iter.lost;
+                console_iter.lost = 0;
+                console_write(line);
+            }
+            if (r.level > console_loglevel) continue;
+            console_write(r.text);
+            console_put_char('\n');
+            stats.flushed++;
+        }
+
+        __atomic_store_n(&flushing, 0, __ATOMIC_RELEASE);
+    } while (log_pending());
+}
+
+/* Is there a finished record klogd has not looked at? */
+static int log_pending(void) {
+    log_record_t r;
+    for (uint32_t c = 0; c < MAX_CPUS; c++) {
+        uint32_t pos  = console_iter.pos[c];
+        uint32_t head = __atomic_load_n(&log_rings[c].head, __ATOMIC_ACQUIRE);
+        if (pos == head) continue;
+        if (head - pos > LOG_RING_SIZE) return 1;
+        if (log_read(&log_rings[c], pos, &r) != READ_NOT_YET) return 1;
+    }
+    return 0;
+}
+
+static void klogd_task(void* arg) {
+    (void)arg;
+    for (;;) {
+        uint32_t irq = irq_save();
+        while (!log_pending()) {
+            wait_queue_sleep(&klog_wait);
+        }
+        irq_restore(irq);
+        log_flush();
+    }
+}
+
+void printk_start(void) {
+    if (klogd_running) return;
+    if (!process_create("klogd", klogd_task, 0, PRIORITY_NORMAL)) return;
+    klogd_running = 1;
+    log_sync = 0;
+}
+
+void printk_panic(void) {
+    log_sync = 1;
+    flushing = 0;       /* Whoever held it is not coming back */
+    log_flush();
+}
+
+/* ------------------------------------------------------------------ */
+/* Writers                                                              */
+/* ------------------------------------------------------------------ */
+
+void vprintk(int level, const char* fmt, va_list ap) {
+    uint32_t cpu = smp_get_current_cpu();
+    if (cpu >= MAX_CPUS) cpu = 0;
+    log_ring_t* ring = &log_rings[cpu];
+
+    uint32_t pos = __atomic_fetch_add(&ring->head, 1, __ATOMIC_ACQ_REL);
+    log_record_t* r = &ring->rec[pos & (LOG_RING_SIZE - 1)];
+    __atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    r->tsc   = rdtsc();
+    r->level = (uint8_t)(level < LOG_EMERG ? LOG_EMERG :
+                         level > LOG_DEBUG ? LOG_DEBUG : level);
+    r->cpu   = (uint8_t)cpu;
+
+    strbuf_t sb;
+    strbuf_init(&sb, r->text, LOG_LINE_MAX);
+    log_format(&sb, fmt, ap);
+    if (sb.len && sb.buf[sb.len - 1] == '\n') strbuf_truncate(&sb, sb.len - 1);
+    r->len = (uint16_t)sb.len;
+
+    __atomic_fetch_add(&stats.records, 1, __ATOMIC_RELAXED);
+    if (sb.overflow) __atomic_fetch_add(&stats.truncated, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&r->seq, pos + 1, __ATOMIC_RELEASE);
+
+    if (log_sync) {
+        log_flush();
+        return;
+    }
+    uint32_t irq = irq_save();
+    if (!wait_queue_empty(&klog_wait)) wait_queue_wake_one(&klog_wait);
+    irq_restore(irq);
+}
+
+void printk(int level, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vprintk(level, fmt, ap);
+    va_end(ap);
+}
+
+void log_get_stats(log_stats_t* out) {
+    *out = stats;
+}
@@ -0,0 +1,99 @@
+/*
+ * OpenOS - Kernel Log (printk)
+ *
+ * printk() formats one line into a record in the calling CPU's log ring
+ * and returns; it never touches VGA or the UART. Each record carries the
+ * TSC at the call, the CPU and a level. A writer claims its slot with an
+ * atomic add on the ring's head and publishes it by storing the slot's
+ * sequence number last, so an interrupt handler can log in the middle of
+ * another printk() on the same CPU, and nothing needs a lock. When a
+ * ring wraps, the oldest records are overwritten.
+ *
+ * Readers never take records out. The klogd thread keeps its own
+ * position in each ring and copies new records at or above
+ * console_loglevel to the console, oldest TSC first across CPUs. dmesg
+ * walks everything still in the rings. A reader copies a slot and then
+ * checks that its sequence number did not change while it copied, which
+ * catches a writer lapping it. Records overwritten before klogd printed
+ * them are counted and reported in their place.
+ *
+ * Before printk_start() creates klogd, and after printk_panic(), each
+ * printk() flushes the rings itself.
+ */
+
+#ifndef OPENOS_KERNEL_PRINTK_H
+#define OPENOS_KERNEL_PRINTK_H
+
+#include <stdint.h>
+#include <stdarg.h>
+#include "../include/smp.h"
+
+/* Levels, most severe first */
+#define LOG_EMERG       0
+#define LOG_ALERT       1
+#define LOG_CRIT        2
+#define LOG_ERR         3
+#define LOG_WARNING     4
+#define LOG_NOTICE      5
+#define LOG_INFO        6
+#define LOG_DEBUG       7
+
+#define LOG_LINE_MAX    112     /* Text per record, NUL included        */
+#define LOG_RING_SIZE   128     /* Records per CPU; power of two        */
+
+typedef struct log_record {
+    uint32_t seq;               /* Position + 1 once written; 0 while   */
+    uint8_t  level;             /* being written                        */
+    uint8_t  cpu;
+    uint16_t len;
+    uint64_t tsc;
+    char     text[LOG_LINE_MAX];
+} log_record_t;
+
+/* A reader's position in every CPU's ring */
+typedef struct log_iter {
+    uint32_t pos[MAX_CPUS];
+    uint32_t lost;              /* Records overwritten before reached   */
+} log_iter_t;
+
+typedef struct log_stats {
+    uint32_t records;           /* printk() calls                       */
+    uint32_t truncated;         /* Lines cut at LOG_LINE_MAX            */
+    uint32_t console_lost;      /* Overwritten before klogd printed     */
+    uint32_t flushed;           /* Records printed on the console       */
+} log_stats_t;
+
+/* Records at or above this level (numerically <=) reach the console */
+extern int console_loglevel;
+
+/* Take the boot TSC that timestamps count from. First thing in kmain(). */
+void printk_init(void);
+
+/* Start klogd; call once processes can be created. */
+void printk_start(void);
+
+/*
+ * Log one line. The format knows %s %c %d %i %u %x %X %p and %%, with
+ * an optional '0' flag and width; a trailing newline is dropped.
+ */
+void printk(int level, const char* fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+void vprintk(int level, const char* fmt, va_list ap);
+
+/* Print everything klogd has not printed yet, synchronously, and keep
+ * doing so for each printk() from now on. For panic paths. */
+void printk_panic(void);
+
+/* Start `it` at the oldest records still retained. */
+void log_iter_start(log_iter_t* it);
+
+/* Copy the next record, oldest TSC first across CPUs, into `out`.
+ * Returns 1, or 0 if there is nothing more (yet). */
+int log_iter_next(log_iter_t* it, log_record_t* out);
+
+/* TSC cycles since printk_init() as microseconds */
+uint64_t log_tsc_to_us(uint64_t tsc);
+
+void log_get_stats(log_stats_t* stats);
+
+#endif /* OPENOS_KERNEL_PRINTK_H */
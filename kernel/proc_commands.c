@@ -247,6 +247,9 @@ void cmd_sched(int argc, char **argv) {
     console_write("  Context switches:  ");
     write_dec((uint32_t)st.context_switches);
     console_write("\n");
+    console_write("  Direct handoffs:   ");
+    write_dec((uint32_t)st.handoffs);
+    console_write("\n");
     console_write("  Timer ticks:       ");
     write_dec((uint32_t)st.ticks);
     console_write("\n");
@@ -0,0 +1,195 @@
+/*
+ * OpenOS - Receive Scaling Implementation
+ */
+
+#include "rss.h"
+#include "ip.h"
+#include "../arch/x86/cpu.h"
+
+/* The key of the Microsoft RSS specification, which NICs use by default */
+static const uint8_t rss_key[RSS_KEY_SIZE] = {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+    0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+    0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+    0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+    0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa,
+};
+
+/* Input bytes hashed: two addresses and two ports */
+#define RSS_INPUT_BYTES     12
+
+/* rss_table[i][v]: what input byte i with value v contributes, the XOR
+ * of the key windows its set bits select */
+static uint32_t rss_table[RSS_INPUT_BYTES][256];
+
+/* One CPU's RPS backlog; napi.queue is the CPU */
+typedef struct rps_backlog {
+    sk_buff_head_t queue;
+    napi_t napi;
+    net_queue_stats_t stats;
+    int added;                  /* napi on the NAPI list              */
+} rps_backlog_t;
+
+static rps_backlog_t rps_backlogs[MAX_CPUS];
+
+/* The 32 key bits starting at bit `bit`, most significant first */
+static uint32_t key_window(uint32_t bit) {
+    const uint8_t* k = rss_key + bit / 8;
+    uint64_t w = ((uint64_t)k[0] << 32) | ((uint32_t)k[1] << 24) |
+                 ((uint32_t)k[2] << 16) | ((uint32_t)k[3] << 8) | k[4];
+    return (uint32_t)(w >> (8 - bit % 8));
+}
+
+static int rps_poll(napi_t* napi, int budget);
+
+void rss_init(void) {
+    for (uint32_t i = 0; i < RSS_INPUT_BYTES; i++) {
+        uint32_t window[8];
+        for (uint32_t b = 0; b < 8; b++) window[b] = key_window(i * 8 + b);
+        for (uint32_t v = 0; v < 256; v++) {
+            uint32_t h = 0;
+            for (uint32_t b = 0; b < 8; b++) {
+                if (v & (0x80 >> b)) h ^= window[b];
+            }
+            rss_table[i][v] = h;
+        }
+    }
+
+    for (uint32_t c = 0; c < MAX_CPUS; c++) {
+        skb_queue_init(&rps_backlogs[c].queue);
+        rps_backlogs[c].napi.poll  = rps_poll;
+        rps_backlogs[c].napi.dev   = NULL;
+        rps_backlogs[c].napi.queue = c;
+    }
+}
+
+/* Bytes go in as they sit in memory, which is wire order */
+static inline uint32_t hash_bytes(uint32_t h, uint32_t first, const uint8_t* p,
+                                  uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) h ^= rss_table[first + i][p[i]];
+    return h;
+}
+
+uint32_t rss_hash_ipv4_addrs(in_addr_t saddr, in_addr_t daddr) {
+    uint32_t h = hash_bytes(0, 0, (const uint8_t*)&saddr, 4);
+    return hash_bytes(h, 4, (const uint8_t*)&daddr, 4);
+}
+
+uint32_t rss_hash_ipv4(in_addr_t saddr, in_addr_t daddr, uint16_t sport,
+                       uint16_t dport) {
+    uint32_t h = rss_hash_ipv4_addrs(saddr, daddr);
+    h = hash_bytes(h, 8, (const uint8_t*)&sport, 2);
+    return hash_bytes(h, 10, (const uint8_t*)&dport, 2);
+}
+
+uint32_t rss_skb_hash(sk_buff_t* skb) {
+    if (skb->hash) return skb->hash;
+
+    uint32_t headlen = skb_headlen(skb);
+    if (headlen < IP_HLEN) return 0;
+    const ip_header_t* iph = (const ip_header_t*)skb->data;
+    uint32_t ihl = (iph->version_ihl & 0x0F) * 4;
+
+    /* Only the first fragment has the ports, so fragments hash on
+     * the addresses, and all of a datagram's go to the same queue */
+    uint32_t h;
+    if ((iph->protocol == PROTO_TCP || iph->protocol == PROTO_UDP) &&
+        !(ntohs(iph->flags_offset) & (IP_FLAG_MF | IP_OFFSET_MASK)) &&
+        ihl >= IP_HLEN && headlen >= ihl + 4) {
+        const uint16_t* ports = (const uint16_t*)(skb->data + ihl);
+        h = rss_hash_ipv4(iph->src_ip, iph->dst_ip, ports[0], ports[1]);
+    } else {
+        h = rss_hash_ipv4_addrs(iph->src_ip, iph->dst_ip);
+    }
+    skb->hash = h;
+    return h;
+}
+
+void net_dev_set_rx_queues(net_device_t* dev, uint32_t n) {
+    if (n == 0) n = 1;
+    if (n > NET_MAX_QUEUES) n = NET_MAX_QUEUES;
+
+    uint32_t cpus = smp_get_cpu_count();
+    if (cpus == 0) cpus = 1;
+    dev->num_rx_queues = n;
+    for (uint32_t q = 0; q < n; q++) dev->rxq_cpu[q] = (uint8_t)(q % cpus);
+    for (uint32_t i = 0; i < RSS_INDIR_SIZE; i++) dev->rss_indir[i] = (uint8_t)(i % n);
+}
+
+/* ------------------------------------------------------------------ */
+/* RPS                                                                  */
+/* ------------------------------------------------------------------ */
+
+int rps_set_cpus(net_device_t* dev, uint32_t mask) {
+    if (MAX_CPUS < 32 && (mask >> MAX_CPUS)) return -1;
+
+    uint32_t irq = irq_save();
+    uint32_t len = 0;
+    for (uint32_t c = 0; c < MAX_CPUS; c++) {
+        if (!(mask & (1u << c))) continue;
+        dev->rps_map[len++] = (uint8_t)c;
+        if (!rps_backlogs[c].added) {
+            rps_backlogs[c].added = 1;
+            napi_add(&rps_backlogs[c].napi);
+        }
+    }
+    dev->rps_len  = len;
+    dev->rps_cpus = mask;
+    irq_restore(irq);
+    return 0;
+}
+
+int rps_steer(net_device_t* dev, sk_buff_t* skb) {
+    if (!dev->rps_len) return 0;
+
+    /* Scale the hash to the map rather than take it modulo, so the
+     * CPU depends on its high bits and the RSS queue on its low ones */
+    uint32_t hash = rss_skb_hash(skb);
+    uint32_t irq = irq_save();
+    uint32_t len = dev->rps_len;
+    if (!len) {
+        irq_restore(irq);
+        return 0;
+    }
+    rps_backlog_t* b = &rps_backlogs[dev->rps_map[((uint64_t)hash * len) >> 32]];
+    if (b->queue.qlen >= RPS_BACKLOG) {
+        b->stats.dropped++;
+        dev->stats.rx_dropped++;
+        irq_restore(irq);
+        skb_free(skb);
+        return 1;
+    }
+    b->stats.packets++;
+    b->stats.bytes += skb->len;
+    skb_queue_tail(&b->queue, skb);
+    napi_schedule(&b->napi);
+    irq_restore(irq);
+    return 1;
+}
+
+static int rps_poll(napi_t* napi, int budget) {
+    rps_backlog_t* b = &rps_backlogs[napi->queue];
+    b->stats.polls++;
+
+    int done = 0;
+    while (done < budget) {
+        uint32_t irq = irq_save();
+        sk_buff_t* skb = skb_dequeue(&b->queue);
+        irq_restore(irq);
+        if (!skb) break;
+        ip_input(skb->dev, skb);
+        done++;
+    }
+
+    uint32_t irq = irq_save();
+    if (b->queue.qlen == 0) napi_complete(napi);
+    irq_restore(irq);
+    return done;
+}
+
+void rps_get_backlog_stats(uint32_t cpu, net_queue_stats_t* stats) {
+    if (cpu >= MAX_CPUS) return;
+    uint32_t irq = irq_save();
+    *stats = rps_backlogs[cpu].stats;
+    irq_restore(irq);
+}
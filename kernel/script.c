@@ -156,6 +156,38 @@ static void trim_whitespace(char* str, char** start, char** end) {
     }
 }
 
+static int is_name_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_';
+}
+
+/* Copy `line` to `out`, replacing each $NAME with the variable's value
+ * (nothing if it is unset) */
+static void expand_vars(const char* line, char* out, size_t size) {
+    strbuf_t sb;
+    strbuf_init(&sb, out, size);
+
+    const char* dollar;
+    while ((dollar = strchr(line, '$')) != NULL) {
+        strbuf_append_n(&sb, line, (size_t)(dollar - line));
+        const char* name = dollar + 1;
+        size_t n = 0;
+        while (is_name_char(name[n])) n++;
+        if (n == 0 || n >= MAX_VAR_NAME) {
+            strbuf_putc(&sb, '$');      /* Not a variable: keep it */
+        } else {
+            char var[MAX_VAR_NAME];
+            memcpy(var, name, n);
+            var[n] = '\0';
+            const char* value = script_get_var(var);
+            if (value) strbuf_append(&sb, value);
+            name += n;
+        }
+        line = name;
+    }
+    strbuf_append(&sb, line);
+}
+
 /* Execute a script */
 int script_execute(const char* script) {
     if (!script) return -1;
@@ -164,6 +196,7 @@ int script_execute(const char* script) {
     
     /* Simple line-by-line execution */
     char line[256];
+    char expanded[MAX_VAR_VALUE];
     int line_pos = 0;
     
     while (*script) {
@@ -186,7 +219,8 @@ int script_execute(const char* script) {
                     char* val_end;
                     trim_whitespace(equals + 1, &val_start, &val_end);
                     
-                    script_set_var(var_start, val_start);
+                    expand_vars(val_start, expanded, sizeof(expanded));
+                    script_set_var(var_start, expanded);
                 }
                 /* Check for if statement */
                 else if (strncmp(line, "if ", 3) == 0) {
@@ -194,8 +228,9 @@ int script_execute(const char* script) {
                 }
                 /* Execute as shell command */
                 else {
+                    expand_vars(line, expanded, sizeof(expanded));
                     console_write("  > ");
-                    console_write(line);
+                    console_write(expanded);
                     console_write("\n");
                 }
             }
@@ -8,7 +8,7 @@
 #include "../drivers/console.h"
 
 /* Maximum number of registered commands */
-#define MAX_COMMANDS 48
+#define MAX_COMMANDS 64
 
 /* Command registry */
 static shell_command_t command_table[MAX_COMMANDS];
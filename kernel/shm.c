@@ -0,0 +1,287 @@
+/*
+ * OpenOS - Shared Memory and Futexes Implementation
+ *
+ * Objects come from a slab cache and use the common IPC object header
+ * for handles and names; their frames come from pmm_alloc_pages().
+ * Futex waiters sleep on one of FUTEX_BUCKETS wait queues chosen by
+ * hashing the key, tagged with the key itself (process_t::wait_key) so
+ * a wake on one word leaves sleepers on colliding words alone.
+ */
+
+#include "../include/shm.h"
+#include "string.h"
+#include "file.h"
+#include "../memory/pmm.h"
+#include "../memory/slab.h"
+#include "../memory/vmm.h"
+#include "../process/waitqueue.h"
+#include "../process/scheduler.h"
+#include "../drivers/timer.h"
+#include "../arch/x86/cpu.h"
+
+#define FUTEX_BUCKETS 32    /* power of two */
+
+static slab_t *shm_slab;
+static wait_queue_t futex_buckets[FUTEX_BUCKETS];
+
+static uint32_t futex_waits;
+static uint32_t futex_wakes;
+
+void shm_init(void) {
+    shm_slab = slab_create(sizeof(shm_object_t));
+    for (int i = 0; i < FUTEX_BUCKETS; i++) {
+        wait_queue_init(&futex_buckets[i]);
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* Objects                                                              */
+/* ------------------------------------------------------------------ */
+
+/* Last handle gone: give the frames back. Interrupts are disabled. */
+static void shm_shutdown(ipc_object_t *o) {
+    shm_object_t *obj = (shm_object_t *)o;
+    pmm_free_pages(obj->base, obj->pages);
+    obj->base = NULL;
+}
+
+static void shm_free(ipc_object_t *o) {
+    slab_free(shm_slab, o);
+}
+
+static const ipc_object_ops_t shm_obj_ops = {
+    .kind     = "shm",
+    .shutdown = shm_shutdown,
+    .free     = shm_free,
+};
+
+static shm_object_t *shm_create(const char *name, size_t size) {
+    shm_object_t *obj = (shm_object_t *)slab_alloc(shm_slab);
+    if (!obj) return NULL;
+
+    uint32_t pages = (uint32_t)((size + PAGE_SIZE - 1) / PAGE_SIZE);
+    uint8_t *base = (uint8_t *)pmm_alloc_pages(pages);
+    if (!base) {
+        slab_free(shm_slab, obj);
+        return NULL;
+    }
+    memset(base, 0, pages * PAGE_SIZE);
+
+    obj->base  = base;
+    obj->pages = pages;
+    obj->size  = (uint32_t)size;
+    ipc_object_setup(&obj->obj, IPC_OBJ_SHM, &shm_obj_ops);
+
+    if (ipc_name_bind(&obj->obj, name) < 0) {
+        ipc_object_close(&obj->obj);
+        return NULL;
+    }
+    return obj;
+}
+
+shm_object_t *shm_open(const char *name, size_t size, uint32_t flags) {
+    if (!name || !name[0]) return NULL;
+
+    uint32_t irq = irq_save();
+    shm_object_t *obj = (shm_object_t *)ipc_name_open(name, IPC_OBJ_SHM);
+    if (obj) {
+        if ((flags & SHM_CREATE) && (flags & SHM_EXCL)) {
+            ipc_object_close(&obj->obj);
+            obj = NULL;
+        }
+    } else if ((flags & SHM_CREATE) && size > 0 && size <= SHM_MAX_SIZE) {
+        obj = shm_create(name, size);
+    }
+    irq_restore(irq);
+    return obj;
+}
+
+void shm_put(shm_object_t *obj) {
+    if (obj) ipc_object_close(&obj->obj);
+}
+
+/* ------------------------------------------------------------------ */
+/* Attachments                                                          */
+/* ------------------------------------------------------------------ */
+
+void *shm_attach(process_t *p, shm_object_t *obj) {
+    if (!p || !obj || !obj->base) return NULL;
+
+    uint32_t irq = irq_save();
+    int slot = -1;
+    for (int i = 0; i < PROCESS_MAX_SHM; i++) {
+        if (p->shm_maps[i] == obj) {
+            irq_restore(irq);
+            return obj->base;
+        }
+        if (!p->shm_maps[i] && slot < 0) slot = i;
+    }
+    if (slot < 0) {
+        irq_restore(irq);
+        return NULL;
+    }
+
+    /* The frames are already identity mapped in the shared directory;
+     * make sure ring 3 may touch them once paging is switched on. */
+    vmm_map_region(NULL, obj->base, (uint32_t)obj->base,
+                   obj->pages * PAGE_SIZE,
+                   PTE_PRESENT | PTE_WRITABLE | PTE_USER);
+
+    p->shm_maps[slot] = obj;
+    ipc_object_open(&obj->obj);
+    irq_restore(irq);
+    return obj->base;
+}
+
+int shm_detach(process_t *p, void *addr) {
+    if (!p) return -1;
+
+    uint32_t irq = irq_save();
+    for (int i = 0; i < PROCESS_MAX_SHM; i++) {
+        shm_object_t *obj = p->shm_maps[i];
+        if (obj && obj->base == (uint8_t *)addr) {
+            p->shm_maps[i] = NULL;
+            shm_put(obj);
+            irq_restore(irq);
+            return 0;
+        }
+    }
+    irq_restore(irq);
+    return -1;
+}
+
+void shm_fork(process_t *child) {
+    if (!child) return;
+    for (int i = 0; i < PROCESS_MAX_SHM; i++) {
+        if (child->shm_maps[i]) ipc_object_open(&child->shm_maps[i]->obj);
+    }
+}
+
+void shm_process_cleanup(process_t *p) {
+    if (!p) return;
+    for (int i = 0; i < PROCESS_MAX_SHM; i++) {
+        shm_object_t *obj = p->shm_maps[i];
+        if (obj) {
+            p->shm_maps[i] = NULL;
+            shm_put(obj);
+        }
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* Descriptors                                                          */
+/* ------------------------------------------------------------------ */
+
+static void shm_file_release(file_t *f) {
+    shm_put((shm_object_t *)f->object);
+}
+
+static const file_ops_t shm_file_ops = {
+    .read    = NULL,
+    .write   = NULL,
+    .release = shm_file_release,
+};
+
+shm_object_t *shm_from_file(file_t *f) {
+    if (!f || f->ops != &shm_file_ops) return NULL;
+    return (shm_object_t *)f->object;
+}
+
+int shm_open_fd(const char *name, size_t size, uint32_t flags) {
+    process_t *self = process_current();
+    if (!self) return -1;
+
+    shm_object_t *obj = shm_open(name, size, flags);
+    if (!obj) return -1;
+
+    file_t *f = file_alloc(&shm_file_ops, obj, FILE_READ | FILE_WRITE);
+    if (!f) {
+        shm_put(obj);
+        return -1;
+    }
+
+    int fd = fd_install(self, f);
+    if (fd < 0) {
+        file_put(f);            /* drops the object handle */
+        return -1;
+    }
+    return fd;
+}
+
+/* ------------------------------------------------------------------ */
+/* Futexes                                                              */
+/* ------------------------------------------------------------------ */
+
+/* Physical address of the word: the key two mappings agree on. */
+static uint32_t futex_key(volatile uint32_t *addr) {
+    if (vmm_paging_enabled()) {
+        return vmm_get_physical(NULL, (void *)addr);
+    }
+    return (uint32_t)addr;
+}
+
+static wait_queue_t *futex_bucket(uint32_t key) {
+    uint32_t h = (key >> 2) * 2654435761u;
+    return &futex_buckets[h >> (32 - 5)];
+}
+
+int futex_wait(volatile uint32_t *addr, uint32_t val, uint32_t timeout_ms) {
+    if (!addr || ((uint32_t)addr & 3) || timeout_ms == 0 ||
+        !scheduler_active() || process_getpid() == 0) {
+        return -1;
+    }
+
+    uint32_t key = futex_key(addr);
+    if (!key) return -1;
+    wait_queue_t *wq = futex_bucket(key);
+
+    /* With interrupts off nobody can change the word and wake us
+     * between this check and going to sleep. */
+    uint32_t irq = irq_save();
+    if (*addr != val) {
+        irq_restore(irq);
+        return -1;
+    }
+
+    process_t *self = process_current();
+    self->wait_key = key;
+    futex_waits++;
+
+    int ret = 0;
+    if (timeout_ms == FUTEX_FOREVER) {
+        wait_queue_sleep(wq);
+    } else {
+        uint32_t ticks = (timeout_ms / 10) + ((timeout_ms % 10) ? 1 : 0);
+        ret = wait_queue_sleep_timeout(wq, ticks);
+    }
+    self->wait_key = 0;
+    irq_restore(irq);
+    return ret;
+}
+
+int futex_wake(volatile uint32_t *addr, int count) {
+    if (!addr || ((uint32_t)addr & 3) || count <= 0) return 0;
+
+    uint32_t key = futex_key(addr);
+    if (!key) return 0;
+
+    int n = wait_queue_wake_key(futex_bucket(key), key, count);
+    futex_wakes += (uint32_t)n;
+    return n;
+}
+
+void shm_get_stats(shm_stats_t *stats) {
+    if (!stats) return;
+
+    stats->objects = 0;
+    stats->pages   = 0;
+
+    uint32_t irq = irq_save();
+    for (ipc_object_t *o = ipc_object_first(IPC_OBJ_SHM); o; o = o->next) {
+        stats->objects++;
+        stats->pages += ((shm_object_t *)o)->pages;
+    }
+    irq_restore(irq);
+    stats->futex_waits = futex_waits;
+    stats->futex_wakes = futex_wakes;
+}
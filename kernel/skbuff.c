@@ -0,0 +1,504 @@
+/*
+ * OpenOS - Packet Buffer Implementation
+ *
+ * sk_buff headers come from a slab cache. Data buffers are page halves
+ * kept on a global free list (linked through their first word while
+ * free) behind a small per-CPU array; buffers move between the two in
+ * batches of SKB_PCPU_BATCH, so the pool is only touched once per batch
+ * of allocations or frees. Everything runs with interrupts disabled
+ * because the RX thread, the shell and interrupt-time TX completion all
+ * allocate and free.
+ *
+ * Fragments of lent memory (skb_ext) are counted on the skb_ext rather
+ * than a buffer; frag_get()/frag_put() take whichever reference a
+ * fragment holds.
+ */
+
+#include "../include/skbuff.h"
+#include "../include/checksum.h"
+#include "../include/smp.h"
+#include "string.h"
+#include "../memory/pmm.h"
+#include "../memory/slab.h"
+#include "../memory/heap.h"
+#include "../arch/x86/cpu.h"
+
+/* Lives in the last SKB_SHINFO_SIZE bytes of every data buffer */
+typedef struct skb_shinfo {
+    uint32_t refs;
+    uint32_t reserved[3];
+} skb_shinfo_t;
+
+typedef struct skb_cache {
+    uint8_t  *bufs[SKB_PCPU_CACHE];
+    uint32_t  count;
+} skb_cache_t;
+
+static slab_t     *skb_slab;
+static uint8_t    *pool_free;
+static uint32_t    pool_count;
+static skb_cache_t skb_caches[MAX_CPUS];
+static skb_stats_t skb_stats;
+
+static inline skb_shinfo_t *skb_shinfo(uint8_t *buf) {
+    return (skb_shinfo_t *)(buf + SKB_BUF_USABLE);
+}
+
+void skb_init(void) {
+    skb_slab = slab_create(sizeof(sk_buff_t));
+}
+
+/* ------------------------------------------------------------------ */
+/* Data buffers                                                         */
+/* ------------------------------------------------------------------ */
+
+/* Carve one more page into buffers. Interrupts must be disabled. */
+static int pool_grow(void) {
+    if (skb_stats.buffers + 2 > SKB_POOL_MAX) return -1;
+
+    uint8_t *page = (uint8_t *)pmm_alloc_page();
+    if (!page) return -1;
+
+    for (int i = 0; i < 2; i++) {
+        uint8_t *buf = page + i * SKB_BUF_SIZE;
+        *(uint8_t **)buf = pool_free;
+        pool_free = buf;
+    }
+    pool_count += 2;
+    skb_stats.buffers += 2;
+    return 0;
+}
+
+/* Move up to a batch from the pool into `c`. Interrupts disabled. */
+static void cache_refill(skb_cache_t *c) {
+    while (c->count < SKB_PCPU_BATCH) {
+        if (!pool_free && pool_grow() < 0) break;
+        uint8_t *buf = pool_free;
+        pool_free = *(uint8_t **)buf;
+        pool_count--;
+        c->bufs[c->count++] = buf;
+    }
+    skb_stats.cache_refills++;
+}
+
+/* Hand a batch back to the pool. Interrupts disabled. */
+static void cache_flush(skb_cache_t *c) {
+    for (uint32_t i = 0; i < SKB_PCPU_BATCH && c->count > 0; i++) {
+        uint8_t *buf = c->bufs[--c->count];
+        *(uint8_t **)buf = pool_free;
+        pool_free = buf;
+        pool_count++;
+    }
+}
+
+uint8_t *skb_buf_alloc(void) {
+    uint32_t irq = irq_save();
+    skb_cache_t *c = &skb_caches[smp_get_current_cpu()];
+
+    if (c->count == 0) {
+        cache_refill(c);
+    } else {
+        skb_stats.cache_hits++;
+    }
+    if (c->count == 0) {
+        skb_stats.alloc_failures++;
+        irq_restore(irq);
+        return NULL;
+    }
+
+    uint8_t *buf = c->bufs[--c->count];
+    skb_shinfo(buf)->refs = 1;
+    irq_restore(irq);
+    return buf;
+}
+
+void skb_buf_get(uint8_t *buf) {
+    uint32_t irq = irq_save();
+    skb_shinfo(buf)->refs++;
+    irq_restore(irq);
+}
+
+void skb_buf_put(uint8_t *buf) {
+    if (!buf) return;
+
+    uint32_t irq = irq_save();
+    if (--skb_shinfo(buf)->refs == 0) {
+        skb_cache_t *c = &skb_caches[smp_get_current_cpu()];
+        if (c->count == SKB_PCPU_CACHE) cache_flush(c);
+        c->bufs[c->count++] = buf;
+    }
+    irq_restore(irq);
+}
+
+/* ------------------------------------------------------------------ */
+/* Lent memory                                                          */
+/* ------------------------------------------------------------------ */
+
+void skb_ext_get(skb_ext_t *ext) {
+    uint32_t irq = irq_save();
+    ext->refs++;
+    irq_restore(irq);
+}
+
+void skb_ext_put(skb_ext_t *ext) {
+    uint32_t irq = irq_save();
+    if (--ext->refs == 0) {
+        if (ext->copy) {
+            kfree(ext->copy);
+            ext->copy = NULL;
+        }
+        ext->release(ext);
+    }
+    irq_restore(irq);
+}
+
+int skb_ext_privatize(skb_ext_t *ext) {
+    if (ext->copy) return 0;
+
+    uint8_t *copy = (uint8_t *)kmalloc(ext->len ? ext->len : 1);
+    if (!copy) return -1;
+    memcpy(copy, ext->data, ext->len);
+    ext->copy = copy;
+    ext->data = copy;
+    return 0;
+}
+
+static void frag_get(const skb_frag_t *f) {
+    if (f->ext) skb_ext_get(f->ext);
+    else        skb_buf_get(f->buf);
+}
+
+static void frag_put(const skb_frag_t *f) {
+    if (f->ext) skb_ext_put(f->ext);
+    else        skb_buf_put(f->buf);
+}
+
+/* ------------------------------------------------------------------ */
+/* sk_buffs                                                             */
+/* ------------------------------------------------------------------ */
+
+sk_buff_t *skb_alloc(void) {
+    sk_buff_t *skb = (sk_buff_t *)slab_alloc(skb_slab);
+    if (!skb) return NULL;
+
+    uint8_t *buf = skb_buf_alloc();
+    if (!buf) {
+        slab_free(skb_slab, skb);
+        return NULL;
+    }
+
+    skb->next      = NULL;
+    skb->dev       = NULL;
+    skb->head      = buf;
+    skb->data      = buf + SKB_HEADROOM;
+    skb->tail      = skb->data;
+    skb->end       = buf + SKB_BUF_USABLE;
+    skb->len       = 0;
+    skb->data_len  = 0;
+    skb->protocol  = 0;
+    skb->nr_frags  = 0;
+    skb->ip_summed = CHECKSUM_NONE;
+    skb->hash      = 0;
+    skb->queue     = 0;
+    skb->users     = 1;
+
+    uint32_t irq = irq_save();
+    skb_stats.skbs_in_use++;
+    irq_restore(irq);
+    return skb;
+}
+
+sk_buff_t *skb_get(sk_buff_t *skb) {
+    uint32_t irq = irq_save();
+    skb->users++;
+    irq_restore(irq);
+    return skb;
+}
+
+void skb_free(sk_buff_t *skb) {
+    if (!skb) return;
+
+    uint32_t irq = irq_save();
+    if (--skb->users > 0) {
+        irq_restore(irq);
+        return;
+    }
+    skb_stats.skbs_in_use--;
+
+    skb_buf_put(skb->head);
+    for (uint32_t i = 0; i < skb->nr_frags; i++) {
+        frag_put(&skb->frags[i]);
+    }
+    slab_free(skb_slab, skb);
+    irq_restore(irq);
+}
+
+void skb_reserve(sk_buff_t *skb, uint32_t n) {
+    if (skb->len == 0 && n <= (uint32_t)(skb->end - skb->data)) {
+        skb->data += n;
+        skb->tail += n;
+    }
+}
+
+uint8_t *skb_put(sk_buff_t *skb, uint32_t n) {
+    if (n > skb_tailroom(skb)) return NULL;
+
+    uint8_t *p = skb->tail;
+    skb->tail += n;
+    skb->len  += n;
+    return p;
+}
+
+uint8_t *skb_push(sk_buff_t *skb, uint32_t n) {
+    if (n > skb_headroom(skb)) return NULL;
+
+    skb->data -= n;
+    skb->len  += n;
+    return skb->data;
+}
+
+uint8_t *skb_pull(sk_buff_t *skb, uint32_t n) {
+    if (n > skb_headlen(skb)) return NULL;
+
+    skb->data += n;
+    skb->len  -= n;
+    return skb->data;
+}
+
+void skb_trim(sk_buff_t *skb, uint32_t len) {
+    if (len >= skb->len) return;
+
+    uint32_t headlen = skb_headlen(skb);
+    if (len <= headlen) {
+        for (uint32_t i = 0; i < skb->nr_frags; i++) {
+            frag_put(&skb->frags[i]);
+        }
+        skb->nr_frags = 0;
+        skb->data_len = 0;
+        skb->tail = skb->data + len;
+        skb->len  = len;
+        return;
+    }
+
+    uint32_t left = len - headlen;
+    uint32_t keep = 0;
+    for (uint32_t i = 0; i < skb->nr_frags; i++) {
+        skb_frag_t *f = &skb->frags[i];
+        if (left == 0) {
+            frag_put(f);
+            continue;
+        }
+        if (f->size > left) f->size = (uint16_t)left;
+        left -= f->size;
+        keep++;
+    }
+    skb->nr_frags = (uint16_t)keep;
+    skb->data_len = len - headlen;
+    skb->len      = len;
+}
+
+int skb_add_frag(sk_buff_t *skb, uint8_t *buf, uint32_t offset, uint32_t size) {
+    if (skb->nr_frags >= SKB_MAX_FRAGS || offset + size > SKB_BUF_USABLE) {
+        return -1;
+    }
+
+    skb_frag_t *f = &skb->frags[skb->nr_frags++];
+    f->buf    = buf;
+    f->ext    = NULL;
+    f->offset = offset;
+    f->size   = (uint16_t)size;
+    skb->len      += size;
+    skb->data_len += size;
+    return 0;
+}
+
+int skb_add_frag_ext(sk_buff_t *skb, skb_ext_t *ext, uint32_t offset,
+                     uint32_t size) {
+    if (skb->nr_frags >= SKB_MAX_FRAGS || size > 0xFFFF ||
+        offset + size > ext->len) {
+        return -1;
+    }
+
+    skb_ext_get(ext);
+    skb_frag_t *f = &skb->frags[skb->nr_frags++];
+    f->buf    = NULL;
+    f->ext    = ext;
+    f->offset = offset;
+    f->size   = (uint16_t)size;
+    skb->len      += size;
+    skb->data_len += size;
+    return 0;
+}
+
+int skb_add_frag_ref(sk_buff_t *skb, const skb_frag_t *f, uint32_t offset,
+                     uint32_t size) {
+    if (skb->nr_frags >= SKB_MAX_FRAGS || offset + size > f->size) return -1;
+
+    frag_get(f);
+    skb_frag_t *to = &skb->frags[skb->nr_frags++];
+    to->buf    = f->buf;
+    to->ext    = f->ext;
+    to->offset = f->offset + offset;
+    to->size   = (uint16_t)size;
+    skb->len      += size;
+    skb->data_len += size;
+    return 0;
+}
+
+/* Room left in the last fragment, if it is a buffer this sk_buff is
+ * the only user of. */
+static uint32_t last_frag_room(const sk_buff_t *skb) {
+    if (skb->nr_frags == 0) return 0;
+
+    const skb_frag_t *f = &skb->frags[skb->nr_frags - 1];
+    if (f->ext || skb_shinfo(f->buf)->refs != 1) return 0;
+    return SKB_BUF_USABLE - (f->offset + f->size);
+}
+
+/* Copy `n` bytes that will sit `pos` bytes into the packet, adding
+ * their sum to *sum on the way if it is given. */
+static void copy_in(uint8_t *to, const uint8_t *from, uint32_t n, uint32_t pos,
+                    uint32_t *sum) {
+    if (sum) *sum = net_csum_block_add(*sum, net_csum_copy(to, from, n, 0), pos);
+    else     memcpy(to, from, n);
+}
+
+static int skb_append(sk_buff_t *skb, const void *src, uint32_t n, uint32_t *sum) {
+    const uint8_t *p = (const uint8_t *)src;
+
+    /* Check capacity up front so a failure appends nothing */
+    uint32_t room = skb_tailroom(skb) + last_frag_room(skb);
+    uint32_t extra = (n > room) ? n - room : 0;
+    uint32_t bufs = (extra + SKB_BUF_USABLE - 1) / SKB_BUF_USABLE;
+    if (skb->nr_frags + bufs > SKB_MAX_FRAGS) return -1;
+
+    uint8_t *fresh[SKB_MAX_FRAGS];
+    for (uint32_t i = 0; i < bufs; i++) {
+        fresh[i] = skb_buf_alloc();
+        if (!fresh[i]) {
+            while (i > 0) skb_buf_put(fresh[--i]);
+            return -1;
+        }
+    }
+
+    uint32_t chunk = skb_tailroom(skb);
+    if (chunk > n) chunk = n;
+    if (chunk) {
+        uint32_t pos = skb->len;
+        copy_in(skb_put(skb, chunk), p, chunk, pos, sum);
+        p += chunk;
+        n -= chunk;
+    }
+
+    chunk = last_frag_room(skb);
+    if (chunk > n) chunk = n;
+    if (chunk) {
+        skb_frag_t *f = &skb->frags[skb->nr_frags - 1];
+        copy_in(f->buf + f->offset + f->size, p, chunk, skb->len, sum);
+        f->size       += (uint16_t)chunk;
+        skb->len      += chunk;
+        skb->data_len += chunk;
+        p += chunk;
+        n -= chunk;
+    }
+
+    for (uint32_t i = 0; i < bufs; i++) {
+        chunk = (n > SKB_BUF_USABLE) ? SKB_BUF_USABLE : n;
+        copy_in(fresh[i], p, chunk, skb->len, sum);
+        skb_add_frag(skb, fresh[i], 0, chunk);
+        p += chunk;
+        n -= chunk;
+    }
+    return 0;
+}
+
+int skb_append_data(sk_buff_t *skb, const void *src, uint32_t n) {
+    return skb_append(skb, src, n, NULL);
+}
+
+int skb_append_data_csum(sk_buff_t *skb, const void *src, uint32_t n,
+                         uint32_t *sum) {
+    return skb_append(skb, src, n, sum);
+}
+
+int skb_copy_bits(const sk_buff_t *skb, uint32_t offset, void *to, uint32_t n) {
+    if (offset > skb->len || n > skb->len - offset) return -1;
+
+    uint8_t *out = (uint8_t *)to;
+    uint32_t headlen = skb_headlen(skb);
+
+    if (offset < headlen) {
+        uint32_t chunk = headlen - offset;
+        if (chunk > n) chunk = n;
+        memcpy(out, skb->data + offset, chunk);
+        out += chunk;
+        n   -= chunk;
+        offset = 0;
+    } else {
+        offset -= headlen;
+    }
+
+    for (uint32_t i = 0; i < skb->nr_frags && n > 0; i++) {
+        const skb_frag_t *f = &skb->frags[i];
+        if (offset >= f->size) {
+            offset -= f->size;
+            continue;
+        }
+        uint32_t chunk = f->size - offset;
+        if (chunk > n) chunk = n;
+        memcpy(out, skb_frag_address(f) + offset, chunk);
+        out += chunk;
+        n   -= chunk;
+        offset = 0;
+    }
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* Queues                                                               */
+/* ------------------------------------------------------------------ */
+
+void skb_queue_init(sk_buff_head_t *q) {
+    q->head = NULL;
+    q->tail = NULL;
+    q->qlen = 0;
+}
+
+void skb_queue_tail(sk_buff_head_t *q, sk_buff_t *skb) {
+    skb->next = NULL;
+    if (q->tail) q->tail->next = skb;
+    else         q->head = skb;
+    q->tail = skb;
+    q->qlen++;
+}
+
+sk_buff_t *skb_dequeue(sk_buff_head_t *q) {
+    sk_buff_t *skb = q->head;
+    if (!skb) return NULL;
+
+    q->head = skb->next;
+    if (!q->head) q->tail = NULL;
+    skb->next = NULL;
+    q->qlen--;
+    return skb;
+}
+
+void skb_queue_purge(sk_buff_head_t *q) {
+    sk_buff_t *skb;
+    while ((skb = skb_dequeue(q)) != NULL) {
+        skb_free(skb);
+    }
+}
+
+void skb_get_stats(skb_stats_t *stats) {
+    if (!stats) return;
+
+    uint32_t irq = irq_save();
+    *stats = skb_stats;
+    stats->pool_free = pool_count;
+    stats->cached = 0;
+    for (int i = 0; i < MAX_CPUS; i++) {
+        stats->cached += skb_caches[i].count;
+    }
+    irq_restore(irq);
+}
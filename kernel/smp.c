@@ -3,7 +3,7 @@
  */
 
 #include "smp.h"
-#include "console.h"
+#include "printk.h"
 #include "string.h"
 
 /* Global SMP information */
@@ -62,7 +62,7 @@ static uint32_t detect_cpu_count(void) {
 void smp_init(void) {
     if (smp_initialized) return;
     
-    console_write("SMP: Detecting CPUs...\n");
+    printk(LOG_INFO, "SMP: Detecting CPUs...\n");
     
     /* Initialize SMP structure */
     smp_system.cpu_count = detect_cpu_count();
@@ -81,11 +81,7 @@ void smp_init(void) {
     smp_system.cpus[0].state = CPU_STATE_ONLINE;
     
     /* Print detection results */
-    console_write("SMP: Detected ");
-    char buf[16];
-    itoa(smp_system.cpu_count, buf, 10);
-    console_write(buf);
-    console_write(" CPU(s)\n");
+    printk(LOG_INFO, "SMP: Detected %u CPU(s)\n", smp_system.cpu_count);
     
     smp_initialized = 1;
 }
@@ -123,11 +119,7 @@ int smp_boot_ap(uint32_t cpu_id) {
     /* TODO: Implement AP boot sequence with APIC */
     smp_system.cpus[cpu_id].state = CPU_STATE_ONLINE;
     
-    console_write("SMP: Booted CPU ");
-    char buf[16];
-    itoa(cpu_id, buf, 10);
-    console_write(buf);
-    console_write("\n");
+    printk(LOG_INFO, "SMP: Booted CPU %u\n", cpu_id);
     
     return 0;
 }
@@ -3,6 +3,32 @@
  */
 
 #include "string.h"
+#include "../arch/x86/cpu.h"
+
+/*
+ * The scanning functions read a word at a time. They go byte by byte
+ * up to a word boundary first: an aligned word never crosses into the
+ * next page, so reading past the terminator within it cannot fault. A
+ * word has a zero byte iff (w - 0x01010101) & ~w & 0x80808080 is not 0,
+ * and its lowest set bit marks the first one.
+ */
+
+/* x86 allows unaligned words; the type says so to GCC, and may_alias
+ * lets it be used on any buffer */
+typedef uint32_t __attribute__((may_alias, aligned(1))) uword_t;
+typedef uint32_t __attribute__((may_alias)) aword_t;
+
+#define BYTES_01    0x01010101u
+#define BYTES_80    0x80808080u
+
+static inline uint32_t zero_bytes(uint32_t w) {
+    return (w - BYTES_01) & ~w & BYTES_80;
+}
+
+/* Whether a word read at `p` would run onto the next page */
+static inline int crosses_page(const void* p) {
+    return ((uintptr_t)p & 4095) > 4092;
+}
 
 /*
  * Static pointer for string_tokenize
@@ -16,23 +42,47 @@ static char* tokenize_last = 0;
  * Get the length of a string
  */
 size_t string_length(const char* str) {
-    size_t len = 0;
-    while (str[len] != '\0') {
-        len++;
+    const char* p = str;
+    for (; (uintptr_t)p & 3; p++) {
+        if (*p == '\0') return (size_t)(p - str);
     }
-    return len;
+    const aword_t* w = (const aword_t*)p;
+    uint32_t z;
+    while (!(z = zero_bytes(*w))) w++;
+    return (size_t)((const char*)w - str) + (__builtin_ctz(z) >> 3);
 }
 
 /*
  * Compare two strings
  * Returns 0 if equal, negative if str1 < str2, positive if str1 > str2
+ *
+ * str1 is read in aligned words, str2 at whatever offset that leaves
+ * it; a str2 word that would cross a page is compared byte by byte.
  */
 int string_compare(const char* str1, const char* str2) {
-    while (*str1 && *str2 && *str1 == *str2) {
-        str1++;
-        str2++;
+    const unsigned char* a = (const unsigned char*)str1;
+    const unsigned char* b = (const unsigned char*)str2;
+
+    for (; (uintptr_t)a & 3; a++, b++) {
+        if (*a != *b || *a == '\0') return *a - *b;
+    }
+    for (;;) {
+        if (crosses_page(b)) {
+            for (int i = 0; i < 4; i++, a++, b++) {
+                if (*a != *b || *a == '\0') return *a - *b;
+            }
+            continue;
+        }
+        uint32_t x = *(const aword_t*)a;
+        if (x != *(const uword_t*)b || zero_bytes(x)) break;
+        a += 4;
+        b += 4;
     }
-    return *(const unsigned char*)str1 - *(const unsigned char*)str2;
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a - *b;
 }
 
 /*
@@ -40,38 +90,21 @@ int string_compare(const char* str1, const char* str2) {
  * Returns pointer to destination
  */
 char* string_copy(char* dest, const char* src) {
-    char* original_dest = dest;
-    while (*src != '\0') {
-        *dest = *src;
-        dest++;
-        src++;
-    }
-    *dest = '\0';
-    return original_dest;
+    memcpy(dest, src, string_length(src) + 1);
+    return dest;
 }
 
 /*
  * Concatenate two strings
  * Appends src to the end of dest
  * Returns pointer to destination
+ *
+ * Each call scans dest again; to build a string from several pieces,
+ * use a strbuf_t.
  */
 char* string_concat(char* dest, const char* src) {
-    char* original_dest = dest;
-    
-    /* Find the end of dest */
-    while (*dest != '\0') {
-        dest++;
-    }
-    
-    /* Copy src to the end of dest */
-    while (*src != '\0') {
-        *dest = *src;
-        dest++;
-        src++;
-    }
-    *dest = '\0';
-    
-    return original_dest;
+    string_copy(dest + string_length(dest), src);
+    return dest;
 }
 
 /*
@@ -167,41 +200,48 @@ char* strncpy(char* dest, const char* src, size_t n) {
     return dest;
 }
 
-void* memcpy(void* dest, const void* src, size_t n) {
-    unsigned char* d = (unsigned char*)dest;
-    const unsigned char* s = (const unsigned char*)src;
-    for (size_t i = 0; i < n; i++) {
-        d[i] = s[i];
+char* strchr(const char* str, int ch) {
+    char c = (char)ch;
+    for (; (uintptr_t)str & 3; str++) {
+        if (*str == c) return (char*)str;
+        if (*str == '\0') return NULL;
     }
-    return dest;
-}
 
-void* memset(void* ptr, int value, size_t num) {
-    unsigned char* p = (unsigned char*)ptr;
-    for (size_t i = 0; i < num; i++) {
-        p[i] = (unsigned char)value;
-    }
-    return ptr;
-}
+    /* Stop at the first word holding either the terminator or c */
+    uint32_t pattern = (uint8_t)c * BYTES_01;
+    const aword_t* w = (const aword_t*)str;
+    while (!(zero_bytes(*w) | zero_bytes(*w ^ pattern))) w++;
 
-char* strchr(const char* str, int ch) {
-    while (*str) {
-        if (*str == (char)ch) {
-            return (char*)str;
-        }
-        str++;
+    for (str = (const char*)w; ; str++) {
+        if (*str == c) return (char*)str;
+        if (*str == '\0') return NULL;
     }
-    return NULL;
 }
 
+/* Like string_compare(), stopping after n characters */
 int strncmp(const char* str1, const char* str2, size_t n) {
-    for (size_t i = 0; i < n; i++) {
-        if (str1[i] != str2[i]) {
-            return (unsigned char)str1[i] - (unsigned char)str2[i];
-        }
-        if (str1[i] == '\0') {
-            return 0;
+    const unsigned char* a = (const unsigned char*)str1;
+    const unsigned char* b = (const unsigned char*)str2;
+
+    for (; n && ((uintptr_t)a & 3); n--, a++, b++) {
+        if (*a != *b || *a == '\0') return *a - *b;
+    }
+    while (n >= 4) {
+        if (crosses_page(b)) {
+            for (int i = 0; i < 4; i++, a++, b++) {
+                if (*a != *b || *a == '\0') return *a - *b;
+            }
+            n -= 4;
+            continue;
         }
+        uint32_t x = *(const aword_t*)a;
+        if (x != *(const uword_t*)b || zero_bytes(x)) break;
+        a += 4;
+        b += 4;
+        n -= 4;
+    }
+    for (; n; n--, a++, b++) {
+        if (*a != *b || *a == '\0') return *a - *b;
     }
     return 0;
 }
@@ -253,3 +293,287 @@ char* itoa(int value, char* str, int base) {
     }
     return str;
 }
+
+/* ------------------------------------------------------------------ */
+/* String builder                                                       */
+/* ------------------------------------------------------------------ */
+
+void strbuf_init(strbuf_t* sb, char* buf, size_t size) {
+    sb->buf = buf;
+    sb->len = 0;
+    sb->size = size;
+    sb->overflow = (size == 0);
+    if (size) buf[0] = '\0';
+}
+
+void strbuf_append_n(strbuf_t* sb, const char* s, size_t n) {
+    if (sb->size == 0) return;
+    size_t room = sb->size - 1 - sb->len;
+    if (n > room) {
+        n = room;
+        sb->overflow = 1;
+    }
+    memcpy(sb->buf + sb->len, s, n);
+    sb->len += n;
+    sb->buf[sb->len] = '\0';
+}
+
+void strbuf_append(strbuf_t* sb, const char* s) {
+    strbuf_append_n(sb, s, string_length(s));
+}
+
+void strbuf_putc(strbuf_t* sb, char c) {
+    if (sb->len + 1 < sb->size) {
+        sb->buf[sb->len++] = c;
+        sb->buf[sb->len] = '\0';
+    } else {
+        sb->overflow = 1;
+    }
+}
+
+void strbuf_append_uint(strbuf_t* sb, uint32_t v) {
+    char digits[10];
+    size_t n = 0;
+    do {
+        digits[sizeof(digits) - 1 - n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    strbuf_append_n(sb, digits + sizeof(digits) - n, n);
+}
+
+void strbuf_truncate(strbuf_t* sb, size_t len) {
+    if (len < sb->len) {
+        sb->len = len;
+        sb->buf[len] = '\0';
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* Memory copy and fill                                                 */
+/* ------------------------------------------------------------------ */
+
+uint32_t mem_features;
+
+void string_init(void) {
+    uint32_t r[4];
+    cpuid_count(0, 0, r);
+    uint32_t max_leaf = r[0];
+
+    uint32_t features = 0;
+    cpuid_count(1, 0, r);
+    if (r[3] & (1u << 26)) features |= MEM_SSE2;
+    if (max_leaf >= 7) {
+        cpuid_count(7, 0, r);
+        if (r[1] & (1u << 9)) features |= MEM_ERMS;
+    }
+    mem_features = features;
+}
+
+static inline void copy_small(uint8_t* d, const uint8_t* s, size_t n) {
+    for (; n >= 4; n -= 4, d += 4, s += 4) *(uword_t*)d = *(const uword_t*)s;
+    for (; n; n--) *d++ = *s++;
+}
+
+static inline void fill_small(uint8_t* p, uint32_t pattern, size_t n) {
+    for (; n >= 4; n -= 4, p += 4) *(uword_t*)p = pattern;
+    for (; n; n--) *p++ = (uint8_t)pattern;
+}
+
+/* The string instructions clear DF themselves: it is not cleared on
+ * kernel entry, and ring 3 may have left it set. */
+static inline void rep_movsb(void* d, const void* s, size_t n) {
+    __asm__ __volatile__("cld; rep movsb"
+                         : "+D"(d), "+S"(s), "+c"(n) : : "memory");
+}
+
+static inline void rep_movsd(void* d, const void* s, size_t words) {
+    __asm__ __volatile__("cld; rep movsl"
+                         : "+D"(d), "+S"(s), "+c"(words) : : "memory");
+}
+
+static inline void rep_stosb(void* p, uint32_t pattern, size_t n) {
+    __asm__ __volatile__("cld; rep stosb"
+                         : "+D"(p), "+c"(n) : "a"(pattern) : "memory");
+}
+
+static inline void rep_stosd(void* p, uint32_t pattern, size_t words) {
+    __asm__ __volatile__("cld; rep stosl"
+                         : "+D"(p), "+c"(words) : "a"(pattern) : "memory");
+}
+
+static inline void movnti(void* p, uint32_t v) {
+    __asm__ __volatile__("movnti %1, %0" : "=m"(*(uint32_t*)p) : "r"(v));
+}
+
+/* Bytes to the next 4-byte boundary of `p`, at most `n` */
+static inline size_t head_bytes(const void* p, size_t n) {
+    size_t head = (0u - (uintptr_t)p) & 3;
+    return head < n ? head : n;
+}
+
+/* Align the destination, move words, then the last 0-3 bytes. A
+ * misaligned store costs more than a misaligned load, so the source
+ * is left as it comes. */
+static void copy_movsd(uint8_t* d, const uint8_t* s, size_t n) {
+    size_t head = head_bytes(d, n);
+    copy_small(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+    rep_movsd(d, s, n / 4);
+    copy_small(d + (n & ~3u), s + (n & ~3u), n & 3);
+}
+
+static void copy_nt(uint8_t* d, const uint8_t* s, size_t n) {
+    size_t head = head_bytes(d, n);
+    copy_small(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+
+    for (; n >= 64; n -= 64, d += 64, s += 64) {
+        __asm__ __volatile__("prefetchnta 512(%0)" : : "r"(s));
+        const uword_t* w = (const uword_t*)s;
+        for (int i = 0; i < 16; i += 4) {
+            uint32_t a = w[i], b = w[i + 1], c = w[i + 2], e = w[i + 3];
+            movnti(d + i * 4, a);
+            movnti(d + i * 4 + 4, b);
+            movnti(d + i * 4 + 8, c);
+            movnti(d + i * 4 + 12, e);
+        }
+    }
+    /* Non-temporal stores are weakly ordered: fence them before
+     * anyone else can be told the copy is done */
+    __asm__ __volatile__("sfence" : : : "memory");
+    copy_small(d, s, n);
+}
+
+static void fill_stosd(uint8_t* p, uint32_t pattern, size_t n) {
+    size_t head = head_bytes(p, n);
+    fill_small(p, pattern, head);
+    p += head;
+    n -= head;
+    rep_stosd(p, pattern, n / 4);
+    fill_small(p + (n & ~3u), pattern, n & 3);
+}
+
+static void fill_nt(uint8_t* p, uint32_t pattern, size_t n) {
+    size_t head = head_bytes(p, n);
+    fill_small(p, pattern, head);
+    p += head;
+    n -= head;
+    for (; n >= 16; n -= 16, p += 16) {
+        movnti(p, pattern);
+        movnti(p + 4, pattern);
+        movnti(p + 8, pattern);
+        movnti(p + 12, pattern);
+    }
+    __asm__ __volatile__("sfence" : : : "memory");
+    fill_small(p, pattern, n);
+}
+
+void* memcpy(void* dest, const void* src, size_t n) {
+    if (n < MEM_SMALL) {
+        copy_small((uint8_t*)dest, (const uint8_t*)src, n);
+    } else if (n >= MEM_NT_MIN && (mem_features & MEM_SSE2)) {
+        copy_nt((uint8_t*)dest, (const uint8_t*)src, n);
+    } else if (mem_features & MEM_ERMS) {
+        rep_movsb(dest, src, n);
+    } else {
+        copy_movsd((uint8_t*)dest, (const uint8_t*)src, n);
+    }
+    return dest;
+}
+
+void* memset(void* ptr, int value, size_t num) {
+    uint32_t pattern = (uint8_t)value * 0x01010101u;
+    if (num < MEM_SMALL) {
+        fill_small((uint8_t*)ptr, pattern, num);
+    } else if (num >= MEM_NT_MIN && (mem_features & MEM_SSE2)) {
+        fill_nt((uint8_t*)ptr, pattern, num);
+    } else if (mem_features & MEM_ERMS) {
+        rep_stosb(ptr, pattern, num);
+    } else {
+        fill_stosd((uint8_t*)ptr, pattern, num);
+    }
+    return ptr;
+}
+
+void* memmove(void* dest, const void* src, size_t n) {
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+
+    /* dest below src, or past its end: a forward copy never reads a
+     * byte it has already overwritten. rep movs is defined to move one
+     * element at a time, so it is safe even when they overlap. */
+    if ((uintptr_t)d - (uintptr_t)s >= n) {
+        if ((uintptr_t)s - (uintptr_t)d >= n) return memcpy(dest, src, n);
+        if (n < MEM_SMALL) copy_small(d, s, n);
+        else if (mem_features & MEM_ERMS) rep_movsb(d, s, n);
+        else copy_movsd(d, s, n);
+        return dest;
+    }
+
+    /* dest overlaps the end of src: copy from the end down, loading a
+     * whole block before storing it. Backward rep movs would need DF
+     * set, which an interrupt handler would inherit. */
+    d += n;
+    s += n;
+    for (; n >= 16; n -= 16) {
+        d -= 16;
+        s -= 16;
+        uint32_t a = ((const uword_t*)s)[0], b = ((const uword_t*)s)[1];
+        uint32_t c = ((const uword_t*)s)[2], e = ((const uword_t*)s)[3];
+        ((uword_t*)d)[3] = e;
+        ((uword_t*)d)[2] = c;
+        ((uword_t*)d)[1] = b;
+        ((uword_t*)d)[0] = a;
+    }
+    while (n--) *--d = *--s;
+    return dest;
+}
+
+/* The methods on their own */
+
+void* memcpy_bytes(void* dest, const void* src, size_t n) {
+    volatile uint8_t* d = (volatile uint8_t*)dest;   /* Kept a byte loop */
+    const uint8_t* s = (const uint8_t*)src;
+    for (size_t i = 0; i < n; i++) d[i] = s[i];
+    return dest;
+}
+
+void* memcpy_movsd(void* dest, const void* src, size_t n) {
+    copy_movsd((uint8_t*)dest, (const uint8_t*)src, n);
+    return dest;
+}
+
+void* memcpy_movsb(void* dest, const void* src, size_t n) {
+    rep_movsb(dest, src, n);
+    return dest;
+}
+
+void* memcpy_nt(void* dest, const void* src, size_t n) {
+    copy_nt((uint8_t*)dest, (const uint8_t*)src, n);
+    return dest;
+}
+
+void* memset_bytes(void* ptr, int value, size_t num) {
+    volatile uint8_t* p = (volatile uint8_t*)ptr;
+    for (size_t i = 0; i < num; i++) p[i] = (uint8_t)value;
+    return ptr;
+}
+
+void* memset_stosd(void* ptr, int value, size_t num) {
+    fill_stosd((uint8_t*)ptr, (uint8_t)value * 0x01010101u, num);
+    return ptr;
+}
+
+void* memset_stosb(void* ptr, int value, size_t num) {
+    rep_stosb(ptr, (uint8_t)value, num);
+    return ptr;
+}
+
+void* memset_nt(void* ptr, int value, size_t num) {
+    fill_nt((uint8_t*)ptr, (uint8_t)value * 0x01010101u, num);
+    return ptr;
+}
@@ -8,6 +8,7 @@
 #define OPENOS_KERNEL_STRING_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 /* Get the length of a string */
 size_t string_length(const char* str);
@@ -34,10 +35,68 @@ char* strcpy(char* dest, const char* src);
 char* strncpy(char* dest, const char* src, size_t n);
 void* memcpy(void* dest, const void* src, size_t n);
 void* memset(void* ptr, int value, size_t num);
+void* memmove(void* dest, const void* src, size_t n);
 char* strchr(const char* str, int ch);
 int strncmp(const char* str1, const char* str2, size_t n);
 
 /* Integer to ASCII conversion */
 char* itoa(int value, char* str, int base);
 
+/*
+ * String builder over a caller's buffer. It keeps the length, so each
+ * append costs the size of what is added rather than a rescan of what
+ * is there. What does not fit is cut off and sets `overflow`; the
+ * buffer is always NUL-terminated.
+ */
+typedef struct strbuf {
+    char*  buf;
+    size_t len;
+    size_t size;        /* Of buf, the NUL included */
+    int    overflow;
+} strbuf_t;
+
+void strbuf_init(strbuf_t* sb, char* buf, size_t size);
+void strbuf_append(strbuf_t* sb, const char* s);
+void strbuf_append_n(strbuf_t* sb, const char* s, size_t n);
+void strbuf_putc(strbuf_t* sb, char c);
+void strbuf_append_uint(strbuf_t* sb, uint32_t v);
+
+/* Cut back to `len` characters, e.g. a length saved before appending */
+void strbuf_truncate(strbuf_t* sb, size_t len);
+
+/*
+ * memcpy() and memset() pick a method by size and CPU:
+ *
+ *   below MEM_SMALL bytes      a loop of 32-bit moves, no string setup
+ *   from MEM_NT_MIN, SSE2      MOVNTI stores that bypass the cache, so
+ *                              a large copy does not evict everything
+ *   otherwise, ERMS            rep movsb / stosb, which those CPUs run
+ *                              in cache-line chunks
+ *   otherwise                  rep movsd / stosd on an aligned
+ *                              destination, with the odd bytes in C
+ *
+ * string_init() reads the CPU features; until it runs only the first
+ * and last methods are used. memmove() copies forward with rep movs when
+ * that is safe and backward a word at a time when dest overlaps the end
+ * of src. The methods are also callable directly, for benchmarks.
+ */
+#define MEM_SMALL       32
+#define MEM_NT_MIN      (256 * 1024)
+
+#define MEM_ERMS        0x1     /* Enhanced rep movsb/stosb */
+#define MEM_SSE2        0x2     /* MOVNTI                   */
+
+extern uint32_t mem_features;
+
+void string_init(void);
+
+void* memcpy_bytes(void* dest, const void* src, size_t n);
+void* memcpy_movsd(void* dest, const void* src, size_t n);
+void* memcpy_movsb(void* dest, const void* src, size_t n);
+void* memcpy_nt(void* dest, const void* src, size_t n);     /* Needs SSE2 */
+void* memset_bytes(void* ptr, int value, size_t num);
+void* memset_stosd(void* ptr, int value, size_t num);
+void* memset_stosb(void* ptr, int value, size_t num);
+void* memset_nt(void* ptr, int value, size_t num);          /* Needs SSE2 */
+
 #endif /* OPENOS_KERNEL_STRING_H */
@@ -20,10 +20,18 @@
 
 #include "syscall.h"
 #include "kernel.h"
+#include "file.h"
+#include "../include/ipc.h"
+#include "../include/shm.h"
+#include "../include/epoll.h"
+#include "../include/network.h"
+#include "../fs/vfs.h"
 #include "../process/process.h"
 #include "../process/scheduler.h"
 #include "../memory/heap.h"
 #include "../drivers/console.h"
+#include "printk.h"
+#include "../drivers/keyboard.h"
 #include "../arch/x86/idt.h"
 #include "../arch/x86/gdt.h"
 
@@ -38,7 +46,7 @@ void syscall_init(void) {
      */
     idt_set_gate(0x80, (uint32_t)int80_handler,
                  KERNEL_CODE_SEGMENT, IDT_FLAGS_USER);
-    console_write("Syscalls: int 0x80 gate installed (8 syscalls)\n");
+    printk(LOG_INFO, "Syscalls: int 0x80 gate installed (28 syscalls)\n");
 }
 
 /* ------------------------------------------------------------------ */
@@ -56,6 +64,192 @@ static int sys_write(const char *str) {
     return n;
 }
 
+/* ------------------------------------------------------------------ */
+/* Descriptor I/O                                                       */
+/* ------------------------------------------------------------------ */
+
+static int sys_pipe(int *fds) {
+    if (!fds) return -1;
+    return pipe_open_fds(fds, PIPE_BUF_SIZE);
+}
+
+static int sys_read(int fd, void *buf, uint32_t n) {
+    if (!buf) return -1;
+    return file_read(fd_get(process_current(), fd), buf, n);
+}
+
+static int sys_writefd(int fd, const void *buf, uint32_t n) {
+    if (!buf) return -1;
+    return file_write(fd_get(process_current(), fd), buf, n);
+}
+
+static int sys_vmsplice(int fd, sys_iovec_t *iov, uint32_t flags) {
+    file_t *f = fd_get(process_current(), fd);
+    pipe_t *pipe = pipe_from_file(f);
+    if (!pipe || !iov) return -1;
+
+    if (f->flags & FILE_WRITE) {
+        if (!iov->base) return -1;
+        return pipe_vmsplice(pipe, iov->base, iov->len, flags);
+    }
+
+    const void *data = 0;
+    int n = pipe_read_view(pipe, &data);
+    iov->base = (void *)data;
+    iov->len  = (n > 0) ? (uint32_t)n : 0;
+    return n;
+}
+
+static int sys_mq_send(int fd, const sys_msg_t *m) {
+    msg_queue_t *q = msgqueue_from_file(fd_get(process_current(), fd));
+    if (!q || !m) return -1;
+    return msgqueue_send(q, process_getpid(), m->type, m->priority,
+                         m->buf, m->len, m->timeout_ms);
+}
+
+static int sys_mq_recv(int fd, sys_msg_t *m) {
+    msg_queue_t *q = msgqueue_from_file(fd_get(process_current(), fd));
+    if (!q || !m) return -1;
+
+    msg_info_t info;
+    int n = msgqueue_receive(q, m->buf, m->len, &info, m->timeout_ms);
+    if (n >= 0) {
+        m->type       = info.type;
+        m->priority   = info.priority;
+        m->sender_pid = info.sender_pid;
+    }
+    return n;
+}
+
+/* ------------------------------------------------------------------ */
+/* Sockets                                                              */
+/* ------------------------------------------------------------------ */
+
+static socket_t *socket_of(int fd) {
+    return net_socket_from_file(fd_get(process_current(), fd));
+}
+
+static int sys_bind(int fd, uint16_t port, in_addr_t addr) {
+    socket_t *s = socket_of(fd);
+    return s ? net_socket_bind_addr(s, addr, port) : -1;
+}
+
+/* A NULL `to` sends on a connected socket (TCP, or connected UDP) */
+static int sys_sendto(int fd, const void *buf, uint32_t len,
+                      const sockaddr_in_t *to, uint32_t flags) {
+    socket_t *s = socket_of(fd);
+    return s ? net_socket_sendmsg(s, buf, len, to, flags) : -1;
+}
+
+static int sys_sendfile(int fd, const char *path, uint32_t offset,
+                        uint32_t count) {
+    socket_t *s = socket_of(fd);
+    vfs_node_t *node = path ? vfs_resolve_path(path) : NULL;
+    if (!s || !node) return -1;
+    return net_socket_sendfile(s, node, offset, count);
+}
+
+static int sys_recvfrom(int fd, void *buf, uint32_t len, sockaddr_in_t *from,
+                        uint32_t flags) {
+    socket_t *s = socket_of(fd);
+    return s ? net_socket_recvfrom(s, buf, len, from, flags) : -1;
+}
+
+static int sys_mmsg(int fd, net_mmsg_t *msgs, int count, uint32_t flags,
+                    int receive) {
+    socket_t *s = socket_of(fd);
+    if (!s) return -1;
+    return receive ? net_socket_recvmmsg(s, msgs, count, flags)
+                   : net_socket_sendmmsg(s, msgs, count, flags);
+}
+
+static int sys_accept(int fd, sockaddr_in_t *peer, uint32_t flags) {
+    socket_t *s = socket_of(fd);
+    socket_t *child = s ? net_socket_accept(s, peer, flags) : NULL;
+    return child ? net_socket_install_fd(child) : -1;
+}
+
+static int sys_connect(int fd, in_addr_t addr, uint16_t port) {
+    socket_t *s = socket_of(fd);
+    if (!s) return -1;
+    ip_addr_t ip = { { (uint8_t)addr, (uint8_t)(addr >> 8),
+                       (uint8_t)(addr >> 16), (uint8_t)(addr >> 24) } };
+    return net_socket_connect(s, &ip, port);
+}
+
+/* ------------------------------------------------------------------ */
+/* Synchronous IPC                                                      */
+/* ------------------------------------------------------------------ */
+
+static void regs_to_msg(const regs_t *r, ipc_msg_t *m) {
+    m->w[0] = r->ecx;
+    m->w[1] = r->edx;
+    m->w[2] = r->esi;
+    m->w[3] = r->edi;
+}
+
+static void msg_to_regs(const ipc_msg_t *m, regs_t *r) {
+    r->ecx = m->w[0];
+    r->edx = m->w[1];
+    r->esi = m->w[2];
+    r->edi = m->w[3];
+}
+
+static int sys_ipc_call(regs_t *r) {
+    ipc_endpoint_t *ep = ipc_endpoint_from_file(fd_get(process_current(),
+                                                       (int)r->ebx));
+    ipc_msg_t m;
+    regs_to_msg(r, &m);
+    int ret = ipc_call(ep, &m);
+    if (ret == 0) msg_to_regs(&m, r);
+    return ret;
+}
+
+static int sys_ipc_reply_wait(regs_t *r) {
+    ipc_endpoint_t *ep = ipc_endpoint_from_file(fd_get(process_current(),
+                                                       (int)r->ebx));
+    ipc_msg_t m;
+    regs_to_msg(r, &m);
+    int ret = ipc_reply_wait(ep, &m);
+    if (ret >= 0) msg_to_regs(&m, r);
+    return ret;
+}
+
+/* ------------------------------------------------------------------ */
+/* Shared memory and futexes                                            */
+/* ------------------------------------------------------------------ */
+
+static int sys_shm_map(int fd) {
+    process_t *self = process_current();
+    void *addr = shm_attach(self, shm_from_file(fd_get(self, fd)));
+    return addr ? (int)addr : -1;
+}
+
+static int sys_futex(volatile uint32_t *addr, uint32_t op, uint32_t val,
+                     uint32_t timeout_ms) {
+    switch (op) {
+        case FUTEX_WAIT: return futex_wait(addr, val, timeout_ms);
+        case FUTEX_WAKE: return futex_wake(addr, (int)val);
+        default:         return -1;
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* Event polling                                                        */
+/* ------------------------------------------------------------------ */
+
+static int sys_epoll_ctl(int epfd, int op, int fd, epoll_event_t *ev) {
+    process_t *self = process_current();
+    return epoll_ctl(epoll_from_file(fd_get(self, epfd)), op,
+                     fd_get(self, fd), ev);
+}
+
+static int sys_epoll_wait(int epfd, epoll_event_t *events, int max,
+                          uint32_t timeout_ms) {
+    return epoll_wait(epoll_from_file(fd_get(process_current(), epfd)),
+                      events, max, timeout_ms);
+}
+
 /* ------------------------------------------------------------------ */
 /* sys_fork                                                             */
 /* ------------------------------------------------------------------ */
@@ -100,6 +294,14 @@ static int sys_fork(regs_t *parent_regs) {
     child->parent_waiting = 0;
     child->cpu_ticks      = 0;
     child->wait_ticks     = 0;
+    child->wait_queue     = 0;
+    child->wait_next      = 0;
+    child->ipc_buf        = 0;
+    child->ipc_reply_to   = 0;
+
+    /* Open files and shared memory are shared with the child. */
+    fd_table_fork(child);
+    shm_fork(child);
 
     /* New pid: reuse process_by_pid-safe allocation via a scan. */
     {
@@ -230,6 +432,152 @@ void syscall_dispatch(regs_t *r) {
             break;
         }
 
+        case SYS_PIPE:
+            r->eax = (uint32_t)sys_pipe((int *)r->ebx);
+            break;
+
+        case SYS_READ:
+            r->eax = (uint32_t)sys_read((int)r->ebx, (void *)r->ecx, r->edx);
+            break;
+
+        case SYS_WRITEFD:
+            r->eax = (uint32_t)sys_writefd((int)r->ebx,
+                                           (const void *)r->ecx, r->edx);
+            break;
+
+        case SYS_CLOSE:
+            r->eax = (uint32_t)fd_close(process_current(), (int)r->ebx);
+            break;
+
+        case SYS_VMSPLICE:
+            r->eax = (uint32_t)sys_vmsplice((int)r->ebx,
+                                            (sys_iovec_t *)r->ecx, r->edx);
+            break;
+
+        case SYS_MQ_OPEN:
+            r->eax = (uint32_t)msgqueue_open_fd((const char *)r->edx,
+                                                r->ebx, r->ecx);
+            break;
+
+        case SYS_MQ_SEND:
+            r->eax = (uint32_t)sys_mq_send((int)r->ebx,
+                                           (const sys_msg_t *)r->ecx);
+            break;
+
+        case SYS_MQ_RECV:
+            r->eax = (uint32_t)sys_mq_recv((int)r->ebx, (sys_msg_t *)r->ecx);
+            break;
+
+        case SYS_IPC_OPEN:
+            r->eax = (uint32_t)ipc_endpoint_open_fd((const char *)r->ebx);
+            break;
+
+        case SYS_IPC_CALL:
+            r->eax = (uint32_t)sys_ipc_call(r);
+            break;
+
+        case SYS_IPC_REPLY_WAIT:
+            r->eax = (uint32_t)sys_ipc_reply_wait(r);
+            break;
+
+        case SYS_SHM_OPEN:
+            r->eax = (uint32_t)shm_open_fd((const char *)r->ebx, r->ecx,
+                                           r->edx);
+            break;
+
+        case SYS_SHM_MAP:
+            r->eax = (uint32_t)sys_shm_map((int)r->ebx);
+            break;
+
+        case SYS_SHM_UNMAP:
+            r->eax = (uint32_t)shm_detach(process_current(),
+                                          (void *)r->ebx);
+            break;
+
+        case SYS_FUTEX:
+            r->eax = (uint32_t)sys_futex((volatile uint32_t *)r->ebx,
+                                         r->ecx, r->edx, r->esi);
+            break;
+
+        case SYS_EPOLL_CREATE:
+            r->eax = (uint32_t)epoll_open_fd();
+            break;
+
+        case SYS_EPOLL_CTL:
+            r->eax = (uint32_t)sys_epoll_ctl((int)r->ebx, (int)r->ecx,
+                                             (int)r->edx,
+                                             (epoll_event_t *)r->esi);
+            break;
+
+        case SYS_EPOLL_WAIT:
+            r->eax = (uint32_t)sys_epoll_wait((int)r->ebx,
+                                              (epoll_event_t *)r->ecx,
+                                              (int)r->edx, r->esi);
+            break;
+
+        case SYS_KBD_OPEN:
+            r->eax = (uint32_t)keyboard_open_fd(r->ebx);
+            break;
+
+        case SYS_SOCKET:
+            r->eax = (uint32_t)net_socket_open_fd((uint8_t)r->ebx);
+            break;
+
+        case SYS_BIND:
+            r->eax = (uint32_t)sys_bind((int)r->ebx, (uint16_t)r->ecx, r->edx);
+            break;
+
+        case SYS_SENDTO:
+            r->eax = (uint32_t)sys_sendto((int)r->ebx, (const void *)r->ecx,
+                                          r->edx, (const sockaddr_in_t *)r->esi,
+                                          r->edi);
+            break;
+
+        case SYS_RECVFROM:
+            r->eax = (uint32_t)sys_recvfrom((int)r->ebx, (void *)r->ecx, r->edx,
+                                            (sockaddr_in_t *)r->esi, r->edi);
+            break;
+
+        case SYS_SENDMMSG:
+        case SYS_RECVMMSG:
+            r->eax = (uint32_t)sys_mmsg((int)r->ebx, (net_mmsg_t *)r->ecx,
+                                        (int)r->edx, r->esi,
+                                        r->eax == SYS_RECVMMSG);
+            break;
+
+        case SYS_LISTEN: {
+            socket_t *s = socket_of((int)r->ebx);
+            r->eax = (uint32_t)(s ? net_socket_listen(s, (int)r->ecx) : -1);
+            break;
+        }
+
+        case SYS_ACCEPT:
+            r->eax = (uint32_t)sys_accept((int)r->ebx, (sockaddr_in_t *)r->ecx,
+                                          r->edx);
+            break;
+
+        case SYS_CONNECT:
+            r->eax = (uint32_t)sys_connect((int)r->ebx, r->ecx, (uint16_t)r->edx);
+            break;
+
+        case SYS_SETSOCKOPT: {
+            socket_t *s = socket_of((int)r->ebx);
+            r->eax = (uint32_t)(s ? net_socket_setopt(s, (int)r->ecx,
+                                                      (int)r->edx) : -1);
+            break;
+        }
+
+        case SYS_SENDFILE:
+            r->eax = (uint32_t)sys_sendfile((int)r->ebx, (const char *)r->ecx,
+                                            r->edx, r->esi);
+            break;
+
+        case SYS_GETSOCKOPT: {
+            socket_t *s = socket_of((int)r->ebx);
+            r->eax = (uint32_t)(s ? net_socket_getopt(s, (int)r->ecx) : -1);
+            break;
+        }
+
         default:
             r->eax = (uint32_t)-1;
             break;
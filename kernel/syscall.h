@@ -5,6 +5,27 @@
  *   EAX = syscall number, EBX/ECX/EDX = arguments,
  *   EAX = return value.
  *
+ * Descriptor-based I/O (pipes, message queues, read/writefd/close)
+ * goes through the per-process file table in kernel/file.h. SYS_WRITE
+ * keeps its original "print a NUL-terminated string" meaning.
+ *
+ * SYS_MQ_OPEN and SYS_IPC_OPEN take an optional global name (NULL for
+ * an anonymous object): an existing object of that name is opened,
+ * otherwise a new one is created and published under it.
+ *
+ * SYS_FUTEX takes a fourth argument, the FUTEX_WAIT timeout, in ESI;
+ * so do SYS_EPOLL_CTL (the epoll_event_t) and SYS_EPOLL_WAIT (the
+ * timeout in milliseconds, see include/epoll.h).
+ *
+ * The socket calls take sockaddr_in_t / net_mmsg_t (include/network.h):
+ * SYS_SENDTO has the destination in ESI, SYS_RECVFROM the sender
+ * buffer (or NULL) in ESI and MSG_* flags in EDI, and the two batch
+ * calls their flags in ESI.
+ *
+ * SYS_IPC_CALL and SYS_IPC_REPLY_WAIT carry their message in ECX, EDX,
+ * ESI and EDI both ways: the kernel rewrites those registers in the
+ * frame with the reply (call) or the next request (reply_wait).
+ *
  * The register frame layout must stay in sync with the int80_handler
  * stub in arch/x86/syscall.S and fork_child_return in context.S.
  */
@@ -23,7 +44,64 @@
 #define SYS_SLEEP    5   /* sleep(ms)                    */
 #define SYS_GETPPID  6   /* getppid()                    */
 #define SYS_WAIT     7   /* wait(&status) -> child pid   */
-#define SYS_MAX      8
+#define SYS_PIPE     8   /* pipe(int fds[2]) -> 0 | -1   */
+#define SYS_READ     9   /* read(fd, buf, n) -> bytes    */
+#define SYS_WRITEFD  10  /* writefd(fd, buf, n) -> bytes */
+#define SYS_CLOSE    11  /* close(fd) -> 0 | -1          */
+#define SYS_VMSPLICE 12  /* vmsplice(fd, iov, flags)     */
+#define SYS_MQ_OPEN  13  /* mq_open(arena, max_msg, name) -> fd */
+#define SYS_MQ_SEND  14  /* mq_send(fd, msg) -> 0 | -1   */
+#define SYS_MQ_RECV  15  /* mq_recv(fd, msg) -> bytes    */
+#define SYS_IPC_OPEN 16  /* endpoint(name) -> fd         */
+#define SYS_IPC_CALL 17  /* call(fd; ECX..EDI) -> 0 | -1 */
+#define SYS_IPC_REPLY_WAIT 18  /* reply_wait(fd; ECX..EDI) -> pid */
+#define SYS_SHM_OPEN 19  /* shm_open(name, size, flags) -> fd */
+#define SYS_SHM_MAP  20  /* shm_map(fd) -> address | -1  */
+#define SYS_SHM_UNMAP 21 /* shm_unmap(address) -> 0 | -1 */
+#define SYS_FUTEX    22  /* futex(addr, op, val; ESI = timeout_ms) */
+#define SYS_EPOLL_CREATE 23  /* epoll_create() -> fd         */
+#define SYS_EPOLL_CTL    24  /* epoll_ctl(epfd, op, fd; ESI = event) */
+#define SYS_EPOLL_WAIT   25  /* epoll_wait(epfd, events, max; ESI = timeout_ms) */
+#define SYS_KBD_OPEN     26  /* kbd_open(flags) -> fd (lines or key events) */
+#define SYS_SOCKET       27  /* socket(protocol) -> fd       */
+#define SYS_BIND         28  /* bind(fd, port, addr) -> 0 | -1 */
+#define SYS_SENDTO       29  /* sendto(fd, buf, len; ESI = to, EDI = flags) -> bytes */
+#define SYS_RECVFROM     30  /* recvfrom(fd, buf, len; ESI = from, EDI = flags) */
+#define SYS_SENDMMSG     31  /* sendmmsg(fd, msgs, count; ESI = flags) -> sent */
+#define SYS_RECVMMSG     32  /* recvmmsg(fd, msgs, count; ESI = flags) -> received */
+#define SYS_LISTEN       33  /* listen(fd, backlog) -> 0 | -1 (TCP)     */
+#define SYS_ACCEPT       34  /* accept(fd, peer, flags) -> fd           */
+#define SYS_CONNECT      35  /* connect(fd, addr, port) -> 0 | -1       */
+#define SYS_SETSOCKOPT   36  /* setsockopt(fd, option, value) -> 0 | -1 */
+#define SYS_SENDFILE     37  /* sendfile(fd, path, offset; ESI = count) -> bytes */
+#define SYS_GETSOCKOPT   38  /* getsockopt(fd, option) -> value | -1    */
+#define SYS_MAX          39
+
+/*
+ * One buffer for SYS_VMSPLICE. On a pipe's write end the pages under
+ * it are queued (gifted with SPLICE_F_GIFT); on the read end the
+ * kernel fills it in with a zero-copy view of the next pipe data,
+ * valid until the next read or vmsplice on that pipe.
+ */
+typedef struct sys_iovec {
+    void     *base;
+    uint32_t  len;
+} sys_iovec_t;
+
+/*
+ * Message descriptor for SYS_MQ_SEND / SYS_MQ_RECV. For a send, `len`
+ * is the payload size; for a receive it is the size of `buf`, and the
+ * kernel fills in type, priority and sender_pid. timeout_ms follows
+ * the MSGQ_NOWAIT / MSGQ_FOREVER convention of include/ipc.h.
+ */
+typedef struct sys_msg {
+    void     *buf;
+    uint32_t  len;
+    uint32_t  type;
+    uint32_t  priority;     /* 0 (lowest) .. 31 */
+    uint32_t  timeout_ms;
+    uint32_t  sender_pid;
+} sys_msg_t;
 
 /*
  * Register frame pushed by int80_handler, lowest address first:
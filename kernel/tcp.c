@@ -0,0 +1,1808 @@
+/*
+ * OpenOS - TCP Implementation
+ *
+ * Segments are processed in the RX thread and timers fire there too;
+ * socket calls run in their caller. Either side keeps interrupts off
+ * for the whole of any change to a connection (see tcp.h).
+ *
+ * A connection outlives its socket: closing hands it over as an orphan
+ * (tp->sk == NULL) that finishes the FIN exchange on its own and frees
+ * itself in tcp_done(). One still attached to a socket is only marked
+ * CLOSED there, and freed when the socket's last reference goes.
+ */
+
+#include "tcp.h"
+#include "ip.h"
+#include "epoll.h"
+#include "string.h"
+#include "../memory/slab.h"
+#include "../drivers/timer.h"
+#include "../process/scheduler.h"
+#include "../arch/x86/cpu.h"
+
+/* Write queue entries carry payload only: cb[0] is the sequence of the
+ * first unacknowledged byte, cb[1] the TCPCB_* flags, cb[2] the bytes
+ * already acknowledged off the front and cb[3], with csum_copy, the
+ * one's complement sum of the payload taken while copying it in. A FIN
+ * is an empty entry. */
+#define TCPCB_FIN       0x1
+#define TCPCB_SACKED    0x2     /* The peer has it (SACK)        */
+#define TCPCB_RETRANS   0x4     /* Retransmitted in this episode */
+
+/* Receive and out-of-order queue entries hold the segment with data at
+ * the payload: cb[0] is the sequence of the first unread byte, cb[1]
+ * its offset into the sk_buff and cb[2] the bytes left. */
+#define RCV_SEQ(skb)    ((skb)->cb[0])
+#define RCV_OFF(skb)    ((skb)->cb[1])
+#define RCV_LEN(skb)    ((skb)->cb[2])
+
+/* tcp_sock_t::error */
+#define TCP_ERR_RESET   1
+#define TCP_ERR_REFUSED 2
+#define TCP_ERR_TIMEOUT 3
+
+typedef struct tcp_opts {
+    uint16_t mss;               /* 0: not present                */
+    uint8_t  has_wscale;
+    uint8_t  wscale;
+    uint8_t  sack_ok;
+    uint8_t  nsack;
+    uint32_t sack[TCP_MAX_SACK][2];
+} tcp_opts_t;
+
+/* A received segment, headers parsed */
+typedef struct tcp_seg {
+    in_addr_t  saddr, daddr;
+    uint16_t   sport, dport;
+    uint32_t   seq, ack;
+    uint32_t   len;             /* Payload bytes                 */
+    uint32_t   wnd;             /* As sent, unscaled             */
+    uint8_t    flags;
+    tcp_opts_t opts;
+} tcp_seg_t;
+
+static slab_t     *tcp_slab;
+static tcp_sock_t *tcp_ehash[TCP_HASH_SIZE];
+static tcp_sock_t *tcp_lhash[TCP_LHASH_SIZE];
+static uint16_t    next_ephemeral = TCP_EPHEMERAL_MIN;
+static tcp_stats_t tcp_stats;
+
+static void tcp_push(tcp_sock_t *tp);
+static void tcp_send_ack(tcp_sock_t *tp);
+
+/* ------------------------------------------------------------------ */
+/* Helpers                                                              */
+/* ------------------------------------------------------------------ */
+
+/* Sequence comparisons, modulo 2^32 */
+static inline int seq_lt(uint32_t a, uint32_t b)  { return (int32_t)(a - b) < 0; }
+static inline int seq_leq(uint32_t a, uint32_t b) { return (int32_t)(a - b) <= 0; }
+
+static inline uint32_t min_u32(uint32_t a, uint32_t b) { return a < b ? a : b; }
+static inline uint32_t max_u32(uint32_t a, uint32_t b) { return a > b ? a : b; }
+
+static uint32_t get_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put_be32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static int tcp_can_block(void) {
+    return scheduler_active() && process_getpid() != 0;
+}
+
+static void tcp_wake(wait_queue_t *wq) {
+    if (!wait_queue_empty(wq)) wait_queue_wake_all(wq);
+}
+
+static void tcp_wake_readers(tcp_sock_t *tp) {
+    if (tp->sk) tcp_wake(&tp->sk->rx_wait);
+}
+
+static void tcp_wake_writers(tcp_sock_t *tp) {
+    if (tp->sk) tcp_wake(&tp->sk->tx_wait);
+}
+
+/* Payload of a write queue entry still unacknowledged */
+static inline uint32_t wq_len(const sk_buff_t *skb) {
+    return skb->len - skb->cb[2];
+}
+
+/* Sequence space it occupies, FIN included */
+static inline uint32_t wq_end(const sk_buff_t *skb) {
+    return skb->cb[0] + wq_len(skb) + ((skb->cb[1] & TCPCB_FIN) ? 1 : 0);
+}
+
+/* Largest payload for packets to `dst`: the outgoing MTU less headers */
+static uint16_t tcp_route_mss(in_addr_t dst) {
+    route_t r;
+    if (ip_route_lookup(dst, &r) < 0 || r.dev->mtu <= IP_HLEN + TCP_HLEN + 64) {
+        return TCP_DEFAULT_MSS;
+    }
+    uint32_t mss = r.dev->mtu - IP_HLEN - TCP_HLEN;
+    return (uint16_t)min_u32(mss, 65535 - IP_HLEN - TCP_HLEN);
+}
+
+static uint32_t tcp_new_isn(void) {
+    uint64_t t = rdtsc();
+    return (uint32_t)t * 2654435761u + (uint32_t)(t >> 32);
+}
+
+/* ------------------------------------------------------------------ */
+/* Connection tables                                                    */
+/* ------------------------------------------------------------------ */
+
+static uint32_t tcp_ehashfn(in_addr_t laddr, uint16_t lport, in_addr_t raddr,
+                            uint16_t rport) {
+    uint32_t h = raddr ^ (laddr >> 5) ^ (((uint32_t)rport << 16) | lport);
+    return (h * 2654435761u) >> (32 - 8);
+}
+
+static uint32_t tcp_lhashfn(uint16_t port) {
+    return ((uint32_t)port * 2654435761u) >> (32 - 5);
+}
+
+static tcp_sock_t *tcp_lookup_established(in_addr_t laddr, uint16_t lport,
+                                          in_addr_t raddr, uint16_t rport) {
+    tcp_sock_t *tp = tcp_ehash[tcp_ehashfn(laddr, lport, raddr, rport)];
+    for (; tp; tp = tp->hash_next) {
+        if (tp->lport == lport && tp->rport == rport &&
+            tp->laddr == laddr && tp->raddr == raddr) {
+            return tp;
+        }
+    }
+    return NULL;
+}
+
+static tcp_sock_t *tcp_lookup_listener_exact(in_addr_t addr, uint16_t port) {
+    for (tcp_sock_t *tp = tcp_lhash[tcp_lhashfn(port)]; tp; tp = tp->hash_next) {
+        if (tp->lport == port && tp->laddr == addr) return tp;
+    }
+    return NULL;
+}
+
+/* The specific binding first, then the wildcard one */
+static tcp_sock_t *tcp_lookup_listener(in_addr_t addr, uint16_t port) {
+    tcp_sock_t *tp = tcp_lookup_listener_exact(addr, port);
+    return tp ? tp : tcp_lookup_listener_exact(INADDR_ANY, port);
+}
+
+static void tcp_hash(tcp_sock_t *tp) {
+    tcp_sock_t **bucket = (tp->state == TCP_LISTEN)
+        ? &tcp_lhash[tcp_lhashfn(tp->lport)]
+        : &tcp_ehash[tcp_ehashfn(tp->laddr, tp->lport, tp->raddr, tp->rport)];
+    tp->hash_next = *bucket;
+    *bucket = tp;
+}
+
+static void tcp_unhash_from(tcp_sock_t **link, tcp_sock_t *tp) {
+    while (*link && *link != tp) link = &(*link)->hash_next;
+    if (*link) *link = tp->hash_next;
+}
+
+/* A connection is in one table or neither; look in both */
+static void tcp_unhash(tcp_sock_t *tp) {
+    tcp_unhash_from(&tcp_lhash[tcp_lhashfn(tp->lport)], tp);
+    tcp_unhash_from(&tcp_ehash[tcp_ehashfn(tp->laddr, tp->lport, tp->raddr,
+                                           tp->rport)], tp);
+    tp->hash_next = NULL;
+}
+
+/* A free local port for a connection to raddr:rport */
+static uint16_t tcp_pick_port(in_addr_t laddr, in_addr_t raddr, uint16_t rport) {
+    uint32_t range = TCP_EPHEMERAL_MAX - TCP_EPHEMERAL_MIN + 1;
+    for (uint32_t tries = 0; tries < range; tries++) {
+        uint16_t port = next_ephemeral;
+        next_ephemeral = (port == TCP_EPHEMERAL_MAX) ? TCP_EPHEMERAL_MIN : port + 1;
+        if (!tcp_lookup_established(laddr, port, raddr, rport) &&
+            !tcp_lookup_listener_exact(laddr, port) &&
+            !tcp_lookup_listener_exact(INADDR_ANY, port)) {
+            return port;
+        }
+    }
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* Connection lifetime                                                  */
+/* ------------------------------------------------------------------ */
+
+static void tcp_rto_fire(void *data);
+static void tcp_delack_fire(void *data);
+static void tcp_probe_fire(void *data);
+static void tcp_linger_fire(void *data);
+
+static tcp_sock_t *tcp_sock_alloc(void) {
+    tcp_sock_t *tp = (tcp_sock_t *)slab_alloc(tcp_slab);
+    if (!tp) return NULL;
+
+    memset(tp, 0, sizeof(*tp));
+    tp->state     = TCP_CLOSED;
+    tp->mss       = TCP_DEFAULT_MSS;
+    tp->csum_copy = 1;
+    tp->rto       = TCP_RTO_INIT;
+    tp->ssthresh  = 0xFFFFFFFFu;
+    while ((TCP_RCVBUF >> tp->rcv_wscale) > 65535) tp->rcv_wscale++;
+    skb_queue_init(&tp->write_queue);
+    skb_queue_init(&tp->rcv_queue);
+    skb_queue_init(&tp->ooo_queue);
+    wheel_timer_init(&tp->rto_timer, tcp_rto_fire, tp);
+    wheel_timer_init(&tp->delack_timer, tcp_delack_fire, tp);
+    wheel_timer_init(&tp->probe_timer, tcp_probe_fire, tp);
+    wheel_timer_init(&tp->linger_timer, tcp_linger_fire, tp);
+    return tp;
+}
+
+static void tcp_clear_timers(tcp_sock_t *tp) {
+    net_timer_del(&tp->rto_timer);
+    net_timer_del(&tp->delack_timer);
+    net_timer_del(&tp->probe_timer);
+    net_timer_del(&tp->linger_timer);
+}
+
+static void tcp_destroy(tcp_sock_t *tp) {
+    tcp_clear_timers(tp);
+    tcp_unhash(tp);
+    if (tp->parent) tp->parent->syn_children--;
+    skb_queue_purge(&tp->write_queue);
+    skb_queue_purge(&tp->rcv_queue);
+    skb_queue_purge(&tp->ooo_queue);
+    slab_free(tcp_slab, tp);
+}
+
+/* The connection is over. Frees an orphan; one with a socket stays
+ * until tcp_release() so the user can still read what arrived. */
+static void tcp_done(tcp_sock_t *tp) {
+    tp->state = TCP_CLOSED;
+    tcp_clear_timers(tp);
+    tcp_unhash(tp);
+    skb_queue_purge(&tp->write_queue);
+    tp->wq_bytes  = 0;
+    tp->send_head = NULL;
+
+    if (!tp->sk) {
+        tcp_destroy(tp);
+        return;
+    }
+    tcp_wake_readers(tp);
+    tcp_wake_writers(tp);
+}
+
+static void tcp_abort(tcp_sock_t *tp, int error) {
+    if (tp->state == TCP_ESTABLISHED || tp->state == TCP_CLOSE_WAIT) {
+        tcp_stats.estab_resets++;
+    }
+    tp->error = error;
+    tcp_done(tp);
+}
+
+static void tcp_time_wait(tcp_sock_t *tp) {
+    tp->state = TCP_TIME_WAIT;
+    net_timer_del(&tp->rto_timer);
+    net_timer_del(&tp->probe_timer);
+    skb_queue_purge(&tp->write_queue);
+    tp->wq_bytes  = 0;
+    tp->send_head = NULL;
+    net_timer_mod(&tp->linger_timer, TCP_TIMEWAIT_TICKS);
+}
+
+/* ------------------------------------------------------------------ */
+/* Output                                                               */
+/* ------------------------------------------------------------------ */
+
+static uint32_t tcp_rcv_space(const tcp_sock_t *tp) {
+    return (tp->rcv_bytes < TCP_RCVBUF) ? TCP_RCVBUF - tp->rcv_bytes : 0;
+}
+
+/* Window field for an outgoing segment. Never moves the right edge back,
+ * and does not open the window by less than a segment (receiver-side
+ * silly window avoidance). */
+static uint16_t tcp_select_window(tcp_sock_t *tp) {
+    uint32_t space = tcp_rcv_space(tp);
+    uint32_t cur   = seq_lt(tp->rcv_nxt, tp->rcv_adv) ? tp->rcv_adv - tp->rcv_nxt : 0;
+    uint32_t unit  = 1u << tp->rcv_wscale;
+
+    if (space < cur + tp->mss && space < TCP_RCVBUF / 2) space = cur;
+    uint32_t win = max_u32(space >> tp->rcv_wscale, (cur + unit - 1) >> tp->rcv_wscale);
+    if (win > 65535) win = 65535;
+
+    tp->rcv_adv = tp->rcv_nxt + (win << tp->rcv_wscale);
+    return (uint16_t)win;
+}
+
+/* SACK blocks for the out-of-order queue: contiguous runs of it, the
+ * one holding the latest arrival first (RFC 2018). Returns the count. */
+static int tcp_sack_blocks(const tcp_sock_t *tp, uint32_t blocks[][2], int max) {
+    uint32_t runs[TCP_MAX_SACK * 2][2];
+    int n = 0, first = -1;
+
+    for (sk_buff_t *skb = tp->ooo_queue.head; skb; skb = skb->next) {
+        uint32_t start = RCV_SEQ(skb), end = start + RCV_LEN(skb);
+        if (n > 0 && runs[n - 1][1] == start) {
+            runs[n - 1][1] = end;
+        } else if (n < TCP_MAX_SACK * 2) {
+            runs[n][0] = start;
+            runs[n][1] = end;
+            n++;
+        } else {
+            break;
+        }
+        if (start == tp->last_ooo_seq) first = n - 1;
+    }
+
+    int out = 0;
+    if (first >= 0 && out < max) {
+        blocks[out][0] = runs[first][0];
+        blocks[out][1] = runs[first][1];
+        out++;
+    }
+    for (int i = 0; i < n && out < max; i++) {
+        if (i == first) continue;
+        blocks[out][0] = runs[i][0];
+        blocks[out][1] = runs[i][1];
+        out++;
+    }
+    return out;
+}
+
+/* Options for a segment with `flags` and `len` payload bytes; returns
+ * their length (a multiple of 4). */
+static uint32_t tcp_build_options(tcp_sock_t *tp, uint8_t flags, uint32_t len,
+                                  uint8_t *p) {
+    uint32_t n = 0;
+
+    if (flags & TCP_SYN) {
+        uint16_t mss = tcp_route_mss(tp->raddr);
+        p[n++] = 2;  p[n++] = 4;
+        p[n++] = (uint8_t)(mss >> 8);
+        p[n++] = (uint8_t)mss;
+        if (tp->state == TCP_SYN_SENT || tp->snd_wscale || tp->rcv_wscale) {
+            p[n++] = 1;  p[n++] = 3;  p[n++] = 3;  p[n++] = tp->rcv_wscale;
+        }
+        if (tp->state == TCP_SYN_SENT || tp->sack_ok) {
+            p[n++] = 1;  p[n++] = 1;  p[n++] = 4;  p[n++] = 2;
+        }
+        return n;
+    }
+
+    if (tp->sack_ok && tp->ooo_queue.head) {
+        /* Keep data segments within the MSS the peer allows */
+        uint32_t room = (tp->mss > len + 4) ? (tp->mss - len - 4) / 8 : 0;
+        uint32_t blocks[TCP_MAX_SACK][2];
+        int count = tcp_sack_blocks(tp, blocks, (int)min_u32(room, TCP_MAX_SACK));
+        if (count > 0) {
+            p[n++] = 1;  p[n++] = 1;  p[n++] = 5;
+            p[n++] = (uint8_t)(2 + 8 * count);
+            for (int i = 0; i < count; i++) {
+                put_be32(p + n, blocks[i][0]);
+                put_be32(p + n + 4, blocks[i][1]);
+                n += 8;
+            }
+        }
+    }
+    return n;
+}
+
+static void tcp_fill_header(tcp_header_t *th, uint16_t sport, uint16_t dport,
+                            uint32_t seq, uint32_t ack, uint8_t flags,
+                            uint32_t hlen, uint16_t window) {
+    th->src_port = htons(sport);
+    th->dst_port = htons(dport);
+    th->seq_num  = htonl(seq);
+    th->ack_num  = htonl(ack);
+    th->flags    = htons((uint16_t)(((hlen / 4) << 12) | flags));
+    th->window   = htons(window);
+    th->checksum = 0;
+    th->urgent   = 0;
+}
+
+/* Attach `len` bytes of a write queue entry, from `off`, as fragments
+ * (references on its buffers, no copy). */
+static int tcp_attach_payload(sk_buff_t *skb, const sk_buff_t *seg, uint32_t off,
+                              uint32_t len) {
+    uint32_t headlen = skb_headlen(seg);
+    if (off < headlen) {
+        uint32_t chunk = min_u32(headlen - off, len);
+        skb_buf_get(seg->head);
+        if (skb_add_frag(skb, seg->head, (uint32_t)(seg->data - seg->head) + off,
+                         chunk) < 0) {
+            skb_buf_put(seg->head);
+            return -1;
+        }
+        len -= chunk;
+        off = 0;
+    } else {
+        off -= headlen;
+    }
+
+    for (uint32_t i = 0; i < seg->nr_frags && len; i++) {
+        const skb_frag_t *f = &seg->frags[i];
+        if (off >= f->size) {
+            off -= f->size;
+            continue;
+        }
+        uint32_t chunk = min_u32(f->size - off, len);
+        if (skb_add_frag_ref(skb, f, off, chunk) < 0) return -1;
+        len -= chunk;
+        off = 0;
+    }
+    return 0;
+}
+
+/* Build and send one segment; with `seg`, its unacked payload rides
+ * along. Any segment carrying an ACK settles a delayed one. */
+static int tcp_transmit(tcp_sock_t *tp, uint32_t seq, uint8_t flags,
+                        const sk_buff_t *seg) {
+    uint32_t len = seg ? wq_len(seg) : 0;
+    sk_buff_t *skb = skb_alloc();
+    if (!skb) return -1;
+    if (len && tcp_attach_payload(skb, seg, seg->cb[2], len) < 0) {
+        skb_free(skb);
+        return -1;
+    }
+
+    uint8_t opts[TCP_MAX_HLEN - TCP_HLEN];
+    uint32_t hlen = TCP_HLEN + tcp_build_options(tp, flags, len, opts);
+
+    uint16_t window;
+    if (flags & TCP_SYN) {
+        window = (uint16_t)min_u32(tcp_rcv_space(tp), 65535);
+        tp->rcv_adv = tp->rcv_nxt + window;
+    } else {
+        window = tcp_select_window(tp);
+    }
+
+    tcp_header_t *th = (tcp_header_t *)skb_push(skb, hlen);
+    tcp_fill_header(th, tp->lport, tp->rport, seq,
+                    (flags & TCP_ACK) ? tp->rcv_nxt : 0, flags, hlen, window);
+    memcpy(th + 1, opts, hlen - TCP_HLEN);
+
+    /* A whole entry's payload was summed when it was queued, so only
+     * the header is left to read; otherwise ip_output() finishes it */
+    uint32_t total = hlen + len;
+    uint32_t pseudo = ip_pseudo_csum(tp->laddr, tp->raddr, PROTO_TCP, total);
+    if (tp->csum_copy && (!len || seg->cb[2] == 0)) {
+        uint32_t sum = net_csum_partial(th, hlen, pseudo);
+        if (len) sum = net_csum_block_add(sum, seg->cb[3], hlen);
+        th->checksum = net_csum_fold(sum);
+    } else {
+        skb_csum_partial_set(skb, offsetof(tcp_header_t, checksum), pseudo);
+    }
+
+    if (flags & TCP_ACK) {
+        tp->ack_pending  = 0;
+        tp->segs_unacked = 0;
+        net_timer_del(&tp->delack_timer);
+    }
+    if (flags & TCP_RST) tcp_stats.out_rsts++;
+    tcp_stats.out_segs++;
+    return ip_output(skb, tp->raddr, PROTO_TCP);
+}
+
+static void tcp_send_ack(tcp_sock_t *tp) {
+    if (tp->state == TCP_SYN_RECV) {
+        tcp_transmit(tp, tp->iss, TCP_SYN | TCP_ACK, NULL);
+    } else {
+        tcp_transmit(tp, tp->snd_nxt, TCP_ACK, NULL);
+    }
+}
+
+static void tcp_send_syn(tcp_sock_t *tp) {
+    uint8_t flags = TCP_SYN | ((tp->state == TCP_SYN_RECV) ? TCP_ACK : 0);
+    if (tp->retries == 0) {
+        tp->rtt_timing = 1;
+        tp->rtt_seq    = tp->iss + 1;
+        tp->rtt_start  = timer_get_ticks();
+    } else {
+        tp->rtt_timing = 0;
+    }
+    tcp_transmit(tp, tp->iss, flags, NULL);
+}
+
+/* Reset for a segment that matches no connection (RFC 793 p. 36) */
+static void tcp_send_reset(const tcp_seg_t *seg) {
+    if (seg->flags & TCP_RST) return;
+
+    uint32_t seq = 0, ack = 0;
+    uint8_t flags = TCP_RST;
+    if (seg->flags & TCP_ACK) {
+        seq = seg->ack;
+    } else {
+        flags |= TCP_ACK;
+        ack = seg->seq + seg->len + ((seg->flags & TCP_SYN) ? 1 : 0) +
+              ((seg->flags & TCP_FIN) ? 1 : 0);
+    }
+
+    sk_buff_t *skb = skb_alloc();
+    if (!skb) return;
+    tcp_header_t *th = (tcp_header_t *)skb_push(skb, TCP_HLEN);
+    tcp_fill_header(th, seg->dport, seg->sport, seq, ack, flags, TCP_HLEN, 0);
+    skb_csum_partial_set(skb, offsetof(tcp_header_t, checksum),
+                         ip_pseudo_csum(seg->daddr, seg->saddr, PROTO_TCP, TCP_HLEN));
+    tcp_stats.out_rsts++;
+    tcp_stats.out_segs++;
+    ip_output(skb, seg->saddr, PROTO_TCP);
+}
+
+static void tcp_arm_rto(tcp_sock_t *tp) {
+    net_timer_mod(&tp->rto_timer, tp->rto);
+}
+
+static void tcp_arm_probe(tcp_sock_t *tp) {
+    if (wheel_timer_pending(&tp->probe_timer)) return;
+    uint32_t when = tp->rto << min_u32(tp->probe_backoff, 8);
+    net_timer_mod(&tp->probe_timer, min_u32(when, TCP_RTO_MAX));
+}
+
+/* Send queued data as far as the peer's window, the congestion window
+ * and Nagle allow. Entries before snd_max are a go-back-N resend after
+ * a timeout. */
+static void tcp_push(tcp_sock_t *tp) {
+    sk_buff_t *skb;
+    while ((skb = tp->send_head) != NULL) {
+        uint32_t seq    = skb->cb[0];
+        uint32_t len    = wq_len(skb);
+        uint32_t end    = wq_end(skb);
+        uint32_t flight = tp->snd_nxt - tp->snd_una;
+        int      last   = (skb->next == NULL);
+
+        if (len && seq_lt(tp->snd_una + tp->snd_wnd, seq + len)) {
+            if (flight == 0) tcp_arm_probe(tp);
+            break;
+        }
+        if (flight && flight + len > tp->cwnd) break;
+        if (!tp->nodelay && flight && last && len < tp->mss &&
+            !(skb->cb[1] & TCPCB_FIN)) {
+            break;                          /* Nagle */
+        }
+
+        uint8_t flags = TCP_ACK;
+        if (skb->cb[1] & TCPCB_FIN) flags |= TCP_FIN;
+        if (last && len) flags |= TCP_PSH;
+        tcp_transmit(tp, seq, flags, skb);
+
+        if (seq_lt(seq, tp->snd_max)) {
+            skb->cb[1] |= TCPCB_RETRANS;
+            tcp_stats.retrans_segs++;
+            tp->retrans++;
+        } else if (!tp->rtt_timing) {
+            tp->rtt_timing    = 1;
+            tp->rtt_seq       = end;
+            tp->rtt_start     = timer_get_ticks();
+            tp->rtt_start_tsc = rdtsc();
+        }
+        tp->snd_nxt = end;
+        if (seq_lt(tp->snd_max, end)) tp->snd_max = end;
+        tp->send_head = skb->next;
+        if (!wheel_timer_pending(&tp->rto_timer)) tcp_arm_rto(tp);
+    }
+}
+
+static void tcp_retransmit(tcp_sock_t *tp, sk_buff_t *skb) {
+    uint8_t flags = TCP_ACK;
+    if (skb->cb[1] & TCPCB_FIN) flags |= TCP_FIN;
+    tcp_transmit(tp, skb->cb[0], flags, skb);
+    skb->cb[1] |= TCPCB_RETRANS;
+    tp->rtt_timing = 0;                 /* Karn */
+    tcp_stats.retrans_segs++;
+    tp->retrans++;
+}
+
+/* First sent entry the peer lacks while holding later data (a hole
+ * SACK has revealed) that has not been retransmitted yet */
+static sk_buff_t *tcp_next_hole(tcp_sock_t *tp) {
+    for (sk_buff_t *skb = tp->write_queue.head; skb && skb != tp->send_head;
+         skb = skb->next) {
+        if (!seq_lt(skb->cb[0], tp->high_sack)) break;
+        if (!(skb->cb[1] & (TCPCB_SACKED | TCPCB_RETRANS))) return skb;
+    }
+    return NULL;
+}
+
+/* Queue user data: into the unsent tail entry while it is short of a
+ * segment, then into new entries of one MSS each. Returns bytes taken. */
+static int tcp_copy_in(tcp_sock_t *tp, sk_buff_t *skb, const uint8_t *p,
+                       uint32_t n) {
+    return tp->csum_copy ? skb_append_data_csum(skb, p, n, &skb->cb[3])
+                         : skb_append_data(skb, p, n);
+}
+
+static uint32_t tcp_queue_data(tcp_sock_t *tp, const uint8_t *p, uint32_t n) {
+    uint32_t done = 0;
+    while (done < n) {
+        sk_buff_t *tail = tp->write_queue.tail;
+        if (tail && tp->send_head && tail->len < tp->mss) {
+            uint32_t chunk = min_u32(n - done, tp->mss - tail->len);
+            if (tcp_copy_in(tp, tail, p + done, chunk) == 0) {
+                done += chunk;
+                continue;
+            }
+        }
+
+        sk_buff_t *skb = skb_alloc();
+        if (!skb) break;
+        uint32_t chunk = min_u32(n - done, tp->mss);
+        skb->cb[3] = 0;
+        if (tcp_copy_in(tp, skb, p + done, chunk) < 0) {
+            skb_free(skb);
+            break;
+        }
+        skb->cb[0] = tp->write_seq + done;
+        skb->cb[1] = 0;
+        skb->cb[2] = 0;
+        skb_queue_tail(&tp->write_queue, skb);
+        if (!tp->send_head) tp->send_head = skb;
+        done += chunk;
+    }
+    tp->write_seq += done;
+    tp->wq_bytes  += done;
+    return done;
+}
+
+/* Queue `n` bytes of lent memory, from `off`, as fragments referencing
+ * it; entries are filled to one MSS as tcp_queue_data() does. With
+ * csum_copy the bytes are summed, as they would be copied. Returns
+ * bytes taken. */
+static uint32_t tcp_queue_ext(tcp_sock_t *tp, skb_ext_t *ext, uint32_t off,
+                              uint32_t n) {
+    uint32_t done = 0;
+    while (done < n) {
+        sk_buff_t *skb = tp->write_queue.tail;
+        int fresh = !skb || !tp->send_head || skb->len >= tp->mss ||
+                    skb->nr_frags >= SKB_MAX_FRAGS;
+        if (fresh) {
+            skb = skb_alloc();
+            if (!skb) break;
+            skb->cb[3] = 0;
+        }
+
+        uint32_t chunk = min_u32(n - done, tp->mss - skb->len);
+        uint32_t pos = skb->len;
+        if (skb_add_frag_ext(skb, ext, off + done, chunk) < 0) {
+            if (fresh) skb_free(skb);
+            break;
+        }
+        if (tp->csum_copy) {
+            skb->cb[3] = net_csum_block_add(skb->cb[3],
+                net_csum_partial(ext->data + off + done, chunk, 0), pos);
+        }
+        if (fresh) {
+            skb->cb[0] = tp->write_seq + done;
+            skb->cb[1] = 0;
+            skb->cb[2] = 0;
+            skb_queue_tail(&tp->write_queue, skb);
+            if (!tp->send_head) tp->send_head = skb;
+        }
+        done += chunk;
+    }
+    tp->write_seq += done;
+    tp->wq_bytes  += done;
+    return done;
+}
+
+static int tcp_queue_fin(tcp_sock_t *tp) {
+    sk_buff_t *skb = skb_alloc();
+    if (!skb) return -1;
+    skb->cb[0] = tp->write_seq++;
+    skb->cb[1] = TCPCB_FIN;
+    skb->cb[2] = 0;
+    skb_queue_tail(&tp->write_queue, skb);
+    if (!tp->send_head) tp->send_head = skb;
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* Timers                                                               */
+/* ------------------------------------------------------------------ */
+
+static uint32_t tcp_calc_rto(const tcp_sock_t *tp) {
+    uint32_t rto = (tp->srtt8 >> 3) + max_u32(tp->rttvar4, 1);
+    return min_u32(max_u32(rto, TCP_RTO_MIN), TCP_RTO_MAX);
+}
+
+/* RFC 6298, in ticks; a sub-tick round trip counts as one */
+static void tcp_rtt_sample(tcp_sock_t *tp, uint32_t m) {
+    if (m == 0) m = 1;
+    if (tp->srtt8 == 0) {
+        tp->srtt8   = m << 3;
+        tp->rttvar4 = m << 1;
+    } else {
+        int32_t delta = (int32_t)m - (int32_t)(tp->srtt8 >> 3);
+        tp->srtt8 += (uint32_t)delta;
+        if (delta < 0) delta = -delta;
+        tp->rttvar4 += (uint32_t)delta - (tp->rttvar4 >> 2);
+    }
+    tp->rto = tcp_calc_rto(tp);
+}
+
+/* The same estimator on TSC cycles, kept for netstat */
+static void tcp_rtt_sample_tsc(tcp_sock_t *tp, uint64_t cycles) {
+    uint32_t m = cycles > 0x7FFFFFFFu ? 0x7FFFFFFFu : (uint32_t)cycles;
+    if (tp->srtt_cycles == 0) {
+        tp->srtt_cycles   = m;
+        tp->rttvar_cycles = m / 2;
+    } else {
+        int32_t delta = (int32_t)(m - tp->srtt_cycles);
+        tp->srtt_cycles += delta / 8;
+        if (delta < 0) delta = -delta;
+        tp->rttvar_cycles += (delta - (int32_t)tp->rttvar_cycles) / 4;
+    }
+}
+
+static void tcp_rto_fire(void *data) {
+    tcp_sock_t *tp = (tcp_sock_t *)data;
+
+    if (tp->state == TCP_SYN_SENT || tp->state == TCP_SYN_RECV) {
+        if (++tp->retries > TCP_SYN_RETRIES) {
+            tcp_stats.attempt_fails++;
+            tcp_abort(tp, TCP_ERR_TIMEOUT);
+            return;
+        }
+        tp->rto = min_u32(tp->rto * 2, TCP_RTO_MAX);
+        tcp_send_syn(tp);
+        tcp_arm_rto(tp);
+        return;
+    }
+    if (tp->snd_una == tp->snd_max) return;
+    if (++tp->retries > TCP_MAX_RETRIES) {
+        tcp_abort(tp, TCP_ERR_TIMEOUT);
+        return;
+    }
+    tcp_stats.rto_timeouts++;
+
+    /* Back to one segment and resend everything outstanding */
+    tp->ssthresh    = max_u32((tp->snd_max - tp->snd_una) / 2, 2u * tp->mss);
+    tp->cwnd        = tp->mss;
+    tp->cwnd_acked  = 0;
+    tp->dupacks     = 0;
+    tp->in_recovery = 0;
+    tp->high_sack   = tp->snd_una;
+    tp->rtt_timing  = 0;
+    tp->rto         = min_u32(tp->rto * 2, TCP_RTO_MAX);
+    for (sk_buff_t *skb = tp->write_queue.head; skb; skb = skb->next) {
+        skb->cb[1] &= ~(TCPCB_SACKED | TCPCB_RETRANS);
+    }
+    tp->snd_nxt   = tp->snd_una;
+    tp->send_head = tp->write_queue.head;
+    tcp_push(tp);
+    tcp_arm_rto(tp);
+}
+
+static void tcp_delack_fire(void *data) {
+    tcp_sock_t *tp = (tcp_sock_t *)data;
+    if (tp->ack_pending && tp->state != TCP_CLOSED) {
+        tcp_stats.delayed_acks++;
+        tcp_send_ack(tp);
+    }
+}
+
+/* Zero-window probe: an old sequence number makes the peer answer with
+ * an ACK carrying its current window */
+static void tcp_probe_fire(void *data) {
+    tcp_sock_t *tp = (tcp_sock_t *)data;
+    sk_buff_t *skb = tp->send_head;
+    if (!skb || tp->snd_nxt != tp->snd_una) {
+        tp->probe_backoff = 0;
+        return;
+    }
+    if (seq_leq(skb->cb[0] + wq_len(skb), tp->snd_una + tp->snd_wnd)) {
+        tp->probe_backoff = 0;
+        tcp_push(tp);
+        return;
+    }
+    tcp_stats.window_probes++;
+    tcp_transmit(tp, tp->snd_una - 1, TCP_ACK, NULL);
+    tp->probe_backoff++;
+    tcp_arm_probe(tp);
+}
+
+static void tcp_linger_fire(void *data) {
+    tcp_done((tcp_sock_t *)data);
+}
+
+/* ------------------------------------------------------------------ */
+/* Input                                                                */
+/* ------------------------------------------------------------------ */
+
+static void tcp_parse_options(const uint8_t *p, uint32_t len, tcp_opts_t *o) {
+    memset(o, 0, sizeof(*o));
+    uint32_t i = 0;
+    while (i < len) {
+        uint8_t kind = p[i];
+        if (kind == 0) break;
+        if (kind == 1) {
+            i++;
+            continue;
+        }
+        if (i + 1 >= len) break;
+        uint8_t olen = p[i + 1];
+        if (olen < 2 || i + olen > len) break;
+
+        switch (kind) {
+        case 2:
+            if (olen == 4) o->mss = (uint16_t)((p[i + 2] << 8) | p[i + 3]);
+            break;
+        case 3:
+            if (olen == 3) {
+                o->has_wscale = 1;
+                o->wscale = (p[i + 2] > 14) ? 14 : p[i + 2];
+            }
+            break;
+        case 4:
+            if (olen == 2) o->sack_ok = 1;
+            break;
+        case 5:
+            for (uint32_t b = i + 2; b + 8 <= i + olen && o->nsack < TCP_MAX_SACK; b += 8) {
+                o->sack[o->nsack][0] = get_be32(p + b);
+                o->sack[o->nsack][1] = get_be32(p + b + 4);
+                o->nsack++;
+            }
+            break;
+        }
+        i += olen;
+    }
+}
+
+/* Settle MSS, window scaling and SACK from the peer's SYN */
+static void tcp_syn_options(tcp_sock_t *tp, const tcp_opts_t *o) {
+    uint32_t peer = o->mss ? o->mss : TCP_DEFAULT_MSS;
+    tp->mss = (uint16_t)min_u32(peer, tcp_route_mss(tp->raddr));
+
+    in_addr_t src;
+    net_device_t *dev;
+    if (ip_route_source(tp->raddr, &src, &dev) == 0) {
+        tp->csum_copy = !(dev->flags & NETDEV_NO_CSUM);
+    }
+    if (o->has_wscale) {
+        tp->snd_wscale = o->wscale;
+    } else {
+        tp->snd_wscale = 0;
+        tp->rcv_wscale = 0;
+    }
+    tp->sack_ok = o->sack_ok;
+}
+
+static void tcp_init_cwnd(tcp_sock_t *tp) {
+    tp->cwnd = 10u * tp->mss;           /* RFC 6928 */
+    tp->high_sack = tp->snd_una;
+}
+
+/* Drop acknowledged entries off the write queue, trimming a partly
+ * acknowledged one. */
+static void tcp_clean_acked(tcp_sock_t *tp, uint32_t ack) {
+    sk_buff_t *skb;
+    while ((skb = tp->write_queue.head) != NULL) {
+        if (seq_leq(wq_end(skb), ack)) {
+            if (skb == tp->send_head) tp->send_head = skb->next;
+            tp->wq_bytes -= wq_len(skb);
+            skb_dequeue(&tp->write_queue);
+            skb_free(skb);
+            continue;
+        }
+        if (seq_lt(skb->cb[0], ack)) {
+            uint32_t n = ack - skb->cb[0];
+            skb->cb[0]  = ack;
+            skb->cb[2] += n;
+            tp->wq_bytes -= n;
+        }
+        break;
+    }
+}
+
+static void tcp_sack_update(tcp_sock_t *tp, const tcp_opts_t *o) {
+    for (int i = 0; i < o->nsack; i++) {
+        uint32_t left = o->sack[i][0], right = o->sack[i][1];
+        if (!seq_lt(left, right) || seq_lt(tp->snd_max, right) ||
+            !seq_lt(tp->snd_una, right)) {
+            continue;
+        }
+        if (seq_lt(tp->high_sack, right)) tp->high_sack = right;
+        for (sk_buff_t *skb = tp->write_queue.head; skb && skb != tp->send_head;
+             skb = skb->next) {
+            uint32_t len = wq_len(skb);
+            if (len && seq_leq(left, skb->cb[0]) && seq_leq(skb->cb[0] + len, right)) {
+                skb->cb[1] |= TCPCB_SACKED;
+            }
+        }
+    }
+}
+
+/* An ACK advancing snd_una: RTT, congestion window, NewReno recovery */
+static void tcp_ack_new(tcp_sock_t *tp, uint32_t ack) {
+    uint32_t acked = ack - tp->snd_una;
+
+    if (tp->rtt_timing && seq_leq(tp->rtt_seq, ack)) {
+        tcp_rtt_sample(tp, (uint32_t)(timer_get_ticks() - tp->rtt_start));
+        tcp_rtt_sample_tsc(tp, rdtsc() - tp->rtt_start_tsc);
+        tp->rtt_timing = 0;
+    } else if (tp->srtt8) {
+        tp->rto = tcp_calc_rto(tp);     /* Undo timeout backoff */
+    }
+
+    tcp_clean_acked(tp, ack);
+    tp->snd_una = ack;
+    if (seq_lt(tp->snd_nxt, ack)) tp->snd_nxt = ack;
+    tp->retries = 0;
+
+    if (tp->in_recovery) {
+        if (seq_leq(tp->recover, ack)) {
+            /* Full ACK: leave recovery with the halved window */
+            uint32_t flight = tp->snd_max - tp->snd_una;
+            tp->cwnd = min_u32(tp->ssthresh, flight + tp->mss);
+            tp->in_recovery = 0;
+            tp->dupacks = 0;
+        } else {
+            /* Partial ACK: the next hole is at snd_una */
+            sk_buff_t *head = tp->write_queue.head;
+            if (head && head != tp->send_head && !(head->cb[1] & TCPCB_SACKED)) {
+                tcp_retransmit(tp, head);
+            }
+            tp->cwnd = (tp->cwnd > acked) ? tp->cwnd - acked : 0;
+            tp->cwnd += tp->mss;
+            tcp_arm_rto(tp);
+        }
+    } else {
+        tp->dupacks = 0;
+        if (tp->cwnd < tp->ssthresh) {
+            tp->cwnd += min_u32(acked, tp->mss);
+        } else {
+            tp->cwnd_acked += acked;
+            if (tp->cwnd_acked >= tp->cwnd) {
+                tp->cwnd_acked -= tp->cwnd;
+                tp->cwnd += tp->mss;
+            }
+        }
+        if (tp->cwnd > 4u * TCP_SNDBUF) tp->cwnd = 4u * TCP_SNDBUF;
+    }
+
+    if (tp->snd_una == tp->snd_max) {
+        net_timer_del(&tp->rto_timer);
+    } else if (!tp->in_recovery) {
+        tcp_arm_rto(tp);
+    }
+    if (tp->wq_bytes < TCP_SNDBUF / 2) tcp_wake_writers(tp);
+}
+
+static void tcp_dupack(tcp_sock_t *tp) {
+    tp->dupacks++;
+    if (tp->in_recovery) {
+        tp->cwnd += tp->mss;            /* A segment has left the network */
+        sk_buff_t *hole = tp->sack_ok ? tcp_next_hole(tp) : NULL;
+        if (hole) {
+            tcp_retransmit(tp, hole);
+            tcp_stats.sack_retrans++;
+        }
+        return;
+    }
+    if (tp->dupacks != 3) return;
+
+    /* Fast retransmit of the first segment the peer lacks */
+    sk_buff_t *skb = tp->write_queue.head;
+    while (skb && skb != tp->send_head && (skb->cb[1] & TCPCB_SACKED)) skb = skb->next;
+    if (!skb || skb == tp->send_head) return;
+
+    tp->ssthresh    = max_u32((tp->snd_max - tp->snd_una) / 2, 2u * tp->mss);
+    tp->cwnd        = tp->ssthresh + 3u * tp->mss;
+    tp->recover     = tp->snd_max;
+    tp->in_recovery = 1;
+    tcp_stats.fast_retrans++;
+    tcp_retransmit(tp, skb);
+    tcp_arm_rto(tp);
+}
+
+/* Insert into the out-of-order queue, trimming against what is there */
+static void tcp_ofo_insert(tcp_sock_t *tp, sk_buff_t *skb) {
+    uint32_t seq = RCV_SEQ(skb), end = seq + RCV_LEN(skb);
+    sk_buff_t *prev = NULL, *cur = tp->ooo_queue.head;
+
+    while (cur && seq_leq(RCV_SEQ(cur) + RCV_LEN(cur), seq)) {
+        prev = cur;
+        cur = cur->next;
+    }
+    if (cur && seq_leq(RCV_SEQ(cur), seq)) {
+        uint32_t cur_end = RCV_SEQ(cur) + RCV_LEN(cur);
+        if (seq_leq(end, cur_end)) {
+            skb_free(skb);              /* Already have all of it */
+            return;
+        }
+        uint32_t d = cur_end - seq;
+        RCV_SEQ(skb) += d;
+        RCV_OFF(skb) += d;
+        RCV_LEN(skb) -= d;
+        seq = cur_end;
+        prev = cur;
+        cur = cur->next;
+    }
+    /* Drop entries the new one covers entirely */
+    while (cur && seq_leq(RCV_SEQ(cur) + RCV_LEN(cur), end)) {
+        sk_buff_t *next = cur->next;
+        tp->rcv_bytes -= RCV_LEN(cur);
+        tp->ooo_queue.qlen--;
+        if (prev) prev->next = next;
+        else      tp->ooo_queue.head = next;
+        if (tp->ooo_queue.tail == cur) tp->ooo_queue.tail = prev;
+        skb_free(cur);
+        cur = next;
+    }
+    if (cur && seq_lt(RCV_SEQ(cur), end)) RCV_LEN(skb) = RCV_SEQ(cur) - seq;
+
+    skb->next = cur;
+    if (prev) prev->next = skb;
+    else      tp->ooo_queue.head = skb;
+    if (!cur) tp->ooo_queue.tail = skb;
+    tp->ooo_queue.qlen++;
+    tp->rcv_bytes += RCV_LEN(skb);
+}
+
+/* Move out-of-order data that has become in order. Returns nonzero if
+ * a hole was filled. */
+static int tcp_ofo_drain(tcp_sock_t *tp) {
+    int moved = 0;
+    sk_buff_t *skb;
+    while ((skb = tp->ooo_queue.head) && seq_leq(RCV_SEQ(skb), tp->rcv_nxt)) {
+        skb_dequeue(&tp->ooo_queue);
+        uint32_t end = RCV_SEQ(skb) + RCV_LEN(skb);
+        if (seq_leq(end, tp->rcv_nxt)) {
+            tp->rcv_bytes -= RCV_LEN(skb);
+            skb_free(skb);
+            continue;
+        }
+        uint32_t d = tp->rcv_nxt - RCV_SEQ(skb);
+        RCV_SEQ(skb) += d;
+        RCV_OFF(skb) += d;
+        RCV_LEN(skb) -= d;
+        tp->rcv_bytes -= d;
+        skb_queue_tail(&tp->rcv_queue, skb);
+        tp->rcv_nxt = end;
+        moved = 1;
+    }
+    return moved;
+}
+
+/* Queue a segment's payload (data at the payload). Consumes `skb`.
+ * Returns nonzero if it should be acknowledged at once. */
+static int tcp_data_queue(tcp_sock_t *tp, sk_buff_t *skb, uint32_t seq, uint32_t len) {
+    uint32_t off = 0;
+    if (seq_lt(seq, tp->rcv_nxt)) {
+        off = tp->rcv_nxt - seq;
+        if (off >= len) {
+            skb_free(skb);              /* Duplicate */
+            return 1;
+        }
+        seq = tp->rcv_nxt;
+        len -= off;
+    }
+    if (!seq_lt(seq, tp->rcv_adv)) {
+        skb_free(skb);                  /* Beyond the window */
+        return 1;
+    }
+    if (seq_lt(tp->rcv_adv, seq + len)) len = tp->rcv_adv - seq;
+
+    RCV_SEQ(skb) = seq;
+    RCV_OFF(skb) = off;
+    RCV_LEN(skb) = len;
+    tp->ack_pending = 1;
+
+    if (seq != tp->rcv_nxt) {
+        tcp_stats.ooo_segs++;
+        tp->last_ooo_seq = seq;
+        tcp_ofo_insert(tp, skb);
+        return 1;
+    }
+
+    skb_queue_tail(&tp->rcv_queue, skb);
+    tp->rcv_bytes += len;
+    tp->rcv_nxt   += len;
+    int filled = tp->ooo_queue.head != NULL;
+    tcp_ofo_drain(tp);
+    tcp_wake_readers(tp);
+    if (filled) return 1;
+    return ++tp->segs_unacked >= 2;
+}
+
+/* A child's handshake completed: give it a socket and queue it for
+ * accept(). Returns -1 (and frees it) if there is no one to take it. */
+static int tcp_child_established(tcp_sock_t *tp) {
+    tcp_sock_t *lp = tp->parent;
+    socket_t *sk = (lp && lp->state == TCP_LISTEN) ? net_socket_alloc(PROTO_TCP) : NULL;
+    if (!sk) {
+        tcp_transmit(tp, tp->snd_nxt, TCP_RST | TCP_ACK, NULL);
+        tcp_stats.attempt_fails++;
+        tcp_done(tp);
+        return -1;
+    }
+
+    lp->syn_children--;
+    tp->parent = NULL;
+    tp->sk = sk;
+    sk->tcp = tp;
+    sk->local_addr  = tp->laddr;
+    sk->local_port  = tp->lport;
+    sk->remote_addr = tp->raddr;
+    sk->remote_port = tp->rport;
+
+    tp->accept_next = NULL;
+    if (lp->accept_tail) lp->accept_tail->accept_next = tp;
+    else                 lp->accept_head = tp;
+    lp->accept_tail = tp;
+    lp->accept_len++;
+    tcp_wake_readers(lp);
+    return 0;
+}
+
+static void tcp_listen_input(tcp_sock_t *lp, const tcp_seg_t *seg) {
+    if (seg->flags & TCP_RST) return;
+    if (seg->flags & TCP_ACK) {
+        tcp_send_reset(seg);
+        return;
+    }
+    if (!(seg->flags & TCP_SYN)) return;
+
+    /* Full backlog: drop the SYN and let the peer retry */
+    if ((uint32_t)lp->syn_children + lp->accept_len >= lp->backlog) {
+        tcp_stats.attempt_fails++;
+        return;
+    }
+    tcp_sock_t *tp = tcp_sock_alloc();
+    if (!tp) return;
+
+    tp->parent = lp;
+    lp->syn_children++;
+    tp->laddr = seg->daddr;
+    tp->lport = seg->dport;
+    tp->raddr = seg->saddr;
+    tp->rport = seg->sport;
+    tp->irs     = seg->seq;
+    tp->rcv_nxt = seg->seq + 1;
+    tcp_syn_options(tp, &seg->opts);
+    tp->snd_wnd = seg->wnd;
+    tp->snd_wl1 = seg->seq;
+    tp->iss       = tcp_new_isn();
+    tp->snd_una   = tp->iss;
+    tp->snd_nxt   = tp->iss + 1;
+    tp->snd_max   = tp->iss + 1;
+    tp->write_seq = tp->iss + 1;
+    tp->nodelay   = lp->nodelay;
+    tp->state     = TCP_SYN_RECV;
+    tcp_hash(tp);
+    tcp_stats.passive_opens++;
+
+    tcp_send_syn(tp);
+    tcp_arm_rto(tp);
+}
+
+static void tcp_synsent_input(tcp_sock_t *tp, const tcp_seg_t *seg) {
+    if ((seg->flags & TCP_ACK) &&
+        (seq_leq(seg->ack, tp->iss) || seq_lt(tp->snd_max, seg->ack))) {
+        tcp_send_reset(seg);
+        return;
+    }
+    if (seg->flags & TCP_RST) {
+        if (seg->flags & TCP_ACK) {
+            tcp_stats.attempt_fails++;
+            tp->error = TCP_ERR_REFUSED;
+            tcp_done(tp);
+        }
+        return;
+    }
+    /* No simultaneous open */
+    if ((seg->flags & (TCP_SYN | TCP_ACK)) != (TCP_SYN | TCP_ACK)) return;
+
+    tp->irs     = seg->seq;
+    tp->rcv_nxt = seg->seq + 1;
+    tp->rcv_adv = tp->rcv_nxt;
+    tcp_syn_options(tp, &seg->opts);
+    tp->snd_una = seg->ack;
+    tp->snd_wnd = seg->wnd;
+    tp->snd_wl1 = seg->seq;
+    tp->snd_wl2 = seg->ack;
+    if (tp->rtt_timing) {
+        tcp_rtt_sample(tp, (uint32_t)(timer_get_ticks() - tp->rtt_start));
+        tp->rtt_timing = 0;
+    }
+    tp->retries = 0;
+    tp->state = TCP_ESTABLISHED;
+    tcp_init_cwnd(tp);
+    net_timer_del(&tp->rto_timer);
+
+    tcp_send_ack(tp);
+    tcp_wake_writers(tp);
+    tcp_push(tp);
+}
+
+/* Processing for synchronized states (RFC 793 p. 69 on). Consumes `skb`. */
+static void tcp_input(tcp_sock_t *tp, sk_buff_t *skb, const tcp_seg_t *seg) {
+    uint8_t  flags = seg->flags;
+    uint32_t seq   = seg->seq;
+    uint32_t len   = seg->len;
+
+    /* 1. Acceptable sequence? */
+    uint32_t wnd = seq_lt(tp->rcv_nxt, tp->rcv_adv) ? tp->rcv_adv - tp->rcv_nxt : 0;
+    uint32_t seglen = len + ((flags & TCP_FIN) ? 1 : 0);
+    int ok;
+    if (seglen == 0) {
+        ok = (wnd == 0) ? seq == tp->rcv_nxt
+                        : seq_leq(tp->rcv_nxt, seq) && seq_lt(seq, tp->rcv_nxt + wnd);
+    } else {
+        uint32_t last = seq + seglen - 1;
+        ok = wnd > 0 &&
+             ((seq_leq(tp->rcv_nxt, seq) && seq_lt(seq, tp->rcv_nxt + wnd)) ||
+              (seq_leq(tp->rcv_nxt, last) && seq_lt(last, tp->rcv_nxt + wnd)));
+    }
+    if (!ok) {
+        if (!(flags & TCP_RST)) tcp_send_ack(tp);
+        skb_free(skb);
+        return;
+    }
+
+    /* 2. Reset */
+    if (flags & TCP_RST) {
+        skb_free(skb);
+        if (tp->parent) tcp_done(tp);   /* Passive open never completed */
+        else            tcp_abort(tp, TCP_ERR_RESET);
+        return;
+    }
+
+    /* 3. A SYN in the window is an error */
+    if (flags & TCP_SYN) {
+        skb_free(skb);
+        tcp_transmit(tp, tp->snd_nxt, TCP_RST | TCP_ACK, NULL);
+        tcp_abort(tp, TCP_ERR_RESET);
+        return;
+    }
+
+    /* 4. Acknowledgement */
+    if (!(flags & TCP_ACK)) {
+        skb_free(skb);
+        return;
+    }
+    uint32_t ack = seg->ack;
+    uint32_t nwnd = seg->wnd << tp->snd_wscale;
+
+    if (tp->state == TCP_SYN_RECV) {
+        if (!seq_lt(tp->snd_una, ack) || seq_lt(tp->snd_max, ack)) {
+            skb_free(skb);
+            tcp_send_reset(seg);
+            return;
+        }
+        if (tp->rtt_timing) {
+            tcp_rtt_sample(tp, (uint32_t)(timer_get_ticks() - tp->rtt_start));
+            tp->rtt_timing = 0;
+        }
+        tp->snd_una = ack;
+        tp->snd_wnd = nwnd;
+        tp->snd_wl1 = seq;
+        tp->snd_wl2 = ack;
+        tp->retries = 0;
+        tp->state = TCP_ESTABLISHED;
+        tcp_init_cwnd(tp);
+        net_timer_del(&tp->rto_timer);
+        if (tcp_child_established(tp) < 0) {
+            skb_free(skb);
+            return;
+        }
+    } else if (seq_lt(tp->snd_max, ack)) {
+        skb_free(skb);                  /* Acknowledges data never sent */
+        tcp_send_ack(tp);
+        return;
+    } else {
+        int dup = (ack == tp->snd_una && len == 0 && !(flags & TCP_FIN) &&
+                   nwnd == tp->snd_wnd && tp->snd_una != tp->snd_max);
+
+        if (seq_lt(tp->snd_wl1, seq) ||
+            (tp->snd_wl1 == seq && seq_leq(tp->snd_wl2, ack))) {
+            if (nwnd > tp->snd_wnd) {
+                net_timer_del(&tp->probe_timer);
+                tp->probe_backoff = 0;
+            }
+            tp->snd_wnd = nwnd;
+            tp->snd_wl1 = seq;
+            tp->snd_wl2 = ack;
+        }
+        if (tp->sack_ok && seg->opts.nsack) tcp_sack_update(tp, &seg->opts);
+
+        if (seq_lt(tp->snd_una, ack)) tcp_ack_new(tp, ack);
+        else if (dup)                 tcp_dupack(tp);
+    }
+
+    /* Our FIN acknowledged? It is the last sequence number we use. */
+    if (tp->snd_una == tp->write_seq) {
+        switch (tp->state) {
+        case TCP_FIN_WAIT1:
+            tp->state = TCP_FIN_WAIT2;
+            if (!tp->sk) net_timer_mod(&tp->linger_timer, TCP_FIN_TIMEOUT);
+            break;
+        case TCP_CLOSING:
+            tcp_time_wait(tp);
+            break;
+        case TCP_LAST_ACK:
+            skb_free(skb);
+            tcp_done(tp);
+            return;
+        default:
+            break;
+        }
+    }
+
+    /* 5. Payload */
+    int ack_now = 0;
+    if (len) {
+        if (tp->state == TCP_ESTABLISHED || tp->state == TCP_FIN_WAIT1 ||
+            tp->state == TCP_FIN_WAIT2) {
+            if (!tp->sk) {
+                /* Closed by the user: nobody will read it */
+                skb_free(skb);
+                tcp_transmit(tp, tp->snd_nxt, TCP_RST | TCP_ACK, NULL);
+                tcp_done(tp);
+                return;
+            }
+            ack_now = tcp_data_queue(tp, skb, seq, len);
+            skb = NULL;
+        }
+    }
+
+    /* 6. FIN, once everything before it has arrived */
+    if (flags & TCP_FIN) {
+        ack_now = 1;
+        tp->ack_pending = 1;
+        if (seq + len == tp->rcv_nxt && !tp->peer_fin) {
+            if (tp->state == TCP_ESTABLISHED || tp->state == TCP_FIN_WAIT1 ||
+                tp->state == TCP_FIN_WAIT2) {
+                tp->peer_fin = 1;
+            }
+            switch (tp->state) {
+            case TCP_ESTABLISHED:
+                tp->rcv_nxt++;
+                tp->state = TCP_CLOSE_WAIT;
+                tcp_wake_readers(tp);
+                break;
+            case TCP_FIN_WAIT1:
+                tp->rcv_nxt++;
+                if (tp->snd_una == tp->write_seq) tcp_time_wait(tp);
+                else                              tp->state = TCP_CLOSING;
+                break;
+            case TCP_FIN_WAIT2:
+                tp->rcv_nxt++;
+                tcp_time_wait(tp);
+                break;
+            default:
+                break;
+            }
+        } else if (tp->state == TCP_TIME_WAIT) {
+            net_timer_mod(&tp->linger_timer, TCP_TIMEWAIT_TICKS);
+        }
+    }
+    if (skb) skb_free(skb);
+
+    tcp_push(tp);
+    if (tp->ack_pending) {
+        if (ack_now) tcp_send_ack(tp);
+        else if (!wheel_timer_pending(&tp->delack_timer)) {
+            net_timer_mod(&tp->delack_timer, TCP_DELACK_TICKS);
+        }
+    }
+}
+
+static void tcp_rcv(sk_buff_t *skb, const ip_header_t *iph) {
+    tcp_stats.in_segs++;
+
+    const tcp_header_t *th = (const tcp_header_t *)skb->data;
+    uint32_t len = skb->len;
+    uint32_t hlen = (skb_headlen(skb) >= TCP_HLEN) ? (ntohs(th->flags) >> 12) * 4u : 0;
+    if (hlen < TCP_HLEN || hlen > skb_headlen(skb)) {
+        tcp_stats.in_errs++;
+        skb_free(skb);
+        return;
+    }
+    if (skb->ip_summed != CHECKSUM_UNNECESSARY &&
+        net_csum_fold(skb_csum_partial(skb, 0, len,
+                      ip_pseudo_csum(iph->src_ip, iph->dst_ip, PROTO_TCP, len))) != 0) {
+        tcp_stats.in_errs++;
+        tcp_stats.in_csum_errs++;
+        skb_free(skb);
+        return;
+    }
+
+    tcp_seg_t seg;
+    seg.saddr = iph->src_ip;
+    seg.daddr = iph->dst_ip;
+    seg.sport = ntohs(th->src_port);
+    seg.dport = ntohs(th->dst_port);
+    seg.seq   = ntohl(th->seq_num);
+    seg.ack   = ntohl(th->ack_num);
+    seg.flags = (uint8_t)(ntohs(th->flags) & 0x3F);
+    seg.wnd   = ntohs(th->window);
+    seg.len   = len - hlen;
+    tcp_parse_options((const uint8_t *)(th + 1), hlen - TCP_HLEN, &seg.opts);
+    skb_pull(skb, hlen);
+
+    uint32_t irq = irq_save();
+    tcp_sock_t *tp = tcp_lookup_established(seg.daddr, seg.dport, seg.saddr, seg.sport);
+    if (!tp) tp = tcp_lookup_listener(seg.daddr, seg.dport);
+
+    if (!tp) {
+        skb_free(skb);
+        tcp_send_reset(&seg);
+    } else if (tp->state == TCP_LISTEN) {
+        skb_free(skb);
+        tcp_listen_input(tp, &seg);
+    } else if (tp->state == TCP_SYN_SENT) {
+        skb_free(skb);
+        tcp_synsent_input(tp, &seg);
+    } else {
+        tcp_input(tp, skb, &seg);
+    }
+    irq_restore(irq);
+}
+
+/* ------------------------------------------------------------------ */
+/* Socket interface                                                     */
+/* ------------------------------------------------------------------ */
+
+void tcp_init(void) {
+    tcp_slab = slab_create(sizeof(tcp_sock_t));
+    ip_register_protocol(PROTO_TCP, tcp_rcv);
+}
+
+int tcp_attach(socket_t *sock) {
+    tcp_sock_t *tp = tcp_sock_alloc();
+    if (!tp) return -1;
+    tp->sk = sock;
+    sock->tcp = tp;
+    return 0;
+}
+
+int tcp_listen(socket_t *sock, int backlog) {
+    uint32_t irq = irq_save();
+    tcp_sock_t *tp = sock->tcp;
+    if (!tp || tp->state != TCP_CLOSED || !sock->local_port) {
+        irq_restore(irq);
+        return -1;
+    }
+
+    /* A wildcard listener and a specific one may not share a port */
+    uint16_t port = sock->local_port;
+    in_addr_t addr = sock->local_addr;
+    int taken = tcp_lookup_listener_exact(addr, port) != NULL;
+    if (addr == INADDR_ANY) {
+        for (tcp_sock_t *l = tcp_lhash[tcp_lhashfn(port)]; l; l = l->hash_next) {
+            if (l->lport == port) taken = 1;
+        }
+    } else if (tcp_lookup_listener_exact(INADDR_ANY, port)) {
+        taken = 1;
+    }
+    if (taken) {
+        irq_restore(irq);
+        return -1;
+    }
+
+    if (backlog < 1) backlog = 1;
+    if (backlog > TCP_MAX_BACKLOG) backlog = TCP_MAX_BACKLOG;
+    tp->backlog = (uint16_t)backlog;
+    tp->laddr = addr;
+    tp->lport = port;
+    tp->state = TCP_LISTEN;
+    tcp_hash(tp);
+    irq_restore(irq);
+    return 0;
+}
+
+socket_t *tcp_accept(socket_t *sock, sockaddr_in_t *peer, uint32_t flags) {
+    uint32_t irq = irq_save();
+    tcp_sock_t *lp = sock->tcp;
+    while (lp && lp->state == TCP_LISTEN && !lp->accept_head) {
+        if (!sock->is_open || (flags & MSG_DONTWAIT) || !tcp_can_block()) break;
+        wait_queue_sleep(&sock->rx_wait);
+        lp = sock->tcp;
+    }
+    if (!lp || lp->state != TCP_LISTEN || !lp->accept_head) {
+        irq_restore(irq);
+        return NULL;
+    }
+
+    tcp_sock_t *tp = lp->accept_head;
+    lp->accept_head = tp->accept_next;
+    if (!lp->accept_head) lp->accept_tail = NULL;
+    lp->accept_len--;
+    tp->accept_next = NULL;
+    if (peer) {
+        peer->addr = tp->raddr;
+        peer->port = tp->rport;
+        peer->reserved = 0;
+    }
+    socket_t *child = tp->sk;
+    irq_restore(irq);
+    return child;
+}
+
+int tcp_connect(socket_t *sock, in_addr_t addr, uint16_t port) {
+    in_addr_t src;
+    if (port == 0 || ip_route_source(addr, &src, NULL) < 0) return -1;
+
+    uint32_t irq = irq_save();
+    tcp_sock_t *tp = sock->tcp;
+    if (!tp || tp->state != TCP_CLOSED || tp->error) {
+        irq_restore(irq);
+        return -1;
+    }
+
+    tp->laddr = (sock->local_addr != INADDR_ANY) ? sock->local_addr : src;
+    tp->raddr = addr;
+    tp->rport = port;
+    tp->lport = sock->local_port;
+    if (tp->lport == 0) {
+        tp->lport = tcp_pick_port(tp->laddr, addr, port);
+    } else if (tcp_lookup_established(tp->laddr, tp->lport, addr, port)) {
+        tp->lport = 0;
+    }
+    if (tp->lport == 0) {
+        irq_restore(irq);
+        return -1;
+    }
+    sock->local_addr  = tp->laddr;
+    sock->local_port  = tp->lport;
+    sock->remote_addr = addr;
+    sock->remote_port = port;
+
+    tp->mss       = tcp_route_mss(addr);
+    tp->iss       = tcp_new_isn();
+    tp->snd_una   = tp->iss;
+    tp->snd_nxt   = tp->iss + 1;
+    tp->snd_max   = tp->iss + 1;
+    tp->write_seq = tp->iss + 1;
+    tp->state     = TCP_SYN_SENT;
+    tcp_hash(tp);
+    tcp_stats.active_opens++;
+    tcp_send_syn(tp);
+    tcp_arm_rto(tp);
+
+    while (tp->state == TCP_SYN_SENT && sock->is_open && tcp_can_block()) {
+        wait_queue_sleep(&sock->tx_wait);
+    }
+    int ok = (tp->state == TCP_ESTABLISHED || tp->state == TCP_CLOSE_WAIT);
+    irq_restore(irq);
+    return ok ? 0 : -1;
+}
+
+/* Queue `size` bytes from `p`, or by reference from `ext` */
+static int tcp_send(socket_t *sock, const uint8_t *p, skb_ext_t *ext,
+                    size_t size, uint32_t flags) {
+    size_t sent = 0;
+
+    uint32_t irq = irq_save();
+    tcp_sock_t *tp = sock->tcp;
+    while (tp && sent < size) {
+        if (tp->error || !sock->is_open ||
+            (tp->state != TCP_ESTABLISHED && tp->state != TCP_CLOSE_WAIT)) {
+            break;
+        }
+        if (tp->wq_bytes >= TCP_SNDBUF) {
+            tcp_push(tp);
+            if ((flags & MSG_DONTWAIT) || !tcp_can_block()) break;
+            wait_queue_sleep(&sock->tx_wait);
+            continue;
+        }
+        uint32_t room = TCP_SNDBUF - tp->wq_bytes;
+        uint32_t chunk = (uint32_t)min_u32(size - sent, room);
+        uint32_t n = ext ? tcp_queue_ext(tp, ext, (uint32_t)sent, chunk)
+                         : tcp_queue_data(tp, p + sent, chunk);
+        if (n == 0) break;              /* Out of buffers */
+        sent += n;
+    }
+    if (tp) tcp_push(tp);
+    irq_restore(irq);
+
+    if (sent == 0 && size > 0) return -1;
+    return (int)sent;
+}
+
+int tcp_sendmsg(socket_t *sock, const void *data, size_t size, uint32_t flags) {
+    return tcp_send(sock, (const uint8_t *)data, NULL, size, flags);
+}
+
+int tcp_send_ext(socket_t *sock, skb_ext_t *ext, uint32_t size, uint32_t flags) {
+    if (size > ext->len) return -1;
+    return tcp_send(sock, NULL, ext, size, flags);
+}
+
+int tcp_recvmsg(socket_t *sock, void *buffer, size_t size, uint32_t flags) {
+    uint8_t *out = (uint8_t *)buffer;
+
+    uint32_t irq = irq_save();
+    tcp_sock_t *tp = sock->tcp;
+    while (tp && !tp->rcv_queue.head) {
+        if (tp->error || tp->state == TCP_LISTEN || tp->peer_fin || !sock->is_open ||
+            (flags & MSG_DONTWAIT) || !tcp_can_block()) {
+            break;
+        }
+        wait_queue_sleep(&sock->rx_wait);
+    }
+    if (!tp || !tp->rcv_queue.head) {
+        int r = (tp && !tp->error && tp->peer_fin) ? 0 : -1;
+        irq_restore(irq);
+        return r;
+    }
+
+    uint32_t copied = 0;
+    sk_buff_t *skb;
+    while (copied < size && (skb = tp->rcv_queue.head) != NULL) {
+        uint32_t n = min_u32(RCV_LEN(skb), (uint32_t)(size - copied));
+        skb_copy_bits(skb, RCV_OFF(skb), out + copied, n);
+        RCV_SEQ(skb) += n;
+        RCV_OFF(skb) += n;
+        RCV_LEN(skb) -= n;
+        tp->rcv_bytes -= n;
+        copied += n;
+        if (RCV_LEN(skb) == 0) {
+            skb_dequeue(&tp->rcv_queue);
+            skb_free(skb);
+        }
+    }
+
+    /* Tell the peer once the window can open by two segments */
+    if (tp->state == TCP_ESTABLISHED || tp->state == TCP_FIN_WAIT1 ||
+        tp->state == TCP_FIN_WAIT2) {
+        uint32_t edge = tp->rcv_nxt + tcp_rcv_space(tp);
+        if (seq_leq(tp->rcv_adv + 2u * tp->mss, edge)) tcp_send_ack(tp);
+    }
+    irq_restore(irq);
+    return (int)copied;
+}
+
+int tcp_setopt(socket_t *sock, int option, int value) {
+    tcp_sock_t *tp = sock->tcp;
+    if (!tp || option != TCP_NODELAY) return -1;
+
+    uint32_t irq = irq_save();
+    tp->nodelay = value ? 1 : 0;
+    if (tp->nodelay) tcp_push(tp);
+    irq_restore(irq);
+    return 0;
+}
+
+uint32_t tcp_poll(socket_t *sock) {
+    tcp_sock_t *tp = sock->tcp;
+    if (!tp) return EPOLLHUP;
+
+    uint32_t events = 0;
+    if (tp->state == TCP_LISTEN) {
+        if (tp->accept_head) events |= EPOLLIN;
+        return events;
+    }
+    if (tp->rcv_queue.head || tp->peer_fin || tp->error) events |= EPOLLIN;
+    if ((tp->state == TCP_ESTABLISHED || tp->state == TCP_CLOSE_WAIT) &&
+        tp->wq_bytes < TCP_SNDBUF) {
+        events |= EPOLLOUT;
+    }
+    if (tp->error || (tp->state == TCP_CLOSED && tp->peer_fin)) events |= EPOLLHUP;
+    return events;
+}
+
+/* Reset every connection still waiting on a listener that is closing */
+static void tcp_close_listener(tcp_sock_t *lp) {
+    tcp_sock_t *tp;
+    while ((tp = lp->accept_head) != NULL) {
+        lp->accept_head = tp->accept_next;
+        lp->accept_len--;
+        socket_t *sk = tp->sk;
+        if (tp->state != TCP_CLOSED) {
+            tcp_transmit(tp, tp->snd_nxt, TCP_RST | TCP_ACK, NULL);
+            tcp_done(tp);
+        }
+        net_socket_close(sk);           /* Frees tp via tcp_release() */
+    }
+    lp->accept_tail = NULL;
+
+    /* Handshakes in progress complete to nobody and get reset then */
+    for (int i = 0; i < TCP_HASH_SIZE; i++) {
+        for (tp = tcp_ehash[i]; tp; tp = tp->hash_next) {
+            if (tp->parent == lp) tp->parent = NULL;
+        }
+    }
+    lp->syn_children = 0;
+}
+
+void tcp_release(socket_t *sock) {
+    uint32_t irq = irq_save();
+    tcp_sock_t *tp = sock->tcp;
+    sock->tcp = NULL;
+    if (!tp) {
+        irq_restore(irq);
+        return;
+    }
+    tp->sk = NULL;
+
+    switch (tp->state) {
+    case TCP_LISTEN:
+        tcp_close_listener(tp);
+        tcp_destroy(tp);
+        break;
+
+    case TCP_ESTABLISHED:
+    case TCP_CLOSE_WAIT:
+        /* Unread data is lost: say so with a reset (RFC 2525 2.17) */
+        if (tp->rcv_queue.head || tcp_queue_fin(tp) < 0) {
+            tcp_transmit(tp, tp->snd_nxt, TCP_RST | TCP_ACK, NULL);
+            tcp_abort(tp, TCP_ERR_RESET);
+            break;
+        }
+        tp->state = (tp->state == TCP_ESTABLISHED) ? TCP_FIN_WAIT1 : TCP_LAST_ACK;
+        tcp_push(tp);
+        break;
+
+    case TCP_FIN_WAIT2:
+        net_timer_mod(&tp->linger_timer, TCP_FIN_TIMEOUT);
+        break;
+
+    case TCP_FIN_WAIT1:
+    case TCP_CLOSING:
+    case TCP_LAST_ACK:
+    case TCP_TIME_WAIT:
+        break;
+
+    default:                            /* CLOSED, SYN_SENT */
+        tcp_done(tp);
+        break;
+    }
+    irq_restore(irq);
+}
+
+const char *tcp_state_name(uint8_t state) {
+    static const char *const names[] = {
+        "CLOSED", "LISTEN", "SYN_SENT", "SYN_RECV", "ESTABLISHED",
+        "FIN_WAIT1", "FIN_WAIT2", "CLOSING", "TIME_WAIT", "CLOSE_WAIT",
+        "LAST_ACK",
+    };
+    return (state <= TCP_LAST_ACK) ? names[state] : "?";
+}
+
+static void tcp_fill_info(tcp_conn_info_t *c, const tcp_sock_t *tp) {
+    c->laddr         = tp->laddr;
+    c->raddr         = tp->raddr;
+    c->lport         = tp->lport;
+    c->rport         = tp->rport;
+    c->state         = tp->state;
+    c->orphan        = tp->sk == NULL;
+    c->rcv_queued    = tp->rcv_bytes;
+    c->snd_queued    = tp->write_seq - tp->snd_una;
+    c->in_flight     = tp->snd_nxt - tp->snd_una;
+    c->accept_len    = tp->accept_len;
+    c->srtt_cycles   = tp->srtt_cycles;
+    c->rttvar_cycles = tp->rttvar_cycles;
+    c->rto           = tp->rto;
+    c->cwnd          = tp->cwnd;
+    c->ssthresh      = tp->ssthresh;
+    c->snd_wnd       = tp->snd_wnd;
+    c->mss           = tp->mss;
+    c->retrans       = tp->retrans;
+}
+
+int tcp_snapshot(tcp_conn_info_t *out, int max) {
+    int count = 0;
+    uint32_t irq = irq_save();
+    for (int i = 0; i < TCP_LHASH_SIZE && count < max; i++) {
+        for (tcp_sock_t *tp = tcp_lhash[i]; tp && count < max; tp = tp->hash_next) {
+            tcp_fill_info(&out[count++], tp);
+        }
+    }
+    for (int i = 0; i < TCP_HASH_SIZE && count < max; i++) {
+        for (tcp_sock_t *tp = tcp_ehash[i]; tp && count < max; tp = tp->hash_next) {
+            tcp_fill_info(&out[count++], tp);
+        }
+    }
+    irq_restore(irq);
+    return count;
+}
+
+void tcp_get_stats(tcp_stats_t *stats) {
+    if (!stats) return;
+    uint32_t irq = irq_save();
+    *stats = tcp_stats;
+    irq_restore(irq);
+}
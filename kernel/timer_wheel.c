@@ -0,0 +1,78 @@
+/*
+ * OpenOS - Hashed Timer Wheel Implementation
+ */
+
+#include "timer_wheel.h"
+#include "../arch/x86/cpu.h"
+
+void timer_wheel_init(timer_wheel_t *wheel, uint64_t now) {
+    for (int i = 0; i < TIMER_WHEEL_SLOTS; i++) wheel->slots[i] = 0;
+    wheel->now     = now;
+    wheel->pending = 0;
+}
+
+void wheel_timer_init(wheel_timer_t *timer, void (*fn)(void *data), void *data) {
+    timer->next  = 0;
+    timer->pprev = 0;
+    timer->fn    = fn;
+    timer->data  = data;
+}
+
+static void unlink_timer(timer_wheel_t *wheel, wheel_timer_t *timer) {
+    *timer->pprev = timer->next;
+    if (timer->next) timer->next->pprev = timer->pprev;
+    timer->next  = 0;
+    timer->pprev = 0;
+    wheel->pending--;
+}
+
+void timer_wheel_add(timer_wheel_t *wheel, wheel_timer_t *timer, uint64_t expires) {
+    uint32_t irq = irq_save();
+    if (timer->pprev) unlink_timer(wheel, timer);
+
+    /* Never schedule into a slot the wheel has already passed */
+    if (expires <= wheel->now) expires = wheel->now + 1;
+    timer->expires = expires;
+
+    wheel_timer_t **slot = &wheel->slots[expires & (TIMER_WHEEL_SLOTS - 1)];
+    timer->next  = *slot;
+    timer->pprev = slot;
+    if (*slot) (*slot)->pprev = &timer->next;
+    *slot = timer;
+    wheel->pending++;
+    irq_restore(irq);
+}
+
+void timer_wheel_del(timer_wheel_t *wheel, wheel_timer_t *timer) {
+    uint32_t irq = irq_save();
+    if (timer->pprev) unlink_timer(wheel, timer);
+    irq_restore(irq);
+}
+
+void timer_wheel_advance(timer_wheel_t *wheel, uint64_t now) {
+    uint32_t irq = irq_save();
+
+    /* After a long gap every slot is due for a look, but only once */
+    uint64_t tick = wheel->now;
+    if (now - tick > TIMER_WHEEL_SLOTS) tick = now - TIMER_WHEEL_SLOTS;
+
+    while (tick < now && wheel->pending) {
+        tick++;
+        wheel->now = tick;
+        wheel_timer_t **link = &wheel->slots[tick & (TIMER_WHEEL_SLOTS - 1)];
+        while (*link) {
+            wheel_timer_t *t = *link;
+            if (t->expires > now) {
+                link = &t->next;
+                continue;
+            }
+            /* The callback may re-arm t or cancel (even free) other
+             * timers in this slot, so rescan it from the head after. */
+            unlink_timer(wheel, t);
+            t->fn(t->data);
+            link = &wheel->slots[tick & (TIMER_WHEEL_SLOTS - 1)];
+        }
+    }
+    wheel->now = now;
+    irq_restore(irq);
+}
@@ -0,0 +1,240 @@
+/*
+ * OpenOS - UDP Implementation
+ *
+ * The port table is shared by the RX thread (demultiplexing) and
+ * socket callers (bind, close), so it is only touched with interrupts
+ * disabled.
+ */
+
+#include "udp.h"
+#include "ip.h"
+#include "../arch/x86/cpu.h"
+
+static socket_t   *udp_table[UDP_HASH_SIZE];
+static uint16_t    next_ephemeral = UDP_EPHEMERAL_MIN;
+static udp_stats_t udp_stats;
+
+static uint32_t udp_hash(uint16_t port, in_addr_t addr) {
+    return ((port ^ addr ^ (addr >> 16)) * 2654435761u) >> (32 - 6);
+}
+
+static socket_t *udp_lookup_exact(uint16_t port, in_addr_t addr) {
+    for (socket_t *s = udp_table[udp_hash(port, addr)]; s; s = s->hash_next) {
+        if (s->local_port == port && s->local_addr == addr) return s;
+    }
+    return NULL;
+}
+
+/* Socket for a datagram to addr:port: the specific binding first, then
+ * the wildcard one. */
+static socket_t *udp_lookup(uint16_t port, in_addr_t addr) {
+    socket_t *s = udp_lookup_exact(port, addr);
+    return s ? s : udp_lookup_exact(port, INADDR_ANY);
+}
+
+/* Would binding (port, addr) overlap an existing binding? */
+static int udp_port_taken(uint16_t port, in_addr_t addr) {
+    if (addr != INADDR_ANY) {
+        return udp_lookup_exact(port, addr) ||
+               udp_lookup_exact(port, INADDR_ANY);
+    }
+    /* A wildcard bind collides with any address on the port; binding
+     * is rare, so scan for those. */
+    for (int i = 0; i < UDP_HASH_SIZE; i++) {
+        for (socket_t *s = udp_table[i]; s; s = s->hash_next) {
+            if (s->local_port == port) return 1;
+        }
+    }
+    return 0;
+}
+
+int udp_bind(socket_t *sock, in_addr_t addr, uint16_t port) {
+    uint32_t irq = irq_save();
+    if (sock->local_port) {
+        irq_restore(irq);
+        return -1;
+    }
+
+    if (port == 0) {
+        uint32_t range = UDP_EPHEMERAL_MAX - UDP_EPHEMERAL_MIN + 1;
+        for (uint32_t tries = 0; tries < range; tries++) {
+            uint16_t candidate = next_ephemeral;
+            next_ephemeral = (candidate == UDP_EPHEMERAL_MAX)
+                             ? UDP_EPHEMERAL_MIN : candidate + 1;
+            if (!udp_port_taken(candidate, addr)) {
+                port = candidate;
+                break;
+            }
+        }
+    } else if (udp_port_taken(port, addr)) {
+        port = 0;
+    }
+    if (port == 0) {
+        irq_restore(irq);
+        return -1;
+    }
+
+    sock->local_port = port;
+    sock->local_addr = addr;
+    uint32_t h = udp_hash(port, addr);
+    sock->hash_next = udp_table[h];
+    udp_table[h] = sock;
+    irq_restore(irq);
+    return 0;
+}
+
+void udp_unbind(socket_t *sock) {
+    uint32_t irq = irq_save();
+    if (sock->local_port) {
+        socket_t **link = &udp_table[udp_hash(sock->local_port, sock->local_addr)];
+        while (*link && *link != sock) link = &(*link)->hash_next;
+        if (*link) *link = sock->hash_next;
+        sock->hash_next = NULL;
+    }
+    irq_restore(irq);
+}
+
+static void udp_rcv(sk_buff_t *skb, const ip_header_t *iph) {
+    const udp_header_t *uh = (const udp_header_t *)skb->data;
+    uint32_t len = (skb_headlen(skb) >= UDP_HLEN) ? ntohs(uh->length) : 0;
+
+    if (len < UDP_HLEN || len > skb->len) {
+        udp_stats.rx_errors++;
+        skb_free(skb);
+        return;
+    }
+    skb_trim(skb, len);
+
+    /* A zero checksum means the sender did not compute one */
+    if (uh->checksum && skb->ip_summed != CHECKSUM_UNNECESSARY &&
+        net_csum_fold(skb_csum_partial(skb, 0, len,
+                      ip_pseudo_csum(iph->src_ip, iph->dst_ip, PROTO_UDP, len))) != 0) {
+        udp_stats.rx_errors++;
+        udp_stats.rx_csum_errors++;
+        skb_free(skb);
+        return;
+    }
+
+    uint16_t sport = ntohs(uh->src_port);
+    uint16_t dport = ntohs(uh->dst_port);
+
+    uint32_t irq = irq_save();
+    socket_t *sock = udp_lookup(dport, iph->dst_ip);
+    if (!sock) {
+        udp_stats.rx_no_port++;
+        irq_restore(irq);
+        skb_free(skb);
+        return;
+    }
+
+    skb->cb[0] = iph->src_ip;
+    skb->cb[1] = sport;
+    skb_pull(skb, UDP_HLEN);
+    if (net_socket_queue_rcv(sock, skb) < 0) udp_stats.rx_queue_drops++;
+    else                                     udp_stats.rx_datagrams++;
+    irq_restore(irq);
+}
+
+void udp_init(void) {
+    ip_register_protocol(PROTO_UDP, udp_rcv);
+}
+
+/* One datagram with the payload copied from `data`, or referencing
+ * `ext` */
+static int udp_send(socket_t *sock, const void *data, skb_ext_t *ext,
+                    size_t size, in_addr_t dst, uint16_t port) {
+    if (size > UDP_MAX_PAYLOAD || port == 0) return -1;
+    if (!sock->local_port && udp_bind(sock, INADDR_ANY, 0) < 0) return -1;
+
+    /* ip_output() sends from the outgoing device's address */
+    in_addr_t src;
+    net_device_t *dev;
+    if (ip_route_source(dst, &src, &dev) < 0) {
+        udp_stats.tx_errors++;
+        return -1;
+    }
+
+    sk_buff_t *skb = skb_alloc();
+    if (!skb) {
+        udp_stats.tx_errors++;
+        return -1;
+    }
+    /* If the route needs a checksum, sum the payload as it is copied
+     * in; otherwise leave it to ip_output(), which will skip it */
+    int csum_now = !(dev->flags & NETDEV_NO_CSUM);
+    uint32_t sum = 0;
+    int r;
+    if (ext) {
+        r = skb_add_frag_ext(skb, ext, 0, (uint32_t)size);
+        if (r == 0 && csum_now) sum = net_csum_partial(ext->data, size, 0);
+    } else {
+        r = csum_now ? skb_append_data_csum(skb, data, size, &sum)
+                     : skb_append_data(skb, data, size);
+    }
+    if (r < 0) {
+        udp_stats.tx_errors++;
+        skb_free(skb);
+        return -1;
+    }
+
+    uint32_t len = UDP_HLEN + size;
+    udp_header_t *uh = (udp_header_t *)skb_push(skb, UDP_HLEN);
+    uh->src_port = htons(sock->local_port);
+    uh->dst_port = htons(port);
+    uh->length   = htons((uint16_t)len);
+    uh->checksum = 0;
+    uint32_t pseudo = ip_pseudo_csum(src, dst, PROTO_UDP, len);
+    if (csum_now) {
+        uint16_t csum = net_csum_fold(net_csum_partial(uh, UDP_HLEN,
+                                      net_csum_block_add(pseudo, sum, 0)));
+        uh->checksum = csum ? csum : 0xFFFF;
+    } else {
+        skb_csum_partial_set(skb, offsetof(udp_header_t, checksum), pseudo);
+    }
+
+    if (ip_output(skb, dst, PROTO_UDP) < 0) {
+        udp_stats.tx_errors++;
+        return -1;
+    }
+    udp_stats.tx_datagrams++;
+    return (int)size;
+}
+
+int udp_sendto(socket_t *sock, const void *data, size_t size, in_addr_t dst,
+               uint16_t port) {
+    return udp_send(sock, data, NULL, size, dst, port);
+}
+
+int udp_sendto_ext(socket_t *sock, skb_ext_t *ext, uint32_t size, in_addr_t dst,
+                   uint16_t port) {
+    if (size > ext->len) return -1;
+    return udp_send(sock, NULL, ext, size, dst, port);
+}
+
+int udp_snapshot(udp_sock_info_t *out, int max) {
+    int count = 0;
+    uint32_t irq = irq_save();
+    for (int i = 0; i < UDP_HASH_SIZE && count < max; i++) {
+        for (socket_t *s = udp_table[i]; s && count < max; s = s->hash_next) {
+            udp_sock_info_t *u = &out[count++];
+            u->laddr       = s->local_addr;
+            u->raddr       = s->remote_addr;
+            u->lport       = s->local_port;
+            u->rport       = s->remote_port;
+            u->rx_qlen     = s->rx_queue.qlen;
+            u->rx_queued   = s->rx_queued;
+            u->rcvbuf      = s->rcvbuf;
+            u->rx_drops    = s->rx_drops;
+            u->rx_filtered = s->rx_filtered;
+        }
+    }
+    irq_restore(irq);
+    return count;
+}
+
+void udp_get_stats(udp_stats_t *stats) {
+    if (!stats) return;
+    uint32_t irq = irq_save();
+    *stats = udp_stats;
+    irq_restore(irq);
+}
@@ -8,6 +8,8 @@
 
 #include "user_programs.h"
 #include "../include/usyscall.h"
+#include "../include/shm.h"
+#include "../include/epoll.h"
 
 /* Format an int into a caller-provided buffer (ring 3 helper). */
 static void u_itoa(int value, char *buf) {
@@ -114,3 +116,369 @@ void uprog_counter(void) {
     u_write("] done\n");
     u_exit(0);
 }
+
+/* ------------------------------------------------------------------ */
+
+void uprog_pipetest(void) {
+    char buf[12];
+    int fds[2];
+
+    if (u_pipe(fds) != 0) {
+        u_write("[pipe] pipe() failed\n");
+        u_exit(1);
+    }
+
+    int pid = u_fork();
+
+    if (pid == 0) {
+        /* Child: producer. Keeps only the write end. */
+        u_close(fds[0]);
+        for (int i = 1; i <= 3; i++) {
+            char digit = (char)('0' + i);
+            u_writefd(fds[1], "message #", 9);
+            u_writefd(fds[1], &digit, 1);
+            u_writefd(fds[1], " through the pipe\n", 18);
+            u_sleep(100);
+        }
+        u_close(fds[1]);
+        u_exit(0);
+    } else if (pid > 0) {
+        /* Parent: consumer. Blocks in read() until data or EOF. */
+        u_close(fds[1]);
+        char data[64];
+        int total = 0;
+        for (;;) {
+            int n = u_read(fds[0], data, sizeof(data) - 1);
+            if (n <= 0) break;
+            data[n] = '\0';
+            u_write("[pipe] parent read: ");
+            u_write(data);
+            total += n;
+        }
+        u_close(fds[0]);
+        u_wait(0);
+
+        u_write("[pipe] EOF after ");
+        u_itoa(total, buf);
+        u_write(buf);
+        u_write(" bytes\n");
+        u_exit(0);
+    } else {
+        u_write("[pipe] fork() failed\n");
+        u_exit(1);
+    }
+}
+
+/* ------------------------------------------------------------------ */
+
+/* Send one string at `prio` (ring 3 helper). */
+static void u_mq_send_str(int fd, const char *text, uint32_t prio) {
+    sys_msg_t m;
+    int len = 0;
+    while (text[len]) len++;
+
+    m.buf        = (void *)text;
+    m.len        = (uint32_t)len + 1;
+    m.type       = 1;
+    m.priority   = prio;
+    m.timeout_ms = 0xFFFFFFFFu;
+    m.sender_pid = 0;
+    u_mq_send(fd, &m);
+}
+
+void uprog_mqtest(void) {
+    char buf[12];
+    char data[64];
+    sys_msg_t m;
+
+    int fd = u_mq_open(0, 0);
+    if (fd < 0) {
+        u_write("[mq] mq_open() failed\n");
+        u_exit(1);
+    }
+
+    int pid = u_fork();
+
+    if (pid == 0) {
+        /* Child: queue three messages out of priority order. */
+        u_mq_send_str(fd, "low priority", 1);
+        u_mq_send_str(fd, "high priority", 20);
+        u_mq_send_str(fd, "medium priority", 5);
+        u_close(fd);
+        u_exit(0);
+    } else if (pid > 0) {
+        /* Parent: let the child fill the queue, then drain it. */
+        u_wait(0);
+        for (int i = 0; i < 3; i++) {
+            m.buf        = data;
+            m.len        = sizeof(data);
+            m.timeout_ms = 1000;
+            int n = u_mq_recv(fd, &m);
+            if (n < 0) {
+                u_write("[mq] receive failed\n");
+                break;
+            }
+            u_write("[mq] prio ");
+            u_itoa((int)m.priority, buf);
+            u_write(buf);
+            u_write(": ");
+            u_write(data);
+            u_write("\n");
+        }
+
+        /* Queue is empty now: this one must time out. */
+        m.buf        = data;
+        m.len        = sizeof(data);
+        m.timeout_ms = 200;
+        if (u_mq_recv(fd, &m) < 0) {
+            u_write("[mq] empty queue: receive timed out after 200 ms\n");
+        }
+        u_close(fd);
+        u_exit(0);
+    } else {
+        u_write("[mq] fork() failed\n");
+        u_exit(1);
+    }
+}
+
+/* ------------------------------------------------------------------ */
+
+/*
+ * Single-producer single-consumer ring in a shared memory object. The
+ * indices only ever grow; each side owns one and reads the other. A
+ * side that finds the ring full (empty) raises its *_waiting flag and
+ * futex-waits on the other side's index; the other side clears the
+ * flag and wakes it after moving that index. The fences order each
+ * side's index store against its read of the peer's flag, so one of
+ * the two always notices the other.
+ */
+typedef struct spsc_ring {
+    volatile uint32_t head;          /* Next slot to fill (producer)  */
+    volatile uint32_t prod_waiting;
+    uint32_t          prod_sleeps;
+    uint32_t          pad0[13];      /* indices on separate lines     */
+    volatile uint32_t tail;          /* Next slot to drain (consumer) */
+    volatile uint32_t cons_waiting;
+    uint32_t          cons_sleeps;
+    uint32_t          pad1[13];
+    volatile uint32_t slots[SHMBENCH_SLOTS];
+} spsc_ring_t;
+
+static void spsc_push(spsc_ring_t *r, uint32_t value) {
+    uint32_t head = r->head;
+    while (head - r->tail == SHMBENCH_SLOTS) {
+        r->prod_waiting = 1;
+        __sync_synchronize();
+        uint32_t tail = r->tail;
+        if (head - tail == SHMBENCH_SLOTS) {
+            r->prod_sleeps++;
+            u_futex_wait(&r->tail, tail, FUTEX_FOREVER);
+        }
+        r->prod_waiting = 0;
+    }
+
+    r->slots[head & (SHMBENCH_SLOTS - 1)] = value;
+    r->head = head + 1;              /* x86 keeps stores in order */
+    __sync_synchronize();
+    if (r->cons_waiting) {
+        r->cons_waiting = 0;
+        u_futex_wake(&r->head, 1);
+    }
+}
+
+static uint32_t spsc_pop(spsc_ring_t *r) {
+    uint32_t tail = r->tail;
+    while (r->head == tail) {
+        r->cons_waiting = 1;
+        __sync_synchronize();
+        uint32_t head = r->head;
+        if (head == tail) {
+            r->cons_sleeps++;
+            u_futex_wait(&r->head, head, FUTEX_FOREVER);
+        }
+        r->cons_waiting = 0;
+    }
+
+    uint32_t value = r->slots[tail & (SHMBENCH_SLOTS - 1)];
+    r->tail = tail + 1;
+    __sync_synchronize();
+    if (r->prod_waiting) {
+        r->prod_waiting = 0;
+        u_futex_wake(&r->tail, 1);
+    }
+    return value;
+}
+
+void uprog_shmbench(void) {
+    char buf[12];
+
+    int fd = u_shm_open("shmbench", sizeof(spsc_ring_t), SHM_CREATE | SHM_EXCL);
+    spsc_ring_t *ring = (fd >= 0) ? (spsc_ring_t *)u_shm_map(fd) : 0;
+    if (!ring) {
+        u_write("[shm] shm_open()/shm_map() failed\n");
+        u_exit(1);
+    }
+
+    int pid = u_fork();
+
+    if (pid == 0) {
+        /* Child: consumer, checks the sequence. */
+        uint32_t errors = 0;
+        for (uint32_t i = 0; i < SHMBENCH_MESSAGES; i++) {
+            if (spsc_pop(ring) != i) errors++;
+        }
+        u_write("[shm] consumer: ");
+        u_itoa((int)SHMBENCH_MESSAGES, buf);
+        u_write(buf);
+        u_write(errors ? " messages, OUT OF ORDER" : " messages in order");
+        u_write(", futex sleeps ");
+        u_itoa((int)ring->cons_sleeps, buf);
+        u_write(buf);
+        u_write("\n");
+        u_exit(errors ? 1 : 0);
+    } else if (pid > 0) {
+        /* Parent: producer. */
+        for (uint32_t i = 0; i < SHMBENCH_MESSAGES; i++) {
+            spsc_push(ring, i);
+        }
+        u_wait(0);
+        u_write("[shm] producer: futex sleeps ");
+        u_itoa((int)ring->prod_sleeps, buf);
+        u_write(buf);
+        u_write("\n");
+        u_shm_unmap(ring);
+        u_close(fd);
+        u_exit(0);
+    } else {
+        u_write("[shm] fork() failed\n");
+        u_exit(1);
+    }
+}
+
+/* ------------------------------------------------------------------ */
+
+/* Event sources in uprog_epolltest(), stored in epoll_event_t::data */
+#define EV_PIPE  0
+#define EV_QUEUE 1
+#define EV_KBD   2
+
+/* Print "[epoll] <what>: <text>" (ring 3 helper). */
+static void u_epoll_report(const char *what, const char *text) {
+    u_write("[epoll] ");
+    u_write(what);
+    u_write(": ");
+    u_write(text);
+}
+
+void uprog_epolltest(void) {
+    char buf[12];
+    char data[64];
+    sys_msg_t m;
+    epoll_event_t ev;
+    epoll_event_t events[4];
+    int fds[2];
+
+    int mq  = u_mq_open(0, 0);
+    int ep  = u_epoll_create();
+    int kbd = u_kbd_open();
+    if (u_pipe(fds) != 0 || mq < 0 || ep < 0 || kbd < 0) {
+        u_write("[epoll] setup failed\n");
+        u_exit(1);
+    }
+
+    if (u_fork() == 0) {
+        /* Child 1: a line through the pipe every 100 ms, then EOF. */
+        u_close(fds[0]);
+        for (int i = 1; i <= 3; i++) {
+            char line[] = "tick #\n";
+            line[5] = (char)('0' + i);
+            u_writefd(fds[1], line, 7);
+            u_sleep(100);
+        }
+        u_exit(0);
+    }
+    if (u_fork() == 0) {
+        /* Child 2: bursts of two messages every 150 ms. */
+        u_close(fds[0]);
+        u_close(fds[1]);
+        for (int i = 0; i < 3; i++) {
+            u_mq_send_str(mq, "burst, first", 1);
+            u_mq_send_str(mq, "burst, second", 1);
+            u_sleep(150);
+        }
+        u_exit(0);
+    }
+    u_close(fds[1]);
+
+    /* Pipe and keyboard level-triggered, the queue edge-triggered. */
+    ev.events = EPOLLIN;
+    ev.data   = EV_PIPE;
+    u_epoll_ctl(ep, EPOLL_CTL_ADD, fds[0], &ev);
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data   = EV_QUEUE;
+    u_epoll_ctl(ep, EPOLL_CTL_ADD, mq, &ev);
+    ev.events = EPOLLIN;
+    ev.data   = EV_KBD;
+    u_epoll_ctl(ep, EPOLL_CTL_ADD, kbd, &ev);
+
+    int pipe_open = 1, messages = 0, wakeups = 0, idle = 0;
+    while ((pipe_open || messages < 6) && idle < 3) {
+        int n = u_epoll_wait(ep, events, 4, 1000);
+        if (n <= 0) {
+            u_write("[epoll] nothing for 1 s\n");
+            idle++;
+            continue;
+        }
+        wakeups++;
+
+        for (int i = 0; i < n; i++) {
+            switch (events[i].data) {
+            case EV_PIPE:
+                if (events[i].events & EPOLLIN) {
+                    /* Level-triggered: anything left is reported again. */
+                    int len = u_read(fds[0], data, sizeof(data) - 1);
+                    data[len > 0 ? len : 0] = '\0';
+                    u_epoll_report("pipe", data);
+                } else if (events[i].events & EPOLLHUP) {
+                    u_epoll_report("pipe", "hang-up\n");
+                    u_epoll_ctl(ep, EPOLL_CTL_DEL, fds[0], 0);
+                    pipe_open = 0;
+                }
+                break;
+            case EV_QUEUE:
+                /* Edge-triggered: drain the queue before waiting again. */
+                for (;;) {
+                    m.buf        = data;
+                    m.len        = sizeof(data);
+                    m.timeout_ms = 0;
+                    if (u_mq_recv(mq, &m) < 0) break;
+                    u_epoll_report("queue", data);
+                    u_write("\n");
+                    messages++;
+                }
+                break;
+            case EV_KBD: {
+                int len = u_read(kbd, data, sizeof(data) - 1);
+                data[len > 0 ? len : 0] = '\0';
+                u_epoll_report("keyboard", data);
+                break;
+            }
+            }
+        }
+    }
+
+    u_wait(0);
+    u_wait(0);
+    u_write("[epoll] ");
+    u_itoa(messages, buf);
+    u_write(buf);
+    u_write(" messages and a pipe served in ");
+    u_itoa(wakeups, buf);
+    u_write(buf);
+    u_write(" wakeups\n");
+    u_close(ep);
+    u_close(kbd);
+    u_close(mq);
+    u_close(fds[0]);
+    u_exit(0);
+}
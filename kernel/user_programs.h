@@ -18,4 +18,22 @@ void uprog_forktest(void);
 /* Counter that yields between iterations (scheduler demo). */
 void uprog_counter(void);
 
+/* pipe() demo: child writes through a pipe, parent reads until EOF. */
+void uprog_pipetest(void);
+
+/* Message queue demo: child sends at mixed priorities, parent receives
+ * them highest first, then shows a receive timing out. */
+void uprog_mqtest(void);
+
+/* Shared memory benchmark: parent and child stream SHMBENCH_MESSAGES
+ * words through a lock-free ring of SHMBENCH_SLOTS (a power of two),
+ * sleeping on futexes only when it is full or empty. */
+#define SHMBENCH_MESSAGES 1000000u
+#define SHMBENCH_SLOTS    1024u
+void uprog_shmbench(void);
+
+/* epoll demo: one loop serves a pipe (level-triggered), a message
+ * queue (edge-triggered) and keyboard lines fed by two children. */
+void uprog_epolltest(void);
+
 #endif /* OPENOS_KERNEL_USER_PROGRAMS_H */
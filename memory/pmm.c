@@ -205,6 +205,44 @@ void pmm_free_page(void *page) {
     }
 }
 
+/*
+ * Allocate `count` physically contiguous pages (first fit). Returns the
+ * physical address of the first one, or NULL if no run is long enough.
+ */
+void *pmm_alloc_pages(uint32_t count) {
+    if (count == 0) {
+        return NULL;
+    }
+
+    uint32_t run = 0;
+    for (uint32_t page = 0; page < total_pages; page++) {
+        if (bitmap_test(page)) {
+            run = 0;
+            continue;
+        }
+        if (++run == count) {
+            uint32_t first = page + 1 - count;
+            for (uint32_t i = first; i <= page; i++) {
+                bitmap_set(i);
+            }
+            used_pages += count;
+            return (void *)(first * PMM_PAGE_SIZE);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Free a run of pages returned by pmm_alloc_pages()
+ */
+void pmm_free_pages(void *first, uint32_t count) {
+    uint8_t *page = (uint8_t *)first;
+    for (uint32_t i = 0; i < count; i++) {
+        pmm_free_page(page + i * PMM_PAGE_SIZE);
+    }
+}
+
 /*
  * Mark a physical page as used
  */
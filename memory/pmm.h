@@ -35,6 +35,12 @@ void *pmm_alloc_page(void);
 /* Free a physical page */
 void pmm_free_page(void *page);
 
+/* Allocate `count` physically contiguous pages (returns physical address) */
+void *pmm_alloc_pages(uint32_t count);
+
+/* Free a run of pages from pmm_alloc_pages() */
+void pmm_free_pages(void *first, uint32_t count);
+
 /* Mark a physical page as used */
 void pmm_mark_used(void *page);
 
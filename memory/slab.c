@@ -1,35 +1,65 @@
+/*
+ * OpenOS - Slab Allocator Implementation
+ */
+
 #include "slab.h"
 #include "heap.h"
+#include "../arch/x86/cpu.h"
 
 slab_t* slab_create(size_t obj_size) {
     slab_t *s = (slab_t*) kmalloc(sizeof(slab_t));
     if (!s) return NULL;
 
-    // Ensure minimum object size can hold pointer
+    // Objects hold the free-list link while free, and stay 8-byte aligned
     if (obj_size < sizeof(void*))
         obj_size = sizeof(void*);
+    obj_size = (obj_size + 7) & ~(size_t)7;
 
     s->obj_size = obj_size;
     s->free_list = NULL;
+    s->per_chunk = (obj_size < SLAB_CHUNK_SIZE) ? SLAB_CHUNK_SIZE / obj_size : 1;
+    s->total = 0;
+    s->in_use = 0;
 
     return s;
 }
 
+// Carve a fresh chunk into objects and push them on the free list.
+static int slab_refill(slab_t *s) {
+    uint8_t *chunk = (uint8_t*) kmalloc(s->per_chunk * s->obj_size);
+    if (!chunk) return -1;
+
+    for (uint32_t i = 0; i < s->per_chunk; i++) {
+        void *obj = chunk + i * s->obj_size;
+        *(void**)obj = s->free_list;
+        s->free_list = obj;
+    }
+    s->total += s->per_chunk;
+    return 0;
+}
+
 void* slab_alloc(slab_t *s) {
     if (!s) return NULL;
 
-    if (s->free_list) {
-        void *obj = s->free_list;
-        s->free_list = *(void**)obj;
-        return obj;
+    uint32_t irq = irq_save();
+    if (!s->free_list && slab_refill(s) < 0) {
+        irq_restore(irq);
+        return NULL;
     }
 
-    return kmalloc(s->obj_size);
+    void *obj = s->free_list;
+    s->free_list = *(void**)obj;
+    s->in_use++;
+    irq_restore(irq);
+    return obj;
 }
 
 void slab_free(slab_t *s, void *ptr) {
     if (!s || !ptr) return;
 
+    uint32_t irq = irq_save();
     *(void**)ptr = s->free_list;
     s->free_list = ptr;
+    s->in_use--;
+    irq_restore(irq);
 }
@@ -1,15 +1,37 @@
+/*
+ * OpenOS - Slab Allocator
+ *
+ * Fixed-size object caches on top of kmalloc(). A cache hands out
+ * objects from a LIFO free list and refills it a chunk of objects at a
+ * time, so allocation and free are O(1) and objects of one kind stay
+ * packed together. Freed objects return to their cache, never to the
+ * heap.
+ */
+
 #ifndef OPENOS_MEMORY_SLAB_H
 #define OPENOS_MEMORY_SLAB_H
 
 #include <stddef.h>
+#include <stdint.h>
+
+/* Bytes carved per refill (at least one object) */
+#define SLAB_CHUNK_SIZE 4096
 
 typedef struct slab {
     void *free_list;
     size_t obj_size;
+    uint32_t per_chunk;     /* Objects per refill             */
+    uint32_t total;         /* Objects carved so far          */
+    uint32_t in_use;        /* Objects currently allocated    */
 } slab_t;
 
+/* Create a cache of `obj_size`-byte objects. Returns NULL on OOM. */
 slab_t* slab_create(size_t obj_size);
+
+/* Allocate one object (contents undefined), or NULL on OOM. */
 void* slab_alloc(slab_t *slab);
+
+/* Return an object to its cache. */
 void slab_free(slab_t *slab, void *ptr);
 
 #endif
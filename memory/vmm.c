@@ -13,6 +13,9 @@ static struct page_directory *current_directory = 0;
 /* Kernel page directory */
 static struct page_directory *kernel_directory = 0;
 
+/* Called when a write hits a copy-on-write page */
+static vmm_cow_break_fn cow_break_handler = 0;
+
 /* Helper macros for page directory/table indexing */
 #define PD_INDEX(addr) (((uint32_t)(addr) >> 22) & 0x3FF)
 #define PT_INDEX(addr) (((uint32_t)(addr) >> 12) & 0x3FF)
@@ -165,6 +168,14 @@ void vmm_init(void) {
     
     /* Set as current directory */
     current_directory = kernel_directory;
+
+    /* CR0.WP: make read-only (copy-on-write) pages fault for ring 0
+     * writes too, so kernel copies into user buffers are caught. It has
+     * no effect until paging is switched on. */
+    uint32_t cr0;
+    __asm__ __volatile__("mov %%cr0, %0" : "=r"(cr0));
+    cr0 |= 0x00010000;
+    __asm__ __volatile__("mov %0, %%cr0" : : "r"(cr0));
     
     /* Load page directory into CR3 */
     vmm_switch_directory(kernel_directory);
@@ -367,3 +378,69 @@ void vmm_page_fault_handler(void) {
     /* The page fault exception (14) will be caught by exception_handler */
     (void)faulting_address;
 }
+
+/* ------------------------------------------------------------------ */
+/* Copy-on-write                                                        */
+/* ------------------------------------------------------------------ */
+
+/* Page table entry for `virt` in the current directory, or NULL. */
+static pte_t *current_pte(void *virt) {
+    if (current_directory == NULL) {
+        return NULL;
+    }
+    struct page_table *pt = get_page_table(current_directory, virt, false);
+    if (pt == NULL) {
+        return NULL;
+    }
+    return &pt->entries[PT_INDEX(virt)];
+}
+
+int vmm_cow_protect(void *virt) {
+    pte_t *pte = current_pte(virt);
+    if (pte == NULL || !(*pte & PTE_PRESENT)) {
+        return -1;
+    }
+    if (*pte & PTE_WRITABLE) {
+        *pte = (*pte & ~PTE_WRITABLE) | PTE_COW;
+        tlb_flush_page(virt);
+    }
+    return 0;
+}
+
+void vmm_cow_unprotect(void *virt) {
+    pte_t *pte = current_pte(virt);
+    if (pte == NULL || !(*pte & PTE_COW)) {
+        return;
+    }
+    *pte = (*pte & ~PTE_COW) | PTE_WRITABLE;
+    tlb_flush_page(virt);
+}
+
+void vmm_set_cow_break_handler(vmm_cow_break_fn fn) {
+    cow_break_handler = fn;
+}
+
+int vmm_paging_enabled(void) {
+    uint32_t cr0;
+    __asm__ __volatile__("mov %%cr0, %0" : "=r"(cr0));
+    return (cr0 & 0x80000000) != 0;
+}
+
+int vmm_handle_fault(uint32_t addr, uint32_t err_code) {
+    /* Only a write to a present page can be a copy-on-write fault. */
+    if ((err_code & 0x3) != 0x3) {
+        return 0;
+    }
+
+    void *page = (void *)PAGE_ALIGN(addr);
+    pte_t *pte = current_pte(page);
+    if (pte == NULL || !(*pte & PTE_COW)) {
+        return 0;
+    }
+
+    if (cow_break_handler) {
+        cow_break_handler((uint32_t)page);
+    }
+    vmm_cow_unprotect(page);
+    return 1;
+}
@@ -28,6 +28,7 @@ typedef uint32_t pde_t;
 #define PTE_DIRTY           (1 << 6)
 #define PTE_PAT             (1 << 7)
 #define PTE_GLOBAL          (1 << 8)
+#define PTE_COW             (1 << 9)    /* OS-available bit: copy-on-write */
 
 /* Kernel virtual base address (higher-half kernel) */
 #define KERNEL_VIRTUAL_BASE 0xC0000000
@@ -77,4 +78,28 @@ void vmm_map_region(struct page_directory *dir, void *virt, uint32_t phys, size_
 /* Page fault handler */
 void vmm_page_fault_handler(void);
 
+/*
+ * Copy-on-write protection for single pages of the current directory.
+ *
+ * vmm_cow_protect() drops PTE_WRITABLE and tags the entry with PTE_COW.
+ * A later write fault on that page calls the registered break handler
+ * (which must stop sharing the frame, typically by taking a private
+ * copy for the other holder) and then makes the page writable again,
+ * so the faulting store simply retries. vmm_cow_unprotect() restores
+ * write access when the sharing ends without a fault.
+ *
+ * The protection only bites once CR0.PG is set; vmm_paging_enabled()
+ * tells callers whether they can rely on it.
+ */
+typedef void (*vmm_cow_break_fn)(uint32_t page);
+
+int  vmm_cow_protect(void *virt);
+void vmm_cow_unprotect(void *virt);
+void vmm_set_cow_break_handler(vmm_cow_break_fn fn);
+int  vmm_paging_enabled(void);
+
+/* Try to resolve a page fault. Returns 1 if handled (resume), 0 if the
+ * fault is fatal. Called by the exception handler. */
+int vmm_handle_fault(uint32_t addr, uint32_t err_code);
+
 #endif /* OPENOS_MEMORY_VMM_H */
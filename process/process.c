@@ -25,8 +25,13 @@
 
 #include "process.h"
 #include "scheduler.h"
+#include "waitqueue.h"
+#include "../kernel/file.h"
+#include "../include/ipc.h"
+#include "../include/shm.h"
 #include "../memory/heap.h"
 #include "../drivers/console.h"
+#include "../kernel/printk.h"
 #include "../drivers/timer.h"
 #include "../arch/x86/gdt.h"
 #include "../kernel/string.h"
@@ -102,7 +107,7 @@ void process_init(void) {
 
     current_process = idle;
 
-    console_write("Process: table initialized (64 slots), PID 0 = idle\n");
+    printk(LOG_INFO, "Process: table initialized (64 slots), PID 0 = idle\n");
 }
 
 /* ------------------------------------------------------------------ */
@@ -218,6 +223,11 @@ void process_exit(int code) {
         self->ustack = 0;
     }
 
+    /* Drop open files (closing pipe ends wakes any peers). */
+    fd_close_all(self);
+    ipc_process_cleanup(self);
+    shm_process_cleanup(self);
+
     /* Wake a parent blocked in process_wait(). */
     process_t *parent = process_by_pid(self->ppid);
     if (parent && parent->parent_waiting &&
@@ -254,6 +264,7 @@ int process_kill(uint32_t pid) {
 
     /* Remove from wherever it is queued and mark it a zombie. */
     scheduler_dequeue(p);
+    wait_queue_remove(p);
     p->exit_code = -1;
     p->state     = PROCESS_STATE_ZOMBIE;
 
@@ -262,6 +273,10 @@ int process_kill(uint32_t pid) {
         p->ustack = 0;
     }
 
+    fd_close_all(p);
+    ipc_process_cleanup(p);
+    shm_process_cleanup(p);
+
     /* Wake a waiting parent, as in process_exit(). */
     process_t *parent = process_by_pid(p->ppid);
     if (parent && parent->parent_waiting &&
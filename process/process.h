@@ -21,6 +21,8 @@
 #define PROCESS_NAME_LEN     32
 #define PROCESS_KSTACK_SIZE  16384   /* 16 KiB kernel stack   */
 #define PROCESS_USTACK_SIZE  16384   /* 16 KiB user stack     */
+#define PROCESS_MAX_FDS      16      /* Open file descriptors */
+#define PROCESS_MAX_SHM      4       /* Attached shared memory objects */
 
 /* Priorities (lower number = higher priority) */
 #define PRIORITY_HIGH    0
@@ -39,6 +41,10 @@ typedef enum {
     PROCESS_STATE_TERMINATED = PROCESS_STATE_ZOMBIE  /* Legacy alias    */
 } process_state_t;
 
+struct file;
+struct wait_queue;
+struct shm_object;
+
 /* Process entry point type (kernel threads) */
 typedef void (*process_entry_t)(void *arg);
 
@@ -72,6 +78,22 @@ typedef struct process {
     uint64_t         sleep_until;    /* Wake tick when SLEEPING          */
     int              exit_code;
     int              parent_waiting; /* Parent blocked in process_wait() */
+
+    /* Wait queue membership (see waitqueue.h) */
+    struct wait_queue *wait_queue;   /* Queue we are blocked on, or 0    */
+    struct process    *wait_next;    /* Wait-queue link                  */
+    uint32_t           wait_key;     /* Tag for keyed wakeups (futex)    */
+
+    /* Open file descriptors (see kernel/file.h) */
+    struct file     *fds[PROCESS_MAX_FDS];
+
+    /* Attached shared memory (see include/shm.h) */
+    struct shm_object *shm_maps[PROCESS_MAX_SHM];
+
+    /* Synchronous IPC (see ipc_call() in include/ipc.h) */
+    uint32_t        *ipc_buf;        /* Message words in flight          */
+    struct process  *ipc_reply_to;   /* Server: caller awaiting a reply  */
+    int              ipc_status;     /* Result handed to a woken caller  */
 } process_t;
 
 /* ---- Lifecycle ---------------------------------------------------- */
@@ -11,7 +11,7 @@
 #include "process.h"
 #include "../arch/x86/gdt.h"
 #include "../drivers/timer.h"
-#include "../drivers/console.h"
+#include "../kernel/printk.h"
 
 /* From arch/x86/context.S */
 extern void context_switch(uint32_t *old_esp, uint32_t new_esp);
@@ -25,6 +25,7 @@ static process_t *queue_tail[PRIORITY_LEVELS];
 
 static int      started = 0;
 static uint64_t context_switches = 0;
+static uint64_t handoffs = 0;
 
 /* ------------------------------------------------------------------ */
 /* Ready queues                                                         */
@@ -137,7 +138,7 @@ static void wake_sleepers(uint64_t now) {
 
 void scheduler_start(void) {
     started = 1;
-    console_write("Scheduler: preemptive round-robin active (quantum 50 ms)\n");
+    printk(LOG_INFO, "Scheduler: preemptive round-robin active (quantum 50 ms)\n");
 }
 
 int scheduler_active(void) {
@@ -241,6 +242,35 @@ void scheduler_block_current(void) {
     schedule();
 }
 
+void scheduler_handoff(process_t *next) {
+    if (!started || !next || next == current_process ||
+        (next->state != PROCESS_STATE_BLOCKED &&
+         next->state != PROCESS_STATE_SLEEPING)) {
+        schedule();
+        return;
+    }
+
+    process_t *prev = current_process;
+
+    if (prev->state == PROCESS_STATE_RUNNING) {
+        prev->state = PROCESS_STATE_READY;
+        prev->priority = prev->base_priority;
+        scheduler_enqueue(prev);
+    }
+
+    /* Donate the remaining timeslice: the pair shares one quantum. */
+    next->state        = PROCESS_STATE_RUNNING;
+    next->priority     = next->base_priority;
+    next->quantum_left = prev->quantum_left ? prev->quantum_left : 1;
+
+    current_process = next;
+    context_switches++;
+    handoffs++;
+
+    tss_set_kernel_stack(next->kstack_top ? next->kstack_top : 0);
+    context_switch(&prev->esp, next->esp);
+}
+
 void scheduler_unblock(process_t *p) {
     if (!p) return;
     if (p->state == PROCESS_STATE_BLOCKED ||
@@ -253,6 +283,7 @@ void scheduler_unblock(process_t *p) {
 void scheduler_get_stats(sched_stats_t *out) {
     if (!out) return;
     out->context_switches = context_switches;
+    out->handoffs = handoffs;
     out->ticks = timer_get_ticks();
     for (int q = 0; q < PRIORITY_LEVELS; q++) {
         uint32_t n = 0;
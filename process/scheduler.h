@@ -55,12 +55,18 @@ void scheduler_yield(void);
 /* Block the current process (state must be set by caller) and switch. */
 void scheduler_block_current(void);
 
+/* Switch directly to the blocked process `next`, bypassing the ready
+ * queues and handing it the rest of the current quantum. The caller
+ * sets its own state first (usually BLOCKED). Interrupts must be off. */
+void scheduler_handoff(process_t *next);
+
 /* Make a blocked/sleeping process runnable again. */
 void scheduler_unblock(process_t *p);
 
 /* Statistics for `sched` shell command. */
 typedef struct {
     uint64_t context_switches;
+    uint64_t handoffs;          /* Direct switches (scheduler_handoff) */
     uint64_t ticks;
     uint32_t ready_count[PRIORITY_LEVELS];
 } sched_stats_t;
@@ -0,0 +1,190 @@
+/*
+ * OpenOS - Wait Queue Implementation
+ *
+ * All manipulation happens with interrupts disabled, like the ready
+ * queues in scheduler.c.
+ */
+
+#include "waitqueue.h"
+#include "scheduler.h"
+#include "../drivers/timer.h"
+#include "../arch/x86/cpu.h"
+
+/* From process.c */
+extern process_t *current_process;
+
+void wait_queue_init(wait_queue_t *wq) {
+    wq->head  = 0;
+    wq->tail  = 0;
+    wq->hooks = 0;
+}
+
+/* Append `p` to the tail of `wq`. Interrupts must be disabled. */
+static void wq_append(wait_queue_t *wq, process_t *p) {
+    p->wait_next  = 0;
+    p->wait_queue = wq;
+    if (wq->tail) {
+        wq->tail->wait_next = p;
+        wq->tail = p;
+    } else {
+        wq->head = wq->tail = p;
+    }
+}
+
+/* Unlink `p` from `wq`. Interrupts must be disabled. */
+static void wq_unlink(wait_queue_t *wq, process_t *p) {
+    process_t *prev = 0;
+    for (process_t *it = wq->head; it; prev = it, it = it->wait_next) {
+        if (it != p) continue;
+        if (prev) prev->wait_next = it->wait_next;
+        else      wq->head = it->wait_next;
+        if (wq->tail == it) wq->tail = prev;
+        break;
+    }
+    p->wait_next  = 0;
+    p->wait_queue = 0;
+}
+
+/* Run the hooks. Interrupts must be disabled; a hook may remove
+ * itself. */
+static void wq_run_hooks(wait_queue_t *wq) {
+    wait_hook_t *h = wq->hooks;
+    while (h) {
+        wait_hook_t *next = h->next;
+        h->func(h);
+        h = next;
+    }
+}
+
+void wait_queue_sleep(wait_queue_t *wq) {
+    process_t *self = current_process;
+
+    wq_append(wq, self);
+    self->state = PROCESS_STATE_BLOCKED;
+    scheduler_block_current();
+
+    /* Woken (or the queue was torn down): make sure we are unlinked. */
+    if (self->wait_queue) {
+        wq_unlink(self->wait_queue, self);
+    }
+}
+
+/*
+ * The timed variant parks the process as SLEEPING with a deadline, so
+ * the scheduler's sleeper scan wakes it if nobody else does first. A
+ * process that comes back still linked on the queue was woken by the
+ * timer, not by wait_queue_wake_*().
+ */
+int wait_queue_sleep_timeout(wait_queue_t *wq, uint32_t ticks) {
+    process_t *self = current_process;
+
+    wq_append(wq, self);
+    self->sleep_until = timer_get_ticks() + ticks;
+    self->state = PROCESS_STATE_SLEEPING;
+    scheduler_block_current();
+
+    if (self->wait_queue) {
+        wq_unlink(self->wait_queue, self);
+        return -1;
+    }
+    return 0;
+}
+
+int wait_queue_wake_one(wait_queue_t *wq) {
+    uint32_t flags = irq_save();
+    wq_run_hooks(wq);
+
+    process_t *p = wq->head;
+    if (p) {
+        wq_unlink(wq, p);
+        scheduler_unblock(p);
+    }
+
+    irq_restore(flags);
+    return p != 0;
+}
+
+int wait_queue_wake_all(wait_queue_t *wq) {
+    uint32_t flags = irq_save();
+    wq_run_hooks(wq);
+
+    int n = 0;
+    while (wq->head) {
+        process_t *p = wq->head;
+        wq_unlink(wq, p);
+        scheduler_unblock(p);
+        n++;
+    }
+
+    irq_restore(flags);
+    return n;
+}
+
+int wait_queue_wake_key(wait_queue_t *wq, uint32_t key, int max) {
+    uint32_t flags = irq_save();
+    wq_run_hooks(wq);
+
+    int n = 0;
+    process_t *p = wq->head;
+    while (p && n < max) {
+        process_t *next = p->wait_next;
+        if (p->wait_key == key) {
+            wq_unlink(wq, p);
+            scheduler_unblock(p);
+            n++;
+        }
+        p = next;
+    }
+
+    irq_restore(flags);
+    return n;
+}
+
+process_t *wait_queue_dequeue(wait_queue_t *wq) {
+    uint32_t flags = irq_save();
+
+    process_t *p = wq->head;
+    if (p) {
+        wq_unlink(wq, p);
+    }
+
+    irq_restore(flags);
+    return p;
+}
+
+int wait_queue_empty(const wait_queue_t *wq) {
+    return wq->head == 0 && wq->hooks == 0;
+}
+
+void wait_queue_add_hook(wait_queue_t *wq, wait_hook_t *hook) {
+    uint32_t flags = irq_save();
+
+    hook->queue = wq;
+    hook->prev  = 0;
+    hook->next  = wq->hooks;
+    if (wq->hooks) wq->hooks->prev = hook;
+    wq->hooks = hook;
+
+    irq_restore(flags);
+}
+
+void wait_queue_remove_hook(wait_hook_t *hook) {
+    if (!hook || !hook->queue) return;
+
+    uint32_t flags = irq_save();
+    if (hook->prev) hook->prev->next = hook->next;
+    else            hook->queue->hooks = hook->next;
+    if (hook->next) hook->next->prev = hook->prev;
+    hook->next  = 0;
+    hook->prev  = 0;
+    hook->queue = 0;
+    irq_restore(flags);
+}
+
+void wait_queue_remove(process_t *p) {
+    if (!p || !p->wait_queue) return;
+
+    uint32_t flags = irq_save();
+    wq_unlink(p->wait_queue, p);
+    irq_restore(flags);
+}
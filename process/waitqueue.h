@@ -0,0 +1,88 @@
+/*
+ * OpenOS - Wait Queues
+ *
+ * A wait queue is a FIFO of processes blocked until some condition
+ * (data in a pipe, space in a buffer, ...) becomes true. The usual
+ * pattern, with interrupts disabled around the whole loop, is:
+ *
+ *      while (!condition) {
+ *          wait_queue_sleep(&obj->wq);
+ *      }
+ *
+ * and on the producing side, after making the condition true:
+ *
+ *      wait_queue_wake_all(&obj->wq);
+ *
+ * Waking only moves processes back to the ready queues; the sleeper
+ * re-checks its condition when it next runs, so spurious wakeups are
+ * harmless. Processes link through process_t::wait_next, so a process
+ * sits on at most one wait queue at a time.
+ *
+ * Besides processes, a queue can carry hooks: callbacks run (with
+ * interrupts disabled) on every wake of the queue. That is how an
+ * object's readiness reaches an epoll instance without anyone
+ * sleeping on the object itself.
+ */
+
+#ifndef OPENOS_PROCESS_WAITQUEUE_H
+#define OPENOS_PROCESS_WAITQUEUE_H
+
+#include "process.h"
+
+struct wait_queue;
+struct wait_hook;
+
+typedef void (*wait_hook_fn)(struct wait_hook *hook);
+
+typedef struct wait_hook {
+    wait_hook_fn       func;
+    void              *data;    /* Owner's context                   */
+    uint32_t           key;     /* Owner-defined, e.g. event bits    */
+    struct wait_queue *queue;   /* Queue hooked on, or NULL          */
+    struct wait_hook  *next;
+    struct wait_hook  *prev;
+} wait_hook_t;
+
+typedef struct wait_queue {
+    process_t   *head;
+    process_t   *tail;
+    wait_hook_t *hooks;
+} wait_queue_t;
+
+/* Initialize an empty wait queue. */
+void wait_queue_init(wait_queue_t *wq);
+
+/* Block the current process on `wq` and switch away.
+ * Must be called with interrupts disabled; returns with them disabled. */
+void wait_queue_sleep(wait_queue_t *wq);
+
+/* Like wait_queue_sleep(), but give up after `ticks` timer ticks.
+ * Returns 0 if woken through the queue, -1 on timeout. */
+int wait_queue_sleep_timeout(wait_queue_t *wq, uint32_t ticks);
+
+/* Wake the longest waiter. Returns 1 if a process was woken. */
+int wait_queue_wake_one(wait_queue_t *wq);
+
+/* Wake every waiter. Returns the number of processes woken. */
+int wait_queue_wake_all(wait_queue_t *wq);
+
+/* Wake up to `max` waiters whose wait_key equals `key`, oldest first,
+ * leaving the others queued. Returns the number woken. */
+int wait_queue_wake_key(wait_queue_t *wq, uint32_t key, int max);
+
+/* Unlink and return the longest waiter WITHOUT waking it (it stays
+ * blocked for the caller to resume later), or NULL if none. */
+process_t *wait_queue_dequeue(wait_queue_t *wq);
+
+/* True if no process is waiting and no hook is attached. */
+int wait_queue_empty(const wait_queue_t *wq);
+
+/* Attach `hook` to `wq` / detach it from its queue. Hooks run on every
+ * wake_one/wake_all/wake_key of the queue, before the processes. */
+void wait_queue_add_hook(wait_queue_t *wq, wait_hook_t *hook);
+void wait_queue_remove_hook(wait_hook_t *hook);
+
+/* Detach `p` from whatever wait queue holds it (used by kill). */
+void wait_queue_remove(process_t *p);
+
+#endif /* OPENOS_PROCESS_WAITQUEUE_H */